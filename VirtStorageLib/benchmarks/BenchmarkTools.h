@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <functional>
+
+namespace bench_tools
+{
+
+using Clock = std::chrono::steady_clock;
+
+// xorshift; cheap enough not to dominate measured operations
+class FastRandom
+{
+public:
+	explicit FastRandom(uint64_t seed) : m_state{ seed * 0x9E3779B97F4A7C15ULL + 1 }
+	{
+	}
+
+	uint64_t Next() noexcept
+	{
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 7;
+		m_state ^= m_state << 17;
+		return m_state;
+	}
+
+private:
+	uint64_t m_state;
+};
+
+// Runs worker(threadIndex, stop) on threadCount threads for the given time;
+// every worker returns the number of operations it did. Returns operations per second.
+inline double MeasureThroughput(size_t threadCount, std::chrono::milliseconds duration,
+	const std::function<uint64_t(size_t, const std::atomic<bool>&)>& worker)
+{
+	std::atomic<bool> stop{ false };
+	std::atomic<uint64_t> totalOps{ 0 };
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < threadCount; i++)
+		threads.emplace_back(
+			[&, i]()
+			{
+				totalOps += worker(i, stop);
+			});
+
+	const auto start = Clock::now();
+	std::this_thread::sleep_for(duration);
+	stop = true;
+
+	for (auto& thread : threads)
+		thread.join();
+
+	const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	return static_cast<double>(totalOps.load()) / seconds;
+}
+
+// Returns the average time of f in milliseconds
+inline double MeasureTime(size_t repetitions, const std::function<void()>& f)
+{
+	const auto start = Clock::now();
+	for (size_t i = 0; i < repetitions; i++)
+		f();
+
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / static_cast<double>(repetitions);
+}
+
+inline std::vector<size_t> ThreadCounts()
+{
+	const size_t maxThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+	std::vector<size_t> res;
+	for (size_t count = 1; count < maxThreads; count *= 2)
+		res.push_back(count);
+	res.push_back(maxThreads);
+
+	return res;
+}
+
+} // namespace bench_tools
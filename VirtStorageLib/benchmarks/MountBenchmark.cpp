@@ -0,0 +1,97 @@
+// Measures Mount time of a volume tree depending on its size and shape, with sequential and parallel mounting
+// (StorageOptions::parallelMounting); the pool has the default number of threads.
+// Build with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Storage.h"
+#include "Volume.h"
+#include "BenchmarkTools.h"
+
+using namespace vs;
+using namespace bench_tools;
+
+namespace
+{
+
+using KeyType = int;
+using ValueType = ValueVariant;
+
+using StorageType = Storage<KeyType, ValueType>;
+using VolumeType = Volume<KeyType, ValueType>;
+
+constexpr int cKeysPerNode = 4;
+
+// nodes are added level by level, every one gets fanOut children until there are nodeCount of them
+void FillTree(const VolumeType::NodePtr& root, size_t nodeCount, size_t fanOut)
+{
+	std::vector<VolumeType::NodePtr> level{ root };
+	size_t count = 1;
+
+	while (count < nodeCount)
+	{
+		std::vector<VolumeType::NodePtr> next;
+		for (const auto& parent : level)
+		{
+			for (size_t i = 0; i < fanOut && count < nodeCount; i++, count++)
+			{
+				const auto child = parent->InsertChild("Node" + std::to_string(i));
+				for (int key = 0; key < cKeysPerNode; key++)
+					child->Insert(key, static_cast<int64_t>(count));
+
+				next.push_back(child);
+			}
+		}
+
+		level = std::move(next);
+	}
+}
+
+double MeasureMount(const VolumeType& volume, bool parallelMounting)
+{
+	StorageOptions options;
+	options.parallelMounting = parallelMounting;
+
+	StorageType storage{ "Root", options };
+	const auto root = storage.GetRoot();
+
+	const auto start = Clock::now();
+	root->Mount(volume.GetRoot());
+	const auto milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	// the volume outlives the storage it is mounted to
+	root->Unmount(volume.GetRoot());
+
+	return milliseconds;
+}
+
+void RunScenario(size_t nodeCount, size_t fanOut)
+{
+	VolumeType volume{ "Volume", 0 };
+	FillTree(volume.GetRoot(), nodeCount, fanOut);
+
+	const auto sequential = MeasureMount(volume, false);
+	const auto parallel = MeasureMount(volume, true);
+
+	std::printf("%8zu nodes, fan-out %4zu: sequential %9.1f ms, parallel %9.1f ms (x%.1f)\n",
+		nodeCount, fanOut, sequential, parallel, sequential / parallel);
+}
+
+} // namespace
+
+int main()
+{
+	std::printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+
+	for (const size_t fanOut : { 8, 1000 })
+	{
+		for (const size_t nodeCount : { 1000, 10000, 100000, 1000000 })
+			RunScenario(nodeCount, fanOut);
+	}
+
+	return 0;
+}
@@ -0,0 +1,119 @@
+// Compares lookups of a key at the end of a path made by FindChild per level with FindValueByPath,
+// in a volume and in a storage it is mounted to, depending on the depth of the path.
+// Build with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Storage.h"
+#include "Volume.h"
+#include "BenchmarkTools.h"
+
+using namespace vs;
+using namespace bench_tools;
+
+namespace
+{
+
+using KeyType = int;
+using ValueType = ValueVariant;
+
+using StorageType = Storage<KeyType, ValueType>;
+using VolumeType = Volume<KeyType, ValueType>;
+
+constexpr size_t cFanOut = 8;
+constexpr size_t cPathCount = 1024;
+constexpr KeyType cKey = 1;
+constexpr std::chrono::milliseconds cDuration{ 500 };
+
+// every node of a path has cFanOut children, so paths share their upper levels
+std::vector<std::string> MakePaths(size_t depth)
+{
+	std::vector<std::string> paths(cPathCount);
+
+	FastRandom random{ depth };
+	for (auto& path : paths)
+	{
+		for (size_t level = 0; level < depth; level++)
+			path += (level == 0 ? "Node" : "/Node") + std::to_string(random.Next() % cFanOut);
+	}
+
+	return paths;
+}
+
+template<typename NodePtrT>
+void RunScenario(const char* nodeName, const NodePtrT& root, const std::vector<std::string>& paths)
+{
+	const auto measure =
+		[&paths](const auto& lookup)
+		{
+			return MeasureThroughput(1, cDuration,
+				[&paths, &lookup](size_t, const std::atomic<bool>& stop) -> uint64_t
+				{
+					FastRandom random{ 1 };
+					uint64_t ops = 0;
+
+					while (!stop.load(std::memory_order_relaxed))
+					{
+						for (int i = 0; i < 256; i++)
+							lookup(paths[random.Next() % paths.size()]);
+						ops += 256;
+					}
+					return ops;
+				});
+		};
+
+	// a caller splits a path itself
+	const auto perLevel = measure(
+		[&root](const std::string& path)
+		{
+			auto node = root;
+			for (size_t begin = 0; node && begin < path.size();)
+			{
+				const auto end = std::min(path.find('/', begin), path.size());
+				node = node->FindChild(path.substr(begin, end - begin));
+				begin = end + 1;
+			}
+
+			ValueType value;
+			if (node)
+				node->Find(cKey, value);
+		});
+
+	const auto byPath = measure(
+		[&root](const std::string& path)
+		{
+			ValueType value;
+			root->FindValueByPath(path, cKey, value);
+		});
+
+	std::printf("%-8s depth %2zu: FindChild per level %10.0f ops/s, FindValueByPath %10.0f ops/s (x%.1f)\n",
+		nodeName, static_cast<size_t>(std::count(paths.front().begin(), paths.front().end(), '/') + 1), perLevel, byPath, byPath / perLevel);
+}
+
+} // namespace
+
+int main()
+{
+	for (const size_t depth : { 2, 4, 8, 16 })
+	{
+		const auto paths = MakePaths(depth);
+
+		StorageType storage{ "Root" };
+		VolumeType volume{ "Volume", 0 };
+		for (const auto& path : paths)
+			volume.GetRoot()->InsertChildPath(path)->Insert(cKey, static_cast<int64_t>(depth));
+
+		storage.GetRoot()->Mount(volume.GetRoot());
+
+		RunScenario("volume", volume.GetRoot(), paths);
+		RunScenario("storage", storage.GetRoot(), paths);
+
+		// the volume outlives the storage it is mounted to
+		storage.GetRoot()->Unmount(volume.GetRoot());
+	}
+
+	return 0;
+}
@@ -0,0 +1,124 @@
+// Compares Find throughput of the lock-based dictionary engines with the epoch-protected one
+// on a read-mostly volume node, with and without a concurrent writer,
+// and Find throughput of a virtual node with several volumes mounted.
+// Build with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Storage.h"
+#include "Volume.h"
+#include "BenchmarkTools.h"
+
+using namespace vs;
+using namespace bench_tools;
+
+namespace
+{
+
+using KeyType = int;
+using ValueType = ValueVariant;
+
+constexpr int cKeyCount = 1 << 20;
+constexpr std::chrono::milliseconds cDuration{ 500 };
+
+template<typename DictT>
+void RunScenario(const char* dictName, bool withWriter)
+{
+	Volume<KeyType, ValueType, DictT> volume{ "Root", 0 };
+	const auto root = volume.GetRoot();
+
+	for (int i = 0; i < cKeyCount; i++)
+		root->Insert(i, static_cast<int64_t>(i));
+
+	for (const auto threadCount : ThreadCounts())
+	{
+		const auto opsPerSecond = MeasureThroughput(threadCount + (withWriter ? 1 : 0), cDuration,
+			[&root, threadCount](size_t threadIndex, const std::atomic<bool>& stop) -> uint64_t
+			{
+				FastRandom random{ threadIndex };
+				uint64_t ops = 0;
+
+				// the last thread is a writer; its operations aren't counted
+				if (threadIndex == threadCount)
+				{
+					while (!stop.load(std::memory_order_relaxed))
+						root->Insert(static_cast<KeyType>(random.Next() % cKeyCount), static_cast<int64_t>(ops++));
+					return 0;
+				}
+
+				ValueType value;
+				while (!stop.load(std::memory_order_relaxed))
+				{
+					for (int i = 0; i < 256; i++)
+						root->Find(static_cast<KeyType>(random.Next() % cKeyCount), value);
+					ops += 256;
+				}
+				return ops;
+			});
+
+		std::printf("%-20s %-8s %3zu readers: %10.2f Mops/s\n",
+			dictName, withWriter ? "writer" : "no-write", threadCount, opsPerSecond / 1e6);
+	}
+}
+
+// keys are spread over mounted volumes, so lookups go through several of them
+void RunVirtualScenario(size_t volumeCount)
+{
+	using StorageType = Storage<KeyType, ValueType>;
+	using VolumeType = Volume<KeyType, ValueType, RcuHashDict<KeyType, ValueType>>;
+
+	StorageType storage{ "Root" };
+	std::vector<VolumeType> volumes;
+	for (size_t i = 0; i < volumeCount; i++)
+	{
+		volumes.emplace_back("Volume" + std::to_string(i), i);
+		storage.GetRoot()->Mount(volumes.back().GetRoot());
+	}
+
+	for (int i = 0; i < cKeyCount; i++)
+		volumes[i % volumeCount].GetRoot()->Insert(i, static_cast<int64_t>(i));
+
+	const auto root = storage.GetRoot();
+	for (const auto threadCount : ThreadCounts())
+	{
+		const auto opsPerSecond = MeasureThroughput(threadCount, cDuration,
+			[&root](size_t threadIndex, const std::atomic<bool>& stop) -> uint64_t
+			{
+				FastRandom random{ threadIndex };
+				uint64_t ops = 0;
+
+				ValueType value;
+				while (!stop.load(std::memory_order_relaxed))
+				{
+					for (int i = 0; i < 256; i++)
+						root->Find(static_cast<KeyType>(random.Next() % cKeyCount), value);
+					ops += 256;
+				}
+				return ops;
+			});
+
+		std::printf("%-20s %zu volumes %3zu readers: %10.2f Mops/s\n",
+			"Storage", volumeCount, threadCount, opsPerSecond / 1e6);
+	}
+
+	// volumes go before the storage they are mounted to
+	volumes.clear();
+}
+
+} // namespace
+
+int main()
+{
+	for (const bool withWriter : { false, true })
+	{
+		RunScenario<HashDict<KeyType, ValueType>>("HashDict", withWriter);
+		RunScenario<FlatHashDict<KeyType, ValueType>>("FlatHashDict", withWriter);
+		RunScenario<RcuHashDict<KeyType, ValueType>>("RcuHashDict", withWriter);
+	}
+
+	RunVirtualScenario(4);
+
+	return 0;
+}
@@ -0,0 +1,92 @@
+// Measures Insert latency of a virtual node depending on the number of mounted volumes:
+// new keys, keys owned by the volume with the lowest priority, and new keys with a pinned write target.
+// Build with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Storage.h"
+#include "Volume.h"
+#include "BenchmarkTools.h"
+
+using namespace vs;
+using namespace bench_tools;
+
+namespace
+{
+
+using KeyType = int;
+using ValueType = ValueVariant;
+
+constexpr int cKeyCount = 1 << 18;
+
+enum class Scenario
+{
+	NewKeys,
+	LowestOwnsKeys,
+	PinnedNewKeys
+};
+
+const char* GetScenarioName(Scenario scenario)
+{
+	switch (scenario)
+	{
+	case Scenario::NewKeys:
+		return "new keys";
+	case Scenario::LowestOwnsKeys:
+		return "lowest owns keys";
+	case Scenario::PinnedNewKeys:
+		return "pinned, new keys";
+	}
+	return "";
+}
+
+void RunScenario(Scenario scenario, size_t volumeCount)
+{
+	using StorageType = Storage<KeyType, ValueType>;
+	using VolumeType = Volume<KeyType, ValueType>;
+
+	StorageType storage{ "Root" };
+	const auto root = storage.GetRoot();
+
+	std::vector<VolumeType> volumes;
+	for (size_t i = 0; i < volumeCount; i++)
+	{
+		volumes.emplace_back("Volume" + std::to_string(i), i);
+		root->Mount(volumes.back().GetRoot());
+	}
+
+	if (scenario == Scenario::LowestOwnsKeys)
+	{
+		for (int i = 0; i < cKeyCount; i++)
+			volumes.front().GetRoot()->Insert(i, 0);
+	}
+
+	if (scenario == Scenario::PinnedNewKeys)
+		root->PinWriteTarget(volumes.back().GetRoot());
+
+	const auto start = Clock::now();
+	for (int i = 0; i < cKeyCount; i++)
+		root->Insert(i, static_cast<int64_t>(i));
+	const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::printf("%-18s %3zu volumes: %8.1f ns/insert\n", GetScenarioName(scenario), volumeCount, seconds * 1e9 / cKeyCount);
+
+	// volumes go before the storage they are mounted to
+	volumes.clear();
+}
+
+} // namespace
+
+int main()
+{
+	for (const auto scenario : { Scenario::NewKeys, Scenario::LowestOwnsKeys, Scenario::PinnedNewKeys })
+	{
+		for (const size_t volumeCount : { 1, 2, 5, 10 })
+			RunScenario(scenario, volumeCount);
+	}
+
+	return 0;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <utility>
+
+#include "../src/utils/BitUtils.h"
+
+namespace vs
+{
+
+// An order of a paged iteration of key-values. A node resumes a page in its own order without a scan
+// (see INode::GetPageOrder) and scans itself for a page in another one
+enum class PageOrder
+{
+	// ascending keys: ordered dictionaries and images
+	Keys,
+	// ascending PageHash of keys, keys with equal hashes ascending: hash dictionaries
+	Hashes
+};
+
+// the hash keys of PageOrder::Hashes are ordered by
+template<typename KeyT>
+uint64_t PageHash(const KeyT& key)
+{
+	return utils::MixHash(static_cast<uint64_t>(std::hash<KeyT>{}(key)));
+}
+
+template<typename KeyT>
+struct PageLess
+{
+	bool operator () (const KeyT& left, const KeyT& right) const
+	{
+		if (order == PageOrder::Hashes)
+		{
+			const auto leftHash = PageHash(left);
+			const auto rightHash = PageHash(right);
+			if (leftHash != rightHash)
+				return leftHash < rightHash;
+		}
+
+		return std::less<KeyT>()(left, right);
+	}
+
+	PageOrder order = PageOrder::Keys;
+};
+
+// A resume position of a paged iteration: the last visited key (or child name) and the order of pages.
+// It doesn't refer to internals of a node, so it stays valid whatever is changed between pages:
+// items come in the order, and an item present during the whole iteration is visited once
+template<typename PositionT>
+class Cursor
+{
+public:
+	// the beginning; pages come in the order of a node
+	Cursor() = default;
+
+	static Cursor After(PositionT last)
+	{
+		Cursor cursor;
+		cursor.m_last = std::move(last);
+		return cursor;
+	}
+
+	static Cursor End()
+	{
+		Cursor cursor;
+		cursor.m_end = true;
+		return cursor;
+	}
+
+	bool IsEnd() const noexcept
+	{
+		return m_end;
+	}
+
+	// nullptr at the beginning
+	const PositionT* GetLast() const noexcept
+	{
+		return m_last ? &*m_last : nullptr;
+	}
+
+	// std::nullopt until the order is chosen by the first page or by InOrder
+	std::optional<PageOrder> GetOrder() const noexcept
+	{
+		return m_order;
+	}
+
+	// the same position with pages in the given order
+	Cursor InOrder(PageOrder order) const
+	{
+		auto cursor = *this;
+		cursor.m_order = order;
+		return cursor;
+	}
+
+	// a cursor of the page following a page of pageSize items asked by count;
+	// last() gives the position of the last item and is called for a full page only
+	template<typename LastT>
+	Cursor Following(size_t count, size_t pageSize, const LastT& last) const
+	{
+		if (count == 0)
+			return *this;
+
+		if (pageSize < count)
+			return End();
+
+		auto cursor = *this;
+		cursor.m_last = last();
+		return cursor;
+	}
+
+	bool operator == (const Cursor& other) const
+	{
+		return m_end == other.m_end && m_last == other.m_last && m_order == other.m_order;
+	}
+
+	bool operator != (const Cursor& other) const
+	{
+		return !(*this == other);
+	}
+
+private:
+	std::optional<PositionT> m_last;
+	std::optional<PageOrder> m_order;
+	bool m_end = false;
+};
+
+} //namespace vs
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+namespace vs
+{
+
+// Caps the size of the tree of a Volume, for cache-like volumes. Once the tree holds more keys (or more bytes
+// of keys and values) than allowed, nodes holding more than an even share of the budget among nodes with keys
+// erase keys not looked up recently (CLOCK); an evicted key is reported to mounting virtual nodes like an erased one.
+// 0 means no limit
+struct EvictionOptions
+{
+	size_t maxKeyCount = 0;
+
+	// sizes of keys and values are estimated: the object itself plus the heap memory of strings, vectors and variants of them;
+	// the eviction policy's own copies of keys and their map nodes are counted too
+	size_t maxBytes = 0;
+};
+
+} //namespace vs
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Types.h"
+#include "PersistenceException.h"
+#include "ParallelScan.h"
+#include "ReadOnlyNodeException.h"
+#include "../src/image/ImageNodeImpl.h"
+#include "../src/image/ImageWriter.h"
+#include "../src/RootHolder.h"
+
+namespace vs
+{
+
+// ImageVolume{ path, priority } serves a tree written by WriteImage read-only, straight from the file
+// mapped into memory: opening takes the same time for any size of an image, and pages are loaded on first access.
+// It is mounted into a Storage like a Volume; modifying calls throw ReadOnlyNodeException.
+// Images are native-endian; keys must be trivially copyable and values serializable (see utils/Serialization.h).
+template <typename KeyT, typename ValueHolderT = ValueVariant>
+using ImageVolume = internal::RootHolder<internal::image::ImageNodeImpl<KeyT, ValueHolderT>>;
+
+// writes a tree of the node (of a Volume, an ImageVolume or any IVolumeNode) to an image file;
+// the tree must not change meanwhile. Throws PersistenceException on I/O errors
+template <typename KeyT, typename ValueHolderT>
+void WriteImage(const std::shared_ptr<IVolumeNode<KeyT, ValueHolderT>>& root, const std::string& path)
+{
+	internal::image::ImageWriter<KeyT, ValueHolderT>::Write(root, path);
+}
+
+} //namespace vs
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+
+namespace vs
+{
+
+// Sizes of a node (GetStats) or of a volume subtree (GetSubtreeStats). Bytes are estimated the way
+// EvictionOptions::maxBytes estimates them; an image node counts bytes of its mapped file instead of heap memory
+struct NodeStats
+{
+	// a virtual node sums up its mounted volumes, so a key of several volumes is counted once per volume
+	size_t keyCount = 0;
+
+	// keys and values, including strings and vectors held by them
+	size_t payloadBytes = 0;
+
+	// memory of the dictionary beyond key-values: buckets, empty slots, tree nodes, filters
+	size_t overheadBytes = 0;
+
+	// children of the node; descendants of the root for subtree stats
+	size_t childCount = 0;
+
+	// children of volumes mounted into a virtual node with StorageOptions::lazyMounting which aren't mounted yet;
+	// a child of several volumes is counted once per volume
+	size_t pendingChildCount = 0;
+
+	NodeStats& operator += (const NodeStats& other) noexcept
+	{
+		keyCount += other.keyCount;
+		payloadBytes += other.payloadBytes;
+		overheadBytes += other.overheadBytes;
+		childCount += other.childCount;
+		pendingChildCount += other.pendingChildCount;
+		return *this;
+	}
+};
+
+} //namespace vs
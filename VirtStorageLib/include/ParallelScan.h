@@ -0,0 +1,40 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "ScanOptions.h"
+
+namespace vs
+{
+
+// Scans a volume node in parallel (IVolumeNode::ParallelScan) and reduces the results:
+// every worker accumulates its own state with accumulate(state, key, value),
+// then the states are combined in the order of workers with combine(state, std::move(otherState))
+template<typename NodePtrT, typename StateT, typename AccumulateT, typename CombineT>
+StateT ParallelReduce(const NodePtrT& node, const ScanOptions& options, const StateT& init,
+	const AccumulateT& accumulate, const CombineT& combine)
+{
+	static constexpr size_t cCacheLineSize = 64;
+
+	// keeps states of neighbouring workers in different cache lines
+	struct alignas(cCacheLineSize) WorkerState
+	{
+		StateT state;
+	};
+
+	std::vector<WorkerState> states(GetScanWorkerCount(options), WorkerState{ init });
+	node->ParallelScan(options,
+		[&states, &accumulate](size_t worker, const auto& key, const auto& value)
+		{
+			accumulate(states[worker].state, key, value);
+		});
+
+	auto res = std::move(states[0].state);
+	for (size_t worker = 1; worker < states.size(); worker++)
+		combine(res, std::move(states[worker].state));
+
+	return res;
+}
+
+} //namespace vs
@@ -0,0 +1,17 @@
+#pragma once
+
+#include  <stdexcept>
+#include  <string>
+
+namespace vs
+{
+
+class PersistenceException :
+	public std::runtime_error
+{
+public:
+	explicit PersistenceException(const std::string& message) : std::runtime_error{ message }
+	{}
+};
+
+} //namespace vs
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstddef>
+
+namespace vs
+{
+
+// Makes a Volume durable: changes of its tree are appended to a write-ahead log in a directory,
+// and a Volume created over a non-empty directory recovers the tree from it.
+// Keys and values must be serializable (see utils/Serialization.h); ValueVariant is.
+struct PersistenceOptions
+{
+	std::string directory;
+
+	// true: modifying calls return once their log records are on a disk (one fsync serves many writers);
+	// false: records reach a disk within syncInterval, so a crash loses at most the last interval
+	bool syncOnWrite = false;
+	std::chrono::milliseconds syncInterval{ 10 };
+
+	// the whole tree is written to a checkpoint and the log is truncated once the log grows over this size
+	size_t checkpointLogSize = size_t{ 64 } << 20;
+};
+
+} //namespace vs
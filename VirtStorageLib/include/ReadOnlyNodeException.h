@@ -0,0 +1,31 @@
+#pragma once
+
+#include  <exception>
+#include  "Types.h"
+
+namespace vs
+{
+
+class ReadOnlyNodeException :
+	public std::exception
+{
+public:
+	explicit ReadOnlyNodeException(NodeId nodeId): m_nodeId{nodeId}
+	{}
+
+	const char* what() const noexcept override
+	{
+		return "Cannot modify a node of a read-only volume";
+	}
+
+	NodeId TargetNodeId() const noexcept
+	{
+		return m_nodeId;
+	}
+
+private:
+	NodeId m_nodeId;
+
+};
+
+} //namespace vs
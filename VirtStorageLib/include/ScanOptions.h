@@ -0,0 +1,28 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+
+namespace vs
+{
+
+// Tuning of a parallel scan of a volume node
+struct ScanOptions
+{
+	// workers including the calling thread; 0 takes the number of hardware threads
+	size_t threadCount = 0;
+
+	// children of the node and their descendants are scanned as well
+	bool subtree = false;
+};
+
+inline size_t GetScanWorkerCount(const ScanOptions& options)
+{
+	if (options.threadCount != 0)
+		return options.threadCount;
+
+	return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+} //namespace vs
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Types.h"
+#include "StorageOptions.h"
 #include "../src/VirtualNodeImpl.h"
 #include "../src/utils/NonCopyable.h"
 
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+
+namespace vs
+{
+
+// How a virtual node skips keys shadowed by volumes with higher priority when it iterates key-values
+enum class IterationMode
+{
+	// keys of every volume are collected and skipped in volumes with lower priority;
+	// memory grows with the number of keys iterated
+	KeySet,
+	// a key of a volume is looked up in volumes with higher priority as it is visited;
+	// memory doesn't grow, a key costs a lookup per volume with higher priority that may have it
+	Streaming
+};
+
+// How a storage follows children inserted into and removed from its mounted volumes
+enum class MountPropagation
+{
+	// InsertChild and RemoveChild of a volume node mount and unmount virtual children before they return
+	Synchronous,
+	// changes are queued and applied to the storage by a task of the process-wide pool (see ConfigureThreadPool),
+	// so writers of volumes don't wait for it; without pool threads they are applied by FlushMounting.
+	// A child removed before its insertion is applied is never mounted. FlushMounting waits for changes made before it
+	// and rethrows the first error applying a change has failed with since the previous FlushMounting
+	Asynchronous
+};
+
+// Tuning of a Storage; every virtual node of the storage gets the same options.
+struct StorageOptions
+{
+	// how many keys a virtual node remembers the owning mounted volumes of (or that none has them),
+	// so lookups of hot keys skip the scan of volumes in priority order; 0 disables the cache.
+	// Mounted volumes report every insertion and erasure of a key to the virtual nodes caching it.
+	// The capacity is split evenly among 64 stripes of the cache, so it's rounded up to a multiple of 64
+	size_t locationCacheCapacity = 0;
+
+	IterationMode iterationMode = IterationMode::KeySet;
+
+	MountPropagation mountPropagation = MountPropagation::Synchronous;
+
+	// children of a mounted node are mounted by workers of the process-wide pool (see ConfigureThreadPool),
+	// subtrees in parallel; the tree mounted is the same as a sequential mount gives
+	bool parallelMounting = true;
+
+	// children of a mounted node are mounted when children of its virtual node are accessed first
+	// (FindChild, ForEachChild, InsertChild and so on), so only visited parts of a volume tree are mirrored
+	bool lazyMounting = false;
+};
+
+} //namespace vs
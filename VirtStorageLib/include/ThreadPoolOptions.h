@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+namespace vs
+{
+
+// Tuning of the process-wide pool of worker threads which runs parallel work of all volumes and storages
+// (parallel scans, bulk inserts), so several of them working at once don't oversubscribe cores
+struct ThreadPoolOptions
+{
+	// 0 takes one less than the number of hardware threads: a caller of a parallel operation takes part in it
+	size_t threadCount = 0;
+};
+
+// must be called before the first parallel operation; returns false if the pool is already running
+bool ConfigureThreadPool(const ThreadPoolOptions& options);
+
+} //namespace vs
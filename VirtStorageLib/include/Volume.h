@@ -1,13 +1,59 @@
 #pragma once
 
 #include "Types.h"
+#include "PersistenceOptions.h"
+#include "PersistenceException.h"
+#include "EvictionOptions.h"
+#include "ParallelScan.h"
 #include "../src/VolumeNodeImpl.h"
 #include "../src/RootHolder.h"
+#include "../src/dict/LockedDict.h"
+#include "../src/dict/ShardedDict.h"
+#include "../src/dict/RcuDict.h"
+#include "../src/dict/FilteredDict.h"
+#include "../src/utils/FlatHashMap.h"
+#include "../src/utils/BPlusTreeMap.h"
 
 namespace vs
 {
 
+// Dictionary engines for volume nodes
+
+// node-based std::unordered_map
+template <typename KeyT, typename ValueHolderT = ValueVariant>
+using HashDict = internal::dict::LockedDict<KeyT, ValueHolderT, std::unordered_map<KeyT, ValueHolderT>>;
+
+// open-addressing flat table; no allocation per key, cache-friendly lookups
+template <typename KeyT, typename ValueHolderT = ValueVariant>
+using FlatHashDict = internal::dict::LockedDict<KeyT, ValueHolderT, utils::FlatHashMap<KeyT, ValueHolderT>>;
+
+// B+-tree; ForEachInRange and LowerBound don't scan the whole node, keys are visited in ascending order
+template <typename KeyT, typename ValueHolderT = ValueVariant>
+using OrderedDict = internal::dict::LockedDict<KeyT, ValueHolderT, utils::BPlusTreeMap<KeyT, ValueHolderT>>;
+
+// key space split into independently locked shards; the shard count is set by DictOptions<...>::shardCount
 template <typename KeyT, typename ValueHolderT = ValueVariant>
-using Volume = internal::RootHolder<internal::VolumeNodeImpl<KeyT, ValueHolderT>>;
+using ShardedHashDict = internal::dict::ShardedDict<KeyT, ValueHolderT, HashDict<KeyT, ValueHolderT>>;
+
+template <typename KeyT, typename ValueHolderT = ValueVariant>
+using ShardedFlatHashDict = internal::dict::ShardedDict<KeyT, ValueHolderT, FlatHashDict<KeyT, ValueHolderT>>;
+
+// lock-free Find/Contains protected by epochs; for read-mostly nodes
+template <typename KeyT, typename ValueHolderT = ValueVariant>
+using RcuHashDict = internal::dict::RcuDict<KeyT, ValueHolderT>;
+
+// a Bloom filter in front of another engine: lookups of missing keys mostly don't reach the engine,
+// and a Storage doesn't ask mounted volumes which surely have no key; sized by DictOptions<...>::expectedKeyCount
+template <typename KeyT, typename ValueHolderT = ValueVariant, typename InnerT = HashDict<KeyT, ValueHolderT>>
+using FilteredDict = internal::dict::FilteredDict<KeyT, ValueHolderT, InnerT>;
+
+template <typename DictT>
+using DictOptions = typename DictT::Options;
+
+// Volume{ name, priority[, dictOptions][, evictionOptions] } is kept in memory only;
+// Volume{ name, priority, [dictOptions, ]PersistenceOptions{ directory }[, evictionOptions] } is recovered from the directory
+// and logs every change of its tree there
+template <typename KeyT, typename ValueHolderT = ValueVariant, typename DictT = HashDict<KeyT, ValueHolderT>>
+using Volume = internal::RootHolder<internal::VolumeNodeImpl<KeyT, ValueHolderT, DictT>>;
 
-} //namespace vs
\ No newline at end of file
+} //namespace vs
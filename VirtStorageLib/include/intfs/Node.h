@@ -1,6 +1,13 @@
 #pragma once
 
 #include <functional>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Cursor.h"
+#include "NodeStats.h"
 
 namespace vs
 {
@@ -9,21 +16,59 @@ template<typename KeyT, typename ValueHolderT>
 struct INode
 {
 	using ForEachKeyValueFunctorType = std::function<void(const KeyT&, ValueHolderT&)>;
+	using ForEachConstKeyValueFunctorType = std::function<void(const KeyT&, const ValueHolderT&)>;
+	using VisitFunctorType = std::function<void(const ValueHolderT&)>;
+
+	using KeysType = std::vector<KeyT>;
+	using KeyValuesType = std::vector<std::pair<KeyT, ValueHolderT>>;
+	using FoundValuesType = std::vector<std::optional<ValueHolderT>>;
+	using CursorType = Cursor<KeyT>;
 
 	virtual ~INode() = default;
 
 	virtual const std::string& GetName() const = 0;
+	// a volume node keeps its stats up to date as it changes, so the call takes no scan; a virtual node
+	// estimates distinct keys of its mounted volumes by a scan of their snapshots and sums their bytes
+	virtual NodeStats GetStats() const = 0;
 
 	virtual void Insert(const KeyT& key, const ValueHolderT& value) = 0;
 	virtual void Insert(const KeyT& key, ValueHolderT&& value) = 0;
 	virtual void Erase(const KeyT& key) = 0;
 	virtual bool Find(const KeyT& key, ValueHolderT& value) const = 0;
+	// calls f with a stored value in place, without copying it out; returns false if there is no key
+	// f is called under a node's read lock, so it must not modify the node
+	virtual bool Visit(const KeyT& key, const VisitFunctorType& f) const = 0;
 	virtual bool Contains(const KeyT& key) const = 0;
+	// Find in a descendant at the path (see INodeContainer::FindByPath); false if there is no such node
+	virtual bool FindValueByPath(const std::string& path, const KeyT& key, ValueHolderT& value) const = 0;
 	virtual bool TryInsert(const KeyT& key, const ValueHolderT& value) = 0;
 	virtual bool TryInsert(const KeyT& key, ValueHolderT&& value) = 0;
 	virtual bool Replace(const KeyT& key, const ValueHolderT& value) = 0;
 	virtual bool Replace(const KeyT& key, ValueHolderT&& value) = 0;
 	virtual void ForEachKeyValue(const ForEachKeyValueFunctorType& f) = 0;
+	// visits a consistent snapshot of keys; changes made during the iteration are not seen
+	// and don't wait for it, so f may take long or modify the node
+	virtual void ForEachKeyValueSnapshot(const ForEachConstKeyValueFunctorType& f) const = 0;
+
+	// visits keys in [from, to); keys come in ascending order if a node keeps them ordered
+	virtual void ForEachInRange(const KeyT& from, const KeyT& to, const ForEachKeyValueFunctorType& f) = 0;
+	// finds the smallest key not less than the given one
+	virtual bool LowerBound(const KeyT& key, KeyT& foundKey, ValueHolderT& value) const = 0;
+	// the order a node resumes pages in without a scan: keys for ordered nodes, hashes of keys for hash ones;
+	// a virtual node has the order of its mounted nodes if they all have the same one, PageOrder::Keys otherwise
+	virtual PageOrder GetPageOrder() const = 0;
+	// paged iteration: keyValues gets up to count key-values following the cursor in the order of the cursor,
+	// GetPageOrder() if it has none; returns the cursor of the next page, an end one after the last page.
+	// A node isn't locked between pages
+	virtual CursorType NextKeyValues(const CursorType& cursor, size_t count, KeyValuesType& keyValues) const = 0;
+
+	// batches: a node is resolved and locked once per call instead of once per key
+	// values[i] gets a value of keys[i] or std::nullopt; returns the number of found keys
+	virtual size_t MultiFind(const KeysType& keys, FoundValuesType& values) const = 0;
+	// works as Insert for every pair in order, so the last of duplicate keys wins
+	virtual void MultiInsert(const KeyValuesType& keyValues) = 0;
+	virtual void MultiInsert(KeyValuesType&& keyValues) = 0;
+	virtual void MultiErase(const KeysType& keys) = 0;
 };
 
 } //namespace vs
\ No newline at end of file
@@ -2,6 +2,10 @@
 
 #include <memory>
 #include <functional>
+#include <string>
+#include <vector>
+
+#include "Cursor.h"
 
 namespace vs
 {
@@ -17,14 +21,25 @@ struct INodeContainer
 	using FindIfFunctorType = std::function<bool(NodePtr)>;
 	using RemoveIfFunctorType = FindIfFunctorType;
 
+	using ChildCursorType = Cursor<std::string>;
+	using ChildrenType = std::vector<NodePtr>;
+
 	virtual ~INodeContainer() = default;
 
 	virtual NodePtr InsertChild(const std::string& name) = 0;
 	virtual void ForEachChild(const ForEachFunctorType& f) const = 0;
+	// paged iteration: children gets up to count children following the cursor in ascending order of names
+	virtual ChildCursorType NextChildren(const ChildCursorType& cursor, size_t count, ChildrenType& children) const = 0;
 	virtual NodePtr FindChild(const std::string& name) const = 0;
 	virtual NodePtr FindChildIf(const FindIfFunctorType& f) const = 0;
 	virtual void RemoveChild(const std::string& name) = 0;
 	virtual void RemoveChildIf(const RemoveIfFunctorType& f) = 0;
+
+	// a path is a sequence of child names separated by '/' resolved in one call, without a proxy per level;
+	// empty names are skipped, so an empty path is the node itself
+	virtual NodePtr FindByPath(const std::string& path) const = 0;
+	// inserts missing nodes of the path, as InsertChild does, and returns the last one
+	virtual NodePtr InsertChildPath(const std::string& path) = 0;
 };
 
 } //namespace vs
\ No newline at end of file
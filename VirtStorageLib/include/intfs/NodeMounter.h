@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <functional>
 
 namespace vs
@@ -22,6 +23,20 @@ struct INodeMounter
 	virtual void ForEachMounted(const ForEachMountedFunctorType& f) const = 0;
 	virtual MountableNodePtr FindMountedIf(const FindMountedIfFunctorType& f) const = 0;
 	virtual void UnmountIf(const UnmountIfFunctorType& f) = 0;
+
+	// keys inserted through the node go to the given mounted node without looking for them in others,
+	// and new keys of TryInsert go there instead of the node with the highest priority;
+	// keys in nodes with higher priority shadow them. nullptr unpins; false if the node isn't mounted
+	virtual bool PinWriteTarget(MountableNodePtr node) = 0;
+
+	// waits until children inserted into and removed from mounted nodes before the call are mounted and unmounted
+	// in the whole tree of the node; returns at once unless the tree propagates them asynchronously.
+	// Rethrows the first error applying them has failed with since the previous call
+	virtual void FlushMounting() = 0;
+
+	// estimates the number of distinct keys of mounted nodes (about 2% error); a single mounted node is counted
+	// exactly. Scans snapshots of all mounted nodes, so it costs O(their keys) unlike GetStats
+	virtual size_t EstimateDistinctKeyCount() const = 0;
 };
 
 } //namespace vs
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <chrono>
+#include <functional>
+
 #include "Types.h"
+#include "ScanOptions.h"
 #include "Node.h"
 #include "NodeContainer.h"
 
@@ -14,9 +18,26 @@ struct IVolumeNode :
 {
 	using INodeContainer<IVolumeNode<KeyT, ValueHolderT>>::NodePtr;
 
+	using ScanFunctorType = std::function<void(size_t worker, const KeyT&, const ValueHolderT&)>;
+
 	virtual ~IVolumeNode() = default;
 
 	virtual Priority GetPriority() const = 0;
+
+	// stats of the node and all its descendants; subtrees not changed since the previous call aren't visited again
+	virtual NodeStats GetSubtreeStats() const = 0;
+
+	// a key inserted with a TTL is erased once the TTL has elapsed; lookups don't find it since then.
+	// Any other change of the key (Insert, TryInsert, Replace, etc.) makes it permanent
+	virtual void InsertWithTtl(const KeyT& key, const ValueHolderT& value, std::chrono::milliseconds ttl) = 0;
+	virtual void InsertWithTtl(const KeyT& key, ValueHolderT&& value, std::chrono::milliseconds ttl) = 0;
+	// gives an existing key a new TTL counted from now; returns false if there is no such key
+	virtual bool Touch(const KeyT& key, std::chrono::milliseconds ttl) = 0;
+
+	// visits a snapshot of key-values (see ForEachKeyValueSnapshot) split into parts scanned by
+	// GetScanWorkerCount(options) workers; f is called concurrently with worker indices of the calling workers.
+	// See ParallelReduce for scans with per-worker states
+	virtual void ParallelScan(const ScanOptions& options, const ScanFunctorType& f) const = 0;
 };
 
 } //namespace vs
\ No newline at end of file
@@ -0,0 +1,403 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "EvictionOptions.h"
+#include "utils/BitUtils.h"
+#include "utils/MemorySize.h"
+#include "utils/NonCopyable.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+//
+// EvictionBudget
+//
+// Totals of keys and bytes of all nodes of a tree, which EvictionOptions cap. Every node holding
+// keys is allowed an even share of the budget, so once the tree is over it, nodes over their shares
+// evict till it fits: when every node is within its share, the tree is within the budget
+//
+
+class EvictionBudget :
+	private utils::NonCopyable
+{
+public:
+	explicit EvictionBudget(const EvictionOptions& options) : m_options{ options }
+	{
+	}
+
+	const EvictionOptions& GetOptions() const noexcept
+	{
+		return m_options;
+	}
+
+	bool IsOver() const noexcept
+	{
+		return IsOver(m_count.load(std::memory_order_relaxed), m_size.load(std::memory_order_relaxed), 1);
+	}
+
+	// count and size are totals of a node
+	bool IsOverShare(size_t count, size_t size) const noexcept
+	{
+		return IsOver(count, size, std::max<size_t>(m_nodeCount.load(std::memory_order_relaxed), 1));
+	}
+
+	void Add(size_t count, size_t size) noexcept
+	{
+		m_count.fetch_add(count, std::memory_order_relaxed);
+		m_size.fetch_add(size, std::memory_order_relaxed);
+	}
+
+	void Subtract(size_t count, size_t size) noexcept
+	{
+		m_count.fetch_sub(count, std::memory_order_relaxed);
+		m_size.fetch_sub(size, std::memory_order_relaxed);
+	}
+
+	// a node has got its first key or has lost its last one
+	void OnNodeFilled() noexcept
+	{
+		m_nodeCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void OnNodeEmptied() noexcept
+	{
+		m_nodeCount.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+private:
+	bool IsOver(size_t count, size_t size, size_t shares) const noexcept
+	{
+		return (m_options.maxKeyCount != 0 && count > m_options.maxKeyCount / shares) ||
+			(m_options.maxBytes != 0 && size > m_options.maxBytes / shares);
+	}
+
+private:
+	const EvictionOptions m_options;
+
+	std::atomic<size_t> m_count{ 0 };
+	std::atomic<size_t> m_size{ 0 };
+	std::atomic<size_t> m_nodeCount{ 0 };
+};
+
+using EvictionBudgetPtr = std::shared_ptr<EvictionBudget>;
+
+//
+// ClockEviction
+//
+// Keeps a node within its share of the EvictionBudget of its tree: keys of the node are accounted in rings,
+// and a hand going round a ring picks keys which haven't been used since it has passed them
+// last time (CLOCK). A lookup marks a key used with a relaxed store to a bit of a table
+// indexed by a hash of the key, so it takes no lock; colliding keys share a bit, which
+// makes the policy a bit less precise than LRU. Keys are split into shards, each with its own lock,
+// ring and hand, so writers of different keys don't contend; every call to PickVictims starts
+// from the next shard. Accounting is serialized per key by LockKey, so a change of a key and
+// its accounting are seen together. Bytes of a node include the policy's own copies of keys
+// and its map nodes
+//
+
+template<typename KeyT, typename HashT = std::hash<KeyT>>
+class ClockEviction :
+	private utils::NonCopyable
+{
+public:
+	explicit ClockEviction(EvictionBudgetPtr budget) :
+		m_budget{ std::move(budget) },
+		m_usedBitCount{ GetUsedBitCount(m_budget->GetOptions()) },
+		m_usedBits{ std::make_unique<std::atomic<uint8_t>[]>(m_usedBitCount) }
+	{
+	}
+
+	~ClockEviction()
+	{
+		Detach();
+	}
+
+	void MarkUsed(const KeyT& key) noexcept
+	{
+		auto& bit = m_usedBits[m_hasher(key) & (m_usedBitCount - 1)];
+
+		// a hot key doesn't write the cache line again and again
+		if (bit.load(std::memory_order_relaxed) == 0)
+			bit.store(1, std::memory_order_relaxed);
+	}
+
+	std::unique_lock<std::mutex> LockKey(const KeyT& key)
+	{
+		return std::unique_lock<std::mutex>(m_keyLocks[m_hasher(key) % cKeyLockCount].mutex);
+	}
+
+	// the key is in the node taking size bytes; a key rewritten counts as used, a new one doesn't:
+	// otherwise a burst of insertions makes the hand clear every bit in one sweep and evict keys
+	// looked up just before. Must be called under LockKey(key)
+	void OnPresent(const KeyT& key, size_t size)
+	{
+		auto& shard = GetShard(key);
+		std::lock_guard lock(shard.mutex);
+
+		auto [it, inserted] = shard.entries.try_emplace(key);
+		auto& entry = it->second;
+		if (inserted)
+		{
+			entry.ringIndex = shard.ring.size();
+			shard.ring.push_back(key);
+			AddTotals(0, GetEntryOverhead(key));
+		}
+
+		if (!inserted && entry.state == EntryState::Present)
+		{
+			MarkUsed(key);
+			SubtractTotals(0, entry.size);
+			AddTotals(0, size);
+		}
+		else
+			AddTotals(1, size);
+
+		entry.state = EntryState::Present;
+		entry.size = size;
+	}
+
+	// the key has left the node; must be called under LockKey(key)
+	void OnAbsent(const KeyT& key)
+	{
+		auto& shard = GetShard(key);
+		std::lock_guard lock(shard.mutex);
+
+		const auto it = shard.entries.find(key);
+		if (it == shard.entries.end())
+			return;
+
+		if (it->second.state == EntryState::Present)
+			SubtractTotals(1, it->second.size);
+		RemoveEntry(shard, it);
+	}
+
+	// the tree is over its budget, and the node is over its share
+	bool IsOverBudget() const noexcept
+	{
+		return !m_detached.load(std::memory_order_relaxed) && m_budget->IsOver() &&
+			m_budget->IsOverShare(m_count.load(std::memory_order_relaxed), m_size.load(std::memory_order_relaxed));
+	}
+
+	// picks keys to be evicted for the node to fit into its share or the tree into the budget;
+	// a key picked is evicted by the caller if IsPicked(key) under LockKey(key)
+	void PickVictims(std::vector<KeyT>& victims)
+	{
+		// hands of the shards go round together a few steps at a time, so they act almost as one hand;
+		// every key gets one chance to show it has been used
+		std::array<size_t, cShardCount> stepsLeft;
+		stepsLeft.fill(cUnknownSteps);
+
+		const auto first = m_nextShard.fetch_add(1, std::memory_order_relaxed);
+		for (auto moving = true; moving && IsOverBudget();)
+		{
+			moving = false;
+			for (size_t i = 0; i < cShardCount && IsOverBudget(); i++)
+			{
+				const auto index = (first + i) % cShardCount;
+				if (PickVictims(m_shards[index], stepsLeft[index], victims))
+					moving = true;
+			}
+		}
+	}
+
+	// a key picked for eviction and not changed since then; must be called under LockKey(key)
+	bool IsPicked(const KeyT& key) const
+	{
+		const auto& shard = GetShard(key);
+		std::lock_guard lock(shard.mutex);
+
+		const auto it = shard.entries.find(key);
+		return it != shard.entries.end() && it->second.state == EntryState::Picked;
+	}
+
+	// the node has left the tree: its keys don't count against the budget anymore
+	void Detach()
+	{
+		for (auto& shard : m_shards)
+			shard.mutex.lock();
+
+		if (!m_detached.exchange(true, std::memory_order_relaxed))
+		{
+			const auto count = m_count.load(std::memory_order_relaxed);
+			m_budget->Subtract(count, m_size.load(std::memory_order_relaxed));
+			if (count != 0)
+				m_budget->OnNodeEmptied();
+		}
+
+		for (auto it = m_shards.rbegin(); it != m_shards.rend(); ++it)
+			it->mutex.unlock();
+	}
+
+private:
+	static constexpr size_t cKeyLockCount = 32;
+	static constexpr size_t cShardCount = 16;
+	static constexpr size_t cStepsPerVisit = 4;
+	static constexpr size_t cUnknownSteps = std::numeric_limits<size_t>::max();
+	static constexpr size_t cCacheLineSize = 64;
+	static constexpr size_t cMinUsedBitCount = size_t{ 1 } << 12;
+	static constexpr size_t cMaxUsedBitCount = size_t{ 1 } << 20;
+
+	// a picked key isn't accounted anymore; it becomes present again if it is changed before it is evicted
+	enum class EntryState : uint8_t
+	{
+		Present,
+		Picked
+	};
+
+	struct Entry
+	{
+		size_t size = 0;
+		// the position of the key in the ring of its shard
+		size_t ringIndex = 0;
+		EntryState state = EntryState::Present;
+	};
+
+	struct alignas(cCacheLineSize) KeyLock
+	{
+		std::mutex mutex;
+	};
+
+	struct alignas(cCacheLineSize) Shard
+	{
+		mutable std::mutex mutex;
+		std::unordered_map<KeyT, Entry, HashT> entries;
+		std::vector<KeyT> ring;
+		size_t hand = 0;
+	};
+
+	static size_t GetUsedBitCount(const EvictionOptions& options) noexcept
+	{
+		return utils::NextPowerOfTwo(std::clamp(options.maxKeyCount, cMinUsedBitCount, cMaxUsedBitCount));
+	}
+
+	// a key in the ring and in a map node: a link, a cached hash and a bucket
+	static size_t GetEntryOverhead(const KeyT& key) noexcept
+	{
+		return 2 * utils::GetMemorySize(key) + sizeof(Entry) + 2 * sizeof(void*) + sizeof(size_t);
+	}
+
+	Shard& GetShard(const KeyT& key)
+	{
+		return m_shards[m_hasher(key) % cShardCount];
+	}
+
+	const Shard& GetShard(const KeyT& key) const
+	{
+		return m_shards[m_hasher(key) % cShardCount];
+	}
+
+	// moves the hand of the shard by up to cStepsPerVisit of stepsLeft (two rounds of its ring on the first visit);
+	// returns whether the hand has steps left
+	bool PickVictims(Shard& shard, size_t& stepsLeft, std::vector<KeyT>& victims)
+	{
+		std::lock_guard lock(shard.mutex);
+
+		auto& ring = shard.ring;
+		if (stepsLeft == cUnknownSteps)
+			stepsLeft = ring.size() * 2;
+
+		for (size_t step = 0; step < cStepsPerVisit && stepsLeft != 0 && !ring.empty() && IsOverBudget(); step++, stepsLeft--)
+		{
+			if (shard.hand >= ring.size())
+				shard.hand = 0;
+
+			const auto it = shard.entries.find(ring[shard.hand]);
+			auto& entry = it->second;
+
+			if (entry.state == EntryState::Present)
+			{
+				auto& bit = m_usedBits[m_hasher(it->first) & (m_usedBitCount - 1)];
+				if (bit.load(std::memory_order_relaxed) != 0)
+					bit.store(0, std::memory_order_relaxed);
+				else
+				{
+					entry.state = EntryState::Picked;
+					SubtractTotals(1, entry.size);
+					victims.push_back(it->first);
+				}
+			}
+
+			shard.hand++;
+		}
+
+		return stepsLeft != 0 && !ring.empty();
+	}
+
+	// a key leaving the node leaves the ring at once, so the ring holds no memory for absent keys;
+	// must be called under the lock of shard
+	void RemoveEntry(Shard& shard, typename std::unordered_map<KeyT, Entry, HashT>::iterator it)
+	{
+		auto& ring = shard.ring;
+
+		const auto index = it->second.ringIndex;
+		if (index + 1 != ring.size())
+		{
+			ring[index] = std::move(ring.back());
+			shard.entries.find(ring[index])->second.ringIndex = index;
+		}
+		ring.pop_back();
+
+		SubtractTotals(0, GetEntryOverhead(it->first));
+		shard.entries.erase(it);
+	}
+
+	// totals of the node go to the budget until the node is detached; must be called under a shard lock
+	void AddTotals(size_t count, size_t size) noexcept
+	{
+		const auto previousCount = m_count.fetch_add(count, std::memory_order_relaxed);
+		m_size.fetch_add(size, std::memory_order_relaxed);
+
+		if (m_detached.load(std::memory_order_relaxed))
+			return;
+
+		m_budget->Add(count, size);
+		if (previousCount == 0 && count != 0)
+			m_budget->OnNodeFilled();
+	}
+
+	void SubtractTotals(size_t count, size_t size) noexcept
+	{
+		const auto previousCount = m_count.fetch_sub(count, std::memory_order_relaxed);
+		m_size.fetch_sub(size, std::memory_order_relaxed);
+
+		if (m_detached.load(std::memory_order_relaxed))
+			return;
+
+		m_budget->Subtract(count, size);
+		if (previousCount == count && count != 0)
+			m_budget->OnNodeEmptied();
+	}
+
+private:
+	const EvictionBudgetPtr m_budget;
+	HashT m_hasher;
+
+	const size_t m_usedBitCount;
+	const std::unique_ptr<std::atomic<uint8_t>[]> m_usedBits;
+
+	std::array<KeyLock, cKeyLockCount> m_keyLocks;
+	std::array<Shard, cShardCount> m_shards;
+	std::atomic<size_t> m_nextShard{ 0 };
+
+	// totals of the node, raised and lowered under shard locks; set under all of them
+	std::atomic<size_t> m_count{ 0 };
+	std::atomic<size_t> m_size{ 0 };
+	std::atomic<bool> m_detached{ false };
+};
+
+} //namespace internal
+
+} //namespace vs
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/NonCopyable.h"
+#include "utils/TimerWheel.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+//
+// ExpirationTable
+//
+// Deadlines of keys of a node which have TTLs. Keys are scheduled into a timer wheel
+// with cTickDuration resolution; a key which deadline has changed keeps its former entry
+// in the wheel, which is dropped when it comes. The table is allocated by the first Activate,
+// so a node without TTLs pays for them with a counter of changes made while the table is inactive:
+// Activate waits for those changes to end, so none of them is applied after a key gets its first deadline
+//
+
+template<typename KeyT, typename HashT = std::hash<KeyT>>
+class ExpirationTable :
+	private utils::NonCopyable
+{
+public:
+	using Clock = std::chrono::steady_clock;
+	using TimePoint = Clock::time_point;
+
+	static constexpr auto cTickDuration = std::chrono::milliseconds(10);
+
+public:
+	ExpirationTable() = default;
+
+	~ExpirationTable()
+	{
+		delete m_state.load(std::memory_order_relaxed);
+	}
+
+	bool IsActive() const noexcept
+	{
+		return m_state.load(std::memory_order_acquire) != nullptr;
+	}
+
+	void Activate()
+	{
+		std::call_once(m_activated,
+			[this]()
+			{
+				// a change either sees the table active or is waited for (both sides are seq_cst)
+				m_state.store(new State(Clock::now()), std::memory_order_seq_cst);
+				while (m_inactiveChangeCount.load(std::memory_order_seq_cst) != 0)
+					std::this_thread::yield();
+			});
+	}
+
+	// a change of keys made without the table while it is inactive; false if the table is active
+	class InactiveChange :
+		private utils::NonCopyable
+	{
+	public:
+		explicit InactiveChange(ExpirationTable& table) noexcept : m_table{ table }
+		{
+			m_table.m_inactiveChangeCount.fetch_add(1, std::memory_order_seq_cst);
+			m_inactive = m_table.m_state.load(std::memory_order_seq_cst) == nullptr;
+			if (!m_inactive)
+				m_table.m_inactiveChangeCount.fetch_sub(1, std::memory_order_release);
+		}
+
+		~InactiveChange()
+		{
+			if (m_inactive)
+				m_table.m_inactiveChangeCount.fetch_sub(1, std::memory_order_release);
+		}
+
+		explicit operator bool() const noexcept
+		{
+			return m_inactive;
+		}
+
+	private:
+		ExpirationTable& m_table;
+		bool m_inactive = false;
+	};
+
+	// the rest must be called on an active table
+
+	// serializes changes of a key along with its deadline
+	std::unique_lock<std::mutex> LockKey(const KeyT& key)
+	{
+		auto& state = GetState();
+		return std::unique_lock<std::mutex>(state.keyLocks[state.hasher(key) % cKeyLockCount].mutex);
+	}
+
+	void Set(const KeyT& key, TimePoint deadline)
+	{
+		auto& state = GetState();
+		std::lock_guard lock(state.mutex);
+
+		// the tick after the one the deadline falls on: the deadline has passed when it comes
+		const auto tick = state.ToTick(deadline) + 1;
+
+		state.deadlines[key] = deadline;
+		state.wheel.Schedule(key, tick);
+		state.deadlineCount.store(state.deadlines.size(), std::memory_order_relaxed);
+		state.nextTick.store(std::min(state.nextTick.load(std::memory_order_relaxed), tick), std::memory_order_relaxed);
+	}
+
+	// the key has no TTL anymore
+	void Reset(const KeyT& key)
+	{
+		auto& state = GetState();
+		if (state.deadlineCount.load(std::memory_order_relaxed) == 0)
+			return;
+
+		std::lock_guard lock(state.mutex);
+		state.deadlines.erase(key);
+		state.deadlineCount.store(state.deadlines.size(), std::memory_order_relaxed);
+	}
+
+	bool IsExpired(const KeyT& key, TimePoint now) const
+	{
+		auto& state = GetState();
+		if (state.deadlineCount.load(std::memory_order_relaxed) == 0)
+			return false;
+
+		std::shared_lock lock(state.mutex);
+
+		const auto it = state.deadlines.find(key);
+		return it != state.deadlines.end() && it->second <= now;
+	}
+
+	// collects up to limit keys which wheel entries have come and which deadlines have passed;
+	// a thread which finds another one collecting returns nothing. A key collected has to be
+	// checked with IsExpired again under its lock: it could be touched since
+	void CollectExpired(TimePoint now, size_t limit, std::vector<KeyT>& keys)
+	{
+		auto& state = GetState();
+		if (state.deadlineCount.load(std::memory_order_relaxed) == 0)
+			return;
+
+		const auto nowTick = state.ToTick(now);
+		if (nowTick < state.nextTick.load(std::memory_order_relaxed))
+			return;
+
+		std::unique_lock lock(state.mutex, std::try_to_lock);
+		if (!lock.owns_lock())
+			return;
+
+		const auto done = state.wheel.Advance(nowTick, limit,
+			[&state, &keys, now](const KeyT& key)
+			{
+				const auto it = state.deadlines.find(key);
+				if (it != state.deadlines.end() && it->second <= now)
+					keys.push_back(key);
+			});
+
+		// the rest of due keys is taken by the next call
+		state.nextTick.store(done ? nowTick + 1 : nowTick, std::memory_order_relaxed);
+		state.deadlineCount.store(state.deadlines.size(), std::memory_order_relaxed);
+	}
+
+private:
+	static constexpr size_t cKeyLockCount = 32;
+	static constexpr size_t cCacheLineSize = 64;
+
+	struct alignas(cCacheLineSize) KeyLock
+	{
+		std::mutex mutex;
+	};
+
+	struct State
+	{
+		explicit State(TimePoint origin) : origin{ origin }
+		{
+		}
+
+		typename utils::TimerWheel<KeyT>::Tick ToTick(TimePoint time) const
+		{
+			if (time <= origin)
+				return 0;
+
+			return static_cast<typename utils::TimerWheel<KeyT>::Tick>((time - origin) / cTickDuration);
+		}
+
+		const TimePoint origin;
+		std::array<KeyLock, cKeyLockCount> keyLocks;
+		HashT hasher;
+
+		mutable std::shared_mutex mutex;
+		std::unordered_map<KeyT, TimePoint, HashT> deadlines;
+		utils::TimerWheel<KeyT> wheel;
+		// lets lookups skip the lock while no key has a TTL, and callers of CollectExpired
+		// skip it until the next tick
+		std::atomic<size_t> deadlineCount{ 0 };
+		std::atomic<typename utils::TimerWheel<KeyT>::Tick> nextTick{ 0 };
+	};
+
+	State& GetState() const noexcept
+	{
+		return *m_state.load(std::memory_order_acquire);
+	}
+
+private:
+	std::atomic<State*> m_state{ nullptr };
+	std::once_flag m_activated;
+	std::atomic<size_t> m_inactiveChangeCount{ 0 };
+};
+
+} //namespace internal
+
+} //namespace vs
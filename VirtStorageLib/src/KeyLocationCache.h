@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+#include "utils/NonCopyable.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+//
+// KeyLocationCache
+//
+// Remembers which of mounted nodes has a key (a default LocationT: none of them).
+// Locations are forgotten one by one on key changes and all together on changes of mounts.
+// A lookup remembers its result only if no change of its key was reported while it ran,
+// so a location found before a change never outlives it.
+// Keys are split into stripes by their hashes; a stripe has its own lock, generation and share
+// of the capacity, so lookups of keys of different stripes don't contend, and a full stripe
+// forgets only its own locations
+//
+
+template<typename KeyT, typename LocationT, typename HashT = std::hash<KeyT>>
+class KeyLocationCache :
+	private utils::NonCopyable
+{
+public:
+	using Generation = uint64_t;
+
+public:
+	explicit KeyLocationCache(size_t capacity) :
+		m_stripeCapacity{ std::max<size_t>((capacity + cStripeCount - 1) / cStripeCount, 1) }
+	{
+		for (auto& stripe : m_stripes)
+			stripe.locations.reserve(m_stripeCapacity);
+	}
+
+	bool Find(const KeyT& key, LocationT& location) const
+	{
+		const auto& stripe = GetStripe(key);
+		std::lock_guard lock(stripe.mutex);
+
+		const auto it = stripe.locations.find(key);
+		if (it == stripe.locations.end())
+			return false;
+
+		location = it->second;
+		return true;
+	}
+
+	// must be taken before a lookup which result is going to be remembered
+	Generation GetGeneration(const KeyT& key) const
+	{
+		const auto& stripe = GetStripe(key);
+		std::lock_guard lock(stripe.mutex);
+
+		return stripe.generation;
+	}
+
+	void Remember(const KeyT& key, LocationT location, Generation generation)
+	{
+		auto& stripe = GetStripe(key);
+		std::lock_guard lock(stripe.mutex);
+
+		if (stripe.generation != generation)
+			return;
+
+		// hot keys are found again soon
+		if (stripe.locations.size() >= m_stripeCapacity)
+			stripe.locations.clear();
+
+		stripe.locations.insert_or_assign(key, location);
+	}
+
+	void Forget(const KeyT& key)
+	{
+		auto& stripe = GetStripe(key);
+		std::lock_guard lock(stripe.mutex);
+
+		stripe.generation++;
+		stripe.locations.erase(key);
+	}
+
+	void Clear()
+	{
+		for (auto& stripe : m_stripes)
+		{
+			std::lock_guard lock(stripe.mutex);
+
+			stripe.generation++;
+			stripe.locations.clear();
+		}
+	}
+
+private:
+	// changes of other keys don't stop remembering a location, unless they share a stripe
+	static constexpr size_t cStripeCount = 64;
+	static constexpr size_t cCacheLineSize = 64;
+
+	struct alignas(cCacheLineSize) Stripe
+	{
+		std::unordered_map<KeyT, LocationT, HashT> locations;
+		Generation generation = 0;
+		mutable std::mutex mutex;
+	};
+
+	Stripe& GetStripe(const KeyT& key)
+	{
+		return m_stripes[m_hasher(key) % cStripeCount];
+	}
+
+	const Stripe& GetStripe(const KeyT& key) const
+	{
+		return m_stripes[m_hasher(key) % cStripeCount];
+	}
+
+private:
+	const size_t m_stripeCapacity;
+	std::array<Stripe, cStripeCount> m_stripes;
+	HashT m_hasher;
+};
+
+} //namespace internal
+
+} //namespace vs
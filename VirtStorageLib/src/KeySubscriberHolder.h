@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Types.h"
+#include "intfs/KeyEvents.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+//
+// KeySubscriberHolder
+//
+// Subscribers to key changes of a node. Every insertion and erasure is reported,
+// so a node without subscribers pays one atomic load for it, and a node with them
+// reads a list copied on (rare) subscriptions instead of locking it
+//
+
+template<typename KeyT>
+class KeySubscriberHolder :
+	public IKeyEvents<KeyT>
+{
+public:
+	using KeyEventsPtr = typename IKeyEventsSubscription<KeyT>::KeyEventsPtr;
+
+public:
+	Cookie Add(KeyEventsPtr subscriber)
+	{
+		std::lock_guard lock(m_mutex);
+
+		auto subscribers = CopySubscribers();
+		subscribers->emplace_back(m_currentCookie, std::move(subscriber));
+		Publish(std::move(subscribers));
+
+		return m_currentCookie++;
+	}
+
+	void Remove(Cookie cookie)
+	{
+		std::lock_guard lock(m_mutex);
+
+		auto subscribers = CopySubscribers();
+		subscribers->erase(std::remove_if(subscribers->begin(), subscribers->end(),
+			[cookie](const auto& cookieSubscriberPair)
+			{
+				return cookieSubscriberPair.first == cookie;
+			}), subscribers->end());
+		Publish(std::move(subscribers));
+	}
+
+	void OnKeyChanged(const KeyT& key) override
+	{
+		// a change is applied before it is reported; pairs with subscribing,
+		// so a subscriber registered after the check sees the change by itself
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_subscriberCount.load(std::memory_order_relaxed) == 0)
+			return;
+
+		const auto subscribers = std::atomic_load(&m_subscribers);
+		for (const auto& cookieSubscriberPair : *subscribers)
+			cookieSubscriberPair.second->OnKeyChanged(key);
+	}
+
+private:
+	using SubscribersContainerType = std::vector<std::pair<Cookie, KeyEventsPtr>>;
+	using SubscribersPtr = std::shared_ptr<const SubscribersContainerType>;
+
+	// must be called under m_mutex
+	std::shared_ptr<SubscribersContainerType> CopySubscribers() const
+	{
+		return std::make_shared<SubscribersContainerType>(*m_subscribers);
+	}
+
+	void Publish(std::shared_ptr<SubscribersContainerType>&& subscribers)
+	{
+		const auto count = subscribers->size();
+		std::atomic_store(&m_subscribers, SubscribersPtr{ std::move(subscribers) });
+		m_subscriberCount.store(count, std::memory_order_seq_cst);
+	}
+
+private:
+	SubscribersPtr m_subscribers{ std::make_shared<SubscribersContainerType>() };
+	std::atomic<size_t> m_subscriberCount{ 0 };
+	Cookie m_currentCookie = 1;
+	std::mutex m_mutex;
+};
+
+} //namespace internal
+
+} //namespace vs
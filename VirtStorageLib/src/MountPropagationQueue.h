@@ -0,0 +1,243 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <unordered_map>
+#include <vector>
+
+#include "Types.h"
+#include "utils/NonCopyable.h"
+#include "utils/WorkStealingPool.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+//
+// MountPropagationQueue
+//
+// Children inserted into and removed from mounted volume nodes, on their way to virtual nodes
+// of a storage (MountPropagation::Asynchronous). A drain task takes all queued changes at once
+// and gives every receiver its own ones in a single ApplyMountChanges(changes) call, in the order they were made.
+// An insertion is dropped if the child is removed before the insertion is applied; the removal is kept,
+// as the child may have been mounted along with its parent meanwhile. A receiver failing to apply its changes
+// doesn't stop the others; the first error is kept and rethrown by the next Flush.
+//
+// The drain runs on a worker of the process-wide pool rather than on a thread of every storage: a push into
+// an empty queue submits it, and it takes changes pushed meanwhile until the queue is empty. A pool without
+// threads leaves the changes to the next Flush, which drains them in the caller.
+//
+// The drain may release the last node of a storage, which destroys the queue; it keeps the state it works with,
+// so it finishes on its own then. Otherwise the queue waits for a running drain on destruction
+//
+
+template<typename ReceiverT, typename NodePtrT>
+class MountPropagationQueue :
+	private utils::NonCopyable
+{
+public:
+	using Ptr = std::shared_ptr<MountPropagationQueue>;
+	using ReceiverPtr = std::shared_ptr<ReceiverT>;
+
+	struct Change
+	{
+		NodeId id = 0;
+		// nullptr for a dropped insertion
+		NodePtrT node;
+		bool added = false;
+	};
+
+	using ChangesType = std::vector<Change>;
+
+public:
+	static Ptr CreateInstance(utils::WorkStealingPool& pool = utils::WorkStealingPool::GetDefault())
+	{
+		return std::shared_ptr<MountPropagationQueue>(new MountPropagationQueue(pool));
+	}
+
+	~MountPropagationQueue()
+	{
+		auto& state = *m_state;
+
+		std::unique_lock lock(state.mutex);
+		state.stopped = true;
+		state.appliedCv.notify_all();
+
+		// a running drain stops after the changes it has taken; a submitted one finds the queue stopped
+		if (state.drainer != std::this_thread::get_id())
+			state.appliedCv.wait(lock,
+				[&state]()
+				{
+					return state.drainer == std::thread::id{};
+				});
+	}
+
+	void Push(ReceiverPtr receiver, NodeId id, NodePtrT node, bool added)
+	{
+		auto& state = *m_state;
+		bool submit = false;
+		{
+			std::lock_guard lock(state.mutex);
+			if (state.stopped)
+				return;
+
+			if (!state.draining && m_pool.GetThreadCount() != 0)
+			{
+				state.draining = true;
+				submit = true;
+			}
+
+			const auto [it, inserted] = state.batchIndices.try_emplace(receiver.get(), state.batches.size());
+			if (inserted)
+				state.batches.push_back(Batch{ std::move(receiver), {}, {} });
+
+			auto& batch = state.batches[it->second];
+			if (added)
+				batch.insertions[id] = batch.changes.size();
+			else
+			{
+				const auto insertion = batch.insertions.find(id);
+				if (insertion != batch.insertions.end())
+				{
+					batch.changes[insertion->second].node = nullptr;
+					batch.insertions.erase(insertion);
+				}
+			}
+			batch.changes.push_back(Change{ id, std::move(node), added });
+
+			state.pushed++;
+		}
+
+		if (submit)
+			m_pool.Submit(
+				[state = m_state]()
+				{
+					Drain(*state);
+				});
+	}
+
+	// waits until changes pushed before the call are applied; rethrows the first error
+	// changes have failed with since the previous Flush
+	void Flush()
+	{
+		auto& state = *m_state;
+
+		std::unique_lock lock(state.mutex);
+
+		// a receiver flushing would wait for itself
+		if (state.drainer == std::this_thread::get_id())
+			return;
+
+		const auto pushed = state.pushed;
+		if (!state.draining && state.applied < pushed)
+		{
+			state.draining = true;
+			lock.unlock();
+			Drain(state);
+			lock.lock();
+		}
+
+		state.appliedCv.wait(lock,
+			[&state, pushed]()
+			{
+				return state.applied >= pushed || state.stopped;
+			});
+
+		if (state.error)
+			std::rethrow_exception(std::exchange(state.error, nullptr));
+	}
+
+private:
+	struct Batch
+	{
+		ReceiverPtr receiver;
+		ChangesType changes;
+		// indices of insertions in changes, to drop them if their children are removed
+		std::unordered_map<NodeId, size_t> insertions;
+	};
+
+	struct State
+	{
+		std::mutex mutex;
+		// notified when changes are applied and when a drain is over
+		std::condition_variable appliedCv;
+
+		std::vector<Batch> batches;
+		std::unordered_map<const ReceiverT*, size_t> batchIndices;
+
+		// changes pushed and applied since the start
+		uint64_t pushed = 0;
+		uint64_t applied = 0;
+		bool stopped = false;
+		// a drain is submitted or running; it is the only one
+		bool draining = false;
+		std::thread::id drainer;
+		// the first error since the last Flush
+		std::exception_ptr error;
+	};
+
+	explicit MountPropagationQueue(utils::WorkStealingPool& pool) : m_state{ std::make_shared<State>() }, m_pool{ pool }
+	{
+	}
+
+	// the queue may be destroyed by a receiver, so only the state is used here; must be called
+	// by the one who has raised state.draining
+	static void Drain(State& state)
+	{
+		std::unique_lock lock(state.mutex);
+		state.drainer = std::this_thread::get_id();
+
+		// changes left after a stop have no storage to reach anymore
+		while (!state.stopped && !state.batches.empty())
+		{
+			auto batches = std::move(state.batches);
+			state.batches.clear();
+			state.batchIndices.clear();
+			const auto pushed = state.pushed;
+
+			lock.unlock();
+
+			// a synchronous change would have failed its writer; the rest are applied anyway
+			std::exception_ptr error;
+			for (auto& batch : batches)
+			{
+				try
+				{
+					batch.receiver->ApplyMountChanges(batch.changes);
+				}
+				catch (...)
+				{
+					if (!error)
+						error = std::current_exception();
+				}
+			}
+
+			// receivers are released outside the lock
+			batches.clear();
+
+			lock.lock();
+			if (!state.error)
+				state.error = std::move(error);
+			state.applied = pushed;
+			state.appliedCv.notify_all();
+		}
+
+		state.drainer = {};
+		state.draining = false;
+		state.appliedCv.notify_all();
+	}
+
+private:
+	const std::shared_ptr<State> m_state;
+	utils::WorkStealingPool& m_pool;
+};
+
+} //namespace internal
+
+} //namespace vs
@@ -18,7 +18,7 @@ namespace internal
 
 template<
 	template <typename, typename> typename BaseT,
-	template <typename, typename> typename NodeImplT,
+	typename NodeImplT,
 	typename KeyT, typename ValueHolderT>
 class NodeProxyBaseImpl:
 	public BaseT<KeyT, ValueHolderT>,
@@ -27,7 +27,7 @@ class NodeProxyBaseImpl:
 
 public:
 	using BaseType = BaseT<KeyT, ValueHolderT>;
-	using NodeImplType = NodeImplT<KeyT, ValueHolderT>;
+	using NodeImplType = NodeImplT;
 	using NodeImplPtr = std::shared_ptr<NodeImplType>;
 	using NodeImplWeakPtr = std::weak_ptr<NodeImplType>;
 
@@ -36,10 +36,18 @@ public:
 	using typename INodeContainer<NodeType>::NodeWeakPtr;
 
 	using typename NodeType::ForEachKeyValueFunctorType;
+	using typename NodeType::ForEachConstKeyValueFunctorType;
+	using typename NodeType::VisitFunctorType;
+	using typename NodeType::KeysType;
+	using typename NodeType::KeyValuesType;
+	using typename NodeType::FoundValuesType;
+	using typename NodeType::CursorType;
 	
 	using typename INodeContainer<NodeType>::ForEachFunctorType;
 	using typename INodeContainer<NodeType>::FindIfFunctorType;
 	using typename INodeContainer<NodeType>::RemoveIfFunctorType;
+	using typename INodeContainer<NodeType>::ChildCursorType;
+	using typename INodeContainer<NodeType>::ChildrenType;
 
 protected:
 	NodeProxyBaseImpl(NodeImplWeakPtr owner, NodeId nodeId) : m_owner{ owner }, m_nodeId{ nodeId }
@@ -59,6 +67,12 @@ protected:
 		return owner;
 	}
 
+	// nullptr if the node was removed
+	NodeImplPtr TryGetOwner() const noexcept
+	{
+		return m_owner.lock();
+	}
+
 private:
 
 	// INode
@@ -67,6 +81,11 @@ private:
 		return GetOwner()->GetName();
 	}
 
+	NodeStats GetStats() const override
+	{
+		return GetOwner()->GetStats();
+	}
+
 	void Insert(const KeyT& key, const ValueHolderT& value) override
 	{
 		GetOwner()->Insert(key, value);
@@ -87,10 +106,20 @@ private:
 		return GetOwner()->Find(key, value);
 	}
 
+	bool Visit(const KeyT& key, const VisitFunctorType& f) const override
+	{
+		return GetOwner()->Visit(key, f);
+	}
+
 	bool Contains(const KeyT& key) const override
 	{
 		return GetOwner()->Contains(key);
 	}
+
+	bool FindValueByPath(const std::string& path, const KeyT& key, ValueHolderT& value) const override
+	{
+		return GetOwner()->FindValueByPath(path, key, value);
+	}
 	
 	bool TryInsert(const KeyT& key, const ValueHolderT& value) override
 	{
@@ -117,6 +146,51 @@ private:
 		return GetOwner()->ForEachKeyValue(f);
 	}
 
+	void ForEachKeyValueSnapshot(const ForEachConstKeyValueFunctorType& f) const override
+	{
+		GetOwner()->ForEachKeyValueSnapshot(f);
+	}
+
+	void ForEachInRange(const KeyT& from, const KeyT& to, const ForEachKeyValueFunctorType& f) override
+	{
+		GetOwner()->ForEachInRange(from, to, f);
+	}
+
+	bool LowerBound(const KeyT& key, KeyT& foundKey, ValueHolderT& value) const override
+	{
+		return GetOwner()->LowerBound(key, foundKey, value);
+	}
+
+	PageOrder GetPageOrder() const override
+	{
+		return GetOwner()->GetPageOrder();
+	}
+
+	CursorType NextKeyValues(const CursorType& cursor, size_t count, KeyValuesType& keyValues) const override
+	{
+		return GetOwner()->NextKeyValues(cursor, count, keyValues);
+	}
+
+	size_t MultiFind(const KeysType& keys, FoundValuesType& values) const override
+	{
+		return GetOwner()->MultiFind(keys, values);
+	}
+
+	void MultiInsert(const KeyValuesType& keyValues) override
+	{
+		GetOwner()->MultiInsert(keyValues);
+	}
+
+	void MultiInsert(KeyValuesType&& keyValues) override
+	{
+		GetOwner()->MultiInsert(std::move(keyValues));
+	}
+
+	void MultiErase(const KeysType& keys) override
+	{
+		GetOwner()->MultiErase(keys);
+	}
+
 	// INodeContainer
 	NodePtr InsertChild(const std::string& name) override
 	{
@@ -138,6 +212,11 @@ private:
 		return GetOwner()->FindChildIf(f);
 	}
 
+	ChildCursorType NextChildren(const ChildCursorType& cursor, size_t count, ChildrenType& children) const override
+	{
+		return GetOwner()->NextChildren(cursor, count, children);
+	}
+
 	void RemoveChild(const std::string& name) override
 	{
 		GetOwner()->RemoveChild(name);
@@ -148,6 +227,16 @@ private:
 		GetOwner()->RemoveChildIf(f);
 	}
 
+	NodePtr FindByPath(const std::string& path) const override
+	{
+		return GetOwner()->FindByPath(path);
+	}
+
+	NodePtr InsertChildPath(const std::string& path) override
+	{
+		return GetOwner()->InsertChildPath(path);
+	}
+
 	// INodeLifespan
 	bool Exists() const noexcept
 	{
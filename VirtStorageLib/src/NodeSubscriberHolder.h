@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Types.h"
+#include "intfs/NodeEvents.h"
+#include "utils/EpochManager.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+//
+// NodeSubscriberHolder
+//
+// Subscribers to events of a node. Subscriptions publish a new immutable list under a lock,
+// and the replaced one is freed through utils::EpochManager once nobody reads it, so an event
+// is delivered to a list taken with one atomic load, without copying it or touching a reference count
+//
+
+template<typename NodeT>
+class NodeSubscriberHolder :
+	public INodeEvents<NodeT>
+{
+public:
+	using typename INodeEvents<NodeT>::NodePtr;
+	using NodeEventsPtr = typename INodeEventsSubscription<NodeT>::NodeEventsPtr;
+
+public:
+	NodeSubscriberHolder() = default;
+
+	~NodeSubscriberHolder()
+	{
+		// the node is being destroyed, so nobody delivers its events anymore
+		delete m_subscribers.load(std::memory_order_relaxed);
+	}
+
+	NodeSubscriberHolder(const NodeSubscriberHolder&) = delete;
+	NodeSubscriberHolder& operator=(const NodeSubscriberHolder&) = delete;
+
+	Cookie Add(NodeEventsPtr subscriber)
+	{
+		std::lock_guard lock(m_mutex);
+
+		auto subscribers = *m_subscribers.load(std::memory_order_relaxed);
+		subscribers.emplace_back(m_currentCookie, std::move(subscriber));
+		Publish(std::move(subscribers));
+
+		return m_currentCookie++;
+	}
+
+	void Remove(Cookie cookie)
+	{
+		std::lock_guard lock(m_mutex);
+
+		auto subscribers = *m_subscribers.load(std::memory_order_relaxed);
+		subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(),
+			[cookie](const auto& cookieSubscriberPair)
+			{
+				return cookieSubscriberPair.first == cookie;
+			}), subscribers.end());
+		Publish(std::move(subscribers));
+	}
+
+	void Clear()
+	{
+		std::lock_guard lock(m_mutex);
+
+		Publish({});
+	}
+
+	void OnNodeAdded(NodePtr node) override
+	{
+		utils::EpochManager::Guard guard;
+
+		for (const auto& cookieSubscriberPair : *m_subscribers.load(std::memory_order_acquire))
+			cookieSubscriberPair.second->OnNodeAdded(node);
+	}
+
+	void OnNodeRemoved(NodePtr node) override
+	{
+		utils::EpochManager::Guard guard;
+
+		for (const auto& cookieSubscriberPair : *m_subscribers.load(std::memory_order_acquire))
+			cookieSubscriberPair.second->OnNodeRemoved(node);
+	}
+
+private:
+	using SubscribersContainerType = std::vector<std::pair<Cookie, NodeEventsPtr>>;
+
+	// must be called under m_mutex
+	void Publish(SubscribersContainerType&& subscribers)
+	{
+		const auto replaced = m_subscribers.exchange(new SubscribersContainerType(std::move(subscribers)), std::memory_order_acq_rel);
+		utils::EpochManager::Retire(const_cast<SubscribersContainerType*>(replaced));
+	}
+
+private:
+	std::atomic<const SubscribersContainerType*> m_subscribers{ new SubscribersContainerType() };
+	Cookie m_currentCookie = 1;
+	std::mutex m_mutex;
+};
+
+} //namespace internal
+
+} //namespace vs
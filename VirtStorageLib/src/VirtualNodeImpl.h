@@ -1,6 +1,10 @@
 #pragma once
 
 #include <algorithm>
+#include <cassert>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
 
 #include "VolumeNode.h"
 #include "VirtualNode.h"
@@ -10,6 +14,8 @@
 #include "NodeIdImpl.h"
 #include "VirtualNodeMounter.h"
 #include "VirtualNodeProxyImpl.h"
+#include "utils/PageCollector.h"
+#include "utils/NodePath.h"
 
 namespace vs
 {
@@ -30,7 +36,9 @@ struct IVirtualNodeImplInternal
 	virtual ~IVirtualNodeImplInternal() = default;
 
 	virtual void OnEntirelyOnmounted() = 0;
-	virtual NodePtr InsertChildForMounting(const std::string& name) = 0;
+	// a child inserted for mounting is kept until EndMountingChild, even if it is entirely unmounted meanwhile
+	virtual std::vector<NodePtr> InsertChildrenForMounting(const std::vector<std::string>& names) = 0;
+	virtual void EndMountingChild(const std::string& name) = 0;
 };
 
 //
@@ -57,8 +65,16 @@ public:
 	using typename INodeContainer<NodeType>::ForEachFunctorType;
 	using typename INodeContainer<NodeType>::FindIfFunctorType;
 	using typename INodeContainer<NodeType>::RemoveIfFunctorType;
+	using typename INodeContainer<NodeType>::ChildCursorType;
+	using typename INodeContainer<NodeType>::ChildrenType;
 
 	using typename NodeType::ForEachKeyValueFunctorType;
+	using typename NodeType::ForEachConstKeyValueFunctorType;
+	using typename NodeType::CursorType;
+	using typename NodeType::VisitFunctorType;
+	using typename NodeType::KeysType;
+	using typename NodeType::KeyValuesType;
+	using typename NodeType::FoundValuesType;
 
 	using VolumeNodeType = IVolumeNode<KeyT, ValueHolderT>;
 	using VolumeNodePtr = typename VolumeNodeType::NodePtr;
@@ -69,9 +85,10 @@ public:
 
 public:
 
-	static VirtualNodeImplPtr CreateInstance(std::string name)
+	static VirtualNodeImplPtr CreateInstance(std::string name, StorageOptions options = {})
 	{
-		return CreateInstance(std::move(name), NodeKind::Ordinary, {});
+		auto propagationQueue = options.mountPropagation == MountPropagation::Asynchronous ? PropagationQueueType::CreateInstance() : nullptr;
+		return CreateInstance(std::move(name), NodeKind::Ordinary, std::move(options), std::move(propagationQueue), {});
 	}
 
 	// INode
@@ -80,6 +97,17 @@ public:
 		return m_name;
 	}
 
+	NodeStats GetStats() const override
+	{
+		// deferred children stay deferred: they are counted as pending by the mounter
+		auto stats = m_mounter.GetStats();
+
+		std::shared_lock lock(m_nodeMutex);
+		stats.childCount = m_children.size();
+
+		return stats;
+	}
+
 	void Insert(const KeyT& key, const ValueHolderT& value) override
 	{
 		m_mounter.Insert(key, value);
@@ -100,11 +128,23 @@ public:
 		return m_mounter.Find(key, value);
 	}
 
+	bool Visit(const KeyT& key, const VisitFunctorType& f) const override
+	{
+		return m_mounter.Visit(key, f);
+	}
+
 	bool Contains(const KeyT& key) const override
 	{
 		return m_mounter.Contains(key);
 	}
 
+	bool FindValueByPath(const std::string& path, const KeyT& key, ValueHolderT& value) const override
+	{
+		const auto node = FindNodeByPath(path);
+
+		return node && node->Find(key, value);
+	}
+
 	bool TryInsert(const KeyT& key, const ValueHolderT& value) override
 	{
 		return m_mounter.TryInsert(key, value);
@@ -130,14 +170,63 @@ public:
 		m_mounter.ForEachKeyValue(f);
 	}
 
+	void ForEachKeyValueSnapshot(const ForEachConstKeyValueFunctorType& f) const override
+	{
+		m_mounter.ForEachKeyValueSnapshot(f);
+	}
+
+	void ForEachInRange(const KeyT& from, const KeyT& to, const ForEachKeyValueFunctorType& f) override
+	{
+		m_mounter.ForEachInRange(from, to, f);
+	}
+
+	bool LowerBound(const KeyT& key, KeyT& foundKey, ValueHolderT& value) const override
+	{
+		return m_mounter.LowerBound(key, foundKey, value);
+	}
+
+	PageOrder GetPageOrder() const override
+	{
+		return m_mounter.GetPageOrder();
+	}
+
+	CursorType NextKeyValues(const CursorType& cursor, size_t count, KeyValuesType& keyValues) const override
+	{
+		return m_mounter.NextKeyValues(cursor, count, keyValues);
+	}
+
+	size_t MultiFind(const KeysType& keys, FoundValuesType& values) const override
+	{
+		return m_mounter.MultiFind(keys, values);
+	}
+
+	void MultiInsert(const KeyValuesType& keyValues) override
+	{
+		m_mounter.MultiInsert(keyValues);
+	}
+
+	void MultiInsert(KeyValuesType&& keyValues) override
+	{
+		m_mounter.MultiInsert(std::move(keyValues));
+	}
+
+	void MultiErase(const KeysType& keys) override
+	{
+		m_mounter.MultiErase(keys);
+	}
+
 	// INodeContainer
 	NodePtr InsertChild(const std::string& name) override
 	{
-		return InsertNode(name, m_kind);
+		m_mounter.MountDeferredChildren();
+
+		return InsertNode(name, m_kind)->GetProxy();
 	}
 
 	void ForEachChild(const ForEachFunctorType& f) const override
 	{
+		m_mounter.MountDeferredChildren();
+
 		std::shared_lock lock(m_nodeMutex);
 
 		for (auto it = m_children.begin(); it != m_children.end();)
@@ -148,19 +237,62 @@ public:
 		}
 	}
 
+	ChildCursorType NextChildren(const ChildCursorType& cursor, size_t count, ChildrenType& children) const override
+	{
+		children.clear();
+		if (cursor.IsEnd())
+			return cursor;
+
+		m_mounter.MountDeferredChildren();
+
+		utils::PageCollector<std::string, NodePtr> collector(cursor.GetLast(), count);
+		{
+			std::shared_lock lock(m_nodeMutex);
+
+			for (const auto& nameNodePair : m_children)
+				if (collector.Accepts(nameNodePair.first))
+					collector.Add(nameNodePair.first, nameNodePair.second->GetProxy());
+		}
+
+		std::vector<std::pair<std::string, NodePtr>> page;
+		collector.MoveTo(page);
+		for (auto& nameNodePair : page)
+			children.push_back(std::move(nameNodePair.second));
+
+		return cursor.Following(count, page.size(),
+			[&page]()
+			{
+				return page.back().first;
+			});
+	}
+
 	NodePtr FindChild(const std::string& name) const override
 	{
-		std::shared_lock lock(m_nodeMutex);
+		return FindChildNode(name);
+	}
 
-		auto it = m_children.find(name);
-		if (it != m_children.end())
-			return it->second;
+	NodePtr FindByPath(const std::string& path) const override
+	{
+		const auto node = FindNodeByPath(path);
 
-		return nullptr;
+		return node ? node->GetProxy() : nullptr;
+	}
+
+	NodePtr InsertChildPath(const std::string& path) override
+	{
+		return utils::WalkPath(this->shared_from_this(), path,
+			[](VirtualNodeImpl& node, const std::string& name)
+			{
+				node.m_mounter.MountDeferredChildren();
+
+				return node.InsertNode(name, node.m_kind);
+			})->GetProxy();
 	}
 
 	NodePtr FindChildIf(const FindIfFunctorType& f) const override
 	{
+		m_mounter.MountDeferredChildren();
+
 		std::shared_lock lock(m_nodeMutex);
 
 		for (auto it = m_children.begin(); it != m_children.end();)
@@ -177,6 +309,8 @@ public:
 
 	void RemoveChildIf(const RemoveIfFunctorType& f)  override
 	{
+		m_mounter.MountDeferredChildren();
+
 		std::lock_guard lock(m_nodeMutex);
 
 		for (auto it = m_children.begin(); it != m_children.end();)
@@ -191,9 +325,9 @@ public:
 
 	void RemoveChild(const std::string& name) override
 	{
-		std::lock_guard lock(m_nodeMutex);
+		m_mounter.MountDeferredChildren();
 
-		m_children.erase(name);
+		RemoveNode(name);
 	}
 
 	// IVirtualNodeMounter
@@ -222,6 +356,21 @@ public:
 		m_mounter.UnmountIf(f);
 	}
 
+	bool PinWriteTarget(VolumeNodePtr node) override
+	{
+		return m_mounter.PinWriteTarget(node);
+	}
+
+	void FlushMounting() override
+	{
+		m_mounter.FlushMounting();
+	}
+
+	size_t EstimateDistinctKeyCount() const override
+	{
+		return m_mounter.EstimateDistinctKeyCount();
+	}
+
 	void MakeOrphan() {};
 
 private:
@@ -232,19 +381,43 @@ private:
 	}
 
 	// IVirtualNodeImplInternal
-	NodePtr InsertChildForMounting(const std::string& name) override
+	std::vector<NodePtr> InsertChildrenForMounting(const std::vector<std::string>& names) override
+	{
+		std::vector<NodePtr> children;
+		children.reserve(names.size());
+
+		std::lock_guard lock(m_nodeMutex);
+
+		for (const auto& name : names)
+		{
+			children.push_back(InsertNodeLocked(name, NodeKind::ForMounting)->GetProxy());
+			m_childrenBeingMounted[name]++;
+		}
+
+		return children;
+	}
+
+	void EndMountingChild(const std::string& name) override
 	{
-		return InsertNode(name, NodeKind::ForMounting);
+		std::lock_guard lock(m_nodeMutex);
+
+		const auto it = m_childrenBeingMounted.find(name);
+		assert(it != m_childrenBeingMounted.end());
+		if (--it->second == 0)
+			m_childrenBeingMounted.erase(it);
 	}
 
 	void OnEntirelyOnmounted()
 	{
+		// called while children of a mounted node are being unmounted, so deferred children of the parent are not mounted
 		if (auto parent = m_parent.lock())
-			parent->RemoveChild(GetName());
+			parent->RemoveUnmountedNode(this);
 	}
 
 private:
 	using ChildrenContainerType = std::unordered_map<std::string, VirtualNodeImplPtr>;
+	using PropagationQueueType = MountPropagationQueue<virtual_node_details::NodeMountAssistant<KeyT, ValueHolderT>, VolumeNodePtr>;
+	using PropagationQueuePtr = typename PropagationQueueType::Ptr;
 	enum class NodeKind
 	{
 		Ordinary,
@@ -253,37 +426,88 @@ private:
 
 private:
 
-	VirtualNodeImpl(std::string name, NodeKind kind, VirtualNodeImplWeakPtr parent) :
-		m_name{ std::move(name) }, m_kind{ kind }, m_mounter{ this }, m_parent { std::move(parent)}
+	VirtualNodeImpl(std::string name, NodeKind kind, StorageOptions options, PropagationQueuePtr propagationQueue, VirtualNodeImplWeakPtr parent) :
+		m_name{ std::move(name) }, m_kind{ kind }, m_options{ std::move(options) }, m_propagationQueue{ std::move(propagationQueue) },
+		m_mounter{ this, m_options, m_propagationQueue }, m_parent { std::move(parent)}
 	{
 	}
 
-	static VirtualNodeImplPtr CreateInstance(std::string name, NodeKind kind, VirtualNodeImplWeakPtr parent)
+	static VirtualNodeImplPtr CreateInstance(std::string name, NodeKind kind, StorageOptions options, PropagationQueuePtr propagationQueue,
+		VirtualNodeImplWeakPtr parent)
 	{
 		// cannot use make_shared without ugly tricks because of private ctor
-		return std::shared_ptr<VirtualNodeImpl>(new VirtualNodeImpl(std::move(name), kind, std::move(parent)));
+		return std::shared_ptr<VirtualNodeImpl>(new VirtualNodeImpl(std::move(name), kind, std::move(options), std::move(propagationQueue), std::move(parent)));
+	}
+
+	void RemoveNode(const std::string& name)
+	{
+		std::lock_guard lock(m_nodeMutex);
+
+		m_children.erase(name);
+	}
+
+	// another volume may be mounting its child into the node, or the node may have been replaced already
+	void RemoveUnmountedNode(const VirtualNodeImpl* node)
+	{
+		std::lock_guard lock(m_nodeMutex);
+
+		const auto it = m_children.find(node->GetName());
+		if (it != m_children.end() && it->second.get() == node && m_childrenBeingMounted.count(it->first) == 0)
+			m_children.erase(it);
 	}
 
-	NodePtr InsertNode(const std::string& name, NodeKind kind)
+	VirtualNodeImplPtr InsertNode(const std::string& name, NodeKind kind)
 	{
 		std::lock_guard lock(m_nodeMutex);
 
+		return InsertNodeLocked(name, kind);
+	}
+
+	// must be called under m_nodeMutex
+	const VirtualNodeImplPtr& InsertNodeLocked(const std::string& name, NodeKind kind)
+	{
 		// "Find-then-insert" instead of "insert-then-test" to avoid
 		// possibly redundant calls CreateInstance
 
 		auto it = m_children.find(name);
 		if (it != m_children.end())
-			return it->second->GetProxy();
+			return it->second;
+
+		return m_children.insert({ name, CreateInstance(name, kind, m_options, m_propagationQueue, this->shared_from_this()) }).first->second;
+	}
+
+	VirtualNodeImplPtr FindChildNode(const std::string& name) const
+	{
+		m_mounter.MountDeferredChildren();
+
+		std::shared_lock lock(m_nodeMutex);
+
+		const auto it = m_children.find(name);
 
-		const auto insertRes = m_children.insert({ name, CreateInstance(name, kind, this->shared_from_this()) });
-		return insertRes.first->second->GetProxy();
+		return it != m_children.end() ? it->second : nullptr;
+	}
+
+	// deferred children are mounted level by level, as the path is walked
+	VirtualNodeImplPtr FindNodeByPath(const std::string& path) const
+	{
+		return utils::WalkPath(std::const_pointer_cast<VirtualNodeImpl>(this->shared_from_this()), path,
+			[](const VirtualNodeImpl& node, const std::string& name)
+			{
+				return node.FindChildNode(name);
+			});
 	}
 
 private:
 
 	std::string m_name;
 	ChildrenContainerType m_children;
+	// numbers of mounts in progress into children, by names
+	std::unordered_map<std::string, size_t> m_childrenBeingMounted;
 	const NodeKind m_kind;
+	// children inherit options
+	const StorageOptions m_options;
+	// the storage's one, nullptr unless it propagates changes of mounted nodes asynchronously
+	const PropagationQueuePtr m_propagationQueue;
 	virtual_node_details::VirtualNodeMounter<KeyT, ValueHolderT> m_mounter;
 	VirtualNodeImplWeakPtr m_parent;
 	mutable std::shared_mutex m_nodeMutex;
@@ -1,23 +1,40 @@
 #pragma once
 
-#include <list>
+#include <atomic>
+#include <exception>
+#include <map>
 #include <unordered_set>
 #include <cassert>
 #include <algorithm>
 #include <mutex>
-#include <shared_mutex>
+#include <functional>
+#include <numeric>
+#include <iterator>
+#include <vector>
+#include <optional>
 
 #include "VolumeNode.h"
 #include "Types.h"
 
+#include "StorageOptions.h"
+
 #include "NodeIdImpl.h"
+#include "KeyLocationCache.h"
+#include "MountPropagationQueue.h"
 #include "ActionOnRemovedNodeException.h"
 #include "InsertInEmptyVirtualNodeException.h"
 
 #include "utils/NonCopyable.h"
+#include "dict/BatchIndices.h"
+#include "utils/BitUtils.h"
+#include "utils/EpochManager.h"
+#include "utils/HyperLogLog.h"
+#include "utils/ParallelFor.h"
 
 #include "intfs/NodeLifespan.h"
 #include "intfs/NodeEvents.h"
+#include "intfs/KeyFilter.h"
+#include "intfs/KeyEvents.h"
 
 namespace vs
 {
@@ -54,6 +71,15 @@ REMOVED_NODE_EXCEPTION_CATCH \
 REMOVED_NODE_EXCEPTION_CATCH_END
 
 
+// where a virtual node found a key last time: an index in a mount table of the version
+struct KeyLocation
+{
+	static constexpr size_t cNowhere = static_cast<size_t>(-1);
+
+	uint64_t tableVersion = 0;
+	size_t index = cNowhere;
+};
+
 //
 // NodeMountAssistant
 // 
@@ -62,6 +88,7 @@ template<typename KeyT, typename ValueHolderT>
 class NodeMountAssistant :
 	public std::enable_shared_from_this<NodeMountAssistant<KeyT, ValueHolderT>>,
 	public INodeEvents<IVolumeNode<KeyT, ValueHolderT>>,
+	public IKeyEvents<KeyT>,
 	private utils::NonCopyable
 {
 public:
@@ -74,6 +101,13 @@ public:
 
 	using Ptr = std::shared_ptr<NodeMountAssistant>;
 
+	using LocationCacheType = KeyLocationCache<KeyT, KeyLocation>;
+	using LocationCachePtr = std::shared_ptr<LocationCacheType>;
+
+	using PropagationQueueType = MountPropagationQueue<NodeMountAssistant, VolumeNodePtr>;
+	using PropagationQueuePtr = typename PropagationQueueType::Ptr;
+	using MountChangesType = typename PropagationQueueType::ChangesType;
+
 public:
 
 	// helper functions 
@@ -85,33 +119,42 @@ public:
 	}
 
 public:
-	static Ptr CreateInstance(VirtualNodeImplType* owner, VolumeNodePtr volumeNode)
+	// children of the node are mounted through the queue if it is given
+	static Ptr CreateInstance(VirtualNodeImplType* owner, VolumeNodePtr volumeNode, LocationCachePtr locationCache,
+		const PropagationQueuePtr& propagationQueue, bool parallelMounting)
 	{
 		// cannot use make_shared without ugly tricks because of private ctor
-		return std::shared_ptr<NodeMountAssistant>(new NodeMountAssistant(owner, volumeNode));
+		return std::shared_ptr<NodeMountAssistant>(new NodeMountAssistant(owner, volumeNode, std::move(locationCache), propagationQueue, parallelMounting));
 	}
 
-	VolumeNodePtr GetNode() const
+	const VolumeNodePtr& GetNode() const noexcept
 	{
 		return m_volumeNode;
 	}
 
 	bool HasAliveNode() const noexcept
 	{
-		if (!m_volumeNode)
-			return false;
-
 		auto nodeLifespan = std::dynamic_pointer_cast<INodeLifespan>(m_volumeNode);
 		assert(nodeLifespan);
 
 		return nodeLifespan->Exists();
 	}
 
-	Priority GetPriority() const noexcept
+	// false if the mounted node surely has no key, so it needn't be asked
+	bool MayContain(const KeyT& key) const noexcept
+	{
+		return !m_keyFilter || m_keyFilter->MayContain(key);
+	}
+
+	// the filter of the mounted node pinned for a batch of keys, so the node isn't locked per key;
+	// nullptr if any key may be there (the node has no filter or is removed)
+	typename IKeyFilter<KeyT>::KeyFilterPtr PinKeyFilter() const noexcept
 	{
-		if (!m_volumeNode)
-			return MINIMAL_PRIORITY;
+		return m_keyFilter ? m_keyFilter->PinKeyFilter() : nullptr;
+	}
 
+	Priority GetPriority() const noexcept
+	{
 		REMOVED_NODE_EXCEPTION_TRY
 			return m_volumeNode->GetPriority();
 		REMOVED_NODE_EXCEPTION_EMPTY_HANDLER
@@ -119,7 +162,8 @@ public:
 		return MINIMAL_PRIORITY;
 	}
 
-	void Mount()
+	// children are mounted by MountChildren later if they are deferred
+	void Mount(bool deferChildren)
 	{
 		assert(m_subscriptionCookie == INVALID_COOKIE);
 
@@ -128,7 +172,64 @@ public:
 
 		m_subscriptionCookie = subscription->RegisterSubscriber(this->shared_from_this());
 
-		MountChildren();
+		// key changes are needed only to keep cached locations actual
+		if (m_locationCache)
+		{
+			const auto keySubscription = std::dynamic_pointer_cast<IKeyEventsSubscription<KeyT>>(m_volumeNode);
+			assert(keySubscription);
+			m_keySubscriptionCookie = keySubscription->RegisterKeySubscriber(this->shared_from_this());
+		}
+
+		if (!deferChildren)
+			MountChildren();
+	}
+
+	// true until MountChildren starts listing children of a lazily mounted node
+	bool HasDeferredChildren()
+	{
+		std::lock_guard lock(m_mutex);
+		return m_childrenState == ChildrenState::Deferred;
+	}
+
+	// does nothing if children are mounted already or the node is unmounted
+	void MountChildren()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+
+			if (m_childrenState != ChildrenState::Deferred)
+				return;
+
+			// children inserted or removed from now on are reported
+			m_childrenState = ChildrenState::Listing;
+		}
+
+		// children are listed outside the lock, as the node reports changes of its children under its own lock
+		std::vector<VolumeNodePtr> children;
+		REMOVED_NODE_EXCEPTION_TRY
+			m_volumeNode->ForEachChild(
+				[&children](auto node)
+				{
+					children.push_back(std::move(node));
+				});
+		REMOVED_NODE_EXCEPTION_EMPTY_HANDLER
+
+		std::lock_guard lock(m_mutex);
+
+		if (m_childrenState != ChildrenState::Listing)
+			return;
+
+		m_childrenState = ChildrenState::Mounted;
+
+		// a child listed may have been removed since then
+		children.erase(std::remove_if(children.begin(), children.end(),
+			[this](const VolumeNodePtr& child)
+			{
+				return m_removedWhileListing.count(GetNodeId(child)) != 0;
+			}), children.end());
+		m_removedWhileListing.clear();
+
+		MountChildrenLocked(std::move(children));
 	}
 
 	void Unmount()
@@ -139,70 +240,220 @@ public:
 			std::shared_ptr<INodeEventsSubscription<VolumeNodeType>> subscription = std::dynamic_pointer_cast<INodeEventsSubscription<VolumeNodeType>>(m_volumeNode);
 			assert(subscription);
 			subscription->UnregisterSubscriber(m_subscriptionCookie);
+
+			if (m_keySubscriptionCookie != INVALID_COOKIE)
+				std::dynamic_pointer_cast<IKeyEventsSubscription<KeyT>>(m_volumeNode)->UnregisterKeySubscriber(m_keySubscriptionCookie);
 		REMOVED_NODE_EXCEPTION_EMPTY_HANDLER
 
+		// the node itself is kept: readers of mount tables may still ask it until they are done
 		UnmountChildren();
-		m_volumeNode = nullptr;
+	}
+
+	// called by a thread of the propagation queue; changes which find the assistant unmounted
+	// or its owner gone are dropped
+	void ApplyMountChanges(MountChangesType& changes)
+	{
+		const auto owner = m_ownerLifetime.lock();
+		if (!owner)
+			return;
+
+		std::lock_guard lock(m_mutex);
+
+		if (!AreChildrenFollowed())
+			return;
+
+		// a child is removed before another one with its name is inserted
+		std::vector<VolumeNodePtr> children;
+		for (auto& change : changes)
+		{
+			if (!change.added)
+				UnmountChild(change.id);
+			else if (change.node)
+				children.push_back(std::move(change.node));
+		}
+
+		MountChildrenLocked(std::move(children));
 	}
 
 private:
 
-	NodeMountAssistant(VirtualNodeImplType* owner, VolumeNodePtr volumeNode) : m_owner{ owner }, m_volumeNode{ volumeNode }
+	NodeMountAssistant(VirtualNodeImplType* owner, VolumeNodePtr volumeNode, LocationCachePtr locationCache,
+		const PropagationQueuePtr& propagationQueue, bool parallelMounting) :
+		m_owner{ owner }, m_volumeNode{ volumeNode }, m_keyFilter{ dynamic_cast<const IKeyFilter<KeyT>*>(volumeNode.get()) },
+		m_locationCache{ std::move(locationCache) }, m_propagationQueue{ propagationQueue },
+		m_propagatesAsynchronously{ propagationQueue != nullptr }, m_parallelMounting{ parallelMounting }
+	{
+		if (m_propagatesAsynchronously)
+			m_ownerLifetime = owner->weak_from_this();
+	}
+
+	// IKeyEvents
+	void OnKeyChanged(const KeyT& key) override
 	{
+		// the key may have come to the node or left it
+		m_locationCache->Forget(key);
 	}
 
 	// INodeEvents
 	void OnNodeAdded(VolumeNodePtr node) override
 	{
+		if (m_propagatesAsynchronously)
+			return Propagate(std::move(node), true);
+
 		std::lock_guard lock(m_mutex);
 
-		MountChild(std::move(node));
+		if (AreChildrenFollowed())
+			MountChild(std::move(node));
 	}
 
 	void OnNodeRemoved(VolumeNodePtr node) override
 	{
+		if (m_propagatesAsynchronously)
+			return Propagate(std::move(node), false);
+
 		std::lock_guard lock(m_mutex);
 
-		auto it = m_nodes.find(GetNodeId(node));
-		if (it != m_nodes.end())
-		{
-			const auto& pair = it->second;
-			pair.virtualNode->Unmount(pair.volumeNode);
-			m_nodes.erase(it);
-		}
+		UnmountChild(GetNodeId(node));
 	}
 
 
 private:
-	void MountChildren()
-	{
-		std::lock_guard lock(m_mutex);
-
-		m_volumeNode->ForEachChild(
-			[this](auto node)
-			{
-				MountChild(std::move(node));
-			});
-	}
-
 	void UnmountChildren()
 	{
 		std::lock_guard lock(m_mutex);
 
+		m_childrenState = ChildrenState::Unmounted;
+
 		for (auto virtualNodeForVolumeNode : m_nodes)
 		{
 			const auto& pair = virtualNodeForVolumeNode.second;
-			pair.virtualNode->Unmount(pair.volumeNode);
+			// the virtual node may have been removed by a user
+			REMOVED_NODE_EXCEPTION_TRY
+				pair.virtualNode->Unmount(pair.volumeNode);
+			REMOVED_NODE_EXCEPTION_EMPTY_HANDLER
 		}
 
 		m_nodes.clear();
 	}
 
+	// must be called under m_mutex
 	void MountChild(VolumeNodePtr&& child)
 	{
-		auto virtualNodeAcceptor = static_cast<VirtualNodeImplInternalType*>(m_owner)->InsertChildForMounting(child->GetName());
-		if (virtualNodeAcceptor->Mount(child))
-			m_nodes.try_emplace(GetNodeId(child), std::move(virtualNodeAcceptor), std::move(child));
+		std::vector<VolumeNodePtr> children;
+		children.push_back(std::move(child));
+		MountChildrenLocked(std::move(children));
+	}
+
+	// virtual children of all the nodes are inserted at once; must be called under m_mutex
+	void MountChildrenLocked(std::vector<VolumeNodePtr>&& children)
+	{
+		// a child removed meanwhile is skipped; its removal follows
+		std::vector<VolumeNodePtr> aliveChildren;
+		std::vector<std::string> names;
+		for (auto& child : children)
+		{
+			REMOVED_NODE_EXCEPTION_TRY
+				names.push_back(child->GetName());
+				aliveChildren.push_back(std::move(child));
+			REMOVED_NODE_EXCEPTION_EMPTY_HANDLER
+		}
+
+		const auto owner = static_cast<VirtualNodeImplInternalType*>(m_owner);
+		auto virtualNodeAcceptors = owner->InsertChildrenForMounting(names);
+
+		// names of siblings are distinct, so every child is mounted to its own virtual node, and its assistant
+		// mounts its subtree in turn: subtrees are mounted by workers of the pool as they are found
+		std::vector<char> mounted(aliveChildren.size(), 0);
+		const auto mount =
+			[&](size_t, size_t i)
+			{
+				// a virtual node entirely unmounted by another volume meanwhile is kept until the mount ends
+				bool removed = false;
+				try
+				{
+					mounted[i] = virtualNodeAcceptors[i]->Mount(aliveChildren[i]);
+				}
+				catch (const ActionOnRemovedNodeException&)
+				{
+					removed = true;
+				}
+				catch (...)
+				{
+					owner->EndMountingChild(names[i]);
+					throw;
+				}
+
+				owner->EndMountingChild(names[i]);
+
+				// removed while being mounted: its virtual node is dropped if nothing else is mounted there
+				if (removed)
+				{
+					REMOVED_NODE_EXCEPTION_TRY
+						virtualNodeAcceptors[i]->Unmount(aliveChildren[i]);
+					REMOVED_NODE_EXCEPTION_EMPTY_HANDLER
+				}
+			};
+
+		// children mounted before a failure are kept, as a sequential mount keeps them
+		std::exception_ptr error;
+		try
+		{
+			const auto workerCount = m_parallelMounting ? utils::GetParallelism() : 1;
+			if (workerCount > 1 && aliveChildren.size() > 1)
+				utils::ParallelFor(workerCount, aliveChildren.size(), mount);
+			else
+			{
+				for (size_t i = 0; i < aliveChildren.size(); i++)
+					mount(0, i);
+			}
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+
+		for (size_t i = 0; i < aliveChildren.size(); i++)
+		{
+			if (mounted[i])
+				m_nodes.try_emplace(GetNodeId(aliveChildren[i]), std::move(virtualNodeAcceptors[i]), std::move(aliveChildren[i]));
+		}
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	// must be called under m_mutex
+	bool AreChildrenFollowed() const noexcept
+	{
+		return m_childrenState == ChildrenState::Listing || m_childrenState == ChildrenState::Mounted;
+	}
+
+	// must be called under m_mutex
+	void UnmountChild(NodeId id)
+	{
+		if (m_childrenState == ChildrenState::Listing)
+			m_removedWhileListing.insert(id);
+
+		auto it = m_nodes.find(id);
+		if (it != m_nodes.end())
+		{
+			const auto& pair = it->second;
+			REMOVED_NODE_EXCEPTION_TRY
+				pair.virtualNode->Unmount(pair.volumeNode);
+			REMOVED_NODE_EXCEPTION_EMPTY_HANDLER
+			m_nodes.erase(it);
+		}
+	}
+
+	void Propagate(VolumeNodePtr&& node, bool added)
+	{
+		// the storage is gone
+		const auto queue = m_propagationQueue.lock();
+		if (!queue)
+			return;
+
+		const auto id = GetNodeId(node);
+		queue->Push(this->shared_from_this(), id, std::move(node), added);
 	}
 
 private:
@@ -218,11 +469,34 @@ private:
 
 	using NodesContainer = std::unordered_map<NodeId, VirtualNodeForVolumeNode>;
 
+	enum class ChildrenState
+	{
+		Deferred,
+		Listing,
+		Mounted,
+		Unmounted
+	};
+
 	VirtualNodeImplType* m_owner = nullptr;
-	VolumeNodePtr m_volumeNode;
+	const VolumeNodePtr m_volumeNode;
+	// m_volumeNode's one; resolved once, as the filter is asked for every key
+	const IKeyFilter<KeyT>* const m_keyFilter;
+	// the owner's one; nullptr if it doesn't cache locations of keys
+	const LocationCachePtr m_locationCache;
+
+	// the storage's one; it owns the queue, and queued changes own their assistants
+	const std::weak_ptr<PropagationQueueType> m_propagationQueue;
+	const bool m_propagatesAsynchronously;
+	const bool m_parallelMounting;
+	// changes are applied by the queue only while the owner is alive
+	std::weak_ptr<VirtualNodeImplType> m_ownerLifetime;
 
 	NodesContainer m_nodes;
+	// changes of children are followed only while they are listed and mounted
+	ChildrenState m_childrenState = ChildrenState::Deferred;
+	std::unordered_set<NodeId> m_removedWhileListing;
 	Cookie m_subscriptionCookie{ INVALID_COOKIE };
+	Cookie m_keySubscriptionCookie{ INVALID_COOKIE };
 	std::mutex m_mutex;
 
 };
@@ -230,12 +504,21 @@ private:
 // Helper macro for handling ActionOnRemovedNodeException raised by VolumeNode
 #define REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER \
 REMOVED_NODE_EXCEPTION_CATCH \
-Invalidate(InvalidReason::NodeUnmounted); \
+Invalidate(); \
 REMOVED_NODE_EXCEPTION_CATCH_END
 
 //
 // VirtualNodeMounter
 // 
+// Mounted nodes are kept in an immutable mount table sorted by priority. Mount and Unmount
+// publish a new table, and the replaced one is freed through utils::EpochManager once nobody reads it,
+// so reads of keys take no lock of the node. With the location cache a read takes the lock of its key's
+// stripe of the cache (see KeyLocationCache). Writes of keys are serialized, as Insert and TryInsert check
+// mounted nodes before changing one of them.
+//
+// A node removed from its volume is found by a failing call; it's dropped from the table
+// at the beginning of the next call.
+//
 
 template<typename KeyT, typename ValueHolderT>
 class VirtualNodeMounter :
@@ -250,58 +533,89 @@ public:
 	using NodeMountAssistantType = NodeMountAssistant<KeyT, ValueHolderT>;
 	using NodeMountAssistantPtr = typename NodeMountAssistantType::Ptr;
 	using VirtualNodeImplInternalType = typename NodeMountAssistantType::VirtualNodeImplInternalType;
+	using LocationCacheType = typename NodeMountAssistantType::LocationCacheType;
+	using PropagationQueuePtr = typename NodeMountAssistantType::PropagationQueuePtr;
 
 	using ForEachMountedFunctorType = typename VirtualNodeImplType::ForEachMountedFunctorType;
 	using FindMountedIfFunctorType = typename VirtualNodeImplType::FindMountedIfFunctorType;
 	using UnmountIfFunctorType = typename VirtualNodeImplType::UnmountIfFunctorType;
 
 	using ForEachKeyValueFunctorType = typename VirtualNodeImplType::ForEachKeyValueFunctorType;
+	using ForEachConstKeyValueFunctorType = typename VirtualNodeImplType::ForEachConstKeyValueFunctorType;
+	using VisitFunctorType = typename VirtualNodeImplType::VisitFunctorType;
+	using KeysType = typename VirtualNodeImplType::KeysType;
+	using KeyValuesType = typename VirtualNodeImplType::KeyValuesType;
+	using FoundValuesType = typename VirtualNodeImplType::FoundValuesType;
+	using CursorType = typename VirtualNodeImplType::CursorType;
 
 public:
-	VirtualNodeMounter(VirtualNodeImplType* owner) : m_owner{ owner }
+	// propagationQueue is nullptr unless the storage propagates changes of mounted nodes asynchronously
+	VirtualNodeMounter(VirtualNodeImplType* owner, const StorageOptions& options, PropagationQueuePtr propagationQueue) :
+		m_owner{ owner }, m_iterationMode{ options.iterationMode }, m_parallelMounting{ options.parallelMounting },
+		m_lazyMounting{ options.lazyMounting },
+		m_table{ new MountTable{} }, m_propagationQueue{ std::move(propagationQueue) }
+	{
+		if (options.locationCacheCapacity != 0)
+			m_locationCache = std::make_shared<LocationCacheType>(options.locationCacheCapacity);
+	}
+
+	~VirtualNodeMounter()
 	{
+		// the owner is being destroyed, so nobody reads the table anymore
+		delete m_table.load(std::memory_order_relaxed);
 	}
 
+	VirtualNodeMounter(const VirtualNodeMounter&) = delete;
+	VirtualNodeMounter& operator=(const VirtualNodeMounter&) = delete;
 
 	template<typename T>
 	void Insert(const KeyT& key, T&& value)
 	{
-		std::lock_guard lock(m_mutex);
+		std::lock_guard lock(m_writeMutex);
 
 		Validate();
 
-		if (ReplaceImpl(key, std::forward<T>(value)))
-			return;
+		utils::EpochManager::Guard guard;
+		const auto& table = GetTable();
 
-		for (auto it = m_assistants.begin(); it != m_assistants.end(); it++)
-		{
-			auto& assistant = *it;
-			const auto assistantNode = assistant->GetNode();
+		// the node having the key is looked for by reading, then it alone is written to
+		const auto owner = table.writeTarget != cNowhere ? cNowhere : FindKeyOwner(table, key,
+			[&key](const VolumeNodePtr& node)
+			{
+				return node->Contains(key);
+			});
 
+		if (owner != cNowhere)
+		{
 			REMOVED_NODE_EXCEPTION_TRY
-				assistantNode->Insert(key, std::forward<T>(value));
-			REMOVED_NODE_EXCEPTION_CATCH
-				// failed to insert because of removed node,
-				// continue searching
-				continue;
-			REMOVED_NODE_EXCEPTION_CATCH_END
+				if (table.assistants[owner]->GetNode()->Replace(key, std::forward<T>(value)))
+					return;
+			REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER
 
-			// successful insertion; return 
-			return;
+			// the key has just left the node; it's a new one then
 		}
 
-		// we have to notify a caller that insertion cannot be done: no actual mounted nodes
-		throw InsertInEmptyVirtualNodeException();
+		InsertNew(table, 
+			[&key, &value](const VolumeNodePtr& node)
+			{
+				node->Insert(key, std::forward<T>(value));
+				return true;
+			});
 	}
 
 	void Erase(const KeyT& key)
 	{
-		std::lock_guard lock(m_mutex);
+		std::lock_guard lock(m_writeMutex);
 
 		Validate();
 
-		for (auto& assistant : m_assistants)
+		utils::EpochManager::Guard guard;
+
+		for (const auto& assistant : GetTable().assistants)
 		{
+			if (!assistant->MayContain(key))
+				continue;
+
 			REMOVED_NODE_EXCEPTION_TRY
 				assistant->GetNode()->Erase(key);
 			REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER
@@ -310,323 +624,889 @@ public:
 
 	bool Find(const KeyT& key, ValueHolderT& value) const
 	{
-		std::lock_guard lock(m_mutex);
+		Validate();
 
+		utils::EpochManager::Guard guard;
+
+		return ForKeyOwner(GetTable(), key,
+			[&key, &value](const VolumeNodePtr& node)
+			{
+				return node->Find(key, value);
+			});
+	}
+
+	bool Visit(const KeyT& key, const VisitFunctorType& f) const
+	{
 		Validate();
 
-		for (auto& assistant : m_assistants)
-		{
-			REMOVED_NODE_EXCEPTION_TRY
-				if (assistant->GetNode()->Find(key, value))
-					return true;
-			REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER
-		}
+		utils::EpochManager::Guard guard;
 
-		return false;
+		return ForKeyOwner(GetTable(), key,
+			[&key, &f](const VolumeNodePtr& node)
+			{
+				return node->Visit(key, f);
+			});
 	}
 
 	bool Contains(const KeyT& key) const
 	{
-		std::lock_guard lock(m_mutex);
+		Validate();
 
-		return ContainsImpl(key);
+		utils::EpochManager::Guard guard;
+
+		return ContainsImpl(GetTable(), key);
 	}
 
 	template<typename T>
 	bool TryInsert(const KeyT& key, T&& value)
 	{
-		std::lock_guard lock(m_mutex);
+		std::lock_guard lock(m_writeMutex);
 
 		Validate();
 
-		if (ContainsImpl(key))
-			return false;
-
-		for (auto it = m_assistants.begin(); it != m_assistants.end(); it++)
-		{
-			auto& assistant = *it;
-			const auto assistantNode = assistant->GetNode();
-
-			REMOVED_NODE_EXCEPTION_TRY
-				assistantNode->TryInsert(key, std::forward<T>(value));
-			REMOVED_NODE_EXCEPTION_CATCH
-				// failed to insert because of removed node,
-				// continue searching
-				continue;
-			REMOVED_NODE_EXCEPTION_CATCH_END
+		utils::EpochManager::Guard guard;
+		const auto& table = GetTable();
 
-			// successful insertion; return 
-			return true;
-		}
+		if (ContainsImpl(table, key))
+			return false;
 
-		// we have to notify a caller that insertion cannot be done: no actual mounted nodes
-		throw InsertInEmptyVirtualNodeException();
+		// false if the key has just come to the target
+		return InsertNew(table,
+			[&key, &value](const VolumeNodePtr& node)
+			{
+				return node->TryInsert(key, std::forward<T>(value));
+			});
 	}
 
 	template<typename T>
 	bool Replace(const KeyT& key, T&& value)
 	{
-		std::lock_guard lock(m_mutex);
+		std::lock_guard lock(m_writeMutex);
+
+		Validate();
+
+		utils::EpochManager::Guard guard;
 
-		return ReplaceImpl(key, std::forward<T>(value));
+		return ReplaceImpl(GetTable(), key, std::forward<T>(value));
 	}
 
 	void ForEachKeyValue(const ForEachKeyValueFunctorType& f)
 	{
-		std::lock_guard lock(m_mutex);
+		ForEachKeyValueImpl(f,
+			[](const VolumeNodePtr& node, const auto& nodeF)
+			{
+				node->ForEachKeyValue(nodeF);
+			});
+	}
+
+	// every mounted node is iterated over its own snapshot; mounting isn't held back,
+	// so nodes mounted or unmounted during the iteration may be seen or not
+	void ForEachKeyValueSnapshot(const ForEachConstKeyValueFunctorType& f) const
+	{
+		ForEachKeyValueImpl(f,
+			[](const VolumeNodePtr& node, const auto& nodeF)
+			{
+				node->ForEachKeyValueSnapshot(nodeF);
+			});
+	}
+
+	void ForEachInRange(const KeyT& from, const KeyT& to, const ForEachKeyValueFunctorType& f)
+	{
+		ForEachKeyValueImpl(f,
+			[&from, &to](const VolumeNodePtr& node, const auto& nodeF)
+			{
+				node->ForEachInRange(from, to, nodeF);
+			});
+	}
 
+	bool LowerBound(const KeyT& key, KeyT& foundKey, ValueHolderT& value) const
+	{
 		Validate();
 
-		using KeysSet = std::unordered_set<KeyT>;
-		KeysSet keysCache;
+		utils::EpochManager::Guard guard;
+
+		auto found = false;
+		KeyT nodeKey;
+		ValueHolderT nodeValue;
 
-		for (auto& assistant : m_assistants)
+		// the smallest of lower bounds; on a tie the node with the highest priority wins
+		for (const auto& assistant : GetTable().assistants)
 		{
-			const auto node = assistant->GetNode();
-			KeysSet currentKeysCache;
 			REMOVED_NODE_EXCEPTION_TRY
-				node->ForEachKeyValue(
-					[this, &f, &keysCache, &currentKeysCache](const KeyT& key, ValueHolderT& value)
-					{
-						if (keysCache.count(key))
-							return;
-						f(key, value);
-						currentKeysCache.insert(key);
-					});
+				if (!assistant->GetNode()->LowerBound(key, nodeKey, nodeValue))
+					continue;
 			REMOVED_NODE_EXCEPTION_CATCH
-				if (e.TargetNodeId() != NodeMountAssistantType::GetNodeId(node))
-					throw; // it's not our node exception, rethrow it to caller
-
-				Invalidate(InvalidReason::NodeUnmounted);
+				Invalidate();
 				continue;
 			REMOVED_NODE_EXCEPTION_CATCH_END
 
-			keysCache.insert(currentKeysCache.begin(), currentKeysCache.end());
+			if (!found || std::less<KeyT>()(nodeKey, foundKey))
+			{
+				foundKey = std::move(nodeKey);
+				value = std::move(nodeValue);
+				found = true;
+			}
 		}
 
+		return found;
 	}
 
-	// INodeMounter
-
-	bool Mount(VolumeNodePtr node) override
+	// the order of mounted nodes if they all have the same one; nodes of another order would scan themselves for pages
+	PageOrder GetPageOrder() const
 	{
-		std::lock_guard m_lock(m_mutex);
-
-		if (FindMountedNode(node))
-			return false; // already mounted
+		std::optional<PageOrder> order;
+		for (const auto& assistant : GetAssistants())
+		{
+			REMOVED_NODE_EXCEPTION_TRY
+				const auto nodeOrder = assistant->GetNode()->GetPageOrder();
+				if (order && *order != nodeOrder)
+					return PageOrder::Keys;
 
-		auto assistant = NodeMountAssistantType::CreateInstance(m_owner, node);
-		m_assistants.push_back(assistant);
-		assistant->Mount();
-		Invalidate(InvalidReason::NodeMounted);
+				order = nodeOrder;
+			REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER
+		}
 
-		return true;
+		return order.value_or(PageOrder::Keys);
 	}
 
-	void Unmount(VolumeNodePtr node) override
+	// every mounted node gives its own page in the order of the cursor: a key of the merged page is among
+	// the first keys of every node having it, so shadowed keys are dropped as by a full iteration
+	CursorType NextKeyValues(const CursorType& cursor, size_t count, KeyValuesType& keyValues) const
 	{
-		std::lock_guard m_lock(m_mutex);
+		Validate();
+
+		keyValues.clear();
+		if (cursor.IsEnd())
+			return cursor;
 
-		const NodeId nodeToRemoveId = NodeMountAssistantType::GetNodeId(node);
+		const auto order = cursor.GetOrder() ? *cursor.GetOrder() : GetPageOrder();
+		const auto nodeCursor = cursor.InOrder(order);
 
-		for (auto it = m_assistants.begin(); it != m_assistants.end(); it++)
+		std::map<KeyT, ValueHolderT, PageLess<KeyT>> merged(PageLess<KeyT>{ order });
+		KeyValuesType nodePage;
+		for (const auto& assistant : GetAssistants())
 		{
-			auto& assistant = *it;
-			const auto assistantNode = assistant->GetNode();
-			if (nodeToRemoveId == NodeMountAssistantType::GetNodeId(assistantNode))
-			{
-				DoUnmount(it);
-				break;
-			}
-		}
+			REMOVED_NODE_EXCEPTION_TRY
+				assistant->GetNode()->NextKeyValues(nodeCursor, count, nodePage);
+			REMOVED_NODE_EXCEPTION_CATCH
+				Invalidate();
+				continue;
+			REMOVED_NODE_EXCEPTION_CATCH_END
 
-		if (m_assistants.size() == 0)
-			static_cast<VirtualNodeImplInternalType*>(m_owner)->OnEntirelyOnmounted();
-	}
+			// nodes come in priority order, so a key keeps a value of the first node having it
+			for (auto& keyValue : nodePage)
+				merged.try_emplace(std::move(keyValue.first), std::move(keyValue.second));
+		}
 
-	void ForEachMounted(const ForEachMountedFunctorType& f) const override
-	{
-		std::shared_lock m_lock(m_mutex);
+		for (auto it = merged.begin(); it != merged.end() && keyValues.size() < count; ++it)
+			keyValues.emplace_back(it->first, std::move(it->second));
 
-		std::for_each(m_assistants.begin(), m_assistants.end(),
-			[&f](auto assistant)
+		return nodeCursor.Following(count, keyValues.size(),
+			[&keyValues]()
 			{
-				if (assistant->HasAliveNode())
-					f(assistant->GetNode());
-			}
-		);
+				return keyValues.back().first;
+			});
 	}
 
-	VolumeNodePtr FindMountedIf(const FindMountedIfFunctorType& f) const override
+	// batches make at most one call per mounted node;
+	// a mounted node is asked only for keys not found in nodes with higher priority and passing its filter
+	size_t MultiFind(const KeysType& keys, FoundValuesType& values) const
 	{
-		std::shared_lock m_lock(m_mutex);
+		Validate();
 
-		auto it = std::find_if(m_assistants.begin(), m_assistants.end(),
-			[&f](auto assistant)
-			{
-				if (!assistant->HasAliveNode())
-					return false;
-				return f(assistant->GetNode());
-			});
+		utils::EpochManager::Guard guard;
 
-		if (it == m_assistants.end())
-			return nullptr;
+		values.assign(keys.size(), std::nullopt);
 
-		return (*it)->GetNode();
-	}
+		std::vector<size_t> pending(keys.size());
+		std::iota(pending.begin(), pending.end(), 0);
 
-	void UnmountIf(const UnmountIfFunctorType& f) override
-	{
-		std::lock_guard m_lock(m_mutex);
+		KeysType nodeKeys;
+		std::vector<size_t> nodeIndices;
+		FoundValuesType nodeValues;
+		size_t found = 0;
 
-		for (auto it = m_assistants.begin(); it != m_assistants.end();)
+		for (const auto& assistant : GetTable().assistants)
 		{
-			auto& assistant = *it;
-			const auto assistantNode = assistant->GetNode();
-			if (f(assistantNode))
-				it = DoUnmount(it);
+			if (pending.empty())
+				break;
+
+			nodeKeys.clear();
+			nodeIndices.clear();
+			const auto filter = assistant->PinKeyFilter();
+			for (const auto index : pending)
+			{
+				if (filter && !filter->MayContain(keys[index]))
+					continue;
+
+				nodeKeys.push_back(keys[index]);
+				nodeIndices.push_back(index);
+			}
+
+			if (nodeKeys.empty())
+				continue;
+
+			REMOVED_NODE_EXCEPTION_TRY
+				if (assistant->GetNode()->MultiFind(nodeKeys, nodeValues) == 0)
+					continue;
+			REMOVED_NODE_EXCEPTION_CATCH
+				Invalidate();
+				continue;
+			REMOVED_NODE_EXCEPTION_CATCH_END
+
+			for (size_t i = 0; i < nodeIndices.size(); i++)
+			{
+				if (nodeValues[i])
+				{
+					values[nodeIndices[i]] = std::move(nodeValues[i]);
+					found++;
+				}
+			}
+
+			pending.erase(std::remove_if(pending.begin(), pending.end(),
+				[&values](size_t index)
+				{
+					return values[index].has_value();
+				}), pending.end());
+		}
+
+		return found;
+	}
+
+	// keys found in a mounted node are replaced there as Insert does; the rest go to the node with the highest
+	// priority. Owners are found by one MultiFind per mounted node over the keys not owned yet,
+	// and every owner gets its keys in one MultiInsert call
+	template<typename KeyValuesT>
+	void MultiInsert(KeyValuesT&& keyValues)
+	{
+		std::lock_guard lock(m_writeMutex);
+
+		Validate();
+
+		utils::EpochManager::Guard guard;
+		const auto& table = GetTable();
+		const auto& assistants = table.assistants;
+
+		if (table.writeTarget != cNowhere)
+		{
+			InsertNew(table,
+				[&keyValues](const VolumeNodePtr& node)
+				{
+					node->MultiInsert(std::forward<KeyValuesT>(keyValues));
+					return true;
+				});
+			return;
+		}
+
+		std::vector<size_t> pending(keyValues.size());
+		std::iota(pending.begin(), pending.end(), 0);
+
+		// indices of keys owned by every mounted node
+		std::vector<std::vector<size_t>> owned(assistants.size());
+
+		KeysType nodeKeys;
+		std::vector<size_t> nodeIndices;
+		std::vector<size_t> notFound;
+		FoundValuesType nodeValues;
+
+		for (size_t i = 0; i < assistants.size() && !pending.empty(); i++)
+		{
+			nodeKeys.clear();
+			nodeIndices.clear();
+			notFound.clear();
+
+			const auto filter = assistants[i]->PinKeyFilter();
+			for (const auto index : pending)
+			{
+				if (filter && !filter->MayContain(keyValues[index].first))
+				{
+					notFound.push_back(index);
+					continue;
+				}
+
+				nodeKeys.push_back(keyValues[index].first);
+				nodeIndices.push_back(index);
+			}
+
+			if (nodeKeys.empty())
+				continue;
+
+			REMOVED_NODE_EXCEPTION_TRY
+				assistants[i]->GetNode()->MultiFind(nodeKeys, nodeValues);
+			REMOVED_NODE_EXCEPTION_CATCH
+				Invalidate();
+				continue;
+			REMOVED_NODE_EXCEPTION_CATCH_END
+
+			for (size_t j = 0; j < nodeIndices.size(); j++)
+				(nodeValues[j] ? owned[i] : notFound).push_back(nodeIndices[j]);
+
+			// the order of the batch is kept, so the last of duplicate keys still wins
+			std::sort(notFound.begin(), notFound.end());
+			pending.swap(notFound);
+		}
+
+		// duplicates of a key have the same owner, so they stay in order within one batch
+		KeyValuesType misses;
+		for (size_t i = 0; i < assistants.size(); i++)
+		{
+			if (owned[i].empty())
+				continue;
+
+			KeyValuesType nodeKeyValues;
+			nodeKeyValues.reserve(owned[i].size());
+			for (const auto index : owned[i])
+				nodeKeyValues.emplace_back(keyValues[index].first, dict::ForwardValue(std::forward<KeyValuesT>(keyValues), index));
+
+			REMOVED_NODE_EXCEPTION_TRY
+				assistants[i]->GetNode()->MultiInsert(std::move(nodeKeyValues));
+				continue;
+			REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER
+
+			// a removed node refuses the batch before taking it; its keys are new to the rest
+			std::move(nodeKeyValues.begin(), nodeKeyValues.end(), std::back_inserter(misses));
+		}
+
+		misses.reserve(misses.size() + pending.size());
+		for (const auto index : pending)
+			misses.emplace_back(keyValues[index].first, dict::ForwardValue(std::forward<KeyValuesT>(keyValues), index));
+
+		if (misses.empty())
+			return;
+
+		InsertNew(table,
+			[&misses](const VolumeNodePtr& node)
+			{
+				node->MultiInsert(std::move(misses));
+				return true;
+			});
+	}
+
+	void MultiErase(const KeysType& keys)
+	{
+		std::lock_guard lock(m_writeMutex);
+
+		Validate();
+
+		utils::EpochManager::Guard guard;
+
+		KeysType nodeKeys;
+		for (const auto& assistant : GetTable().assistants)
+		{
+			nodeKeys.clear();
+			const auto filter = assistant->PinKeyFilter();
+			std::copy_if(keys.begin(), keys.end(), std::back_inserter(nodeKeys),
+				[&filter](const KeyT& key)
+				{
+					return !filter || filter->MayContain(key);
+				});
+
+			if (nodeKeys.empty())
+				continue;
+
+			REMOVED_NODE_EXCEPTION_TRY
+				assistant->GetNode()->MultiErase(nodeKeys);
+			REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER
+		}
+	}
+
+	// counters of mounted nodes are summed up, so a key found in several nodes is counted once per node;
+	// costs O(number of mounted nodes). EstimateDistinctKeyCount counts distinct keys instead.
+	// Children of lazily mounted nodes are reported as pending rather than mounted
+	NodeStats GetStats() const
+	{
+		NodeStats stats;
+
+		for (const auto& assistant : GetAssistants())
+		{
+			if (!assistant->HasAliveNode())
+				continue;
+
+			REMOVED_NODE_EXCEPTION_TRY
+				const auto nodeStats = assistant->GetNode()->GetStats();
+				stats.keyCount += nodeStats.keyCount;
+				stats.payloadBytes += nodeStats.payloadBytes;
+				stats.overheadBytes += nodeStats.overheadBytes;
+				if (assistant->HasDeferredChildren())
+					stats.pendingChildCount += nodeStats.childCount;
+			REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER
+		}
+
+		return stats;
+	}
+
+	// INodeMounter
+
+	bool Mount(VolumeNodePtr node) override
+	{
+		std::lock_guard m_lock(m_mountMutex);
+
+		auto assistants = GetAliveAssistants();
+
+		const auto nodeId = NodeMountAssistantType::GetNodeId(node);
+		if (FindAssistantForNode(assistants, nodeId) != assistants.end())
+			return false; // already mounted
+
+		auto assistant = NodeMountAssistantType::CreateInstance(m_owner, node, m_locationCache, m_propagationQueue, m_parallelMounting);
+		assistant->Mount(m_lazyMounting);
+
+		// after nodes with the same priority, as they were mounted earlier
+		const auto priority = assistant->GetPriority();
+		const auto position = std::find_if(assistants.begin(), assistants.end(),
+			[priority](const NodeMountAssistantPtr& mounted)
+			{
+				return mounted->GetPriority() < priority;
+			});
+		assistants.insert(position, std::move(assistant));
+
+		Publish(std::move(assistants));
+
+		// the published table has the node, so children of the generation are found there
+		if (m_lazyMounting)
+			m_mountGeneration.fetch_add(1, std::memory_order_release);
+
+		return true;
+	}
+
+	void Unmount(VolumeNodePtr node) override
+	{
+		std::lock_guard m_lock(m_mountMutex);
+
+		auto assistants = GetAliveAssistants();
+
+		const auto it = FindAssistantForNode(assistants, NodeMountAssistantType::GetNodeId(node));
+		if (it != assistants.end())
+		{
+			(*it)->Unmount();
+			assistants.erase(it);
+		}
+
+		const auto entirelyUnmounted = assistants.empty();
+		if (assistants.size() != m_table.load(std::memory_order_relaxed)->assistants.size())
+			Publish(std::move(assistants));
+
+		if (entirelyUnmounted)
+			static_cast<VirtualNodeImplInternalType*>(m_owner)->OnEntirelyOnmounted();
+	}
+
+	void ForEachMounted(const ForEachMountedFunctorType& f) const override
+	{
+		for (const auto& assistant : GetAssistants())
+		{
+			if (assistant->HasAliveNode())
+				f(assistant->GetNode());
+		}
+	}
+
+	VolumeNodePtr FindMountedIf(const FindMountedIfFunctorType& f) const override
+	{
+		for (const auto& assistant : GetAssistants())
+		{
+			if (assistant->HasAliveNode() && f(assistant->GetNode()))
+				return assistant->GetNode();
+		}
+
+		return nullptr;
+	}
+
+	void UnmountIf(const UnmountIfFunctorType& f) override
+	{
+		std::lock_guard m_lock(m_mountMutex);
+
+		auto assistants = GetAliveAssistants();
+
+		for (auto it = assistants.begin(); it != assistants.end();)
+		{
+			if (f((*it)->GetNode()))
+			{
+				(*it)->Unmount();
+				it = assistants.erase(it);
+			}
 			else
 				it++;
 		}
 
-		if (m_assistants.size() == 0)
+		const auto entirelyUnmounted = assistants.empty();
+		if (assistants.size() != m_table.load(std::memory_order_relaxed)->assistants.size())
+			Publish(std::move(assistants));
+
+		if (entirelyUnmounted)
 			static_cast<VirtualNodeImplInternalType*>(m_owner)->OnEntirelyOnmounted();
 	}
 
+	bool PinWriteTarget(VolumeNodePtr node) override
+	{
+		std::lock_guard m_lock(m_mountMutex);
+
+		auto assistants = GetAliveAssistants();
+
+		if (!node)
+			m_writeTargetId.reset();
+		else
+		{
+			const auto nodeId = NodeMountAssistantType::GetNodeId(node);
+			if (FindAssistantForNode(assistants, nodeId) == assistants.end())
+				return false;
+
+			m_writeTargetId = nodeId;
+		}
+
+		Publish(std::move(assistants));
+
+		return true;
+	}
+
+	void FlushMounting() override
+	{
+		if (m_propagationQueue)
+			m_propagationQueue->Flush();
+	}
+
+	// keys of a single node are distinct, so its count is taken as is; keys of several nodes are counted
+	// by a sketch of their snapshots, bounded by the largest node and the sum
+	size_t EstimateDistinctKeyCount() const override
+	{
+		auto assistants = GetAssistants();
+		assistants.erase(std::remove_if(assistants.begin(), assistants.end(),
+			[](const NodeMountAssistantPtr& assistant)
+			{
+				return !assistant->HasAliveNode();
+			}), assistants.end());
+
+		size_t keyCount = 0;
+		size_t maxKeyCount = 0;
+		utils::HyperLogLog sketch;
+
+		for (const auto& assistant : assistants)
+		{
+			const auto& node = assistant->GetNode();
+			REMOVED_NODE_EXCEPTION_TRY
+				const auto nodeKeyCount = node->GetStats().keyCount;
+				keyCount += nodeKeyCount;
+				maxKeyCount = std::max(maxKeyCount, nodeKeyCount);
+
+				if (assistants.size() > 1)
+					node->ForEachKeyValueSnapshot(
+						[&sketch](const KeyT& key, const ValueHolderT&)
+						{
+							sketch.Add(utils::MixHash(static_cast<uint64_t>(std::hash<KeyT>()(key))));
+						});
+			REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER
+		}
+
+		if (assistants.size() > 1)
+			keyCount = std::clamp(sketch.Estimate(), maxKeyCount, keyCount);
+
+		return keyCount;
+	}
+
+	// mounts children of nodes mounted lazily since the last call; must be called before children
+	// of the owner are accessed, and never under locks of mount assistants or of the owner's children
+	void MountDeferredChildren() const
+	{
+		if (m_childrenGeneration.load(std::memory_order_acquire) == m_mountGeneration.load(std::memory_order_acquire))
+			return;
+
+		std::lock_guard lock(m_deferredMutex);
+
+		const auto generation = m_mountGeneration.load(std::memory_order_acquire);
+		if (m_childrenGeneration.load(std::memory_order_relaxed) == generation)
+			return;
+
+		for (const auto& assistant : GetAssistants())
+			assistant->MountChildren();
+
+		m_childrenGeneration.store(generation, std::memory_order_release);
+	}
+
 	bool IsEntirelyUnmounted() const
 	{
-		auto res = true;
+		utils::EpochManager::Guard guard;
 
-		std::lock_guard m_lock(m_mutex);
-		for (auto assistant : m_assistants)
+		for (const auto& assistant : GetTable().assistants)
 		{
 			if (assistant->HasAliveNode())
-			{
-				res = false;
-				break;
-			}
+				return false;
 
-			Invalidate(InvalidReason::NodeUnmounted);
+			Invalidate();
 		}
 
-		return res;
+		return true;
 	}
 
 private:
-	using AssistantsContainer = std::list<NodeMountAssistantPtr>;
+	using AssistantsContainer = std::vector<NodeMountAssistantPtr>;
+
+	static constexpr size_t cNowhere = KeyLocation::cNowhere;
 
-	enum class InvalidReason : uint8_t
+	// immutable once published
+	struct MountTable
 	{
-		Valid = 0,
-		NodeUnmounted,
-		NodeMounted
+		// by priority, the highest first
+		AssistantsContainer assistants;
+		uint64_t version = 0;
+		// the pinned one's index
+		size_t writeTarget = cNowhere;
 	};
 
-	NodeMountAssistantPtr FindAssistantForNode(NodeId id) const
+	static typename AssistantsContainer::iterator FindAssistantForNode(AssistantsContainer& assistants, NodeId id)
 	{
-		auto it = std::find_if(m_assistants.begin(), m_assistants.end(),
-			[this, id](auto& assistant)
+		return std::find_if(assistants.begin(), assistants.end(),
+			[id](const NodeMountAssistantPtr& assistant)
 			{
-				REMOVED_NODE_EXCEPTION_TRY
-					const auto node = assistant->GetNode();
-					if (!node)
-						return false;
-					if (NodeMountAssistantType::GetNodeId(node) == id)
-						return true;
-				REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER
-
-			return false;
+				return NodeMountAssistantType::GetNodeId(assistant->GetNode()) == id;
 			});
+	}
 
-		if (it != m_assistants.end())
-			return (*it);
+	// must be called in a critical section of utils::EpochManager, which keeps the table alive
+	const MountTable& GetTable() const noexcept
+	{
+		return *m_table.load(std::memory_order_acquire);
+	}
 
-		return nullptr;
+	// a copy for long calls, which shouldn't hold reclamation back
+	AssistantsContainer GetAssistants() const
+	{
+		utils::EpochManager::Guard guard;
+
+		return GetTable().assistants;
 	}
 
-	VolumeNodePtr FindMountedNode(NodeId id) const
+	// must be called under m_mountMutex
+	AssistantsContainer GetAliveAssistants() const
 	{
-		if (auto assistant = FindAssistantForNode(id))
-			return assistant->GetNode();
+		auto assistants = m_table.load(std::memory_order_relaxed)->assistants;
+		assistants.erase(std::remove_if(assistants.begin(), assistants.end(),
+			[](const NodeMountAssistantPtr& assistant)
+			{
+				return !assistant->HasAliveNode();
+			}), assistants.end());
 
-		return nullptr;
+		return assistants;
 	}
 
-	VolumeNodePtr FindMountedNode(const VolumeNodePtr& volumeNode) const
+	// must be called under m_mountMutex
+	void Publish(AssistantsContainer&& assistants) const
 	{
-		if (auto assistant = FindAssistantForNode(NodeMountAssistantType::GetNodeId(volumeNode)))
-			return assistant->GetNode();
+		// an unmounted write target is unpinned
+		auto writeTarget = cNowhere;
+		if (m_writeTargetId)
+		{
+			const auto it = FindAssistantForNode(assistants, *m_writeTargetId);
+			if (it != assistants.end())
+				writeTarget = static_cast<size_t>(it - assistants.begin());
+			else
+				m_writeTargetId.reset();
+		}
 
-		return nullptr;
+		const auto table = m_table.load(std::memory_order_relaxed);
+		m_table.store(new MountTable{ std::move(assistants), table->version + 1, writeTarget }, std::memory_order_release);
+		utils::EpochManager::Retire(const_cast<MountTable*>(table));
+
+		// cached locations are indices in the previous table
+		if (m_locationCache)
+			m_locationCache->Clear();
 	}
 
-	void Invalidate(InvalidReason reason) const
+	void Invalidate() const noexcept
 	{
-		if (reason > m_invalidReason)
-			m_invalidReason = reason;
+		m_hasRemovedNodes.store(true, std::memory_order_relaxed);
 	}
 
 	void Validate() const
 	{
-		if (IsValid())
+		if (!m_hasRemovedNodes.load(std::memory_order_relaxed))
 			return;
 
-		for (auto assistantIt = m_assistants.begin(); assistantIt != m_assistants.end();)
-		{
-			if (!(*assistantIt)->HasAliveNode())
-				assistantIt = m_assistants.erase(assistantIt);
-			else
-				assistantIt++;
-		}
+		std::lock_guard lock(m_mountMutex);
 
-		if (m_invalidReason == InvalidReason::NodeMounted)
-			m_assistants.sort(
-				[](const NodeMountAssistantPtr& left, const NodeMountAssistantPtr& right)
-				{
-					return left->GetPriority() > right->GetPriority();
-				});
+		if (!m_hasRemovedNodes.exchange(false, std::memory_order_relaxed))
+			return;
 
-		m_invalidReason = InvalidReason::Valid;
+		Publish(GetAliveAssistants());
+	}
 
+	template<typename T>
+	bool ReplaceImpl(const MountTable& table, const KeyT& key, T&& value)
+	{
+		return ForKeyOwner(table, key,
+			[&key, &value](const VolumeNodePtr& node)
+			{
+				return node->Replace(key, std::forward<T>(value));
+			});
 	}
 
-	bool IsValid() const
+	// calls f(node) for mounted nodes which may have the key in priority order until it returns true;
+	// with the location cache the first node is the one f returned true for last time
+	template<typename FunctorT>
+	bool ForKeyOwner(const MountTable& table, const KeyT& key, const FunctorT& f) const
 	{
-		return m_invalidReason == InvalidReason::Valid;
+		return FindKeyOwner(table, key, f) != cNowhere;
 	}
 
-	typename AssistantsContainer::iterator DoUnmount(typename AssistantsContainer::iterator it)
+	// the index of the node ForKeyOwner stops at, cNowhere if none
+	template<typename FunctorT>
+	size_t FindKeyOwner(const MountTable& table, const KeyT& key, const FunctorT& f) const
 	{
-		(*it)->Unmount();
-		Invalidate(InvalidReason::NodeUnmounted);
+		const auto& assistants = table.assistants;
+
+		typename LocationCacheType::Generation generation = 0;
+		if (m_locationCache)
+		{
+			KeyLocation location;
+			if (m_locationCache->Find(key, location) && location.tableVersion == table.version)
+			{
+				if (location.index == cNowhere)
+					return cNowhere;
+
+				REMOVED_NODE_EXCEPTION_TRY
+					if (f(assistants[location.index]->GetNode()))
+						return location.index;
+				REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER
+
+				// the key has left the node, and it isn't reported yet; or the node is removed
+			}
+
+			generation = m_locationCache->GetGeneration(key);
+		}
 
-		return m_assistants.erase(it);
+		auto hasRemovedNodes = false;
+		for (size_t i = 0; i < assistants.size(); i++)
+		{
+			if (!assistants[i]->MayContain(key))
+				continue;
+
+			REMOVED_NODE_EXCEPTION_TRY
+				if (f(assistants[i]->GetNode()))
+				{
+					RememberLocation(table, key, i, generation, hasRemovedNodes);
+					return i;
+				}
+			REMOVED_NODE_EXCEPTION_CATCH
+				Invalidate();
+				hasRemovedNodes = true;
+			REMOVED_NODE_EXCEPTION_CATCH_END
+		}
+
+		RememberLocation(table, key, cNowhere, generation, hasRemovedNodes);
+		return cNowhere;
 	}
 
-	template<typename T>
-	bool ReplaceImpl(const KeyT& key, T&& value)
+	// insert(node) writes keys, which no mounted node has, to the pinned node
+	// or to the one with the highest priority; returns what insert returns
+	template<typename InsertT>
+	bool InsertNew(const MountTable& table, const InsertT& insert)
 	{
-		Validate();
+		const auto& assistants = table.assistants;
 
-		for (auto& assistant : m_assistants)
+		if (table.writeTarget != cNowhere)
 		{
 			REMOVED_NODE_EXCEPTION_TRY
-				if (assistant->GetNode()->Replace(key, std::forward<T>(value)))
-					return true;
+				return insert(assistants[table.writeTarget]->GetNode());
 			REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER
+
+			// the pinned node is removed; the rest are tried as if nothing is pinned
 		}
 
-		return false;
+		for (const auto& assistant : assistants)
+		{
+			REMOVED_NODE_EXCEPTION_TRY
+				return insert(assistant->GetNode());
+			REMOVED_NODE_EXCEPTION_CATCH
+				// failed to insert because of removed node,
+				// continue searching
+				Invalidate();
+				continue;
+			REMOVED_NODE_EXCEPTION_CATCH_END
+		}
+
+		// we have to notify a caller that insertion cannot be done: no actual mounted nodes
+		throw InsertInEmptyVirtualNodeException();
 	}
 
-	bool ContainsImpl(const KeyT& key) const
+	void RememberLocation(const MountTable& table, const KeyT& key, size_t index,
+		typename LocationCacheType::Generation generation, bool hasRemovedNodes) const
+	{
+		// the table is about to be replaced
+		if (m_locationCache && !hasRemovedNodes)
+			m_locationCache->Remember(key, KeyLocation{ table.version, index }, generation);
+	}
+
+	// visitor(node, f) runs an iteration of a mounted node;
+	// keys shadowed by nodes with higher priority are skipped
+	template<typename FunctorT, typename VisitorT>
+	void ForEachKeyValueImpl(const FunctorT& f, const VisitorT& visitor) const
 	{
 		Validate();
 
-		for (auto& assistant : m_assistants)
+		if (m_iterationMode == IterationMode::Streaming)
+			return StreamKeyValues(f, visitor);
+
+		using KeysSet = std::unordered_set<KeyT>;
+		KeysSet keysCache;
+
+		for (const auto& assistant : GetAssistants())
 		{
+			const auto& node = assistant->GetNode();
+			KeysSet currentKeysCache;
 			REMOVED_NODE_EXCEPTION_TRY
-				if (assistant->GetNode()->Contains(key))
+				visitor(node,
+					[&f, &keysCache, &currentKeysCache](const KeyT& key, auto& value)
+					{
+						if (keysCache.count(key))
+							return;
+						f(key, value);
+						currentKeysCache.insert(key);
+					});
+			REMOVED_NODE_EXCEPTION_CATCH
+				if (e.TargetNodeId() != NodeMountAssistantType::GetNodeId(node))
+					throw; // it's not our node exception, rethrow it to caller
+
+				Invalidate();
+				continue;
+			REMOVED_NODE_EXCEPTION_CATCH_END
+
+			keysCache.insert(currentKeysCache.begin(), currentKeysCache.end());
+		}
+	}
+
+	// nodes are iterated one by one in priority order; a key is skipped if a node before has it.
+	// Nodes with lower priority are asked while a node with higher one is iterated, never vice versa
+	template<typename FunctorT, typename VisitorT>
+	void StreamKeyValues(const FunctorT& f, const VisitorT& visitor) const
+	{
+		const auto assistants = GetAssistants();
+
+		for (size_t i = 0; i < assistants.size(); i++)
+		{
+			const auto& node = assistants[i]->GetNode();
+			REMOVED_NODE_EXCEPTION_TRY
+				visitor(node,
+					[this, &f, &assistants, i](const KeyT& key, auto& value)
+					{
+						if (!IsShadowed(assistants, i, key))
+							f(key, value);
+					});
+			REMOVED_NODE_EXCEPTION_CATCH
+				if (e.TargetNodeId() != NodeMountAssistantType::GetNodeId(node))
+					throw; // it's not our node exception, rethrow it to caller
+
+				Invalidate();
+				continue;
+			REMOVED_NODE_EXCEPTION_CATCH_END
+		}
+	}
+
+	// true if one of nodes before the given one has the key
+	bool IsShadowed(const AssistantsContainer& assistants, size_t index, const KeyT& key) const
+	{
+		for (size_t i = 0; i < index; i++)
+		{
+			if (!assistants[i]->MayContain(key))
+				continue;
+
+			REMOVED_NODE_EXCEPTION_TRY
+				if (assistants[i]->GetNode()->Contains(key))
 					return true;
 			REMOVED_NODE_EXCEPTION_INVALIDATE_HANDLER
 		}
@@ -634,12 +1514,42 @@ private:
 		return false;
 	}
 
+	bool ContainsImpl(const MountTable& table, const KeyT& key) const
+	{
+		return ForKeyOwner(table, key,
+			[&key](const VolumeNodePtr& node)
+			{
+				return node->Contains(key);
+			});
+	}
+
 private:
 
 	VirtualNodeImplType* m_owner = nullptr;
-	mutable AssistantsContainer m_assistants;
-	mutable InvalidReason m_invalidReason = InvalidReason::Valid;
-	mutable std::shared_mutex m_mutex;
+	const IterationMode m_iterationMode;
+	const bool m_parallelMounting;
+	const bool m_lazyMounting;
+
+	mutable std::atomic<const MountTable*> m_table;
+	mutable std::atomic<bool> m_hasRemovedNodes{ false };
+	// guarded by m_mountMutex
+	mutable std::optional<NodeId> m_writeTargetId;
+	// serializes publishing of tables
+	mutable std::mutex m_mountMutex;
+	// serializes writes of keys
+	std::mutex m_writeMutex;
+
+	// shared with assistants, which forget locations of changed keys
+	std::shared_ptr<LocationCacheType> m_locationCache;
+
+	// shared by nodes of the storage
+	const PropagationQueuePtr m_propagationQueue;
+
+	// nodes mounted lazily so far and those having their children mounted
+	std::atomic<uint64_t> m_mountGeneration{ 0 };
+	mutable std::atomic<uint64_t> m_childrenGeneration{ 0 };
+	// serializes mounting of deferred children
+	mutable std::mutex m_deferredMutex;
 };
 
 } // namespace virtual_node_details
@@ -16,14 +16,14 @@ template<typename KeyT, typename ValueHolderT>
 class VirtualNodeProxyImpl final :
 	public NodeProxyBaseImpl<
 	internal::VirtualNodeBase,
-	VirtualNodeImpl,
+	VirtualNodeImpl<KeyT, ValueHolderT>,
 	KeyT,
 	ValueHolderT>
 {
 public:
 	using NodeProxyBaseImplType = NodeProxyBaseImpl<
 		internal::VirtualNodeBase,
-		VirtualNodeImpl,
+		VirtualNodeImpl<KeyT, ValueHolderT>,
 		KeyT, ValueHolderT>;
 
 	using NodeType = typename NodeProxyBaseImplType::NodeType;
@@ -74,6 +74,21 @@ private:
 	{
 		NodeProxyBaseImplType::GetOwner()->UnmountIf(f);
 	}
+
+	bool PinWriteTarget(VolumeNodePtr node) override
+	{
+		return NodeProxyBaseImplType::GetOwner()->PinWriteTarget(node);
+	}
+
+	void FlushMounting() override
+	{
+		NodeProxyBaseImplType::GetOwner()->FlushMounting();
+	}
+
+	size_t EstimateDistinctKeyCount() const override
+	{
+		return NodeProxyBaseImplType::GetOwner()->EstimateDistinctKeyCount();
+	}
 };
 
 } //namespace internal
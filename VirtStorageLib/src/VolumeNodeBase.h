@@ -3,6 +3,8 @@
 #include "VolumeNode.h"
 
 #include "intfs/NodeEvents.h"
+#include "intfs/KeyEvents.h"
+#include "intfs/KeyFilter.h"
 #include "intfs/NodeId.h"
 #include "utils/NonCopyable.h"
 
@@ -20,7 +22,9 @@ template<typename KeyT, typename ValueHolderT>
 class VolumeNodeBase :
 	public IVolumeNode<KeyT, ValueHolderT>,
 	public INodeEventsSubscription<IVolumeNode<KeyT, ValueHolderT>>,
+	public IKeyEventsSubscription<KeyT>,
 	public INodeId,
+	public IKeyFilter<KeyT>,
 	utils::NonCopyable
 {
 };
@@ -2,8 +2,11 @@
 
 #include <unordered_map>
 #include <algorithm>
+#include <atomic>
+#include <limits>
 #include <mutex>
 #include <shared_mutex>
+#include <vector>
 
 #include "Types.h"
 #include "VolumeNode.h"
@@ -13,6 +16,18 @@
 #include "VolumeNodeBase.h"
 #include "VolumeNodeProxyImpl.h"
 #include "NodeIdImpl.h"
+#include "NodeSubscriberHolder.h"
+#include "KeySubscriberHolder.h"
+#include "ExpirationTable.h"
+#include "ClockEviction.h"
+#include "dict/LockedDict.h"
+#include "dict/BatchIndices.h"
+#include "persistence/Journal.h"
+#include "utils/TypeTraits.h"
+#include "utils/PageCollector.h"
+#include "utils/NodePath.h"
+#include "utils/ParallelFor.h"
+#include "utils/MemorySize.h"
 
 
 namespace vs
@@ -24,37 +39,98 @@ namespace internal
 //
 // VolumeNodeImpl
 //
+// DictT is a dictionary engine (see dict/LockedDict.h) keeping key-values of the node.
+// Keys with TTLs are erased by the node itself: every change and every lookup of it
+// removes a bounded batch of keys which deadlines have passed, a lookup of an expired key
+// removes the key, and an iteration removes all of them first. TTLs aren't logged:
+// a persistent node recovers keys inserted with TTLs as permanent ones.
+// Stats of a node are counters of its dictionary; stats of a subtree are cached in every node
+// along with a flag which a change of the node raises in it and in its ancestors, so GetSubtreeStats
+// visits only changed subtrees. A change stops raising flags at the first ancestor which has it raised
+//
 
-template<typename KeyT, typename ValueHolderT>
+template<typename KeyT, typename ValueHolderT, typename DictT = dict::LockedDict<KeyT, ValueHolderT>>
 class VolumeNodeImpl final :
 	public NodeIdImpl<VolumeNodeBase<KeyT, ValueHolderT>>,
 	public IProxyProvider<IVolumeNode<KeyT, ValueHolderT>>,
 	public INodeInternal,
-	public std::enable_shared_from_this<VolumeNodeImpl<KeyT, ValueHolderT>>
+	public std::enable_shared_from_this<VolumeNodeImpl<KeyT, ValueHolderT, DictT>>
 {
 
 public:
 	using VolumeNodeBaseType = NodeIdImpl < VolumeNodeBase<KeyT, ValueHolderT>>;
-	using VolumeNodeImplType = VolumeNodeImpl<KeyT, ValueHolderT>;
+	using VolumeNodeImplType = VolumeNodeImpl<KeyT, ValueHolderT, DictT>;
 	using VolumeNodeImplPtr = std::shared_ptr<VolumeNodeImplType>;
 
 	using NodeType = IVolumeNode<KeyT, ValueHolderT>;
 
 	using typename NodeType::ForEachKeyValueFunctorType;
+	using typename NodeType::ForEachConstKeyValueFunctorType;
+	using typename NodeType::CursorType;
+	using typename NodeType::ScanFunctorType;
+	using typename NodeType::VisitFunctorType;
+	using typename NodeType::KeysType;
+	using typename NodeType::KeyValuesType;
+	using typename NodeType::FoundValuesType;
 
 	using typename INodeContainer<NodeType>::NodePtr;
 
 	using typename INodeContainer<NodeType>::ForEachFunctorType;
 	using typename INodeContainer<NodeType>::FindIfFunctorType;
 	using typename INodeContainer<NodeType>::RemoveIfFunctorType;
+	using typename INodeContainer<NodeType>::ChildCursorType;
+	using typename INodeContainer<NodeType>::ChildrenType;
 
 	using typename INodeEventsSubscription<NodeType>::NodeEventsPtr;
+	using typename IKeyEventsSubscription<KeyT>::KeyEventsPtr;
+
+	using DictType = DictT;
+	using DictOptions = typename DictType::Options;
+
+	using JournalType = persistence::Journal<KeyT, ValueHolderT>;
+	using JournalPtr = typename JournalType::Ptr;
+	using JournalNodeId = typename JournalType::NodeId;
 
 public:
 
-	static VolumeNodeImplPtr CreateInstance(std::string name, Priority priority)
+	static VolumeNodeImplPtr CreateInstance(std::string name, Priority priority, DictOptions dictOptions = {}, const EvictionOptions& evictionOptions = {})
+	{
+		return Register(std::shared_ptr<VolumeNodeImpl>(new VolumeNodeImpl(std::move(name), priority, std::move(dictOptions), CreateEvictionTree(evictionOptions), nullptr,
+			JournalType::cRootNodeId, nullptr)));
+	}
+
+	static VolumeNodeImplPtr CreateInstance(std::string name, Priority priority, const EvictionOptions& evictionOptions)
+	{
+		return CreateInstance(std::move(name), priority, DictOptions{}, evictionOptions);
+	}
+
+	// a persistent tree: recovered from the directory, then every change is logged there
+	static VolumeNodeImplPtr CreateInstance(std::string name, Priority priority, const PersistenceOptions& persistenceOptions, const EvictionOptions& evictionOptions = {})
 	{
-		return std::shared_ptr<VolumeNodeImpl>(new VolumeNodeImpl(std::move(name), priority));
+		return CreateInstance(std::move(name), priority, DictOptions{}, persistenceOptions, evictionOptions);
+	}
+
+	static VolumeNodeImplPtr CreateInstance(std::string name, Priority priority, DictOptions dictOptions, const PersistenceOptions& persistenceOptions,
+		const EvictionOptions& evictionOptions = {})
+	{
+		const auto journal = JournalType::CreateInstance(persistenceOptions);
+		const auto root = Register(std::shared_ptr<VolumeNodeImpl>(new VolumeNodeImpl(std::move(name), priority, std::move(dictOptions), CreateEvictionTree(evictionOptions), journal,
+			JournalType::cRootNodeId, nullptr)));
+
+		root->Recover();
+
+		journal->Start(
+			[weakRoot = std::weak_ptr<VolumeNodeImpl>(root)](typename JournalType::CheckpointWriter& writer)
+			{
+				const auto root = weakRoot.lock();
+				if (!root)
+					return false;
+
+				root->WriteCheckpoint(writer);
+				return true;
+			});
+
+		return root;
 	}
 
 	// INode
@@ -65,86 +141,211 @@ public:
 
 	void Insert(const KeyT& key, const ValueHolderT& value) override
 	{
-		std::lock_guard lock(m_dictMutex);
-
-		InsertImpl(key, value);
+		ChangeKey(key,
+			[&]()
+			{
+				InsertImpl(key, value);
+				return true;
+			});
 	}
 
 	void Insert(const KeyT& key, ValueHolderT&& value) override
 	{
-		std::lock_guard lock(m_dictMutex);
-
-		InsertImpl(key, std::move(value));
+		ChangeKey(key,
+			[&]()
+			{
+				InsertImpl(key, std::move(value));
+				return true;
+			});
 	}
 
 	void Erase(const KeyT& key) override
 	{
-		std::lock_guard lock(m_dictMutex);
-
-		m_dict.erase(key);
+		ChangeKey(key,
+			[&]()
+			{
+				return EraseImpl(key);
+			});
 	}
 
 	bool Find(const KeyT& key, ValueHolderT& value) const override
 	{
-		std::shared_lock lock(m_dictMutex);
-
-		auto it = FindImpl(key);
-		if (it == m_dict.end())
+		if (!PrepareLookup(key))
 			return false;
 
-		value = it->second;
+		return m_dict.Find(key, value);
+	}
 
-		return true;
+	bool FindValueByPath(const std::string& path, const KeyT& key, ValueHolderT& value) const override
+	{
+		const auto node = FindNodeByPath(path);
+
+		return node && node->Find(key, value);
 	}
 
-	bool Contains(const KeyT& key) const override
+	bool Visit(const KeyT& key, const VisitFunctorType& f) const override
 	{
-		std::shared_lock lock(m_dictMutex);
+		if (!PrepareLookup(key))
+			return false;
+
+		return m_dict.Visit(key, f);
+	}
 
-		auto it = FindImpl(key);
-		if (it == m_dict.end())
+	bool Contains(const KeyT& key) const override
+	{
+		if (!PrepareLookup(key))
 			return false;
 
-		return true;
+		return m_dict.Contains(key);
 	}
 
 	bool TryInsert(const KeyT& key, const ValueHolderT& value) override
 	{
-		std::lock_guard lock(m_dictMutex);
-
-		return TryInsertImpl(key, value);
+		return ChangeKey(key,
+			[&]()
+			{
+				return TryInsertImpl(key, value);
+			});
 	}
 
 	bool TryInsert(const KeyT& key, ValueHolderT&& value) override
 	{
-		std::lock_guard lock(m_dictMutex);
-
-		return TryInsertImpl(key, std::move(value));
+		return ChangeKey(key,
+			[&]()
+			{
+				return TryInsertImpl(key, std::move(value));
+			});
 	}
 
 	bool Replace(const KeyT& key, const ValueHolderT& value) override
 	{
-		std::lock_guard lock(m_dictMutex);
-
-		return ReplaceImpl(key, value);
+		return ChangeKey(key,
+			[&]()
+			{
+				return ReplaceImpl(key, value);
+			});
 	}
 
 	bool Replace(const KeyT& key, ValueHolderT&& value) override
 	{
-		std::lock_guard lock(m_dictMutex);
-
-		return ReplaceImpl(key, std::move(value));
+		return ChangeKey(key,
+			[&]()
+			{
+				return ReplaceImpl(key, std::move(value));
+			});
 	}
 
 	void ForEachKeyValue(const ForEachKeyValueFunctorType& f) override
 	{
-		std::lock_guard lock(m_dictMutex);
+		ExpireDueKeys(cAllKeys);
+		ForEachKeyValueImpl(f,
+			[this](const auto& journaledF)
+			{
+				m_dict.ForEachKeyValue(journaledF);
+			});
+	}
 
-		std::for_each(m_dict.begin(), m_dict.end(), [&f](auto& it)
+	void ForEachKeyValueSnapshot(const ForEachConstKeyValueFunctorType& f) const override
+	{
+		GetMutable().ExpireDueKeys(cAllKeys);
+		DictType::ForEachInSnapshot(TakeSnapshot(), f);
+	}
+
+	void ForEachInRange(const KeyT& from, const KeyT& to, const ForEachKeyValueFunctorType& f) override
+	{
+		ExpireDueKeys(cAllKeys);
+		ForEachKeyValueImpl(f,
+			[this, &from, &to](const auto& journaledF)
+			{
+				m_dict.ForEachInRange(from, to, journaledF);
+			});
+	}
+
+	bool LowerBound(const KeyT& key, KeyT& foundKey, ValueHolderT& value) const override
+	{
+		// an expired key found is removed, so the next lookup goes past it
+		while (m_dict.LowerBound(key, foundKey, value))
+			if (PrepareLookup(foundKey))
+				return true;
+
+		return false;
+	}
+
+	PageOrder GetPageOrder() const override
+	{
+		return DictT::cPageOrder;
+	}
+
+	CursorType NextKeyValues(const CursorType& cursor, size_t count, KeyValuesType& keyValues) const override
+	{
+		keyValues.clear();
+		if (cursor.IsEnd())
+			return cursor;
+
+		const auto order = cursor.GetOrder().value_or(DictT::cPageOrder);
+
+		GetMutable().ExpireDueKeys(cAllKeys);
+		m_dict.NextPage(cursor.GetLast(), count, order, keyValues);
+
+		return cursor.InOrder(order).Following(count, keyValues.size(),
+			[&keyValues]()
+			{
+				return keyValues.back().first;
+			});
+	}
+
+	size_t MultiFind(const KeysType& keys, FoundValuesType& values) const override
+	{
+		values.assign(keys.size(), std::nullopt);
+		auto found = m_dict.MultiFind(keys, dict::IndexSequence{ keys.size() }, values);
+		if (!m_expiration.IsActive() && !m_eviction)
+			return found;
+
+		for (size_t i = 0; i < keys.size(); i++)
+			if (values[i] && !PrepareLookup(keys[i]))
+			{
+				values[i].reset();
+				found--;
+			}
+
+		return found;
+	}
+
+	void MultiInsert(const KeyValuesType& keyValues) override
+	{
+		MultiInsertImpl(keyValues);
+	}
+
+	void MultiInsert(KeyValuesType&& keyValues) override
+	{
+		MultiInsertImpl(std::move(keyValues));
+	}
+
+	void MultiErase(const KeysType& keys) override
+	{
+		// a node with TTLs or a budget changes keys one by one
+		{
+			const typename ExpirationTableType::InactiveChange inactiveChange{ m_expiration };
+			if (inactiveChange && !m_eviction)
 			{
-				f(it.first, it.second);
+				MultiEraseBatch(keys);
+				return;
 			}
-		);
+		}
+
+		for (const auto& key : keys)
+			Erase(key);
+	}
+
+	NodeStats GetStats() const override
+	{
+		NodeStats stats;
+		m_dict.AddStats(stats);
+
+		std::shared_lock lock(m_nodeMutex);
+		stats.childCount = m_children.size();
+
+		return stats;
 	}
 
 	Priority GetPriority() const noexcept override
@@ -152,30 +353,97 @@ public:
 		return m_priority;
 	}
 
-	// INodeContainer
-	NodePtr InsertChild(const std::string& name) override
+	// a caller holds the cache of the node while it sums up changed children, so a concurrent caller
+	// waits for the sum instead of taking the stale cache
+	NodeStats GetSubtreeStats() const override
 	{
-		NodePtr newChild;
+		auto& subtree = *m_subtreeStats;
+		std::lock_guard lock(subtree.mutex);
+
+		// acquires counters published by changes which have raised the flag
+		if (!subtree.changed.exchange(false, std::memory_order_acq_rel))
+			return subtree.stats;
 
+		auto stats = GetStats();
+
+		ContainerType children;
 		{
-			std::lock_guard lock(m_nodeMutex);
+			std::shared_lock nodeLock(m_nodeMutex);
+			children = m_children;
+		}
 
-			// "Find-then-insert" instead of "insert-then-test" to avoid
-			// possibly redundant calls CreateInstance
+		for (const auto& nameNodePair : children)
+		{
+			const auto childStats = nameNodePair.second->GetSubtreeStats();
+			stats += childStats;
+		}
 
-			auto it = m_children.find(name);
-			if (it != m_children.end())
-				newChild = it->second->GetProxy();
-			else
+		subtree.stats = stats;
+		return stats;
+	}
+
+	void InsertWithTtl(const KeyT& key, const ValueHolderT& value, std::chrono::milliseconds ttl) override
+	{
+		InsertWithTtlImpl(key, value, ttl);
+	}
+
+	void InsertWithTtl(const KeyT& key, ValueHolderT&& value, std::chrono::milliseconds ttl) override
+	{
+		InsertWithTtlImpl(key, std::move(value), ttl);
+	}
+
+	bool Touch(const KeyT& key, std::chrono::milliseconds ttl) override
+	{
+		m_expiration.Activate();
+		ExpireDueKeys(cExpireBatchSize);
+
+		const auto lock = m_expiration.LockKey(key);
+		if (ExpireIfDue(key) || !m_dict.Contains(key))
+			return false;
+
+		MarkUsed(key);
+		m_expiration.Set(key, ExpirationTableType::Clock::now() + ttl);
+		return true;
+	}
+
+	// a worker takes parts of snapshots one by one, so a fast worker takes more of them
+	void ParallelScan(const ScanOptions& options, const ScanFunctorType& f) const override
+	{
+		std::vector<typename DictType::SnapshotType> snapshots;
+		GetMutable().CollectSnapshots(options.subtree, snapshots);
+
+		const auto workerCount = GetScanWorkerCount(options);
+		const auto partCount = workerCount == 1 ? 1 : workerCount * cScanPartsPerWorker;
+
+		utils::ParallelFor(workerCount, snapshots.size() * partCount,
+			[&snapshots, &f, partCount](size_t worker, size_t item)
 			{
-				const auto insertRes = m_children.insert({ name, CreateInstance(name, m_priority) });
-				newChild = insertRes.first->second->GetProxy();
-			}
-		}
+				DictType::ForEachInSnapshotPart(snapshots[item / partCount], item % partCount, partCount,
+					[&f, worker](const KeyT& key, const ValueHolderT& value)
+					{
+						f(worker, key, value);
+					});
+			});
+	}
 
-		m_subscriberHolder.OnNodeAdded(newChild);
+	// IKeyFilter
+	bool MayContain(const KeyT& key) const noexcept override
+	{
+		if constexpr (utils::HasMayContain<DictT, KeyT>::value)
+			return m_dict.MayContain(key);
+		else
+			return true;
+	}
 
-		return newChild;
+	typename IKeyFilter<KeyT>::KeyFilterPtr PinKeyFilter() const noexcept override
+	{
+		return this->shared_from_this();
+	}
+
+	// INodeContainer
+	NodePtr InsertChild(const std::string& name) override
+	{
+		return InsertChildNode(name)->GetProxy();
 	}
 
 	void ForEachChild(const ForEachFunctorType& f) const  override
@@ -189,6 +457,33 @@ public:
 			});
 	}
 
+	ChildCursorType NextChildren(const ChildCursorType& cursor, size_t count, ChildrenType& children) const override
+	{
+		children.clear();
+		if (cursor.IsEnd())
+			return cursor;
+
+		utils::PageCollector<std::string, NodePtr> collector(cursor.GetLast(), count);
+		{
+			std::shared_lock lock(m_nodeMutex);
+
+			for (const auto& nameNodePair : m_children)
+				if (collector.Accepts(nameNodePair.first))
+					collector.Add(nameNodePair.first, nameNodePair.second->GetProxy());
+		}
+
+		std::vector<std::pair<std::string, NodePtr>> page;
+		collector.MoveTo(page);
+		for (auto& nameNodePair : page)
+			children.push_back(std::move(nameNodePair.second));
+
+		return cursor.Following(count, page.size(),
+			[&page]()
+			{
+				return page.back().first;
+			});
+	}
+
 	NodePtr FindChild(const std::string& name) const override
 	{
 		std::shared_lock lock(m_nodeMutex);
@@ -201,6 +496,22 @@ public:
 		return nullptr;
 	}
 
+	NodePtr FindByPath(const std::string& path) const override
+	{
+		const auto node = FindNodeByPath(path);
+
+		return node ? node->GetProxy() : nullptr;
+	}
+
+	NodePtr InsertChildPath(const std::string& path) override
+	{
+		return utils::WalkPath(this->shared_from_this(), path,
+			[](VolumeNodeImpl& node, const std::string& name)
+			{
+				return node.InsertChildNode(name);
+			})->GetProxy();
+	}
+
 	NodePtr FindChildIf(const FindIfFunctorType& f) const override
 	{
 		std::shared_lock lock(m_nodeMutex);
@@ -227,27 +538,42 @@ public:
 
 		const auto node = it->second;
 		m_children.erase(it);
+		OnStatsChanged();
+
+		const auto lsn = LogRemoveChild(name, node);
 
 		//TODO: consider calling outside lock
 		DoRemoveChild(node);
+
+		if (m_journal)
+			m_journal->Commit(lsn);
 	}
 
 	void RemoveChildIf(const RemoveIfFunctorType& f)  override
 	{
-		std::lock_guard lock(m_nodeMutex);
+		typename JournalType::Lsn lsn = 0;
 
-		for (auto it = m_children.begin(); it != m_children.end();)
 		{
-			const auto node = it->second;
-			if (f(node->GetProxy()))
+			std::lock_guard lock(m_nodeMutex);
+
+			for (auto it = m_children.begin(); it != m_children.end();)
 			{
-				it = m_children.erase(it);
-				//TODO: consider calling outside lock
-				DoRemoveChild(node);
+				const auto node = it->second;
+				if (f(node->GetProxy()))
+				{
+					lsn = LogRemoveChild(it->first, node);
+					it = m_children.erase(it);
+					OnStatsChanged();
+					//TODO: consider calling outside lock
+					DoRemoveChild(node);
+				}
+				else
+					it++;
 			}
-			else
-				it++;
 		}
+
+		if (m_journal)
+			m_journal->Commit(lsn);
 	}
 
 
@@ -263,20 +589,40 @@ private:
 		m_subscriberHolder.Remove(cookie);
 	}
 
+	// IKeyEventsSubscription
+	Cookie RegisterKeySubscriber(KeyEventsPtr subscriber) override
+	{
+		return m_keySubscriberHolder.Add(std::move(subscriber));
+	}
+
+	void UnregisterKeySubscriber(Cookie cookie) override
+	{
+		m_keySubscriberHolder.Remove(cookie);
+	}
+
 	// IProxyProvider
 	NodePtr GetProxy() override
 	{
-		return VolumeNodeProxyImpl<KeyT, ValueHolderT>::CreateInstance(this->shared_from_this(), VolumeNodeBaseType::GetId());
+		return VolumeNodeProxyImpl<KeyT, ValueHolderT, VolumeNodeImpl>::CreateInstance(this->shared_from_this(), VolumeNodeBaseType::GetId());
 	}
 
 	void MakeOrphan() override
 	{
+		// keys of a removed node don't count against the budget of the tree
+		if (m_eviction)
+			m_eviction->Detach();
+
+		// a tree being freed is not removed from its directory: the log is closed first
+		if (m_journal && m_journalId == JournalType::cRootNodeId)
+			m_journal->Close();
+
 		ContainerType childrenCopy;
 		{
 			std::lock_guard lock(m_nodeMutex);
 			childrenCopy = m_children;
 			m_children.clear();
 		}
+		OnStatsChanged();
 
 		for (const auto& nodeNamePair : childrenCopy)
 		{
@@ -287,117 +633,752 @@ private:
 	}
 
 private:
-	using DictType = std::unordered_map<KeyT, ValueHolderT>;
 	using ContainerType = std::unordered_map<std::string, VolumeNodeImplPtr>;
 
+	using ExpirationTableType = ExpirationTable<KeyT>;
+	using EvictionType = ClockEviction<KeyT>;
+
+	// outlives the node while its children refer to it, so a change of a removed child raises
+	// the flag of a cache nobody reads rather than of a freed one
+	struct SubtreeStats
+	{
+		explicit SubtreeStats(std::shared_ptr<SubtreeStats> parent) : parent{ std::move(parent) }
+		{
+		}
+
+		const std::shared_ptr<SubtreeStats> parent;
+		// raised by a change of the subtree; a new node has no cache yet
+		std::atomic<bool> changed{ true };
+		std::mutex mutex;
+		NodeStats stats;
+	};
+
+	using SubtreeStatsPtr = std::shared_ptr<SubtreeStats>;
+
+	// nodes of a tree with a budget, so a node which changes can make the nodes over their shares evict
+	struct EvictionTree
+	{
+		explicit EvictionTree(const EvictionOptions& options) : budget{ std::make_shared<EvictionBudget>(options) }
+		{
+		}
+
+		std::vector<VolumeNodeImplPtr> GetNodes()
+		{
+			std::lock_guard lock(mutex);
+
+			std::vector<VolumeNodeImplPtr> res;
+			res.reserve(nodes.size());
+			for (const auto& node : nodes)
+				if (auto locked = node.lock())
+					res.push_back(std::move(locked));
+			return res;
+		}
+
+		const EvictionBudgetPtr budget;
+		std::mutex mutex;
+		// freed nodes are dropped when the vector is about to grow
+		std::vector<std::weak_ptr<VolumeNodeImpl>> nodes;
+	};
+
+	using EvictionTreePtr = std::shared_ptr<EvictionTree>;
+
+	static constexpr size_t cScanPartsPerWorker = 4;
+	// keys with passed deadlines a change or a lookup removes by the way
+	static constexpr size_t cExpireBatchSize = 16;
+	static constexpr size_t cAllKeys = std::numeric_limits<size_t>::max();
+
 
 private:
-	VolumeNodeImpl(std::string name, Priority priority) :
-		m_priority{ priority }, m_name {std::move(name)	}
+	VolumeNodeImpl(std::string name, Priority priority, DictOptions dictOptions, EvictionTreePtr evictionTree, JournalPtr journal, JournalNodeId journalId,
+		SubtreeStatsPtr parentStats) :
+		m_dict{ dictOptions }, m_dictOptions{ std::move(dictOptions) }, m_evictionTree{ std::move(evictionTree) }, m_journal{ std::move(journal) }, m_journalId{ journalId },
+		m_priority{ priority }, m_name{ std::move(name) }, m_subtreeStats{ std::make_shared<SubtreeStats>(std::move(parentStats)) }
+	{
+		if (m_evictionTree)
+			m_eviction = std::make_unique<EvictionType>(m_evictionTree->budget);
+	}
+
+	static EvictionTreePtr CreateEvictionTree(const EvictionOptions& options)
+	{
+		if (options.maxKeyCount == 0 && options.maxBytes == 0)
+			return nullptr;
+
+		return std::make_shared<EvictionTree>(options);
+	}
+
+	// a node of a tree with a budget joins its eviction tree
+	static VolumeNodeImplPtr Register(VolumeNodeImplPtr node)
+	{
+		if (!node->m_evictionTree)
+			return node;
+
+		auto& tree = *node->m_evictionTree;
+		std::lock_guard lock(tree.mutex);
+
+		auto& nodes = tree.nodes;
+		if (nodes.size() == nodes.capacity())
+			nodes.erase(std::remove_if(nodes.begin(), nodes.end(),
+				[](const auto& weakNode)
+				{
+					return weakNode.expired();
+				}), nodes.end());
+
+		nodes.push_back(node);
+		return node;
+	}
+
+	// children inherit the engine options, the budget and the journal; a child's changes raise the flag of this node
+	VolumeNodeImplPtr CreateChild(const std::string& name, JournalNodeId journalId) const
 	{
+		return Register(std::shared_ptr<VolumeNodeImpl>(new VolumeNodeImpl(name, m_priority, m_dictOptions, m_evictionTree, m_journal, journalId, m_subtreeStats)));
+	}
+
+	// lookups and iterations remove expired keys; a node is never created const
+	VolumeNodeImplPtr InsertChildNode(const std::string& name)
+	{
+		VolumeNodeImplPtr newChild;
+		typename JournalType::Lsn lsn = 0;
+
+		{
+			std::lock_guard lock(m_nodeMutex);
+
+			// "Find-then-insert" instead of "insert-then-test" to avoid
+			// possibly redundant calls CreateInstance
+
+			// an existing child changes nothing, so nobody is notified
+			auto it = m_children.find(name);
+			if (it != m_children.end())
+				return it->second;
+
+			const auto childJournalId = m_journal ? m_journal->NextNodeId() : JournalType::cRootNodeId;
+			if (m_journal)
+				lsn = m_journal->LogInsertChild(m_journalId, name, childJournalId);
+
+			newChild = m_children.insert({ name, CreateChild(name, childJournalId) }).first->second;
+			OnStatsChanged();
+		}
+
+		if (m_journal)
+			m_journal->Commit(lsn);
+
+		m_subscriberHolder.OnNodeAdded(newChild->GetProxy());
+
+		return newChild;
+	}
+
+	VolumeNodeImplPtr FindChildNode(const std::string& name) const
+	{
+		std::shared_lock lock(m_nodeMutex);
+
+		const auto it = m_children.find(name);
+
+		return it != m_children.end() ? it->second : nullptr;
+	}
+
+	VolumeNodeImplPtr FindNodeByPath(const std::string& path) const
+	{
+		return utils::WalkPath(GetMutable().shared_from_this(), path,
+			[](const VolumeNodeImpl& node, const std::string& name)
+			{
+				return node.FindChildNode(name);
+			});
+	}
+
+	VolumeNodeImpl& GetMutable() const noexcept
+	{
+		return const_cast<VolumeNodeImpl&>(*this);
+	}
+
+	// change() writes the key without a TTL and returns whether it has changed it; on a node with TTLs
+	// the key is serialized with its deadline, an expired key is removed first, and a key changed loses its TTL;
+	// a node with a budget evicts keys over it afterwards
+	template<typename ChangeT>
+	bool ChangeKey(const KeyT& key, const ChangeT& change)
+	{
+		bool changed;
+		{
+			// InsertWithTtl activating the table meanwhile waits for a change made without it
+			const typename ExpirationTableType::InactiveChange inactiveChange{ m_expiration };
+			if (inactiveChange && !m_eviction)
+				return change();
+
+			std::unique_lock<std::mutex> expirationLock;
+			if (!inactiveChange)
+			{
+				ExpireDueKeys(cExpireBatchSize);
+				expirationLock = m_expiration.LockKey(key);
+				ExpireIfDue(key);
+			}
+
+			changed = ApplyChange(key, change);
+			if (changed && expirationLock)
+				m_expiration.Reset(key);
+		}
+
+		EvictOverBudget();
+		return changed;
+	}
+
+	// a node with a budget accounts the key changed by change() together with the change
+	template<typename ChangeT>
+	bool ApplyChange(const KeyT& key, const ChangeT& change)
+	{
+		if (!m_eviction)
+			return change();
+
+		const auto lock = m_eviction->LockKey(key);
+		if (!change())
+			return false;
+
+		AccountKey(key);
+		return true;
+	}
+
+	// must be called under m_eviction->LockKey(key)
+	void AccountKey(const KeyT& key)
+	{
+		size_t size = 0;
+		const auto present = m_dict.Visit(key,
+			[&key, &size](const ValueHolderT& value)
+			{
+				size = utils::GetMemorySize(key) + utils::GetMemorySize(value);
+			});
+
+		if (present)
+			m_eviction->OnPresent(key, size);
+		else
+			m_eviction->OnAbsent(key);
+	}
+
+	// once the tree is over its budget, the node evicts its keys if it is over its share, and then the other
+	// nodes over their shares do, till the tree fits; must be called with no key locked
+	void EvictOverBudget()
+	{
+		if (!m_eviction)
+			return;
+
+		const auto& budget = *m_evictionTree->budget;
+		if (!budget.IsOver())
+			return;
+
+		EvictOwnKeys();
+
+		if (!budget.IsOver())
+			return;
+
+		for (const auto& node : m_evictionTree->GetNodes())
+		{
+			if (node.get() != this)
+				node->EvictOwnKeys();
+
+			if (!budget.IsOver())
+				return;
+		}
+	}
+
+	// erases keys picked by the eviction policy unless they are changed meanwhile;
+	// must be called with no key locked
+	void EvictOwnKeys()
+	{
+		if (!m_eviction->IsOverBudget())
+			return;
+
+		std::vector<KeyT> victims;
+		m_eviction->PickVictims(victims);
+
+		for (const auto& key : victims)
+		{
+			std::unique_lock<std::mutex> expirationLock;
+			if (m_expiration.IsActive())
+				expirationLock = m_expiration.LockKey(key);
+
+			const auto lock = m_eviction->LockKey(key);
+			if (!m_eviction->IsPicked(key))
+				continue;
+
+			EraseImpl(key);
+			m_eviction->OnAbsent(key);
+			if (expirationLock)
+				m_expiration.Reset(key);
+		}
+	}
+
+	template<typename T>
+	void InsertWithTtlImpl(const KeyT& key, T&& value, std::chrono::milliseconds ttl)
+	{
+		m_expiration.Activate();
+		ExpireDueKeys(cExpireBatchSize);
+
+		{
+			const auto lock = m_expiration.LockKey(key);
+			ApplyChange(key,
+				[&]()
+				{
+					InsertImpl(key, std::forward<T>(value));
+					return true;
+				});
+			m_expiration.Set(key, ExpirationTableType::Clock::now() + ttl);
+		}
+
+		EvictOverBudget();
+	}
+
+	void MarkUsed(const KeyT& key) const noexcept
+	{
+		if (m_eviction)
+			m_eviction->MarkUsed(key);
+	}
+
+	// marks the key used; false if the key has expired (it is removed then)
+	bool PrepareLookup(const KeyT& key) const
+	{
+		MarkUsed(key);
+
+		if (!m_expiration.IsActive())
+			return true;
+
+		auto& node = GetMutable();
+		node.ExpireDueKeys(cExpireBatchSize);
+
+		if (!m_expiration.IsExpired(key, ExpirationTableType::Clock::now()))
+			return true;
+
+		const auto lock = node.m_expiration.LockKey(key);
+		return !node.ExpireIfDue(key);
+	}
+
+	// removes up to limit keys which deadlines have passed
+	void ExpireDueKeys(size_t limit)
+	{
+		if (!m_expiration.IsActive())
+			return;
+
+		std::vector<KeyT> keys;
+		m_expiration.CollectExpired(ExpirationTableType::Clock::now(), limit, keys);
+
+		for (const auto& key : keys)
+		{
+			const auto lock = m_expiration.LockKey(key);
+			ExpireIfDue(key);
+		}
+	}
+
+	// must be called under m_expiration.LockKey(key)
+	bool ExpireIfDue(const KeyT& key)
+	{
+		if (!m_expiration.IsExpired(key, ExpirationTableType::Clock::now()))
+			return false;
+
+		ApplyChange(key,
+			[this, &key]()
+			{
+				EraseImpl(key);
+				return true;
+			});
+		m_expiration.Reset(key);
+		return true;
+	}
+
+	// subscribers are notified only if the key was there
+	bool EraseImpl(const KeyT& key)
+	{
+		if (!m_journal)
+		{
+			if (!m_dict.Erase(key))
+				return false;
+
+			OnStatsChanged();
+			m_keySubscriberHolder.OnKeyChanged(key);
+			return true;
+		}
+
+		typename JournalType::Lsn lsn;
+		bool erased;
+		{
+			const auto lock = m_journal->LockKey(key);
+			lsn = m_journal->LogErase(m_journalId, key);
+			erased = m_dict.Erase(key);
+		}
+		if (erased)
+		{
+			OnStatsChanged();
+			m_keySubscriberHolder.OnKeyChanged(key);
+		}
+		m_journal->Commit(lsn);
+		return erased;
 	}
 
 	template<typename T>
 	void InsertImpl(const KeyT& key, T&& value)
 	{
-		m_dict.insert_or_assign(key, std::forward<T>(value));
+		if (!m_journal)
+		{
+			m_dict.Insert(key, std::forward<T>(value));
+			OnStatsChanged();
+			m_keySubscriberHolder.OnKeyChanged(key);
+			return;
+		}
+
+		typename JournalType::Lsn lsn;
+		{
+			const auto lock = m_journal->LockKey(key);
+			lsn = m_journal->LogInsert(m_journalId, key, value);
+			m_dict.Insert(key, std::forward<T>(value));
+		}
+		OnStatsChanged();
+		m_keySubscriberHolder.OnKeyChanged(key);
+		m_journal->Commit(lsn);
 	}
 
+	// a persistent node logs a conditional change only if it is going to be applied;
+	// nobody else changes the key while its lock is held
 	template<typename T>
 	bool TryInsertImpl(const KeyT& key, T&& value)
 	{
-		auto resIt = m_dict.try_emplace(key, std::forward<T>(value));
-		return resIt.second;
+		if (!m_journal)
+		{
+			if (!m_dict.TryInsert(key, std::forward<T>(value)))
+				return false;
+
+			OnStatsChanged();
+			m_keySubscriberHolder.OnKeyChanged(key);
+			return true;
+		}
+
+		typename JournalType::Lsn lsn;
+		{
+			const auto lock = m_journal->LockKey(key);
+			if (m_dict.Contains(key))
+				return false;
+
+			lsn = m_journal->LogInsert(m_journalId, key, value);
+			m_dict.TryInsert(key, std::forward<T>(value));
+		}
+		OnStatsChanged();
+		m_keySubscriberHolder.OnKeyChanged(key);
+		m_journal->Commit(lsn);
+
+		return true;
 	}
 
 	template<typename T>
 	bool ReplaceImpl(const KeyT& key, T&& value)
 	{
-		auto resIt = m_dict.find(key);
-		if (resIt == m_dict.end())
-			return false;
+		if (!m_journal)
+		{
+			if (!m_dict.Replace(key, std::forward<T>(value)))
+				return false;
+
+			OnStatsChanged();
+			return true;
+		}
+
+		typename JournalType::Lsn lsn;
+		{
+			const auto lock = m_journal->LockKey(key);
+			if (!m_dict.Contains(key))
+				return false;
+
+			lsn = m_journal->LogInsert(m_journalId, key, value);
+			m_dict.Replace(key, std::forward<T>(value));
+		}
+		OnStatsChanged();
+		m_journal->Commit(lsn);
 
-		resIt->second = std::forward<T>(value);
 		return true;
 	}
 
-	typename DictType::const_iterator FindImpl(const KeyT& key) const
+	template<typename KeyValuesT>
+	void MultiInsertImpl(KeyValuesT&& keyValues)
 	{
-		return m_dict.find(key);
+		// a node with TTLs or a budget changes keys one by one
+		{
+			const typename ExpirationTableType::InactiveChange inactiveChange{ m_expiration };
+			if (inactiveChange && !m_eviction)
+			{
+				MultiInsertBatch(std::forward<KeyValuesT>(keyValues));
+				return;
+			}
+		}
+
+		for (size_t i = 0; i < keyValues.size(); i++)
+		{
+			const auto& key = keyValues[i].first;
+			ChangeKey(key,
+				[&]()
+				{
+					InsertImpl(key, dict::ForwardValue(std::forward<KeyValuesT>(keyValues), i));
+					return true;
+				});
+		}
 	}
 
-	void DoRemoveChild(const VolumeNodeImplPtr& child)
+	template<typename KeyValuesT>
+	void MultiInsertBatch(KeyValuesT&& keyValues)
 	{
-		m_subscriberHolder.OnNodeRemoved(child->GetProxy());
 
-		// It's needed because we want to notify "virtual clients" about removed nodes ASAP
-		// Actually different strategies can be applied for making "virtual clients" actual
-		child->MakeOrphan();
+		if (!m_journal)
+		{
+			m_dict.MultiInsert(std::forward<KeyValuesT>(keyValues), dict::IndexSequence{ keyValues.size() });
+			OnStatsChanged();
+			for (const auto& keyValue : keyValues)
+				m_keySubscriberHolder.OnKeyChanged(keyValue.first);
+			return;
+		}
+
+		// a persistent node logs keys one by one; a batch still waits for a disk once
+		typename JournalType::Lsn lsn = 0;
+		for (size_t i = 0; i < keyValues.size(); i++)
+		{
+			const auto& key = keyValues[i].first;
+			const auto lock = m_journal->LockKey(key);
+			lsn = m_journal->LogInsert(m_journalId, key, keyValues[i].second);
+			m_dict.Insert(key, dict::ForwardValue(std::forward<KeyValuesT>(keyValues), i));
+		}
+		OnStatsChanged();
+		for (const auto& keyValue : keyValues)
+			m_keySubscriberHolder.OnKeyChanged(keyValue.first);
+		m_journal->Commit(lsn);
 	}
 
-private:
-	class SubscriberHolder :
-		public INodeEvents<IVolumeNode<KeyT, ValueHolderT>>
+	// subscribers are notified of erased keys only, in the order of the batch, as Erase does
+	void MultiEraseBatch(const KeysType& keys)
 	{
-	public:
-		Cookie Add(NodeEventsPtr subscriber)
+		std::vector<size_t> erased;
+		typename JournalType::Lsn lsn = 0;
+
+		if (!m_journal)
 		{
-			std::lock_guard lock(m_mutex);
-			m_subscribers[m_currentCookie] = subscriber;
-			return m_currentCookie++;
+			m_dict.MultiErase(keys, dict::IndexSequence{ keys.size() }, erased);
+			std::sort(erased.begin(), erased.end());
+		}
+		else
+		{
+			// a persistent node logs keys one by one; a batch still waits for a disk once
+			for (size_t i = 0; i < keys.size(); i++)
+			{
+				const auto lock = m_journal->LockKey(keys[i]);
+				lsn = m_journal->LogErase(m_journalId, keys[i]);
+				if (m_dict.Erase(keys[i]))
+					erased.push_back(i);
+			}
 		}
 
-		void Remove(Cookie cookie)
+		if (!erased.empty())
 		{
-			std::lock_guard lock(m_mutex);
-			m_subscribers.erase(cookie);
+			OnStatsChanged();
+			for (const auto index : erased)
+				m_keySubscriberHolder.OnKeyChanged(keys[index]);
 		}
 
-		void Clear()
+		if (m_journal)
+			m_journal->Commit(lsn);
+	}
+
+	// iterate(f) runs an iteration of the dictionary; a persistent node logs values changed by f.
+	// Key locks are taken after the dictionary locks elsewhere, so changed keys are collected during
+	// the iteration and logged after it, each under its own lock. The value logged is the one the key has
+	// at that moment: a writer changing the key in between has logged its value already and logs nothing later
+	template<typename IterateT>
+	void ForEachKeyValueImpl(const ForEachKeyValueFunctorType& f, const IterateT& iterate)
+	{
+		if (!m_journal)
 		{
-			std::lock_guard lock(m_mutex);
-			m_subscribers.clear();
+			iterate(f);
+			OnStatsChanged();
+			return;
 		}
 
-		void OnNodeAdded(NodePtr node) override
+		std::vector<KeyT> changedKeys;
+		iterate(
+			[&f, &changedKeys](const KeyT& key, ValueHolderT& value)
+			{
+				if constexpr (utils::IsEqualityComparable<ValueHolderT>::value)
+				{
+					const auto oldValue = value;
+					f(key, value);
+					if (value == oldValue)
+						return;
+				}
+				else
+					f(key, value);
+
+				changedKeys.push_back(key);
+			});
+
+		typename JournalType::Lsn lsn = 0;
+		ValueHolderT value;
+		for (const auto& key : changedKeys)
 		{
-			SubscribersContainerType subscribersCopy;
+			const auto lock = m_journal->LockKey(key);
+			lsn = m_dict.Find(key, value) ?
+				m_journal->LogInsert(m_journalId, key, value) :
+				m_journal->LogErase(m_journalId, key);
+		}
+		OnStatsChanged();
+		m_journal->Commit(lsn);
+	}
+
+	// must be called after the dictionary or the children have changed. An RMW publishes counters of the change
+	// to the caller of GetSubtreeStats which lowers the flag: a plain load could see the flag raised by an earlier
+	// change, and the caller lowering it could miss counters of this one
+	void OnStatsChanged() const noexcept
+	{
+		for (auto subtree = m_subtreeStats.get(); subtree; subtree = subtree->parent.get())
+			if (subtree->changed.exchange(true, std::memory_order_acq_rel))
+				return;
+	}
+
+	// must be called under m_nodeMutex
+	typename JournalType::Lsn LogRemoveChild(const std::string& name, const VolumeNodeImplPtr& child)
+	{
+		if (!m_journal)
+			return 0;
+
+		return m_journal->LogRemoveChild(m_journalId, name, child->m_journalId);
+	}
+
+	// replays the journal into a new root
+	void Recover()
+	{
+		std::unordered_map<JournalNodeId, VolumeNodeImplPtr> nodes{ { m_journalId, this->shared_from_this() } };
+
+		m_journal->Recover(
+			[&nodes](typename JournalType::Record& record)
 			{
-				std::lock_guard lock(m_mutex);
-				subscribersCopy = m_subscribers;
+				const auto it = nodes.find(record.node);
+				if (it == nodes.end())
+					return; // a change of a removed node
+
+				const auto node = it->second;
+				switch (record.type)
+				{
+				case JournalType::RecordType::Insert:
+					node->m_dict.Insert(record.key, std::move(record.value));
+					break;
+				case JournalType::RecordType::Erase:
+					node->m_dict.Erase(record.key);
+					break;
+				case JournalType::RecordType::InsertChild:
+					nodes[record.child] = node->RecoverChild(record.name, record.child);
+					break;
+				case JournalType::RecordType::RemoveChild:
+				{
+					std::lock_guard lock(node->m_nodeMutex);
+					const auto childIt = node->m_children.find(record.name);
+					if (childIt != node->m_children.end() && childIt->second->m_journalId == record.child)
+						node->m_children.erase(childIt);
+					nodes.erase(record.child);
+					break;
+				}
+				}
+			});
+
+		// recovered keys are accounted at once; keys over a budget are evicted by the next change
+		if (m_eviction)
+			for (const auto& idNodePair : nodes)
+			{
+				const auto& node = idNodePair.second;
+				node->m_dict.ForEachKeyValue(
+					[&node](const KeyT& key, const ValueHolderT& value)
+					{
+						node->m_eviction->OnPresent(key, utils::GetMemorySize(key) + utils::GetMemorySize(value));
+					});
 			}
+	}
 
-			for (auto subscriber : subscribersCopy)
-				subscriber.second->OnNodeAdded(node);
-		}
+	VolumeNodeImplPtr RecoverChild(const std::string& name, JournalNodeId journalId)
+	{
+		std::lock_guard lock(m_nodeMutex);
+
+		auto& child = m_children[name];
+		if (!child || child->m_journalId != journalId)
+			child = CreateChild(name, journalId);
+
+		return child;
+	}
+
+	// the dictionary holds changes back only while the snapshot is taken
+	typename DictType::SnapshotType TakeSnapshot() const
+	{
+		typename DictType::SnapshotType snapshot;
+		m_dict.TakeSnapshot(
+			[&snapshot](auto&& taken)
+			{
+				snapshot = std::forward<decltype(taken)>(taken);
+			});
 
-		void OnNodeRemoved(NodePtr node) override
+		return snapshot;
+	}
+
+	void CollectSnapshots(bool subtree, std::vector<typename DictType::SnapshotType>& snapshots)
+	{
+		ExpireDueKeys(cAllKeys);
+		snapshots.push_back(TakeSnapshot());
+		if (!subtree)
+			return;
+
+		ContainerType children;
 		{
-			SubscribersContainerType subscribersCopy;
+			std::shared_lock lock(m_nodeMutex);
+			children = m_children;
+		}
+
+		for (const auto& nameNodePair : children)
+			nameNodePair.second->CollectSnapshots(true, snapshots);
+	}
+
+	// a dump doesn't block writers: changes made after the snapshot are in the log as well
+	void WriteCheckpoint(typename JournalType::CheckpointWriter& writer)
+	{
+		DictType::ForEachInSnapshot(TakeSnapshot(),
+			[this, &writer](const KeyT& key, const ValueHolderT& value)
 			{
-				std::lock_guard lock(m_mutex);
-				subscribersCopy = m_subscribers;
-			}
+				JournalType::EncodeInsert(writer.GetBuffer(), m_journalId, key, value);
+				writer.FlushIfFull();
+			});
 
-			for (auto subscriber : subscribersCopy)
-				subscriber.second->OnNodeRemoved(node);
+		ContainerType children;
+		{
+			std::shared_lock lock(m_nodeMutex);
+			children = m_children;
 		}
-	private:
-		using SubscribersContainerType = std::unordered_map<Cookie, NodeEventsPtr>;
-		SubscribersContainerType m_subscribers;
-		Cookie m_currentCookie = 1;
-		std::mutex m_mutex;
-	};
+
+		for (const auto& nameNodePair : children)
+		{
+			const auto& child = nameNodePair.second;
+			JournalType::EncodeChild(writer.GetBuffer(), JournalType::RecordType::InsertChild, m_journalId, nameNodePair.first, child->m_journalId);
+			child->WriteCheckpoint(writer);
+		}
+	}
+
+	void DoRemoveChild(const VolumeNodeImplPtr& child)
+	{
+		m_subscriberHolder.OnNodeRemoved(child->GetProxy());
+
+		// It's needed because we want to notify "virtual clients" about removed nodes ASAP
+		// Actually different strategies can be applied for making "virtual clients" actual
+		child->MakeOrphan();
+	}
 
 private:
 	DictType m_dict;
+	const DictOptions m_dictOptions;
+	// null if the tree has no budget
+	const EvictionTreePtr m_evictionTree;
+	std::unique_ptr<EvictionType> m_eviction;
+	const JournalPtr m_journal;
+	const JournalNodeId m_journalId;
 	Priority m_priority;
 	std::string m_name;
 
 	ContainerType m_children;
-	SubscriberHolder m_subscriberHolder;
+	NodeSubscriberHolder<NodeType> m_subscriberHolder;
+	// insertions and erasures of keys; values changed in place aren't reported
+	KeySubscriberHolder<KeyT> m_keySubscriberHolder;
+	ExpirationTableType m_expiration;
+	const SubtreeStatsPtr m_subtreeStats;
 
-	mutable std::shared_mutex m_dictMutex;
 	mutable std::shared_mutex m_nodeMutex;
 };
 
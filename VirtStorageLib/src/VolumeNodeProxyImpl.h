@@ -10,27 +10,30 @@ namespace vs
 namespace internal
 {
 
+//
+// VolumeNodeProxyImpl
+//
+// NodeImplT is a volume node implementation: VolumeNodeImpl or image::ImageNodeImpl
+//
 
-template<typename KeyT, typename ValueHolderT>
-class VolumeNodeImpl;
-
-template<typename KeyT, typename ValueHolderT>
+template<typename KeyT, typename ValueHolderT, typename NodeImplT>
 class VolumeNodeProxyImpl final :
 	public NodeProxyBaseImpl<
 		internal::VolumeNodeBase,
-		VolumeNodeImpl,
+		NodeImplT,
 		KeyT,
 		ValueHolderT>
 {
 public:
 	using NodeProxyBaseImplType = NodeProxyBaseImpl<
 		internal::VolumeNodeBase,
-		VolumeNodeImpl,
+		NodeImplT,
 		KeyT, ValueHolderT>;
 
 	using NodeType = typename NodeProxyBaseImplType::NodeType;
 	using VolumeNodeImplWeakPtr = typename NodeProxyBaseImplType::NodeImplWeakPtr;
 	using typename INodeEventsSubscription<NodeType>::NodeEventsPtr;
+	using typename IKeyEventsSubscription<KeyT>::KeyEventsPtr;
 
 	VolumeNodeProxyImpl(VolumeNodeImplWeakPtr owner, NodeId nodeId) : NodeProxyBaseImplType(owner, nodeId)
 	{
@@ -49,6 +52,44 @@ private:
 		return NodeProxyBaseImplType::GetOwner()->GetPriority();
 	}
 
+	NodeStats GetSubtreeStats() const override
+	{
+		return NodeProxyBaseImplType::GetOwner()->GetSubtreeStats();
+	}
+
+	void InsertWithTtl(const KeyT& key, const ValueHolderT& value, std::chrono::milliseconds ttl) override
+	{
+		NodeProxyBaseImplType::GetOwner()->InsertWithTtl(key, value, ttl);
+	}
+
+	void InsertWithTtl(const KeyT& key, ValueHolderT&& value, std::chrono::milliseconds ttl) override
+	{
+		NodeProxyBaseImplType::GetOwner()->InsertWithTtl(key, std::move(value), ttl);
+	}
+
+	bool Touch(const KeyT& key, std::chrono::milliseconds ttl) override
+	{
+		return NodeProxyBaseImplType::GetOwner()->Touch(key, ttl);
+	}
+
+	void ParallelScan(const ScanOptions& options, const typename NodeType::ScanFunctorType& f) const override
+	{
+		NodeProxyBaseImplType::GetOwner()->ParallelScan(options, f);
+	}
+
+	// IKeyFilter
+	bool MayContain(const KeyT& key) const noexcept override
+	{
+		// a removed node is left to fail when it is called
+		const auto owner = NodeProxyBaseImplType::TryGetOwner();
+		return !owner || owner->MayContain(key);
+	}
+
+	typename IKeyFilter<KeyT>::KeyFilterPtr PinKeyFilter() const noexcept override
+	{
+		return NodeProxyBaseImplType::TryGetOwner();
+	}
+
 	// INodeEventsSubscription
 	Cookie RegisterSubscriber(NodeEventsPtr subscriber) override
 	{
@@ -63,6 +104,21 @@ private:
 
 		return subscription->UnregisterSubscriber(cookie);
 	}
+
+	// IKeyEventsSubscription
+	Cookie RegisterKeySubscriber(KeyEventsPtr subscriber) override
+	{
+		std::shared_ptr<IKeyEventsSubscription<KeyT>> subscription = std::static_pointer_cast<IKeyEventsSubscription<KeyT>>(NodeProxyBaseImplType::GetOwner());
+
+		return subscription->RegisterKeySubscriber(std::move(subscriber));
+	}
+
+	void UnregisterKeySubscriber(Cookie cookie) override
+	{
+		std::shared_ptr<IKeyEventsSubscription<KeyT>> subscription = std::static_pointer_cast<IKeyEventsSubscription<KeyT>>(NodeProxyBaseImplType::GetOwner());
+
+		subscription->UnregisterKeySubscriber(cookie);
+	}
 };
 
 } //namespace internal
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace dict
+{
+
+// Batch operations of dictionary engines process keys[indices[i]] for i < indices.size(),
+// so a batch can be split (e.g. by shards) without copying keys.
+
+// all indices of a batch
+struct IndexSequence
+{
+	size_t size() const noexcept { return count; }
+	size_t operator[](size_t i) const noexcept { return i; }
+
+	size_t count;
+};
+
+// a part of a batch
+struct IndexSpan
+{
+	size_t size() const noexcept { return count; }
+	size_t operator[](size_t i) const noexcept { return data[i]; }
+
+	const size_t* data;
+	size_t count;
+};
+
+// distance (in keys) at which batch lookups prefetch table slots ahead of use
+constexpr size_t cPrefetchDistance = 8;
+
+// a value of a key-value batch: moved out of a batch passed as an rvalue, referenced otherwise
+template<typename KeyValuesT>
+decltype(auto) ForwardValue(KeyValuesT&& keyValues, size_t index)
+{
+	if constexpr (std::is_rvalue_reference_v<KeyValuesT&&>)
+		return std::move(keyValues[index].second);
+	else
+		return (keyValues[index].second);
+}
+
+} //namespace dict
+
+} //namespace internal
+
+} //namespace vs
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include <optional>
+#include <utility>
+
+#include "LockedDict.h"
+#include "BatchIndices.h"
+#include "../utils/BitUtils.h"
+#include "../utils/BloomFilter.h"
+#include "../utils/EpochManager.h"
+#include "../utils/NonCopyable.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace dict
+{
+
+//
+// FilteredDict
+//
+// Keeps a Bloom filter of keys of an inner dictionary engine. Lookups of missing keys mostly
+// stop at the filter, and MayContain lets a virtual node skip mounted volumes that surely don't have a key.
+// A key is added to the filter before it is inserted, so the filter never misses a present key.
+// Erased keys stay in the filter; it is rebuilt from the inner engine once erases or growth
+// make it inaccurate. Readers reach the filter without locks; replaced ones are retired through utils::EpochManager.
+//
+
+template<typename KeyT, typename ValueHolderT, typename InnerT = LockedDict<KeyT, ValueHolderT>, typename HashT = std::hash<KeyT>>
+class FilteredDict :
+	private utils::NonCopyable
+{
+public:
+	using InnerType = InnerT;
+	using SnapshotType = typename InnerT::SnapshotType;
+
+	static constexpr size_t cMinCapacity = 1024;
+	static constexpr PageOrder cPageOrder = InnerT::cPageOrder;
+
+	struct Options
+	{
+		// the filter is sized for this many keys at first and follows the size of a node later
+		size_t expectedKeyCount = cMinCapacity;
+		typename InnerT::Options innerOptions;
+	};
+
+public:
+	explicit FilteredDict(const Options& options = {}) :
+		m_inner{ options.innerOptions }, m_filter{ new utils::BloomFilter(std::max(options.expectedKeyCount, cMinCapacity)) }
+	{
+		m_capacity = m_filter.load(std::memory_order_relaxed)->GetCapacity();
+	}
+
+	~FilteredDict()
+	{
+		// the owning node is being destroyed, so no one can read it anymore
+		delete m_filter.load(std::memory_order_relaxed);
+	}
+
+	template<typename T>
+	bool Insert(const KeyT& key, T&& value)
+	{
+		bool inserted;
+		{
+			std::shared_lock lock(m_rebuildMutex);
+			Add(key);
+			inserted = m_inner.Insert(key, std::forward<T>(value));
+			CountAdded(inserted ? 1 : 0);
+		}
+		RebuildIfNeeded();
+
+		return inserted;
+	}
+
+	template<typename T>
+	bool TryInsert(const KeyT& key, T&& value)
+	{
+		bool inserted;
+		{
+			std::shared_lock lock(m_rebuildMutex);
+			Add(key);
+			inserted = m_inner.TryInsert(key, std::forward<T>(value));
+			CountAdded(inserted ? 1 : 0);
+		}
+		RebuildIfNeeded();
+
+		return inserted;
+	}
+
+	// a replaced key is in the filter already
+	template<typename T>
+	bool Replace(const KeyT& key, T&& value)
+	{
+		return MayContain(key) && m_inner.Replace(key, std::forward<T>(value));
+	}
+
+	// keys missing in the inner engine (false positives of the filter) don't make the filter less accurate
+	bool Erase(const KeyT& key)
+	{
+		if (!MayContain(key) || !m_inner.Erase(key))
+			return false;
+
+		m_erased.fetch_add(1, std::memory_order_relaxed);
+		RebuildIfNeeded();
+		return true;
+	}
+
+	bool Find(const KeyT& key, ValueHolderT& value) const
+	{
+		return MayContain(key) && m_inner.Find(key, value);
+	}
+
+	template<typename F>
+	bool Visit(const KeyT& key, const F& f) const
+	{
+		return MayContain(key) && m_inner.Visit(key, f);
+	}
+
+	bool Contains(const KeyT& key) const
+	{
+		return MayContain(key) && m_inner.Contains(key);
+	}
+
+	template<typename F>
+	void ForEachKeyValue(const F& f)
+	{
+		m_inner.ForEachKeyValue(f);
+	}
+
+	template<typename F>
+	void ForEachInRange(const KeyT& from, const KeyT& to, const F& f)
+	{
+		m_inner.ForEachInRange(from, to, f);
+	}
+
+	template<typename F>
+	void TakeSnapshot(const F& f) const
+	{
+		m_inner.TakeSnapshot(f);
+	}
+
+	template<typename F>
+	static void ForEachInSnapshot(const SnapshotType& snapshot, const F& f)
+	{
+		InnerT::ForEachInSnapshot(snapshot, f);
+	}
+
+	template<typename F>
+	static void ForEachInSnapshotPart(const SnapshotType& snapshot, size_t part, size_t partCount, const F& f)
+	{
+		InnerT::ForEachInSnapshotPart(snapshot, part, partCount, f);
+	}
+
+	bool LowerBound(const KeyT& key, KeyT& foundKey, ValueHolderT& value) const
+	{
+		return m_inner.LowerBound(key, foundKey, value);
+	}
+
+	template<typename KeyValuesT>
+	void NextPage(const KeyT* after, size_t count, PageOrder order, KeyValuesT& page) const
+	{
+		m_inner.NextPage(after, count, order, page);
+	}
+
+	// the inner engine gets only keys passing the filter
+	template<typename IndicesT>
+	size_t MultiFind(const std::vector<KeyT>& keys, const IndicesT& indices, std::vector<std::optional<ValueHolderT>>& values) const
+	{
+		const auto passed = Filter(indices,
+			[&keys](size_t index) -> const KeyT&
+			{
+				return keys[index];
+			});
+
+		if (passed.empty())
+			return 0;
+
+		return m_inner.MultiFind(keys, IndexSpan{ passed.data(), passed.size() }, values);
+	}
+
+	template<typename KeyValuesT, typename IndicesT>
+	size_t MultiInsert(KeyValuesT&& keyValues, const IndicesT& indices)
+	{
+		size_t inserted;
+		{
+			std::shared_lock lock(m_rebuildMutex);
+			for (size_t i = 0; i < indices.size(); i++)
+				Add(keyValues[indices[i]].first);
+
+			inserted = m_inner.MultiInsert(std::forward<KeyValuesT>(keyValues), indices);
+			CountAdded(inserted);
+		}
+		RebuildIfNeeded();
+
+		return inserted;
+	}
+
+	template<typename IndicesT>
+	void MultiErase(const std::vector<KeyT>& keys, const IndicesT& indices, std::vector<size_t>& erased)
+	{
+		const auto passed = Filter(indices,
+			[&keys](size_t index) -> const KeyT&
+			{
+				return keys[index];
+			});
+
+		if (passed.empty())
+			return;
+
+		const auto erasedBefore = erased.size();
+		m_inner.MultiErase(keys, IndexSpan{ passed.data(), passed.size() }, erased);
+		if (erased.size() == erasedBefore)
+			return;
+
+		m_erased.fetch_add(erased.size() - erasedBefore, std::memory_order_relaxed);
+		RebuildIfNeeded();
+	}
+
+	// the filter counts as overhead
+	void AddStats(NodeStats& stats) const noexcept
+	{
+		m_inner.AddStats(stats);
+		stats.overheadBytes += m_capacity.load(std::memory_order_relaxed) * utils::BloomFilter::cBitsPerKey / 8;
+	}
+
+	// false if there is surely no key; never blocks
+	bool MayContain(const KeyT& key) const noexcept
+	{
+		utils::EpochManager::Guard guard;
+		return m_filter.load(std::memory_order_acquire)->MayContain(HashOf(key));
+	}
+
+private:
+	uint64_t HashOf(const KeyT& key) const noexcept
+	{
+		return utils::MixHash(static_cast<uint64_t>(m_hasher(key)));
+	}
+
+	// must be called under a shared lock of m_rebuildMutex, before the key is inserted
+	void Add(const KeyT& key) noexcept
+	{
+		m_filter.load(std::memory_order_relaxed)->Add(HashOf(key));
+	}
+
+	// must be called under the same lock as Add, so a rebuild doesn't reset counts of keys added past it
+	void CountAdded(size_t count) noexcept
+	{
+		if (count != 0)
+			m_added.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	template<typename IndicesT, typename KeyOfT>
+	std::vector<size_t> Filter(const IndicesT& indices, const KeyOfT& keyOf) const
+	{
+		std::vector<size_t> passed;
+		passed.reserve(indices.size());
+
+		utils::EpochManager::Guard guard;
+		const auto filter = m_filter.load(std::memory_order_acquire);
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			if (filter->MayContain(HashOf(keyOf(indices[i]))))
+				passed.push_back(indices[i]);
+		}
+
+		return passed;
+	}
+
+	// only new keys are counted as added: overwriting a key doesn't make the filter less accurate
+	bool NeedsRebuild() const noexcept
+	{
+		const auto capacity = m_capacity.load(std::memory_order_relaxed);
+		return m_added.load(std::memory_order_relaxed) > capacity || m_erased.load(std::memory_order_relaxed) > capacity / 2;
+	}
+
+	// writers wait while a new filter is built, so no key is inserted past it
+	void RebuildIfNeeded()
+	{
+		if (!NeedsRebuild())
+			return;
+
+		std::unique_lock lock(m_rebuildMutex);
+		if (!NeedsRebuild())
+			return;
+
+		// a snapshot is iterated without locking writers of the engine out, and unlike the mutating iteration
+		// it doesn't make the engine copy what it shares with snapshots taken by others
+		SnapshotType snapshot;
+		m_inner.TakeSnapshot(
+			[&snapshot](auto&& taken)
+			{
+				snapshot = std::forward<decltype(taken)>(taken);
+			});
+
+		std::vector<uint64_t> hashes;
+		InnerT::ForEachInSnapshot(snapshot,
+			[this, &hashes](const KeyT& key, const ValueHolderT&)
+			{
+				hashes.push_back(HashOf(key));
+			});
+
+		// room for growth, so a growing node isn't rebuilt too often
+		const auto filter = new utils::BloomFilter(std::max(hashes.size() * 2, cMinCapacity));
+		for (const auto hash : hashes)
+			filter->Add(hash);
+
+		m_added.store(hashes.size(), std::memory_order_relaxed);
+		m_erased.store(0, std::memory_order_relaxed);
+		m_capacity.store(filter->GetCapacity(), std::memory_order_relaxed);
+
+		utils::EpochManager::Retire(m_filter.exchange(filter, std::memory_order_acq_rel));
+	}
+
+private:
+	InnerT m_inner;
+	std::atomic<utils::BloomFilter*> m_filter;
+	std::atomic<size_t> m_capacity{ 0 };
+	std::atomic<size_t> m_added{ 0 };
+	std::atomic<size_t> m_erased{ 0 };
+	std::shared_mutex m_rebuildMutex;
+	HashT m_hasher;
+};
+
+} //namespace dict
+
+} //namespace internal
+
+} //namespace vs
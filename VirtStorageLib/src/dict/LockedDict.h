@@ -0,0 +1,737 @@
+#pragma once
+
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include <optional>
+#include <type_traits>
+
+#include "Cursor.h"
+#include "NodeStats.h"
+#include "BatchIndices.h"
+#include "../utils/BitUtils.h"
+#include "../utils/MemorySize.h"
+#include "../utils/NonCopyable.h"
+#include "../utils/PageCollector.h"
+#include "../utils/TypeTraits.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace dict
+{
+
+//
+// LockedDict
+//
+// Dictionary engine of a volume node: a map guarded by a single reader-writer lock.
+// MapT is any map with the std::unordered_map interface subset
+// (find, try_emplace, insert_or_assign, erase, begin, end).
+// If MapT is ordered (provides lower_bound), ranges are served without a full scan.
+//
+// Every dictionary engine provides:
+//   Options                  - per-volume settings, passed at Volume construction and inherited by children
+//   Insert/TryInsert/Replace - templated on the value reference type; Insert and TryInsert return whether the key is new
+//   Erase/Find/Visit/Contains - Erase returns whether the key was there
+//   ForEachKeyValue
+//   ForEachInRange/LowerBound
+//   NextPage                 - appends up to count key-values with keys greater than a given one in a PageOrder;
+//                            cPageOrder is the one resumed without a scan
+//   MultiFind/MultiInsert/MultiErase - batches over indices of keys (see BatchIndices.h);
+//                            MultiInsert returns the number of new keys; MultiErase appends indices of the keys it has erased
+//   SnapshotType/TakeSnapshot/ForEachInSnapshot - a consistent view of the dictionary
+//                            that is iterated without blocking writers
+//   ForEachInSnapshotPart    - visits one of partCount disjoint parts of a snapshot;
+//                            different parts may be visited concurrently
+//   AddStats                 - adds the key count, payload and overhead bytes to NodeStats without a scan;
+//                            counters a writer has published are seen by a thread synchronized with it
+// and is responsible for its own synchronization.
+//
+// The map is kept in chunks of up to cMaxChunkSize keys, split by ranges of keys (of hashes of keys
+// for hash maps), so an ordered map stays ordered across its chunks. A snapshot shares the chunks
+// with the dictionary; the first change of a chunk after taking it copies only that chunk,
+// so a writer holds the lock for O(cMaxChunkSize) rather than for a copy of the whole map.
+//
+
+template<typename KeyT, typename ValueHolderT, typename MapT = std::unordered_map<KeyT, ValueHolderT>>
+class LockedDict :
+	private utils::NonCopyable
+{
+	struct Table;
+
+public:
+	using MapType = MapT;
+	using SnapshotType = std::shared_ptr<const Table>;
+
+	struct Options
+	{
+	};
+
+	static constexpr size_t cMaxChunkSize = 4096;
+
+public:
+	explicit LockedDict(const Options& = {}) : m_table{ std::make_shared<Table>() }
+	{
+		m_table->chunks.push_back(std::make_shared<MapT>());
+		m_overheadLocked = GetChunkOverhead(*m_table->chunks.front());
+		AccountTableVectors(*m_table);
+		PublishStats(0);
+	}
+
+	template<typename T>
+	bool Insert(const KeyT& key, T&& value)
+	{
+		std::lock_guard lock(m_mutex);
+
+		bool inserted = false;
+		auto payloadBytes = m_payloadBytes.load(std::memory_order_relaxed);
+		ChangeChunk(key,
+			[&](MapT& chunk)
+			{
+				inserted = InsertLocked(chunk, key, std::forward<T>(value), payloadBytes);
+			});
+		PublishStats(payloadBytes);
+		return inserted;
+	}
+
+	template<typename T>
+	bool TryInsert(const KeyT& key, T&& value)
+	{
+		std::lock_guard lock(m_mutex);
+
+		// an existing key changes nothing, so it doesn't copy a shared chunk
+		if (Contains(*m_table, key))
+			return false;
+
+		auto payloadBytes = m_payloadBytes.load(std::memory_order_relaxed);
+		ChangeChunk(key,
+			[&](MapT& chunk)
+			{
+				const auto it = chunk.try_emplace(key, std::forward<T>(value)).first;
+				payloadBytes += EntrySize(it->first, it->second);
+			});
+		PublishStats(payloadBytes);
+		return true;
+	}
+
+	template<typename T>
+	bool Replace(const KeyT& key, T&& value)
+	{
+		std::lock_guard lock(m_mutex);
+
+		// a missing key changes nothing, so it doesn't copy a shared chunk
+		if (!Contains(*m_table, key))
+			return false;
+
+		auto payloadBytes = m_payloadBytes.load(std::memory_order_relaxed);
+		ChangeChunk(key,
+			[&](MapT& chunk)
+			{
+				auto it = chunk.find(key);
+				payloadBytes -= EntrySize(it->first, it->second);
+				it->second = std::forward<T>(value);
+				payloadBytes += EntrySize(it->first, it->second);
+			});
+		PublishStats(payloadBytes);
+		return true;
+	}
+
+	bool Erase(const KeyT& key)
+	{
+		std::lock_guard lock(m_mutex);
+
+		if (!Contains(*m_table, key))
+			return false;
+
+		auto payloadBytes = m_payloadBytes.load(std::memory_order_relaxed);
+		ChangeChunk(key,
+			[&](MapT& chunk)
+			{
+				payloadBytes = EraseLocked(chunk, key, payloadBytes);
+			});
+		PublishStats(payloadBytes);
+		return true;
+	}
+
+	bool Find(const KeyT& key, ValueHolderT& value) const
+	{
+		std::shared_lock lock(m_mutex);
+
+		const auto& chunk = ChunkOf(*m_table, key);
+		auto it = chunk.find(key);
+		if (it == chunk.end())
+			return false;
+
+		value = it->second;
+
+		return true;
+	}
+
+	template<typename F>
+	bool Visit(const KeyT& key, const F& f) const
+	{
+		std::shared_lock lock(m_mutex);
+
+		const auto& chunk = ChunkOf(*m_table, key);
+		auto it = chunk.find(key);
+		if (it == chunk.end())
+			return false;
+
+		f(it->second);
+
+		return true;
+	}
+
+	bool Contains(const KeyT& key) const
+	{
+		std::shared_lock lock(m_mutex);
+
+		return Contains(*m_table, key);
+	}
+
+	template<typename F>
+	void ForEachKeyValue(const F& f)
+	{
+		// exclusive: a functor is allowed to modify values, so the payload is summed up again
+		std::lock_guard lock(m_mutex);
+
+		auto& table = MutableTable();
+		size_t payloadBytes = 0;
+		for (size_t index = 0; index < table.chunks.size(); index++)
+		{
+			for (auto&& keyValue : MutableChunk(table, index))
+			{
+				f(keyValue.first, keyValue.second);
+				payloadBytes += EntrySize(keyValue.first, keyValue.second);
+			}
+		}
+
+		PublishStats(payloadBytes);
+	}
+
+	// [from, to); ordered maps visit keys in ascending order
+	template<typename F>
+	void ForEachInRange(const KeyT& from, const KeyT& to, const F& f)
+	{
+		std::lock_guard lock(m_mutex);
+
+		auto& table = MutableTable();
+		auto payloadBytes = m_payloadBytes.load(std::memory_order_relaxed);
+		const auto visit =
+			[&f, &payloadBytes](const KeyT& key, ValueHolderT& value)
+			{
+				payloadBytes -= EntrySize(key, value);
+				f(key, value);
+				payloadBytes += EntrySize(key, value);
+			};
+
+		if constexpr (IsOrdered())
+		{
+			// only chunks of the range are visited, so only they are copied if they are shared
+			for (auto index = ChunkIndex(table, from); index < table.chunks.size() && (index == 0 || m_less(table.bounds[index - 1], to)); index++)
+			{
+				auto& chunk = MutableChunk(table, index);
+				for (auto it = chunk.lower_bound(from); it != chunk.end() && m_less(it->first, to); ++it)
+					visit(it->first, it->second);
+			}
+		}
+		else
+		{
+			for (size_t index = 0; index < table.chunks.size(); index++)
+			{
+				for (auto&& keyValue : MutableChunk(table, index))
+					if (!m_less(keyValue.first, from) && m_less(keyValue.first, to))
+						visit(keyValue.first, keyValue.second);
+			}
+		}
+
+		PublishStats(payloadBytes);
+	}
+
+	// finds the smallest key not less than the given one
+	bool LowerBound(const KeyT& key, KeyT& foundKey, ValueHolderT& value) const
+	{
+		std::shared_lock lock(m_mutex);
+
+		const auto& table = *m_table;
+		if constexpr (IsOrdered())
+		{
+			// chunks following the key's one have greater keys
+			for (auto index = ChunkIndex(table, key); index < table.chunks.size(); index++)
+			{
+				const auto& chunk = *table.chunks[index];
+				const auto it = chunk.lower_bound(key);
+				if (it != chunk.end())
+				{
+					foundKey = it->first;
+					value = it->second;
+					return true;
+				}
+			}
+
+			return false;
+		}
+		else
+		{
+			const KeyT* resKey = nullptr;
+			const ValueHolderT* resValue = nullptr;
+			for (const auto& chunk : table.chunks)
+				for (const auto& keyValue : *chunk)
+					if (!m_less(keyValue.first, key) && (!resKey || m_less(keyValue.first, *resKey)))
+					{
+						resKey = &keyValue.first;
+						resValue = &keyValue.second;
+					}
+
+			if (!resKey)
+				return false;
+
+			foundKey = *resKey;
+			value = *resValue;
+			return true;
+		}
+	}
+
+	// ordered maps seek to the key in its chunk; hash maps resume at the chunk of the key's hash, chunks following
+	// it have greater hashes, so a page visits O(cMaxChunkSize + count) keys. Another order scans the whole map
+	template<typename KeyValuesT>
+	void NextPage(const KeyT* after, size_t count, PageOrder order, KeyValuesT& page) const
+	{
+		std::shared_lock lock(m_mutex);
+
+		const auto& table = *m_table;
+		if constexpr (IsOrdered())
+		{
+			if (order == cPageOrder)
+			{
+				for (auto index = after ? ChunkIndex(table, *after) : 0; index < table.chunks.size() && count != 0; index++)
+				{
+					const auto& chunk = *table.chunks[index];
+
+					auto it = chunk.begin();
+					if (after)
+					{
+						it = chunk.lower_bound(*after);
+						if (it != chunk.end() && !m_less(*after, it->first))
+							++it;
+					}
+
+					for (; it != chunk.end() && count != 0; ++it, count--)
+						page.emplace_back(it->first, it->second);
+				}
+				return;
+			}
+		}
+
+		// a hash map stops after the chunk which fills the page
+		const auto resumed = !IsOrdered() && order == cPageOrder;
+		utils::PageCollector<KeyT, ValueHolderT, PageLess<KeyT>> collector(after, count, PageLess<KeyT>{ order });
+		for (auto index = resumed && after ? ChunkIndex(table, BoundOf(*after)) : 0; index < table.chunks.size() && !(resumed && collector.IsFull()); index++)
+			for (const auto& keyValue : *table.chunks[index])
+				if (collector.Accepts(keyValue.first))
+					collector.Add(keyValue.first, keyValue.second);
+
+		collector.MoveTo(page);
+	}
+
+	// batches take the lock once; a hash map prefetches slots of keys a few positions ahead
+	template<typename IndicesT>
+	size_t MultiFind(const std::vector<KeyT>& keys, const IndicesT& indices, std::vector<std::optional<ValueHolderT>>& values) const
+	{
+		const auto keyOf = [&keys](size_t index) -> const KeyT& { return keys[index]; };
+
+		std::shared_lock lock(m_mutex);
+
+		const auto& table = *m_table;
+		PrefetchFirst(table, keyOf, indices);
+
+		size_t found = 0;
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			PrefetchAhead(table, keyOf, indices, i);
+
+			const auto index = indices[i];
+			const auto& chunk = ChunkOf(table, keys[index]);
+			const auto it = chunk.find(keys[index]);
+			if (it == chunk.end())
+				continue;
+
+			values[index] = it->second;
+			found++;
+		}
+
+		return found;
+	}
+
+	template<typename KeyValuesT, typename IndicesT>
+	size_t MultiInsert(KeyValuesT&& keyValues, const IndicesT& indices)
+	{
+		const auto keyOf = [&keyValues](size_t index) -> const KeyT& { return keyValues[index].first; };
+
+		std::lock_guard lock(m_mutex);
+
+		PrefetchFirst(*m_table, keyOf, indices);
+
+		size_t inserted = 0;
+		auto payloadBytes = m_payloadBytes.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			PrefetchAhead(*m_table, keyOf, indices, i);
+
+			const auto index = indices[i];
+			ChangeChunk(keyValues[index].first,
+				[&](MapT& chunk)
+				{
+					if (InsertLocked(chunk, keyValues[index].first, ForwardValue(std::forward<KeyValuesT>(keyValues), index), payloadBytes))
+						inserted++;
+				});
+		}
+
+		PublishStats(payloadBytes);
+		return inserted;
+	}
+
+	template<typename IndicesT>
+	void MultiErase(const std::vector<KeyT>& keys, const IndicesT& indices, std::vector<size_t>& erased)
+	{
+		std::lock_guard lock(m_mutex);
+
+		auto payloadBytes = m_payloadBytes.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			const auto& key = keys[indices[i]];
+			if (!Contains(*m_table, key))
+				continue;
+
+			ChangeChunk(key,
+				[&](MapT& chunk)
+				{
+					payloadBytes = EraseLocked(chunk, key, payloadBytes);
+				});
+			erased.push_back(indices[i]);
+		}
+
+		PublishStats(payloadBytes);
+	}
+
+	void AddStats(NodeStats& stats) const noexcept
+	{
+		stats.keyCount += m_keyCount.load(std::memory_order_relaxed);
+		stats.payloadBytes += m_payloadBytes.load(std::memory_order_relaxed);
+		stats.overheadBytes += m_overheadBytes.load(std::memory_order_relaxed);
+	}
+
+	// f is called with the snapshot while changes are held back
+	template<typename F>
+	void TakeSnapshot(const F& f) const
+	{
+		std::shared_lock lock(m_mutex);
+
+		f(SnapshotType{ m_table });
+	}
+
+	template<typename F>
+	static void ForEachInSnapshot(const SnapshotType& snapshot, const F& f)
+	{
+		for (const auto& chunk : snapshot->chunks)
+			for (const auto& keyValue : *chunk)
+				f(keyValue.first, keyValue.second);
+	}
+
+	// parts are made of whole chunks; a snapshot with fewer chunks than parts splits its chunks
+	template<typename F>
+	static void ForEachInSnapshotPart(const SnapshotType& snapshot, size_t part, size_t partCount, const F& f)
+	{
+		const auto& chunks = snapshot->chunks;
+		const auto chunkCount = chunks.size();
+
+		if (chunkCount >= partCount)
+		{
+			for (auto index = chunkCount * part / partCount; index < chunkCount * (part + 1) / partCount; index++)
+				ForEachInMapPart(*chunks[index], 0, 1, f);
+			return;
+		}
+
+		// parts with the same chunkCount * part / partCount share a chunk
+		const auto index = chunkCount * part / partCount;
+		const auto firstPart = (index * partCount + chunkCount - 1) / chunkCount;
+		const auto endPart = ((index + 1) * partCount + chunkCount - 1) / chunkCount;
+		ForEachInMapPart(*chunks[index], part - firstPart, endPart - firstPart, f);
+	}
+
+	static constexpr bool IsOrdered()
+	{
+		return utils::IsOrderedMap<MapT>::value;
+	}
+
+	static constexpr PageOrder cPageOrder = utils::IsOrderedMap<MapT>::value ? PageOrder::Keys : PageOrder::Hashes;
+
+private:
+	// keys of an ordered map are split by their ranges, keys of a hash map by ranges of their hashes
+	using BoundType = std::conditional_t<utils::IsOrderedMap<MapT>::value, KeyT, uint64_t>;
+	using ChunkPtr = std::shared_ptr<MapT>;
+
+	struct Table
+	{
+		std::vector<ChunkPtr> chunks;
+		// the smallest bound of chunks[i + 1]
+		std::vector<BoundType> bounds;
+	};
+
+	// a chunk smaller than that is merged with a neighbor if they fit into half of cMaxChunkSize together
+	static constexpr size_t cMinChunkSize = cMaxChunkSize / 8;
+
+	static decltype(auto) BoundOf(const KeyT& key)
+	{
+		if constexpr (IsOrdered())
+			return (key);
+		else
+			return PageHash(key);
+	}
+
+	static size_t ChunkIndex(const Table& table, const BoundType& bound)
+	{
+		return static_cast<size_t>(std::upper_bound(table.bounds.begin(), table.bounds.end(), bound, std::less<BoundType>{}) - table.bounds.begin());
+	}
+
+	static const MapT& ChunkOf(const Table& table, const KeyT& key)
+	{
+		return *table.chunks[ChunkIndex(table, BoundOf(key))];
+	}
+
+	static bool Contains(const Table& table, const KeyT& key)
+	{
+		const auto& chunk = ChunkOf(table, key);
+		return chunk.find(key) != chunk.end();
+	}
+
+	// a map which can't be split is visited by the first part
+	template<typename F>
+	static void ForEachInMapPart(const MapT& map, size_t part, size_t partCount, const F& f)
+	{
+		if constexpr (utils::HasSplitPoint<MapT>::value)
+		{
+			const auto end = map.split_point(part + 1, partCount);
+			for (auto it = map.split_point(part, partCount); it != end; ++it)
+				f(it->first, it->second);
+		}
+		else if constexpr (utils::HasBuckets<MapT>::value)
+		{
+			const auto bucketCount = map.bucket_count();
+			for (auto bucket = bucketCount * part / partCount; bucket < bucketCount * (part + 1) / partCount; bucket++)
+				for (auto it = map.begin(bucket); it != map.end(bucket); ++it)
+					f(it->first, it->second);
+		}
+		else if (part == 0)
+		{
+			for (const auto& keyValue : map)
+				f(keyValue.first, keyValue.second);
+		}
+	}
+
+	template<typename KeyOfT, typename IndicesT>
+	static void PrefetchFirst(const Table& table, const KeyOfT& keyOf, const IndicesT& indices)
+	{
+		if constexpr (utils::HasPrefetch<MapT>::value)
+		{
+			for (size_t i = 0; i < std::min(cPrefetchDistance, indices.size()); i++)
+				ChunkOf(table, keyOf(indices[i])).prefetch(keyOf(indices[i]));
+		}
+	}
+
+	template<typename KeyOfT, typename IndicesT>
+	static void PrefetchAhead(const Table& table, const KeyOfT& keyOf, const IndicesT& indices, size_t i)
+	{
+		if constexpr (utils::HasPrefetch<MapT>::value)
+		{
+			if (i + cPrefetchDistance < indices.size())
+				ChunkOf(table, keyOf(indices[i + cPrefetchDistance])).prefetch(keyOf(indices[i + cPrefetchDistance]));
+		}
+	}
+
+	static size_t EntrySize(const KeyT& key, const ValueHolderT& value) noexcept
+	{
+		return utils::GetMemorySize(key) + utils::GetMemorySize(value);
+	}
+
+	static size_t GetChunkOverhead(const MapT& chunk) noexcept
+	{
+		return sizeof(MapT) + utils::GetMapOverhead(chunk);
+	}
+
+	// insert_or_assign which accounts the entry; try_emplace leaves the value alone if the key is there.
+	// Returns payloadBytes changed by the entry
+	template<typename T>
+	static bool InsertLocked(MapT& map, const KeyT& key, T&& value, size_t& payloadBytes)
+	{
+		auto [it, inserted] = map.try_emplace(key, std::forward<T>(value));
+		if (!inserted)
+		{
+			payloadBytes -= EntrySize(it->first, it->second);
+			it->second = std::forward<T>(value);
+		}
+
+		payloadBytes += EntrySize(it->first, it->second);
+		return inserted;
+	}
+
+	static size_t EraseLocked(MapT& map, const KeyT& key, size_t payloadBytes)
+	{
+		const auto it = map.find(key);
+		if (it == map.end())
+			return payloadBytes;
+
+		payloadBytes -= EntrySize(it->first, it->second);
+		map.erase(key);
+		return payloadBytes;
+	}
+
+	// calls change with the chunk of the key made exclusive, then splits or merges the chunk
+	// if its size has gone out of bounds; must be called under the exclusive lock
+	template<typename ChangeT>
+	void ChangeChunk(const KeyT& key, const ChangeT& change)
+	{
+		auto& table = MutableTable();
+		const auto index = ChunkIndex(table, BoundOf(key));
+		auto& chunk = MutableChunk(table, index);
+
+		m_keyCountLocked -= chunk.size();
+		m_overheadLocked -= GetChunkOverhead(chunk);
+		change(chunk);
+		m_keyCountLocked += chunk.size();
+		m_overheadLocked += GetChunkOverhead(chunk);
+
+		if (chunk.size() > cMaxChunkSize)
+			SplitChunk(table, index);
+		else if (chunk.size() < cMinChunkSize && table.chunks.size() > 1)
+			MergeChunk(table, index);
+	}
+
+	// splits the chunk at the median bound of its keys; keys with the same bound are kept together
+	void SplitChunk(Table& table, size_t index)
+	{
+		const auto& chunk = *table.chunks[index];
+
+		std::vector<BoundType> keyBounds;
+		keyBounds.reserve(chunk.size());
+		for (const auto& keyValue : chunk)
+			keyBounds.push_back(BoundOf(keyValue.first));
+
+		const auto median = keyBounds.begin() + keyBounds.size() / 2;
+		std::nth_element(keyBounds.begin(), median, keyBounds.end(), std::less<BoundType>{});
+		auto splitter = *median;
+		if (!std::any_of(keyBounds.begin(), keyBounds.end(), [&splitter](const BoundType& bound) { return std::less<BoundType>{}(bound, splitter); }))
+		{
+			// the lower half has a single bound; the upper one starts with the next bound if there is one
+			const BoundType* next = nullptr;
+			for (const auto& bound : keyBounds)
+				if (std::less<BoundType>{}(splitter, bound) && (!next || std::less<BoundType>{}(bound, *next)))
+					next = &bound;
+
+			if (!next)
+				return;
+
+			splitter = *next;
+		}
+
+		auto lower = std::make_shared<MapT>();
+		auto upper = std::make_shared<MapT>();
+		for (const auto& keyValue : chunk)
+			(std::less<BoundType>{}(BoundOf(keyValue.first), splitter) ? lower : upper)->try_emplace(keyValue.first, keyValue.second);
+
+		m_overheadLocked -= GetChunkOverhead(chunk);
+		m_overheadLocked += GetChunkOverhead(*lower) + GetChunkOverhead(*upper);
+
+		table.chunks[index] = std::move(lower);
+		table.chunks.insert(table.chunks.begin() + index + 1, std::move(upper));
+		table.bounds.insert(table.bounds.begin() + index, std::move(splitter));
+		AccountTableVectors(table);
+	}
+
+	void MergeChunk(Table& table, size_t index)
+	{
+		// with the next chunk, or with the previous one for the last chunk
+		const auto first = index + 1 < table.chunks.size() ? index : index - 1;
+		const auto& lower = *table.chunks[first];
+		const auto& upper = *table.chunks[first + 1];
+		if (lower.size() + upper.size() > cMaxChunkSize / 2)
+			return;
+
+		auto merged = std::make_shared<MapT>(lower);
+		for (const auto& keyValue : upper)
+			merged->try_emplace(keyValue.first, keyValue.second);
+
+		m_overheadLocked -= GetChunkOverhead(lower) + GetChunkOverhead(upper);
+		m_overheadLocked += GetChunkOverhead(*merged);
+
+		table.chunks[first] = std::move(merged);
+		table.chunks.erase(table.chunks.begin() + first + 1);
+		table.bounds.erase(table.bounds.begin() + first);
+		AccountTableVectors(table);
+	}
+
+	// vectors of the table are accounted by their capacities
+	void AccountTableVectors(const Table& table) noexcept
+	{
+		m_overheadLocked -= m_tableVectorsBytes;
+		m_tableVectorsBytes = table.chunks.capacity() * sizeof(ChunkPtr) + table.bounds.capacity() * sizeof(BoundType);
+		m_overheadLocked += m_tableVectorsBytes;
+	}
+
+	// must be called under the exclusive lock after a change of the map
+	void PublishStats(size_t payloadBytes) noexcept
+	{
+		m_keyCount.store(m_keyCountLocked, std::memory_order_relaxed);
+		m_payloadBytes.store(payloadBytes, std::memory_order_relaxed);
+		m_overheadBytes.store(m_overheadLocked, std::memory_order_relaxed);
+	}
+
+	// must be called under the exclusive lock.
+	// Taking a reference is an acquire-release change of the counter released by the last snapshot,
+	// so reads of a released snapshot are done before the table or a chunk changes
+	Table& MutableTable()
+	{
+		const auto table = m_table;
+		if (table.use_count() != 2)
+			m_table = std::make_shared<Table>(*table);
+
+		return *m_table;
+	}
+
+	// the table must be mutable
+	static MapT& MutableChunk(Table& table, size_t index)
+	{
+		const auto chunk = table.chunks[index];
+		if (chunk.use_count() != 2)
+			table.chunks[index] = std::make_shared<MapT>(*chunk);
+
+		return *table.chunks[index];
+	}
+
+private:
+	std::shared_ptr<Table> m_table;
+	// written under the exclusive lock, read without it
+	std::atomic<size_t> m_keyCount{ 0 };
+	std::atomic<size_t> m_payloadBytes{ 0 };
+	std::atomic<size_t> m_overheadBytes{ 0 };
+	// counters behind the published ones, changed under the exclusive lock
+	size_t m_keyCountLocked = 0;
+	size_t m_overheadLocked = 0;
+	size_t m_tableVectorsBytes = 0;
+	std::less<KeyT> m_less;
+	mutable std::shared_mutex m_mutex;
+};
+
+} //namespace dict
+
+} //namespace internal
+
+} //namespace vs
@@ -0,0 +1,661 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <vector>
+#include <optional>
+#include <type_traits>
+
+#include "Cursor.h"
+#include "NodeStats.h"
+#include "BatchIndices.h"
+#include "../utils/BitUtils.h"
+#include "../utils/EpochManager.h"
+#include "../utils/MemorySize.h"
+#include "../utils/NonCopyable.h"
+#include "../utils/PageCollector.h"
+#include "../utils/TypeTraits.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace dict
+{
+
+//
+// RcuDict
+//
+// Dictionary engine with a non-blocking read path for read-mostly nodes.
+// Every key-value is an immutable entry referenced from an open-addressing table of atomic pointers.
+// Find and Contains never lock and never write to memory shared with other readers: they announce
+// an epoch in a per-thread record, probe the table and copy the value out. Writers are serialized
+// by a mutex, publish new entries (or a whole new table on growth) with atomic stores
+// and retire replaced ones through utils::EpochManager.
+//
+// Every write allocates an entry, so it suits read-mostly data.
+//
+// Entries are never changed in place, so a snapshot is a list of live entries; writers are held back
+// only while the list is collected. While snapshots of a dictionary exist, entries it retires are held
+// by the dictionary rather than handed to utils::EpochManager, so a long scan delays reclamation of
+// this dictionary only. A snapshot may be passed to and released by any thread, and may outlive the dictionary.
+//
+
+template<typename KeyT, typename ValueHolderT, typename HashT = std::hash<KeyT>, typename KeyEqualT = std::equal_to<KeyT>>
+class RcuDict :
+	private utils::NonCopyable
+{
+	struct Entry;
+	struct Snapshot;
+	struct RetireHold;
+
+public:
+	struct Options
+	{
+	};
+
+	using SnapshotType = std::shared_ptr<const Snapshot>;
+
+	// only the default hash orders slots by PageHash
+	static constexpr PageOrder cPageOrder = std::is_same_v<HashT, std::hash<KeyT>> ? PageOrder::Hashes : PageOrder::Keys;
+
+public:
+	explicit RcuDict(const Options& = {}) : m_table{ new Table(cMinCapacity) }, m_retireHold{ std::make_shared<RetireHold>() }
+	{
+	}
+
+	~RcuDict()
+	{
+		// the owning node is being destroyed, so no one can read it anymore but snapshots
+		auto table = m_table.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < table->capacity; i++)
+		{
+			auto entry = table->slots[i].load(std::memory_order_relaxed);
+			if (IsLive(entry))
+				RetireEntry(entry, false);
+		}
+		delete table;
+	}
+
+	template<typename T>
+	bool Insert(const KeyT& key, T&& value)
+	{
+		std::lock_guard lock(m_writeMutex);
+
+		return InsertLocked(key, std::forward<T>(value));
+	}
+
+	template<typename T>
+	bool TryInsert(const KeyT& key, T&& value)
+	{
+		std::lock_guard lock(m_writeMutex);
+
+		const auto hash = HashOf(key);
+		const auto location = Locate(key, hash);
+		if (location.found != cNotFound)
+			return false;
+
+		InsertEntry(location.free, new Entry{ key, std::forward<T>(value), hash });
+		return true;
+	}
+
+	template<typename T>
+	bool Replace(const KeyT& key, T&& value)
+	{
+		std::lock_guard lock(m_writeMutex);
+
+		const auto hash = HashOf(key);
+		const auto location = Locate(key, hash);
+		if (location.found == cNotFound)
+			return false;
+
+		ReplaceEntry(location.found, new Entry{ key, std::forward<T>(value), hash });
+		return true;
+	}
+
+	bool Erase(const KeyT& key)
+	{
+		std::lock_guard lock(m_writeMutex);
+
+		return EraseLocked(key);
+	}
+
+	bool Find(const KeyT& key, ValueHolderT& value) const
+	{
+		utils::EpochManager::Guard guard;
+
+		if (auto entry = Lookup(key))
+		{
+			value = entry->value;
+			return true;
+		}
+
+		return false;
+	}
+
+	// an entry is immutable and can't be reclaimed while the guard is held
+	template<typename F>
+	bool Visit(const KeyT& key, const F& f) const
+	{
+		utils::EpochManager::Guard guard;
+
+		if (auto entry = Lookup(key))
+		{
+			f(entry->value);
+			return true;
+		}
+
+		return false;
+	}
+
+	bool Contains(const KeyT& key) const
+	{
+		utils::EpochManager::Guard guard;
+
+		return Lookup(key) != nullptr;
+	}
+
+	// a functor gets a copy of every value; a changed copy is published as a new entry
+	template<typename F>
+	void ForEachKeyValue(const F& f)
+	{
+		std::lock_guard lock(m_writeMutex);
+
+		VisitEntries(
+			[](const Entry*)
+			{
+				return true;
+			}, f);
+	}
+
+	// [from, to); requires a full scan
+	template<typename F>
+	void ForEachInRange(const KeyT& from, const KeyT& to, const F& f)
+	{
+		std::lock_guard lock(m_writeMutex);
+
+		VisitEntries(
+			[this, &from, &to](const Entry* entry)
+			{
+				return !m_less(entry->key, from) && m_less(entry->key, to);
+			}, f);
+	}
+
+	bool LowerBound(const KeyT& key, KeyT& foundKey, ValueHolderT& value) const
+	{
+		utils::EpochManager::Guard guard;
+
+		const Entry* res = nullptr;
+		const auto table = m_table.load(std::memory_order_acquire);
+		for (size_t i = 0; i < table->capacity; i++)
+		{
+			const auto entry = table->slots[i].load(std::memory_order_acquire);
+			if (IsLive(entry) && !m_less(entry->key, key) && (!res || m_less(entry->key, res->key)))
+				res = entry;
+		}
+
+		if (!res)
+			return false;
+
+		foundKey = res->key;
+		value = res->value;
+		return true;
+	}
+
+	// slots are homed by the high bits of hashes, so with the default hash they come in PageOrder::Hashes
+	// but for keys probing has moved past their homes. A page resumes at the home of the key and stops at
+	// an empty slot following the homes of all keys it has, which visits O(count) slots on average.
+	// Another order scans the whole table
+	template<typename KeyValuesT>
+	void NextPage(const KeyT* after, size_t count, PageOrder order, KeyValuesT& page) const
+	{
+		if (count == 0)
+			return;
+
+		utils::EpochManager::Guard guard;
+
+		utils::PageCollector<KeyT, ValueHolderT, PageLess<KeyT>> collector(after, count, PageLess<KeyT>{ order });
+		const auto collect =
+			[&collector](const Entry* entry)
+			{
+				if (IsLive(entry) && collector.Accepts(entry->key))
+					collector.Add(entry->key, entry->value);
+			};
+
+		const auto table = m_table.load(std::memory_order_acquire);
+		if (cPageOrder != PageOrder::Hashes || order != cPageOrder)
+		{
+			for (size_t i = 0; i < table->capacity; i++)
+				collect(table->slots[i].load(std::memory_order_acquire));
+
+			collector.MoveTo(page);
+			return;
+		}
+
+		// slots following an empty one have only keys homed after it
+		const auto first = after ? HomeOf(*table, HashOf(*after)) : 0;
+		auto index = first;
+		for (; index < table->capacity; index++)
+		{
+			const auto entry = table->slots[index].load(std::memory_order_acquire);
+			if (!entry && collector.IsFull() && HomeOf(*table, HashOf(collector.GetLast())) <= index)
+				break;
+
+			collect(entry);
+		}
+
+		// keys homed at the end of the table may have wrapped around to its beginning
+		if (index == table->capacity)
+		{
+			for (index = 0; index < first; index++)
+			{
+				const auto entry = table->slots[index].load(std::memory_order_acquire);
+				if (!entry)
+					break;
+
+				collect(entry);
+			}
+		}
+
+		collector.MoveTo(page);
+	}
+
+	// readers of a batch stay in one epoch critical section, writers take the lock once
+	template<typename IndicesT>
+	size_t MultiFind(const std::vector<KeyT>& keys, const IndicesT& indices, std::vector<std::optional<ValueHolderT>>& values) const
+	{
+		utils::EpochManager::Guard guard;
+
+		size_t found = 0;
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			const auto index = indices[i];
+			if (auto entry = Lookup(keys[index]))
+			{
+				values[index] = entry->value;
+				found++;
+			}
+		}
+
+		return found;
+	}
+
+	template<typename KeyValuesT, typename IndicesT>
+	size_t MultiInsert(KeyValuesT&& keyValues, const IndicesT& indices)
+	{
+		std::lock_guard lock(m_writeMutex);
+
+		size_t inserted = 0;
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			const auto index = indices[i];
+			if (InsertLocked(keyValues[index].first, ForwardValue(std::forward<KeyValuesT>(keyValues), index)))
+				inserted++;
+		}
+
+		return inserted;
+	}
+
+	template<typename IndicesT>
+	void MultiErase(const std::vector<KeyT>& keys, const IndicesT& indices, std::vector<size_t>& erased)
+	{
+		std::lock_guard lock(m_writeMutex);
+
+		for (size_t i = 0; i < indices.size(); i++)
+			if (EraseLocked(keys[indices[i]]))
+				erased.push_back(indices[i]);
+	}
+
+	template<typename F>
+	void TakeSnapshot(const F& f) const
+	{
+		std::shared_ptr<Snapshot> snapshot;
+		{
+			std::lock_guard lock(m_writeMutex);
+
+			// entries retired from now on are held until the snapshot is released
+			snapshot = std::make_shared<Snapshot>(m_retireHold);
+
+			const auto table = m_table.load(std::memory_order_relaxed);
+			snapshot->entries.reserve(m_size);
+			for (size_t i = 0; i < table->capacity; i++)
+			{
+				const auto entry = table->slots[i].load(std::memory_order_relaxed);
+				if (IsLive(entry))
+					snapshot->entries.push_back(entry);
+			}
+		}
+
+		f(SnapshotType{ std::move(snapshot) });
+	}
+
+	template<typename F>
+	static void ForEachInSnapshot(const SnapshotType& snapshot, const F& f)
+	{
+		for (const auto entry : snapshot->entries)
+			f(entry->key, entry->value);
+	}
+
+	// different parts may be visited by different threads
+	template<typename F>
+	static void ForEachInSnapshotPart(const SnapshotType& snapshot, size_t part, size_t partCount, const F& f)
+	{
+		const auto& entries = snapshot->entries;
+		for (auto i = entries.size() * part / partCount; i < entries.size() * (part + 1) / partCount; i++)
+			f(entries[i]->key, entries[i]->value);
+	}
+
+	// an entry's hash and the table are overhead
+	void AddStats(NodeStats& stats) const noexcept
+	{
+		const auto keyCount = m_keyCount.load(std::memory_order_relaxed);
+		stats.keyCount += keyCount;
+		stats.payloadBytes += m_payloadBytes.load(std::memory_order_relaxed);
+
+		utils::EpochManager::Guard guard;
+		stats.overheadBytes += m_table.load(std::memory_order_acquire)->capacity * sizeof(std::atomic<Entry*>) +
+			keyCount * (sizeof(Entry) - sizeof(KeyT) - sizeof(ValueHolderT));
+	}
+
+private:
+	static constexpr size_t cMinCapacity = 16;
+	static constexpr size_t cNotFound = static_cast<size_t>(-1);
+
+	struct Entry
+	{
+		const KeyT key;
+		const ValueHolderT value;
+		const uint64_t hash;
+	};
+
+	// entries retired while snapshots of the dictionary exist; shared with the snapshots
+	struct RetireHold
+	{
+		std::mutex mutex;
+		size_t snapshotCount = 0;
+		std::vector<Entry*> entries;
+	};
+
+	// entries collected are pinned by the hold taken before they were collected
+	struct Snapshot :
+		private utils::NonCopyable
+	{
+		explicit Snapshot(std::shared_ptr<RetireHold> hold) : hold{ std::move(hold) }
+		{
+			std::lock_guard lock(this->hold->mutex);
+			this->hold->snapshotCount++;
+		}
+
+		~Snapshot()
+		{
+			std::vector<Entry*> released;
+			{
+				std::lock_guard lock(hold->mutex);
+				if (--hold->snapshotCount == 0)
+					released.swap(hold->entries);
+			}
+
+			// epoch readers of the dictionary may still see entries retired while it was alive
+			for (const auto entry : released)
+				utils::EpochManager::Retire(entry);
+		}
+
+		const std::shared_ptr<RetireHold> hold;
+		std::vector<const Entry*> entries;
+	};
+
+	struct Table
+	{
+		explicit Table(size_t capacity) :
+			capacity{ capacity }, shift{ 64 - utils::CountTrailingZeros(capacity) }, slots{ new std::atomic<Entry*>[capacity] }
+		{
+			for (size_t i = 0; i < capacity; i++)
+				slots[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		const size_t capacity;
+		// a key is homed by the high bits of its hash, so slots keep the order of hashes across growth
+		const uint32_t shift;
+		std::unique_ptr<std::atomic<Entry*>[]> slots;
+	};
+
+	struct Location
+	{
+		size_t found = cNotFound;
+		size_t free = cNotFound;
+	};
+
+	// marks an erased slot; probing continues past it
+	static Entry* Tombstone() noexcept
+	{
+		alignas(Entry) static char tombstone;
+		return reinterpret_cast<Entry*>(&tombstone);
+	}
+
+	static bool IsLive(const Entry* entry) noexcept
+	{
+		return entry && entry != Tombstone();
+	}
+
+	uint64_t HashOf(const KeyT& key) const
+	{
+		return utils::MixHash(static_cast<uint64_t>(m_hasher(key)));
+	}
+
+	static size_t HomeOf(const Table& table, uint64_t hash) noexcept
+	{
+		return static_cast<size_t>(hash >> table.shift);
+	}
+
+	// must be called inside an epoch guard
+	const Entry* Lookup(const KeyT& key) const
+	{
+		const auto hash = HashOf(key);
+		const auto table = m_table.load(std::memory_order_acquire);
+		const auto mask = table->capacity - 1;
+
+		// the table is never filled more than a half, so probing ends at an empty slot
+		for (auto index = HomeOf(*table, hash);; index = (index + 1) & mask)
+		{
+			const auto entry = table->slots[index].load(std::memory_order_acquire);
+			if (!entry)
+				return nullptr;
+
+			if (entry != Tombstone() && entry->hash == hash && m_keyEqual(entry->key, key))
+				return entry;
+		}
+	}
+
+	// writers only
+	Location Locate(const KeyT& key, uint64_t hash) const
+	{
+		Location res;
+
+		const auto table = m_table.load(std::memory_order_relaxed);
+		const auto mask = table->capacity - 1;
+
+		for (auto index = HomeOf(*table, hash);; index = (index + 1) & mask)
+		{
+			const auto entry = table->slots[index].load(std::memory_order_relaxed);
+			if (!entry)
+			{
+				if (res.free == cNotFound)
+					res.free = index;
+				return res;
+			}
+
+			if (entry == Tombstone())
+			{
+				if (res.free == cNotFound)
+					res.free = index;
+			}
+			else if (entry->hash == hash && m_keyEqual(entry->key, key))
+			{
+				res.found = index;
+				return res;
+			}
+		}
+	}
+
+	// writers only
+	template<typename T>
+	bool InsertLocked(const KeyT& key, T&& value)
+	{
+		const auto hash = HashOf(key);
+		const auto location = Locate(key, hash);
+		if (location.found != cNotFound)
+		{
+			ReplaceEntry(location.found, new Entry{ key, std::forward<T>(value), hash });
+			return false;
+		}
+
+		InsertEntry(location.free, new Entry{ key, std::forward<T>(value), hash });
+		return true;
+	}
+
+	// writers only
+	bool EraseLocked(const KeyT& key)
+	{
+		const auto location = Locate(key, HashOf(key));
+		if (location.found == cNotFound)
+			return false;
+
+		auto& slot = m_table.load(std::memory_order_relaxed)->slots[location.found];
+		auto entry = slot.load(std::memory_order_relaxed);
+		slot.store(Tombstone(), std::memory_order_release);
+		m_size--;
+		AccountEntries(nullptr, entry);
+
+		RetireEntry(entry, true);
+		return true;
+	}
+
+	// writers only
+	template<typename PredicateT, typename F>
+	void VisitEntries(const PredicateT& predicate, const F& f)
+	{
+		const auto table = m_table.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < table->capacity; i++)
+		{
+			const auto entry = table->slots[i].load(std::memory_order_relaxed);
+			if (!IsLive(entry) || !predicate(entry))
+				continue;
+
+			ValueHolderT value = entry->value;
+			f(entry->key, value);
+
+			if constexpr (utils::IsEqualityComparable<ValueHolderT>::value)
+			{
+				if (value == entry->value)
+					continue;
+			}
+
+			ReplaceEntry(i, new Entry{ entry->key, std::move(value), entry->hash });
+		}
+	}
+
+	void ReplaceEntry(size_t index, Entry* entry)
+	{
+		auto& slot = m_table.load(std::memory_order_relaxed)->slots[index];
+		const auto oldEntry = slot.load(std::memory_order_relaxed);
+		slot.store(entry, std::memory_order_release);
+		AccountEntries(entry, oldEntry);
+
+		RetireEntry(oldEntry, true);
+	}
+
+	// writers only; an entry is held while snapshots which may have it exist.
+	// Entries of a destroyed dictionary aren't seen by epoch readers anymore, so they are deleted at once
+	void RetireEntry(Entry* entry, bool readable)
+	{
+		{
+			std::lock_guard lock(m_retireHold->mutex);
+			if (m_retireHold->snapshotCount != 0)
+			{
+				m_retireHold->entries.push_back(entry);
+				return;
+			}
+		}
+
+		if (readable)
+			utils::EpochManager::Retire(entry);
+		else
+			delete entry;
+	}
+
+	void InsertEntry(size_t index, Entry* entry)
+	{
+		auto& slot = m_table.load(std::memory_order_relaxed)->slots[index];
+		if (!slot.load(std::memory_order_relaxed))
+			m_used++;
+
+		slot.store(entry, std::memory_order_release);
+		m_size++;
+		AccountEntries(entry, nullptr);
+
+		if (m_used * 2 > m_table.load(std::memory_order_relaxed)->capacity)
+			Rebuild();
+	}
+
+	// writers only; published counters are read without the lock
+	void AccountEntries(const Entry* added, const Entry* removed) noexcept
+	{
+		auto payloadBytes = m_payloadBytes.load(std::memory_order_relaxed);
+		if (added)
+			payloadBytes += utils::GetMemorySize(added->key) + utils::GetMemorySize(added->value);
+		if (removed)
+			payloadBytes -= utils::GetMemorySize(removed->key) + utils::GetMemorySize(removed->value);
+
+		m_payloadBytes.store(payloadBytes, std::memory_order_relaxed);
+		m_keyCount.store(m_size, std::memory_order_relaxed);
+	}
+
+	// a new table shares entries with the old one; only the old slot array is retired
+	void Rebuild()
+	{
+		const auto oldTable = m_table.load(std::memory_order_relaxed);
+		const auto newTable = new Table(utils::NextPowerOfTwo(std::max(cMinCapacity, m_size * 4)));
+		const auto mask = newTable->capacity - 1;
+
+		for (size_t i = 0; i < oldTable->capacity; i++)
+		{
+			const auto entry = oldTable->slots[i].load(std::memory_order_relaxed);
+			if (!IsLive(entry))
+				continue;
+
+			auto index = HomeOf(*newTable, entry->hash);
+			while (newTable->slots[index].load(std::memory_order_relaxed))
+				index = (index + 1) & mask;
+			newTable->slots[index].store(entry, std::memory_order_relaxed);
+		}
+
+		m_table.store(newTable, std::memory_order_release);
+		m_used = m_size;
+
+		utils::EpochManager::Retire(oldTable);
+	}
+
+private:
+	std::atomic<Table*> m_table;
+	size_t m_size = 0;
+	size_t m_used = 0; // live entries and tombstones
+	std::atomic<size_t> m_keyCount{ 0 };
+	std::atomic<size_t> m_payloadBytes{ 0 };
+	const std::shared_ptr<RetireHold> m_retireHold;
+	mutable std::mutex m_writeMutex;
+
+	HashT m_hasher;
+	KeyEqualT m_keyEqual;
+	std::less<KeyT> m_less;
+};
+
+} //namespace dict
+
+} //namespace internal
+
+} //namespace vs
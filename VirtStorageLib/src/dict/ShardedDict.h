@@ -0,0 +1,356 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <type_traits>
+
+#include "LockedDict.h"
+#include "BatchIndices.h"
+#include "../utils/BitUtils.h"
+#include "../utils/NonCopyable.h"
+#include "../utils/ParallelFor.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace dict
+{
+
+//
+// ShardedDict
+//
+// Splits the key space of a node into independently locked shards,
+// so writers touching different shards don't serialize on one lock.
+// ShardT is a dictionary engine used for every shard.
+//
+
+template<typename KeyT, typename ValueHolderT, typename ShardT = LockedDict<KeyT, ValueHolderT>, typename HashT = std::hash<KeyT>>
+class ShardedDict :
+	private utils::NonCopyable
+{
+public:
+	using ShardType = ShardT;
+	using SnapshotType = std::vector<typename ShardT::SnapshotType>;
+
+	static constexpr size_t cDefaultShardCount = 16;
+	// batches of this many keys fill shards in parallel
+	static constexpr size_t cParallelBatchSize = 16384;
+	static constexpr size_t cCacheLineSize = 64;
+	// only the default hash splits shards by PageHash
+	static constexpr PageOrder cPageOrder = std::is_same_v<HashT, std::hash<KeyT>> ? ShardT::cPageOrder : PageOrder::Keys;
+
+	struct Options
+	{
+		// rounded up to a power of two
+		size_t shardCount = cDefaultShardCount;
+		typename ShardT::Options shardOptions;
+	};
+
+public:
+	explicit ShardedDict(const Options& options = {})
+	{
+		const auto shardCount = utils::NextPowerOfTwo(std::max<size_t>(1, options.shardCount));
+
+		while ((size_t{ 1 } << m_shardBits) < shardCount)
+			m_shardBits++;
+
+		m_shards.reserve(shardCount);
+		for (size_t i = 0; i < shardCount; i++)
+			m_shards.push_back(std::make_unique<AlignedShard>(options.shardOptions));
+	}
+
+	template<typename T>
+	bool Insert(const KeyT& key, T&& value)
+	{
+		return ShardFor(key).Insert(key, std::forward<T>(value));
+	}
+
+	template<typename T>
+	bool TryInsert(const KeyT& key, T&& value)
+	{
+		return ShardFor(key).TryInsert(key, std::forward<T>(value));
+	}
+
+	template<typename T>
+	bool Replace(const KeyT& key, T&& value)
+	{
+		return ShardFor(key).Replace(key, std::forward<T>(value));
+	}
+
+	bool Erase(const KeyT& key)
+	{
+		return ShardFor(key).Erase(key);
+	}
+
+	bool Find(const KeyT& key, ValueHolderT& value) const
+	{
+		return ShardFor(key).Find(key, value);
+	}
+
+	template<typename F>
+	bool Visit(const KeyT& key, const F& f) const
+	{
+		return ShardFor(key).Visit(key, f);
+	}
+
+	bool Contains(const KeyT& key) const
+	{
+		return ShardFor(key).Contains(key);
+	}
+
+	// walks shards in turn; only one shard is locked at a time
+	template<typename F>
+	void ForEachKeyValue(const F& f)
+	{
+		for (auto& shard : m_shards)
+			shard->dict.ForEachKeyValue(f);
+	}
+
+	// shards are visited in turn, so keys come in ascending order only within a shard
+	template<typename F>
+	void ForEachInRange(const KeyT& from, const KeyT& to, const F& f)
+	{
+		for (auto& shard : m_shards)
+			shard->dict.ForEachInRange(from, to, f);
+	}
+
+	bool LowerBound(const KeyT& key, KeyT& foundKey, ValueHolderT& value) const
+	{
+		auto found = false;
+		KeyT shardKey;
+		ValueHolderT shardValue;
+
+		for (const auto& shard : m_shards)
+		{
+			if (!shard->dict.LowerBound(key, shardKey, shardValue))
+				continue;
+
+			if (!found || std::less<KeyT>()(shardKey, foundKey))
+			{
+				foundKey = std::move(shardKey);
+				value = std::move(shardValue);
+				found = true;
+			}
+		}
+
+		return found;
+	}
+
+	// shards split the high bits of hashes, so with the default hash they follow each other in PageOrder::Hashes:
+	// a page resumes at the shard of the key and goes on to the next shards until it is full.
+	// In another order every shard gives its own page, the first keys of them make the page
+	template<typename KeyValuesT>
+	void NextPage(const KeyT* after, size_t count, PageOrder order, KeyValuesT& page) const
+	{
+		if (cPageOrder == PageOrder::Hashes && order == cPageOrder)
+		{
+			const auto size = page.size();
+			for (auto shard = after ? ShardIndex(*after) : 0; shard < m_shards.size() && page.size() - size < count; shard++)
+				m_shards[shard]->dict.NextPage(after, count - (page.size() - size), order, page);
+			return;
+		}
+
+		KeyValuesT shardsPage;
+		for (const auto& shard : m_shards)
+			shard->dict.NextPage(after, count, order, shardsPage);
+
+		const auto size = std::min(count, shardsPage.size());
+		std::partial_sort(shardsPage.begin(), shardsPage.begin() + size, shardsPage.end(),
+			[less = PageLess<KeyT>{ order }](const auto& left, const auto& right)
+			{
+				return less(left.first, right.first);
+			});
+
+		std::move(shardsPage.begin(), shardsPage.begin() + size, std::back_inserter(page));
+	}
+
+	// a batch is split by shards, so every shard is locked once
+	template<typename IndicesT>
+	size_t MultiFind(const std::vector<KeyT>& keys, const IndicesT& indices, std::vector<std::optional<ValueHolderT>>& values) const
+	{
+		size_t found = 0;
+		ForEachShardBatch([&keys](size_t index) -> const KeyT& { return keys[index]; }, indices,
+			[&keys, &values, &found](const ShardT& shard, const IndexSpan& shardIndices)
+			{
+				found += shard.MultiFind(keys, shardIndices, values);
+			});
+
+		return found;
+	}
+
+	template<typename KeyValuesT, typename IndicesT>
+	size_t MultiInsert(KeyValuesT&& keyValues, const IndicesT& indices)
+	{
+		// every shard forwards (moves) values of its own indices only, so shards of a bulk load are filled in parallel
+		std::atomic<size_t> inserted{ 0 };
+		ForEachShardBatch([&keyValues](size_t index) -> const KeyT& { return keyValues[index].first; }, indices,
+			[&keyValues, &inserted](ShardT& shard, const IndexSpan& shardIndices)
+			{
+				inserted.fetch_add(shard.MultiInsert(std::forward<KeyValuesT>(keyValues), shardIndices), std::memory_order_relaxed);
+			}, indices.size() >= cParallelBatchSize);
+
+		return inserted.load(std::memory_order_relaxed);
+	}
+
+	template<typename IndicesT>
+	// shards are visited one by one, so they append to the same vector
+	void MultiErase(const std::vector<KeyT>& keys, const IndicesT& indices, std::vector<size_t>& erased)
+	{
+		ForEachShardBatch([&keys](size_t index) -> const KeyT& { return keys[index]; }, indices,
+			[&keys, &erased](ShardT& shard, const IndexSpan& shardIndices)
+			{
+				shard.MultiErase(keys, shardIndices, erased);
+			});
+	}
+
+	// every shard holds its changes back until snapshots of all shards are taken,
+	// so the snapshot is consistent across shards; a shard copies only its own map afterwards
+	template<typename F>
+	void TakeSnapshot(const F& f) const
+	{
+		SnapshotType snapshot;
+		snapshot.reserve(m_shards.size());
+
+		TakeShardSnapshots(0, snapshot, f);
+	}
+
+	template<typename F>
+	static void ForEachInSnapshot(const SnapshotType& snapshot, const F& f)
+	{
+		for (const auto& shardSnapshot : snapshot)
+			ShardT::ForEachInSnapshot(shardSnapshot, f);
+	}
+
+	// parts are made of whole shards or, if there are more parts than shards, of parts of shards
+	template<typename F>
+	static void ForEachInSnapshotPart(const SnapshotType& snapshot, size_t part, size_t partCount, const F& f)
+	{
+		const auto shardParts = (partCount + snapshot.size() - 1) / snapshot.size();
+		const auto totalParts = shardParts * snapshot.size();
+
+		for (auto shardPart = totalParts * part / partCount; shardPart < totalParts * (part + 1) / partCount; shardPart++)
+			ShardT::ForEachInSnapshotPart(snapshot[shardPart / shardParts], shardPart % shardParts, shardParts, f);
+	}
+
+	// shards are summed up one by one, so the sum is consistent only while the node doesn't change
+	void AddStats(NodeStats& stats) const noexcept
+	{
+		for (const auto& shard : m_shards)
+			shard->dict.AddStats(stats);
+	}
+
+	size_t GetShardCount() const noexcept
+	{
+		return m_shards.size();
+	}
+
+private:
+	// keeps locks of neighbouring shards in different cache lines
+	struct alignas(cCacheLineSize) AlignedShard
+	{
+		explicit AlignedShard(const typename ShardT::Options& options) : dict{ options }
+		{
+		}
+
+		ShardT dict;
+	};
+
+	size_t ShardIndex(const KeyT& key) const
+	{
+		if (m_shardBits == 0)
+			return 0;
+
+		// high bits: shards' own tables use the low ones
+		return static_cast<size_t>(utils::MixHash(static_cast<uint64_t>(m_hasher(key))) >> (64 - m_shardBits));
+	}
+
+	// groups batch indices by shards with a counting sort and calls f once for every shard involved;
+	// relative order of keys is kept within a shard, so the last of duplicate keys still wins
+	template<typename KeyOfT, typename IndicesT, typename F>
+	void ForEachShardBatch(const KeyOfT& keyOf, const IndicesT& indices, const F& f, bool parallel = false) const
+	{
+		const auto count = indices.size();
+
+		std::vector<size_t> shardOf(count);
+		std::vector<size_t> offsets(m_shards.size() + 1, 0);
+		for (size_t i = 0; i < count; i++)
+		{
+			shardOf[i] = ShardIndex(keyOf(indices[i]));
+			offsets[shardOf[i] + 1]++;
+		}
+
+		std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+		std::vector<size_t> grouped(count);
+		auto next = offsets;
+		for (size_t i = 0; i < count; i++)
+			grouped[next[shardOf[i]]++] = indices[i];
+
+		const auto shardBatch =
+			[this, &f, &grouped, &offsets](size_t shard)
+			{
+				if (offsets[shard] != offsets[shard + 1])
+					f(m_shards[shard]->dict, IndexSpan{ grouped.data() + offsets[shard], offsets[shard + 1] - offsets[shard] });
+			};
+
+		if (parallel)
+		{
+			utils::ParallelFor(utils::GetParallelism(), m_shards.size(),
+				[&shardBatch](size_t, size_t shard)
+				{
+					shardBatch(shard);
+				});
+			return;
+		}
+
+		for (size_t shard = 0; shard < m_shards.size(); shard++)
+			shardBatch(shard);
+	}
+
+	template<typename F>
+	void TakeShardSnapshots(size_t shard, SnapshotType& snapshot, const F& f) const
+	{
+		if (shard == m_shards.size())
+		{
+			f(static_cast<const SnapshotType&>(snapshot));
+			return;
+		}
+
+		m_shards[shard]->dict.TakeSnapshot(
+			[this, shard, &snapshot, &f](auto&& shardSnapshot)
+			{
+				snapshot.push_back(std::forward<decltype(shardSnapshot)>(shardSnapshot));
+				TakeShardSnapshots(shard + 1, snapshot, f);
+			});
+	}
+
+	ShardT& ShardFor(const KeyT& key)
+	{
+		return m_shards[ShardIndex(key)]->dict;
+	}
+
+	const ShardT& ShardFor(const KeyT& key) const
+	{
+		return m_shards[ShardIndex(key)]->dict;
+	}
+
+private:
+	std::vector<std::unique_ptr<AlignedShard>> m_shards;
+	size_t m_shardBits = 0;
+	HashT m_hasher;
+};
+
+} //namespace dict
+
+} //namespace internal
+
+} //namespace vs
@@ -0,0 +1,180 @@
+#include "ImageFile.h"
+
+#include <cstring>
+#include <cerrno>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "PersistenceException.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace image
+{
+
+namespace
+{
+
+[[noreturn]] void ThrowIoError(const std::string& action, const std::string& path)
+{
+#if defined(_WIN32)
+	throw PersistenceException("Failed to " + action + " " + path + ": error " + std::to_string(::GetLastError()));
+#else
+	throw PersistenceException("Failed to " + action + " " + path + ": " + std::strerror(errno));
+#endif
+}
+
+// checks that count entries of entrySize bytes from offset fit before end
+bool FitsBefore(uint64_t offset, uint64_t count, uint64_t entrySize, uint64_t end) noexcept
+{
+	return offset <= end && count <= (end - offset) / entrySize;
+}
+
+} //namespace
+
+ImageFile::ImageFile(const std::string& path, size_t keySize) : m_path{ path }
+{
+#if defined(_WIN32)
+	const auto file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		ThrowIoError("open", path);
+
+	LARGE_INTEGER size{};
+	if (!::GetFileSizeEx(file, &size) || static_cast<uint64_t>(size.QuadPart) < sizeof(ImageFooter))
+	{
+		::CloseHandle(file);
+		ThrowCorrupted();
+	}
+
+	m_size = static_cast<size_t>(size.QuadPart);
+	m_mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	::CloseHandle(file);
+	if (!m_mapping)
+		ThrowIoError("map", path);
+
+	m_data = static_cast<const char*>(::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_data)
+	{
+		::CloseHandle(m_mapping);
+		ThrowIoError("map", path);
+	}
+#else
+	const auto fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		ThrowIoError("open", path);
+
+	struct stat status {};
+	if (::fstat(fd, &status) != 0 || static_cast<uint64_t>(status.st_size) < sizeof(ImageFooter))
+	{
+		::close(fd);
+		ThrowCorrupted();
+	}
+
+	m_size = static_cast<size_t>(status.st_size);
+	const auto data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED)
+		ThrowIoError("map", path);
+
+	m_data = static_cast<const char*>(data);
+#endif
+
+	try
+	{
+		Validate(keySize);
+	}
+	catch (...)
+	{
+		Unmap();
+		throw;
+	}
+}
+
+ImageFile::~ImageFile()
+{
+	Unmap();
+}
+
+const char* ImageFile::GetBytes(uint64_t begin, uint64_t end) const
+{
+	if (begin > end || end > m_footer->nodesOffset)
+		ThrowCorrupted();
+
+	return m_data + begin;
+}
+
+void ImageFile::Validate(size_t keySize)
+{
+	const auto footerOffset = m_size - sizeof(ImageFooter);
+	if (footerOffset % cImageAlignment != 0)
+		ThrowCorrupted();
+
+	m_footer = reinterpret_cast<const ImageFooter*>(m_data + footerOffset);
+	if (m_footer->magic != cImageMagic || m_footer->version != cImageVersion || m_footer->fileSize != m_size)
+		ThrowCorrupted();
+
+	if (m_footer->keySize != keySize)
+		throw PersistenceException("Image " + m_path + " has keys of another type");
+
+	const auto nodesOffset = m_footer->nodesOffset;
+	const auto nodeCount = m_footer->nodeCount;
+	if (nodeCount == 0 || nodesOffset % cImageAlignment != 0 || !FitsBefore(nodesOffset, nodeCount, sizeof(ImageNodeEntry), footerOffset)
+		|| nodesOffset + nodeCount * sizeof(ImageNodeEntry) != footerOffset)
+		ThrowCorrupted();
+
+	m_nodes = reinterpret_cast<const ImageNodeEntry*>(m_data + nodesOffset);
+
+	// the rest of the image is checked as it is read
+	for (uint64_t i = 0; i < nodeCount; i++)
+	{
+		const auto& node = m_nodes[i];
+
+		const auto childrenValid = node.childCount == 0 ||
+			(node.firstChild > i && FitsBefore(node.firstChild, node.childCount, 1, nodeCount));
+
+		const auto tablesValid = node.keysOffset % cImageAlignment == 0 && node.valueOffsetsOffset % cImageAlignment == 0 &&
+			FitsBefore(node.keysOffset, node.keyCount, keySize, nodesOffset) &&
+			node.keyCount < UINT64_MAX && FitsBefore(node.valueOffsetsOffset, node.keyCount + 1, sizeof(uint64_t), nodesOffset);
+
+		if (!childrenValid || !tablesValid || !FitsBefore(node.nameOffset, node.nameSize, 1, nodesOffset))
+			ThrowCorrupted();
+	}
+}
+
+void ImageFile::Unmap() noexcept
+{
+	if (!m_data)
+		return;
+
+#if defined(_WIN32)
+	::UnmapViewOfFile(m_data);
+	::CloseHandle(m_mapping);
+#else
+	::munmap(const_cast<char*>(m_data), m_size);
+#endif
+	m_data = nullptr;
+}
+
+void ImageFile::ThrowCorrupted() const
+{
+	throw PersistenceException("Corrupted image " + m_path);
+}
+
+} //namespace image
+
+} //namespace internal
+
+} //namespace vs
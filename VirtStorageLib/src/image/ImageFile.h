@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+#include "ImageFormat.h"
+#include "../utils/NonCopyable.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace image
+{
+
+//
+// ImageFile
+//
+// An image mapped into memory read-only. Pages are loaded by the OS on first access,
+// so opening costs the same for any size of an image: only the tables are checked.
+//
+
+class ImageFile :
+	private utils::NonCopyable
+{
+public:
+	// throws PersistenceException if the file cannot be mapped or is not an image with keys of keySize bytes
+	ImageFile(const std::string& path, size_t keySize);
+	~ImageFile();
+
+	const std::string& GetPath() const noexcept
+	{
+		return m_path;
+	}
+
+	uint64_t GetNodeCount() const noexcept
+	{
+		return m_footer->nodeCount;
+	}
+
+	const ImageNodeEntry& GetNode(uint64_t index) const noexcept
+	{
+		return m_nodes[index];
+	}
+
+	std::string_view GetName(const ImageNodeEntry& node) const noexcept
+	{
+		return std::string_view(m_data + node.nameOffset, static_cast<size_t>(node.nameSize));
+	}
+
+	// T is a type of a table of the image (keys or value offsets) placed at offset
+	template<typename T>
+	const T* GetTable(uint64_t offset) const noexcept
+	{
+		return reinterpret_cast<const T*>(m_data + offset);
+	}
+
+	// checks a range of a value read from a value offsets table
+	const char* GetBytes(uint64_t begin, uint64_t end) const;
+
+private:
+	void Validate(size_t keySize);
+	void Unmap() noexcept;
+	[[noreturn]] void ThrowCorrupted() const;
+
+private:
+	std::string m_path;
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+#if defined(_WIN32)
+	void* m_mapping = nullptr;
+#endif
+
+	const ImageFooter* m_footer = nullptr;
+	const ImageNodeEntry* m_nodes = nullptr;
+};
+
+} //namespace image
+
+} //namespace internal
+
+} //namespace vs
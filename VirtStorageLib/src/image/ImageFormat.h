@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace image
+{
+
+//
+// Image format
+//
+// A whole volume tree in one native-endian file, served from a memory mapping as is.
+// The file is written in one pass, so the tables describing it come last:
+//
+//   for every node:
+//     KeyT[keyCount]           sorted keys, aligned to cImageAlignment
+//     uint64_t[keyCount + 1]   file offsets of values; a value ends where the next one begins
+//     values                   encoded with utils::Serialize
+//   names                      node names, not terminated
+//   ImageNodeEntry[nodeCount]  nodes in breadth-first order, the root first; children of a node are
+//                              consecutive entries sorted by name, so a node's index is less than its children's
+//   ImageFooter
+//
+
+constexpr uint32_t cImageMagic = 0x4D495356; // "VSIM"
+constexpr uint32_t cImageVersion = 1;
+constexpr size_t cImageAlignment = 8;
+
+struct ImageFooter
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t keySize;
+	uint32_t reserved;
+	uint64_t nodeCount;
+	uint64_t nodesOffset;
+	uint64_t fileSize;
+};
+
+struct ImageNodeEntry
+{
+	uint64_t nameOffset;
+	uint64_t nameSize;
+	uint64_t firstChild;
+	uint64_t childCount;
+	uint64_t keyCount;
+	uint64_t keysOffset;
+	uint64_t valueOffsetsOffset;
+};
+
+static_assert(std::is_trivially_copyable_v<ImageFooter> && sizeof(ImageFooter) % cImageAlignment == 0);
+static_assert(std::is_trivially_copyable_v<ImageNodeEntry> && sizeof(ImageNodeEntry) % cImageAlignment == 0);
+
+constexpr uint64_t AlignImageOffset(uint64_t offset) noexcept
+{
+	return (offset + cImageAlignment - 1) / cImageAlignment * cImageAlignment;
+}
+
+} //namespace image
+
+} //namespace internal
+
+} //namespace vs
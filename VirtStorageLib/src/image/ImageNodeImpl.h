@@ -0,0 +1,690 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Types.h"
+#include "VolumeNode.h"
+#include "ReadOnlyNodeException.h"
+#include "../intfs/ProxyProvider.h"
+#include "../intfs/NodeInternal.h"
+
+#include "../VolumeNodeBase.h"
+#include "../VolumeNodeProxyImpl.h"
+#include "../NodeIdImpl.h"
+#include "../NodeSubscriberHolder.h"
+#include "../utils/ParallelFor.h"
+#include "../utils/NodePath.h"
+#include "../utils/PageCollector.h"
+#include "ImageFile.h"
+#include "ImageWriter.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace image
+{
+
+//
+// ImageNodeImpl
+//
+// A read-only volume node served from an image file (see ImageFormat.h) mapped into memory.
+// Keys are searched right in the mapping, a value is decoded only when it is read.
+// Node objects of a subtree are created on first access to it.
+// Calls that would change the tree throw ReadOnlyNodeException; the ones that would change nothing
+// (Erase of a missing key, Replace of a missing key, InsertChild of an existing child, etc.) work as usual,
+// so an image behaves as a volume nobody writes to when it is mounted along with writable ones.
+//
+
+template<typename KeyT, typename ValueHolderT>
+class ImageNodeImpl final :
+	public NodeIdImpl<VolumeNodeBase<KeyT, ValueHolderT>>,
+	public IProxyProvider<IVolumeNode<KeyT, ValueHolderT>>,
+	public INodeInternal,
+	public std::enable_shared_from_this<ImageNodeImpl<KeyT, ValueHolderT>>
+{
+
+public:
+	using VolumeNodeBaseType = NodeIdImpl<VolumeNodeBase<KeyT, ValueHolderT>>;
+	using ImageNodeImplType = ImageNodeImpl<KeyT, ValueHolderT>;
+	using ImageNodeImplPtr = std::shared_ptr<ImageNodeImplType>;
+
+	using NodeType = IVolumeNode<KeyT, ValueHolderT>;
+
+	using typename NodeType::ForEachKeyValueFunctorType;
+	using typename NodeType::ForEachConstKeyValueFunctorType;
+	using typename NodeType::CursorType;
+	using typename NodeType::ScanFunctorType;
+	using typename NodeType::VisitFunctorType;
+	using typename NodeType::KeysType;
+	using typename NodeType::KeyValuesType;
+	using typename NodeType::FoundValuesType;
+
+	using typename INodeContainer<NodeType>::NodePtr;
+
+	using typename INodeContainer<NodeType>::ForEachFunctorType;
+	using typename INodeContainer<NodeType>::FindIfFunctorType;
+	using typename INodeContainer<NodeType>::RemoveIfFunctorType;
+	using typename INodeContainer<NodeType>::ChildCursorType;
+	using typename INodeContainer<NodeType>::ChildrenType;
+
+	using typename INodeEventsSubscription<NodeType>::NodeEventsPtr;
+	using typename IKeyEventsSubscription<KeyT>::KeyEventsPtr;
+
+	using ImageFilePtr = std::shared_ptr<const ImageFile>;
+
+public:
+	// the root of an image; nodes of the tree keep the file mapped
+	static ImageNodeImplPtr CreateInstance(const std::string& path, Priority priority)
+	{
+		static_assert(IsImageable<KeyT, ValueHolderT>(), "Keys of an image must be trivially copyable and values serializable");
+
+		auto file = std::make_shared<const ImageFile>(path, sizeof(KeyT));
+		return std::shared_ptr<ImageNodeImpl>(new ImageNodeImpl(std::move(file), 0, priority));
+	}
+
+	// INode
+	const std::string& GetName() const noexcept override
+	{
+		return m_name;
+	}
+
+	// keys, encoded values and the offsets of values as they are in the mapped file
+	NodeStats GetStats() const override
+	{
+		auto stats = GetEntryStats(m_file->GetNode(m_index));
+
+		std::lock_guard lock(m_nodeMutex);
+		if (m_orphan)
+			stats.childCount = 0;
+
+		return stats;
+	}
+
+	void Insert(const KeyT&, const ValueHolderT&) override
+	{
+		throw ReadOnlyError();
+	}
+
+	void Insert(const KeyT&, ValueHolderT&&) override
+	{
+		throw ReadOnlyError();
+	}
+
+	void Erase(const KeyT& key) override
+	{
+		if (Contains(key))
+			throw ReadOnlyError();
+	}
+
+	bool Find(const KeyT& key, ValueHolderT& value) const override
+	{
+		const auto index = FindIndex(key);
+		if (index == m_keyCount)
+			return false;
+
+		ReadValue(index, value);
+		return true;
+	}
+
+	// f gets a value decoded from the image
+	bool Visit(const KeyT& key, const VisitFunctorType& f) const override
+	{
+		ValueHolderT value;
+		if (!Find(key, value))
+			return false;
+
+		f(value);
+		return true;
+	}
+
+	bool Contains(const KeyT& key) const override
+	{
+		return FindIndex(key) != m_keyCount;
+	}
+
+	bool FindValueByPath(const std::string& path, const KeyT& key, ValueHolderT& value) const override
+	{
+		const auto node = FindNodeByPath(path);
+
+		return node && node->Find(key, value);
+	}
+
+	bool TryInsert(const KeyT& key, const ValueHolderT&) override
+	{
+		return TryInsertImpl(key);
+	}
+
+	bool TryInsert(const KeyT& key, ValueHolderT&&) override
+	{
+		return TryInsertImpl(key);
+	}
+
+	bool Replace(const KeyT& key, const ValueHolderT&) override
+	{
+		return ReplaceImpl(key);
+	}
+
+	bool Replace(const KeyT& key, ValueHolderT&&) override
+	{
+		return ReplaceImpl(key);
+	}
+
+	// keys are visited in ascending order; changes f makes to values are not kept
+	void ForEachKeyValue(const ForEachKeyValueFunctorType& f) override
+	{
+		ForEachFrom(0, f,
+			[](const KeyT&)
+			{
+				return true;
+			});
+	}
+
+	// an image never changes, so it is a snapshot itself
+	void ForEachKeyValueSnapshot(const ForEachConstKeyValueFunctorType& f) const override
+	{
+		ForEachFrom(0, f,
+			[](const KeyT&)
+			{
+				return true;
+			});
+	}
+
+	void ForEachInRange(const KeyT& from, const KeyT& to, const ForEachKeyValueFunctorType& f) override
+	{
+		ForEachFrom(LowerBoundIndex(from), f,
+			[&to](const KeyT& key)
+			{
+				return key < to;
+			});
+	}
+
+	bool LowerBound(const KeyT& key, KeyT& foundKey, ValueHolderT& value) const override
+	{
+		const auto index = LowerBoundIndex(key);
+		if (index == m_keyCount)
+			return false;
+
+		foundKey = m_keys[index];
+		ReadValue(index, value);
+		return true;
+	}
+
+	PageOrder GetPageOrder() const override
+	{
+		return PageOrder::Keys;
+	}
+
+	// keys are sorted, so a page in another order scans all of them
+	CursorType NextKeyValues(const CursorType& cursor, size_t count, KeyValuesType& keyValues) const override
+	{
+		keyValues.clear();
+		if (cursor.IsEnd())
+			return cursor;
+
+		const auto order = cursor.GetOrder().value_or(PageOrder::Keys);
+		if (order == PageOrder::Keys)
+		{
+			auto index = cursor.GetLast() ? UpperBoundIndex(*cursor.GetLast()) : 0;
+			for (; index < m_keyCount && keyValues.size() < count; index++)
+			{
+				keyValues.emplace_back(m_keys[index], ValueHolderT{});
+				ReadValue(index, keyValues.back().second);
+			}
+		}
+		else
+		{
+			utils::PageCollector<KeyT, ValueHolderT, PageLess<KeyT>> collector(cursor.GetLast(), count, PageLess<KeyT>{ order });
+			for (size_t index = 0; index < m_keyCount; index++)
+			{
+				if (!collector.Accepts(m_keys[index]))
+					continue;
+
+				ValueHolderT value;
+				ReadValue(index, value);
+				collector.Add(m_keys[index], std::move(value));
+			}
+
+			collector.MoveTo(keyValues);
+		}
+
+		return cursor.InOrder(order).Following(count, keyValues.size(),
+			[&keyValues]()
+			{
+				return keyValues.back().first;
+			});
+	}
+
+	size_t MultiFind(const KeysType& keys, FoundValuesType& values) const override
+	{
+		values.assign(keys.size(), std::nullopt);
+
+		size_t found = 0;
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			const auto index = FindIndex(keys[i]);
+			if (index == m_keyCount)
+				continue;
+
+			ReadValue(index, values[i].emplace());
+			found++;
+		}
+
+		return found;
+	}
+
+	void MultiInsert(const KeyValuesType& keyValues) override
+	{
+		if (!keyValues.empty())
+			throw ReadOnlyError();
+	}
+
+	void MultiInsert(KeyValuesType&& keyValues) override
+	{
+		if (!keyValues.empty())
+			throw ReadOnlyError();
+	}
+
+	void MultiErase(const KeysType& keys) override
+	{
+		if (std::any_of(keys.begin(), keys.end(), [this](const KeyT& key) { return Contains(key); }))
+			throw ReadOnlyError();
+	}
+
+	Priority GetPriority() const noexcept override
+	{
+		return m_priority;
+	}
+
+	// an image never changes, so the subtree is summed up from the node table without creating its nodes
+	NodeStats GetSubtreeStats() const override
+	{
+		auto stats = GetStats();
+		if (stats.childCount == 0)
+			return stats;
+
+		std::vector<uint64_t> nodes{ m_index };
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			const auto& entry = m_file->GetNode(nodes[i]);
+			for (auto child = entry.firstChild; child < entry.firstChild + entry.childCount; child++)
+			{
+				stats += GetEntryStats(m_file->GetNode(child));
+				nodes.push_back(child);
+			}
+		}
+
+		return stats;
+	}
+
+	void InsertWithTtl(const KeyT&, const ValueHolderT&, std::chrono::milliseconds) override
+	{
+		throw ReadOnlyError();
+	}
+
+	void InsertWithTtl(const KeyT&, ValueHolderT&&, std::chrono::milliseconds) override
+	{
+		throw ReadOnlyError();
+	}
+
+	bool Touch(const KeyT& key, std::chrono::milliseconds) override
+	{
+		if (!Contains(key))
+			return false;
+
+		throw ReadOnlyError();
+	}
+
+	// keys of a node are split into ranges of the same size
+	void ParallelScan(const ScanOptions& options, const ScanFunctorType& f) const override
+	{
+		std::vector<const ImageNodeImpl*> nodes{ this };
+		std::vector<ContainerType> holders;
+		for (size_t i = 0; options.subtree && i < nodes.size(); i++)
+		{
+			holders.push_back(nodes[i]->GetChildren());
+			for (const auto& child : holders.back())
+				nodes.push_back(child.get());
+		}
+
+		const auto workerCount = GetScanWorkerCount(options);
+		const auto partCount = workerCount == 1 ? 1 : workerCount * cScanPartsPerWorker;
+
+		utils::ParallelFor(workerCount, nodes.size() * partCount,
+			[&nodes, &f, partCount](size_t worker, size_t item)
+			{
+				const auto node = nodes[item / partCount];
+				const auto part = item % partCount;
+
+				ValueHolderT value;
+				for (auto index = node->m_keyCount * part / partCount; index < node->m_keyCount * (part + 1) / partCount; index++)
+				{
+					const KeyT key = node->m_keys[index];
+					node->ReadValue(index, value);
+					f(worker, key, value);
+				}
+			});
+	}
+
+	// IKeyFilter: keys out of the node's range are skipped without a search
+	bool MayContain(const KeyT& key) const noexcept override
+	{
+		return m_keyCount != 0 && !(key < m_keys[0]) && !(m_keys[m_keyCount - 1] < key);
+	}
+
+	typename IKeyFilter<KeyT>::KeyFilterPtr PinKeyFilter() const noexcept override
+	{
+		return this->shared_from_this();
+	}
+
+	// INodeContainer
+	NodePtr InsertChild(const std::string& name) override
+	{
+		auto child = FindChild(name);
+		if (!child)
+			throw ReadOnlyError();
+
+		return child;
+	}
+
+	void ForEachChild(const ForEachFunctorType& f) const override
+	{
+		for (const auto& child : GetChildren())
+			f(child->GetProxy());
+	}
+
+	NodePtr FindChild(const std::string& name) const override
+	{
+		const auto child = FindChildNode(name);
+
+		return child ? child->GetProxy() : nullptr;
+	}
+
+	NodePtr FindByPath(const std::string& path) const override
+	{
+		const auto node = FindNodeByPath(path);
+
+		return node ? node->GetProxy() : nullptr;
+	}
+
+	// every node of the path must exist
+	NodePtr InsertChildPath(const std::string& path) override
+	{
+		auto node = FindByPath(path);
+		if (!node)
+			throw ReadOnlyError();
+
+		return node;
+	}
+
+	ChildCursorType NextChildren(const ChildCursorType& cursor, size_t count, ChildrenType& children) const override
+	{
+		children.clear();
+		if (cursor.IsEnd())
+			return cursor;
+
+		const auto allChildren = GetChildren();
+		auto it = allChildren.begin();
+		if (cursor.GetLast())
+			it = std::upper_bound(allChildren.begin(), allChildren.end(), *cursor.GetLast(),
+				[](const std::string& name, const ImageNodeImplPtr& child)
+				{
+					return name < child->GetName();
+				});
+
+		for (; it != allChildren.end() && children.size() < count; ++it)
+			children.push_back((*it)->GetProxy());
+
+		return cursor.Following(count, children.size(),
+			[&children]()
+			{
+				return children.back()->GetName();
+			});
+	}
+
+	NodePtr FindChildIf(const FindIfFunctorType& f) const override
+	{
+		for (const auto& child : GetChildren())
+		{
+			auto proxy = child->GetProxy();
+			if (f(proxy))
+				return proxy;
+		}
+
+		return nullptr;
+	}
+
+	void RemoveChild(const std::string& name) override
+	{
+		if (FindChild(name))
+			throw ReadOnlyError();
+	}
+
+	void RemoveChildIf(const RemoveIfFunctorType& f) override
+	{
+		if (FindChildIf(f))
+			throw ReadOnlyError();
+	}
+
+private:
+	// INodeEventsSubscription
+	Cookie RegisterSubscriber(NodeEventsPtr subscriber) override
+	{
+		return m_subscriberHolder.Add(subscriber);
+	}
+
+	void UnregisterSubscriber(Cookie cookie) override
+	{
+		m_subscriberHolder.Remove(cookie);
+	}
+
+	// IKeyEventsSubscription; keys of an image never change
+	Cookie RegisterKeySubscriber(KeyEventsPtr) override
+	{
+		return INVALID_COOKIE;
+	}
+
+	void UnregisterKeySubscriber(Cookie) override
+	{
+	}
+
+	// IProxyProvider
+	NodePtr GetProxy() override
+	{
+		return VolumeNodeProxyImpl<KeyT, ValueHolderT, ImageNodeImpl>::CreateInstance(this->shared_from_this(), VolumeNodeBaseType::GetId());
+	}
+
+	void MakeOrphan() override
+	{
+		ContainerType children;
+		{
+			std::lock_guard lock(m_nodeMutex);
+			m_orphan = true;
+			children.swap(m_children);
+		}
+
+		for (const auto& child : children)
+		{
+			m_subscriberHolder.OnNodeRemoved(child->GetProxy());
+			child->MakeOrphan();
+		}
+	}
+
+private:
+	using ContainerType = std::vector<ImageNodeImplPtr>;
+
+	static constexpr size_t cScanPartsPerWorker = 4;
+
+private:
+	ImageNodeImpl(ImageFilePtr file, uint64_t index, Priority priority) :
+		m_file{ std::move(file) }, m_index{ index }, m_priority{ priority }
+	{
+		const auto& entry = m_file->GetNode(m_index);
+
+		m_name = m_file->GetName(entry);
+		m_keys = m_file->template GetTable<KeyT>(entry.keysOffset);
+		m_valueOffsets = m_file->template GetTable<uint64_t>(entry.valueOffsetsOffset);
+		m_keyCount = static_cast<size_t>(entry.keyCount);
+	}
+
+	NodeStats GetEntryStats(const ImageNodeEntry& entry) const noexcept
+	{
+		const auto keyCount = static_cast<size_t>(entry.keyCount);
+		const auto valueOffsets = m_file->template GetTable<uint64_t>(entry.valueOffsetsOffset);
+
+		NodeStats stats;
+		stats.keyCount = keyCount;
+		stats.payloadBytes = keyCount * sizeof(KeyT) + static_cast<size_t>(valueOffsets[keyCount] - valueOffsets[0]);
+		stats.overheadBytes = (keyCount + 1) * sizeof(uint64_t);
+		stats.childCount = static_cast<size_t>(entry.childCount);
+		return stats;
+	}
+
+	ReadOnlyNodeException ReadOnlyError() const noexcept
+	{
+		return ReadOnlyNodeException(VolumeNodeBaseType::GetId());
+	}
+
+	// a conditional change fails as usual if it wouldn't change anything
+	bool TryInsertImpl(const KeyT& key) const
+	{
+		if (Contains(key))
+			return false;
+
+		throw ReadOnlyError();
+	}
+
+	bool ReplaceImpl(const KeyT& key) const
+	{
+		if (!Contains(key))
+			return false;
+
+		throw ReadOnlyError();
+	}
+
+	size_t LowerBoundIndex(const KeyT& key) const
+	{
+		return static_cast<size_t>(std::lower_bound(m_keys, m_keys + m_keyCount, key) - m_keys);
+	}
+
+	size_t UpperBoundIndex(const KeyT& key) const
+	{
+		return static_cast<size_t>(std::upper_bound(m_keys, m_keys + m_keyCount, key) - m_keys);
+	}
+
+	// returns m_keyCount if there is no key
+	size_t FindIndex(const KeyT& key) const
+	{
+		const auto index = LowerBoundIndex(key);
+		if (index != m_keyCount && !(key < m_keys[index]))
+			return index;
+
+		return m_keyCount;
+	}
+
+	void ReadValue(size_t index, ValueHolderT& value) const
+	{
+		const auto begin = m_valueOffsets[index];
+		const auto end = m_valueOffsets[index + 1];
+
+		utils::BinaryReader reader(m_file->GetBytes(begin, end), static_cast<size_t>(end - begin));
+		utils::Deserialize(reader, value);
+	}
+
+	template<typename FunctorT, typename InRangeT>
+	void ForEachFrom(size_t index, const FunctorT& f, const InRangeT& inRange) const
+	{
+		for (; index < m_keyCount; index++)
+		{
+			const KeyT key = m_keys[index];
+			if (!inRange(key))
+				break;
+
+			ValueHolderT value;
+			ReadValue(index, value);
+			f(key, value);
+		}
+	}
+
+	ContainerType GetChildren() const
+	{
+		std::lock_guard lock(m_nodeMutex);
+
+		LoadChildrenLocked();
+
+		return m_children;
+	}
+
+	// the vector of children is not copied
+	ImageNodeImplPtr FindChildNode(const std::string& name) const
+	{
+		std::lock_guard lock(m_nodeMutex);
+
+		LoadChildrenLocked();
+
+		// children are sorted by name in an image
+		const auto it = std::lower_bound(m_children.begin(), m_children.end(), name,
+			[](const ImageNodeImplPtr& child, const std::string& name)
+			{
+				return child->GetName() < name;
+			});
+
+		if (it != m_children.end() && (*it)->GetName() == name)
+			return *it;
+
+		return nullptr;
+	}
+
+	ImageNodeImplPtr FindNodeByPath(const std::string& path) const
+	{
+		return utils::WalkPath(std::const_pointer_cast<ImageNodeImpl>(this->shared_from_this()), path,
+			[](const ImageNodeImpl& node, const std::string& name)
+			{
+				return node.FindChildNode(name);
+			});
+	}
+
+	// must be called under m_nodeMutex
+	void LoadChildrenLocked() const
+	{
+		if (!m_childrenLoaded && !m_orphan)
+		{
+			const auto& entry = m_file->GetNode(m_index);
+
+			m_children.reserve(static_cast<size_t>(entry.childCount));
+			for (uint64_t i = 0; i < entry.childCount; i++)
+				m_children.push_back(ImageNodeImplPtr(new ImageNodeImpl(m_file, entry.firstChild + i, m_priority)));
+
+			m_childrenLoaded = true;
+		}
+	}
+
+private:
+	const ImageFilePtr m_file;
+	const uint64_t m_index;
+	Priority m_priority;
+	std::string m_name;
+
+	const KeyT* m_keys = nullptr;
+	const uint64_t* m_valueOffsets = nullptr;
+	size_t m_keyCount = 0;
+
+	mutable ContainerType m_children;
+	mutable bool m_childrenLoaded = false;
+	bool m_orphan = false;
+	NodeSubscriberHolder<NodeType> m_subscriberHolder;
+
+	mutable std::mutex m_nodeMutex;
+};
+
+} //namespace image
+
+} //namespace internal
+
+} //namespace vs
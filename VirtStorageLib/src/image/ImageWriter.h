@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "VolumeNode.h"
+#include "PersistenceException.h"
+
+#include "ImageFormat.h"
+#include "../persistence/LogDirectory.h"
+#include "../utils/NonCopyable.h"
+#include "../utils/Serialization.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace image
+{
+
+template<typename KeyT, typename ValueHolderT>
+constexpr bool IsImageable()
+{
+	return std::is_trivially_copyable_v<KeyT> && alignof(KeyT) <= cImageAlignment && utils::IsSerializable<ValueHolderT>::value;
+}
+
+//
+// ImageWriter
+//
+// Writes a tree in the image format (see ImageFormat.h) in one pass keeping
+// key-values of one node in memory at a time. The tree must not change while it is written.
+//
+
+template<typename KeyT, typename ValueHolderT>
+class ImageWriter :
+	private utils::NonCopyable
+{
+public:
+	using NodeType = IVolumeNode<KeyT, ValueHolderT>;
+	using NodePtr = typename NodeType::NodePtr;
+
+public:
+	// the image is written next to path and replaces it once complete
+	static void Write(const NodePtr& root, const std::string& path)
+	{
+		static_assert(IsImageable<KeyT, ValueHolderT>(), "Keys of an image must be trivially copyable and values serializable");
+
+		const auto tempPath = path + ".tmp";
+		try
+		{
+			persistence::LogFile file(tempPath, true);
+			ImageWriter writer(file);
+			writer.WriteTree(root);
+			file.Sync();
+		}
+		catch (...)
+		{
+			std::error_code error;
+			std::filesystem::remove(tempPath, error);
+			throw;
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tempPath, path, error);
+		if (error)
+			throw PersistenceException("Failed to replace " + path + ": " + error.message());
+	}
+
+private:
+	explicit ImageWriter(persistence::LogFile& file) : m_file{ file }
+	{
+	}
+
+	void WriteTree(const NodePtr& root)
+	{
+		// nodes are numbered breadth-first, so children of a node get consecutive entries
+		std::vector<NodePtr> nodes{ root };
+		std::vector<ImageNodeEntry> entries(1);
+		std::string names;
+
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			std::vector<NodePtr> children;
+			nodes[i]->ForEachChild(
+				[&children](NodePtr child)
+				{
+					children.push_back(std::move(child));
+				});
+
+			std::sort(children.begin(), children.end(),
+				[](const NodePtr& left, const NodePtr& right)
+				{
+					return left->GetName() < right->GetName();
+				});
+
+			auto& entry = entries[i];
+			entry.firstChild = nodes.size();
+			entry.childCount = children.size();
+
+			// made absolute once the names are written
+			const auto name = nodes[i]->GetName();
+			entry.nameOffset = names.size();
+			entry.nameSize = name.size();
+			names += name;
+
+			WriteNode(*nodes[i], entry);
+
+			nodes[i] = nullptr;
+			nodes.insert(nodes.end(), std::make_move_iterator(children.begin()), std::make_move_iterator(children.end()));
+			entries.resize(nodes.size());
+		}
+
+		const auto namesOffset = m_offset;
+		Write(names.data(), names.size());
+
+		for (auto& entry : entries)
+			entry.nameOffset += namesOffset;
+
+		Align();
+		ImageFooter footer{};
+		footer.magic = cImageMagic;
+		footer.version = cImageVersion;
+		footer.keySize = sizeof(KeyT);
+		footer.nodeCount = entries.size();
+		footer.nodesOffset = m_offset;
+		footer.fileSize = m_offset + entries.size() * sizeof(ImageNodeEntry) + sizeof(ImageFooter);
+
+		Write(entries.data(), entries.size() * sizeof(ImageNodeEntry));
+		Write(&footer, sizeof(footer));
+	}
+
+	void WriteNode(NodeType& node, ImageNodeEntry& entry)
+	{
+		std::vector<std::pair<KeyT, ValueHolderT>> keyValues;
+		node.ForEachKeyValue(
+			[&keyValues](const KeyT& key, ValueHolderT& value)
+			{
+				keyValues.emplace_back(key, value);
+			});
+
+		std::sort(keyValues.begin(), keyValues.end(),
+			[](const auto& left, const auto& right)
+			{
+				return left.first < right.first;
+			});
+
+		Align();
+		entry.keyCount = keyValues.size();
+		entry.keysOffset = m_offset;
+
+		std::string buffer;
+		utils::BinaryWriter writer(buffer);
+		for (const auto& keyValue : keyValues)
+			writer.WritePod(keyValue.first);
+		Write(buffer.data(), buffer.size());
+
+		Align();
+		entry.valueOffsetsOffset = m_offset;
+
+		const auto valuesOffset = m_offset + (keyValues.size() + 1) * sizeof(uint64_t);
+		std::vector<uint64_t> valueOffsets;
+		valueOffsets.reserve(keyValues.size() + 1);
+
+		buffer.clear();
+		for (const auto& keyValue : keyValues)
+		{
+			valueOffsets.push_back(valuesOffset + buffer.size());
+			utils::Serialize(writer, keyValue.second);
+		}
+		valueOffsets.push_back(valuesOffset + buffer.size());
+
+		Write(valueOffsets.data(), valueOffsets.size() * sizeof(uint64_t));
+		Write(buffer.data(), buffer.size());
+	}
+
+	void Write(const void* data, size_t size)
+	{
+		m_file.Write(static_cast<const char*>(data), size);
+		m_offset += size;
+	}
+
+	void Align()
+	{
+		static const char cPadding[cImageAlignment] = {};
+		Write(cPadding, AlignImageOffset(m_offset) - m_offset);
+	}
+
+private:
+	persistence::LogFile& m_file;
+	uint64_t m_offset = 0;
+};
+
+} //namespace image
+
+} //namespace internal
+
+} //namespace vs
@@ -0,0 +1,36 @@
+#pragma once
+#include <memory>
+
+#include <Types.h>
+
+namespace vs
+{
+
+namespace internal
+{
+
+template<typename KeyT>
+struct IKeyEvents
+{
+	virtual ~IKeyEvents() = default;
+
+	// called after a key is inserted or erased
+	virtual void OnKeyChanged(const KeyT& key) = 0;
+};
+
+
+template<typename KeyT>
+struct IKeyEventsSubscription
+{
+	using KeyEventsPtr = std::shared_ptr<IKeyEvents<KeyT>>;
+
+	virtual ~IKeyEventsSubscription() = default;
+
+	// returns INVALID_COOKIE if keys of a node never change
+	virtual Cookie RegisterKeySubscriber(KeyEventsPtr subscriber) = 0;
+	virtual void UnregisterKeySubscriber(Cookie cookie) = 0;
+};
+
+} //namespace internal
+
+} //namespace vs
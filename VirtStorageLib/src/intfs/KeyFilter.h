@@ -0,0 +1,28 @@
+#pragma once
+
+#include <memory>
+
+namespace vs
+{
+
+namespace internal
+{
+
+template<typename KeyT>
+struct IKeyFilter
+{
+	using KeyFilterPtr = std::shared_ptr<const IKeyFilter>;
+
+	virtual ~IKeyFilter() = default;
+
+	// returns false if a node surely has no key, true if it may have it
+	virtual bool MayContain(const KeyT& key) const noexcept = 0;
+
+	// the filter of the node itself for a batch of MayContain calls: a proxy pins its node once
+	// instead of once per key. nullptr if the node was removed
+	virtual KeyFilterPtr PinKeyFilter() const noexcept = 0;
+};
+
+} //namespace internal
+
+} //namespace vs
@@ -0,0 +1,449 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "PersistenceOptions.h"
+#include "PersistenceException.h"
+
+#include "LogDirectory.h"
+#include "LogRecord.h"
+#include "WriteAheadLog.h"
+#include "../utils/NonCopyable.h"
+#include "../utils/Serialization.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace persistence
+{
+
+//
+// Journal
+//
+// Durability of a volume tree. Nodes of the tree have persistent ids (the root's one is cRootNodeId)
+// and log their changes as records: Insert (Replace and TryInsert are logged only if they succeed,
+// as Insert), Erase, InsertChild and RemoveChild. Every record is a blind change, so replaying a log
+// over a checkpoint taken while the tree kept changing gives the latest state.
+//
+// A checkpoint is taken in the background once the current log segment grows over a limit:
+// the log is switched to a new segment, the tree is dumped as a sequence of records,
+// and older segments are removed.
+//
+// A directory must be used by one volume at a time.
+//
+
+template<typename KeyT, typename ValueHolderT>
+class Journal :
+	private utils::NonCopyable
+{
+public:
+	using Ptr = std::shared_ptr<Journal>;
+	using NodeId = uint64_t;
+	using Lsn = WriteAheadLog::Lsn;
+
+	static constexpr NodeId cRootNodeId = 0;
+
+	enum class RecordType : uint8_t
+	{
+		Insert = 1,
+		Erase,
+		InsertChild,
+		RemoveChild
+	};
+
+	struct Record
+	{
+		RecordType type{};
+		NodeId node = cRootNodeId;
+		KeyT key{};
+		ValueHolderT value{};
+		std::string name;
+		NodeId child = cRootNodeId;
+	};
+
+	// buffers records of a checkpoint dump
+	class CheckpointWriter
+	{
+	public:
+		explicit CheckpointWriter(LogFile& file) : m_file{ file }
+		{
+		}
+
+		std::string& GetBuffer() noexcept
+		{
+			return m_buffer;
+		}
+
+		void FlushIfFull()
+		{
+			if (m_buffer.size() >= cFlushSize)
+				Flush();
+		}
+
+		void Flush()
+		{
+			m_file.Write(m_buffer);
+			m_buffer.clear();
+		}
+
+	private:
+		static constexpr size_t cFlushSize = size_t{ 1 } << 20;
+
+		LogFile& m_file;
+		std::string m_buffer;
+	};
+
+	// returns false if there is no tree to dump anymore
+	using DumpFunctorType = std::function<bool(CheckpointWriter&)>;
+	using ReplayFunctorType = std::function<void(Record&)>;
+
+	// serializes logging and applying changes of the same key, so a log keeps their order
+	class AllKeysLock :
+		private utils::NonCopyable
+	{
+	public:
+		explicit AllKeysLock(Journal& journal) : m_journal{ journal }
+		{
+			for (auto& keyLock : m_journal.m_keyLocks)
+				keyLock.mutex.lock();
+		}
+
+		~AllKeysLock()
+		{
+			for (auto it = m_journal.m_keyLocks.rbegin(); it != m_journal.m_keyLocks.rend(); ++it)
+				it->mutex.unlock();
+		}
+
+	private:
+		Journal& m_journal;
+	};
+
+public:
+	static Ptr CreateInstance(const PersistenceOptions& options)
+	{
+		static_assert(IsPersistable(), "Keys and values of a persistent volume must be serializable");
+
+		return std::shared_ptr<Journal>(new Journal(options));
+	}
+
+	~Journal()
+	{
+		Close();
+	}
+
+	static constexpr bool IsPersistable()
+	{
+		return utils::IsSerializable<KeyT>::value && utils::IsSerializable<ValueHolderT>::value;
+	}
+
+	// reads the checkpoint and log segments of the directory and calls f for every record in order
+	void Recover(const ReplayFunctorType& f)
+	{
+		uint64_t segment = 0;
+		std::string records;
+		if (m_directory.ReadCheckpoint(segment, records))
+			Replay(records, f);
+
+		// segments older than a checkpoint may be left by a crash right after it was written
+		auto nextSegment = segment;
+		for (const auto existing : m_directory.ListSegments())
+		{
+			if (existing < segment)
+				continue;
+
+			// a torn tail ends a segment; appending resumes in a new one
+			Replay(m_directory.ReadSegment(existing), f);
+			nextSegment = existing + 1;
+		}
+
+		m_firstSegment = nextSegment;
+	}
+
+	// starts logging; dump is called to write checkpoints
+	void Start(DumpFunctorType dump)
+	{
+		m_dump = std::move(dump);
+		m_log = std::make_unique<WriteAheadLog>(m_directory, m_firstSegment, WriteAheadLog::Options{ m_options.syncOnWrite, m_options.syncInterval });
+		m_checkpointer = std::thread([this]() { RunCheckpointer(); });
+	}
+
+	// waits for a running checkpoint and writes out the log; later changes are not logged.
+	// A tree is closed while its root is still owned, so a checkpoint never holds the last reference to it
+	void Close()
+	{
+		{
+			std::lock_guard lock(m_checkpointMutex);
+			if (m_closed)
+				return;
+
+			m_closed = true;
+		}
+		m_checkpointCv.notify_one();
+
+		if (m_checkpointer.joinable())
+			m_checkpointer.join();
+
+		if (m_log)
+			m_log->Close();
+	}
+
+	NodeId NextNodeId() noexcept
+	{
+		return m_nextNodeId.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::unique_lock<std::mutex> LockKey(const KeyT& key)
+	{
+		return std::unique_lock<std::mutex>(m_keyLocks[m_hasher(key) % cKeyLockCount].mutex);
+	}
+
+	AllKeysLock LockAllKeys()
+	{
+		return AllKeysLock(*this);
+	}
+
+	// logging of key changes must be done under LockKey/LockAllKeys together with applying them,
+	// or after applying them under LockKey, logging the value the key has then
+	Lsn LogInsert(NodeId node, const KeyT& key, const ValueHolderT& value)
+	{
+		return Append(
+			[&](std::string& buffer)
+			{
+				EncodeInsert(buffer, node, key, value);
+			});
+	}
+
+	Lsn LogErase(NodeId node, const KeyT& key)
+	{
+		return Append(
+			[&](std::string& buffer)
+			{
+				const auto offset = BeginRecord(buffer);
+				utils::BinaryWriter writer(buffer);
+				WriteHeader(writer, RecordType::Erase, node);
+				WriteKey(writer, key);
+				EndRecord(buffer, offset);
+			});
+	}
+
+	// logging of children changes must be done under a lock of the parent's children
+	Lsn LogInsertChild(NodeId parent, const std::string& name, NodeId child)
+	{
+		return Append(
+			[&](std::string& buffer)
+			{
+				EncodeChild(buffer, RecordType::InsertChild, parent, name, child);
+			});
+	}
+
+	Lsn LogRemoveChild(NodeId parent, const std::string& name, NodeId child)
+	{
+		return Append(
+			[&](std::string& buffer)
+			{
+				EncodeChild(buffer, RecordType::RemoveChild, parent, name, child);
+			});
+	}
+
+	// must be called after key locks are released, so writers waiting for a disk share one sync
+	void Commit(Lsn lsn)
+	{
+		if (m_log && lsn != 0)
+			m_log->Commit(lsn);
+	}
+
+	// encoders for checkpoint dumps
+	static void EncodeInsert(std::string& buffer, NodeId node, const KeyT& key, const ValueHolderT& value)
+	{
+		const auto offset = BeginRecord(buffer);
+		utils::BinaryWriter writer(buffer);
+		WriteHeader(writer, RecordType::Insert, node);
+		WriteKey(writer, key);
+		if constexpr (utils::IsSerializable<ValueHolderT>::value)
+			utils::Serialize(writer, value);
+		EndRecord(buffer, offset);
+	}
+
+	static void EncodeChild(std::string& buffer, RecordType type, NodeId parent, const std::string& name, NodeId child)
+	{
+		const auto offset = BeginRecord(buffer);
+		utils::BinaryWriter writer(buffer);
+		WriteHeader(writer, type, parent);
+		utils::Serialize(writer, name);
+		writer.WritePod(child);
+		EndRecord(buffer, offset);
+	}
+
+private:
+	static constexpr size_t cKeyLockCount = 32;
+	static constexpr size_t cCacheLineSize = 64;
+
+	struct alignas(cCacheLineSize) KeyLock
+	{
+		std::mutex mutex;
+	};
+
+	explicit Journal(const PersistenceOptions& options) : m_options{ options }, m_directory{ options.directory }
+	{
+	}
+
+	static void WriteHeader(utils::BinaryWriter& writer, RecordType type, NodeId node)
+	{
+		writer.WritePod(type);
+		writer.WritePod(node);
+	}
+
+	static void WriteKey(utils::BinaryWriter& writer, const KeyT& key)
+	{
+		if constexpr (utils::IsSerializable<KeyT>::value)
+			utils::Serialize(writer, key);
+	}
+
+	template<typename EncoderT>
+	Lsn Append(const EncoderT& encode)
+	{
+		if (!m_log)
+			return 0;
+
+		thread_local std::string buffer;
+		buffer.clear();
+		encode(buffer);
+
+		const auto lsn = m_log->Append(buffer);
+
+		if (m_log->GetSegmentSize() > m_options.checkpointLogSize && !m_checkpointRequested.exchange(true))
+		{
+			std::lock_guard lock(m_checkpointMutex);
+			m_checkpointCv.notify_one();
+		}
+
+		return lsn;
+	}
+
+	void Replay(const std::string& records, const ReplayFunctorType& f)
+	{
+		if constexpr (IsPersistable())
+		{
+			size_t offset = 0;
+			const char* payload = nullptr;
+			size_t size = 0;
+
+			while (NextRecord(records, offset, payload, size))
+			{
+				utils::BinaryReader reader(payload, size);
+
+				Record record;
+				record.type = reader.ReadPod<RecordType>();
+				record.node = reader.ReadPod<NodeId>();
+
+				switch (record.type)
+				{
+				case RecordType::Insert:
+					utils::Deserialize(reader, record.key);
+					utils::Deserialize(reader, record.value);
+					break;
+				case RecordType::Erase:
+					utils::Deserialize(reader, record.key);
+					break;
+				case RecordType::InsertChild:
+				case RecordType::RemoveChild:
+					utils::Deserialize(reader, record.name);
+					record.child = reader.ReadPod<NodeId>();
+					break;
+				default:
+					throw PersistenceException("Unknown record type in " + m_options.directory);
+				}
+
+				m_nextNodeId = std::max({ m_nextNodeId.load(), record.node + 1, record.child + 1 });
+
+				f(record);
+			}
+		}
+	}
+
+	void RunCheckpointer()
+	{
+		std::unique_lock lock(m_checkpointMutex);
+
+		while (true)
+		{
+			m_checkpointCv.wait(lock,
+				[this]()
+				{
+					return m_closed || m_checkpointRequested.load();
+				});
+
+			if (m_closed)
+				return;
+
+			lock.unlock();
+
+			try
+			{
+				Checkpoint();
+			}
+			catch (const std::exception&)
+			{
+				// the log is kept as is; the next request retries
+			}
+
+			lock.lock();
+			m_checkpointRequested = false;
+		}
+	}
+
+	void Checkpoint()
+	{
+		const auto segment = m_log->Rotate();
+
+		// a change logged into an older segment may not be applied yet, but its key lock is held until it is:
+		// once every key lock has been taken, the dump sees all changes the checkpoint replaces
+		{
+			const auto barrier = LockAllKeys();
+		}
+
+		auto file = m_directory.BeginCheckpoint(segment);
+		CheckpointWriter writer(*file);
+		if (!m_dump(writer))
+			return;
+
+		writer.Flush();
+		m_directory.CommitCheckpoint(std::move(file));
+
+		m_directory.RemoveSegmentsBefore(segment);
+	}
+
+private:
+	const PersistenceOptions m_options;
+	const LogDirectory m_directory;
+	uint64_t m_firstSegment = 0;
+
+	std::unique_ptr<WriteAheadLog> m_log;
+	std::array<KeyLock, cKeyLockCount> m_keyLocks;
+	std::hash<KeyT> m_hasher;
+	std::atomic<NodeId> m_nextNodeId{ cRootNodeId + 1 };
+
+	DumpFunctorType m_dump;
+	std::thread m_checkpointer;
+	std::atomic<bool> m_checkpointRequested{ false };
+	bool m_closed = false;
+	std::mutex m_checkpointMutex;
+	std::condition_variable m_checkpointCv;
+};
+
+} //namespace persistence
+
+} //namespace internal
+
+} //namespace vs
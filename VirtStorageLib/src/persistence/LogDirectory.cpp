@@ -0,0 +1,240 @@
+#include "LogDirectory.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+#include <cerrno>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "LogRecord.h"
+#include "PersistenceException.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace persistence
+{
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+constexpr const char* cSegmentPrefix = "wal.";
+constexpr const char* cCheckpointName = "checkpoint";
+constexpr const char* cCheckpointTempName = "checkpoint.tmp";
+constexpr uint32_t cCheckpointMagic = 0x50435356; // "VSCP"
+
+[[noreturn]] void ThrowIoError(const std::string& action, const std::string& path)
+{
+	throw PersistenceException("Failed to " + action + " " + path + ": " + std::strerror(errno));
+}
+
+// makes a rename or a creation of a file in the directory durable
+void SyncDirectory(const std::string& path)
+{
+#if !defined(_WIN32)
+	const auto fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		ThrowIoError("open", path);
+
+	const auto res = ::fsync(fd);
+	::close(fd);
+
+	if (res != 0)
+		ThrowIoError("sync", path);
+#else
+	(void)path;
+#endif
+}
+
+} //namespace
+
+//
+// LogFile
+//
+
+LogFile::LogFile(const std::string& path, bool truncate) : m_path{ path }
+{
+	m_file = std::fopen(path.c_str(), truncate ? "wb" : "ab");
+	if (!m_file)
+		ThrowIoError("open", path);
+}
+
+LogFile::~LogFile()
+{
+	std::fclose(m_file);
+}
+
+void LogFile::Write(const char* data, size_t size)
+{
+	if (std::fwrite(data, 1, size, m_file) != size)
+		ThrowIoError("write", m_path);
+}
+
+void LogFile::Sync()
+{
+	if (std::fflush(m_file) != 0)
+		ThrowIoError("write", m_path);
+
+#if defined(_WIN32)
+	const auto res = ::_commit(::_fileno(m_file));
+#else
+	const auto res = ::fsync(::fileno(m_file));
+#endif
+
+	if (res != 0)
+		ThrowIoError("sync", m_path);
+}
+
+//
+// LogDirectory
+//
+
+LogDirectory::LogDirectory(std::string path) : m_path{ std::move(path) }
+{
+	std::error_code error;
+	fs::create_directories(m_path, error);
+	if (error)
+		throw PersistenceException("Failed to create " + m_path + ": " + error.message());
+}
+
+std::string LogDirectory::GetSegmentPath(uint64_t segment) const
+{
+	return (fs::path(m_path) / (cSegmentPrefix + std::to_string(segment))).string();
+}
+
+std::unique_ptr<LogFile> LogDirectory::OpenSegment(uint64_t segment) const
+{
+	auto file = std::make_unique<LogFile>(GetSegmentPath(segment));
+	SyncDirectory(m_path);
+	return file;
+}
+
+std::vector<uint64_t> LogDirectory::ListSegments() const
+{
+	std::vector<uint64_t> res;
+
+	const std::string prefix = cSegmentPrefix;
+	for (const auto& entry : fs::directory_iterator(m_path))
+	{
+		const auto name = entry.path().filename().string();
+		if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0)
+			continue;
+
+		const auto number = name.substr(prefix.size());
+		if (std::all_of(number.begin(), number.end(), [](char c) { return c >= '0' && c <= '9'; }))
+			res.push_back(std::stoull(number));
+	}
+
+	std::sort(res.begin(), res.end());
+	return res;
+}
+
+std::string LogDirectory::ReadSegment(uint64_t segment) const
+{
+	return ReadFile(GetSegmentPath(segment));
+}
+
+void LogDirectory::RemoveSegmentsBefore(uint64_t segment) const
+{
+	for (const auto existing : ListSegments())
+	{
+		if (existing >= segment)
+			break;
+
+		std::error_code error;
+		fs::remove(GetSegmentPath(existing), error);
+	}
+}
+
+bool LogDirectory::ReadCheckpoint(uint64_t& segment, std::string& records) const
+{
+	const auto path = fs::path(m_path) / cCheckpointName;
+	if (!fs::exists(path))
+		return false;
+
+	records = ReadFile(path.string());
+
+	// the header record: magic and the segment
+	size_t offset = 0;
+	const char* payload = nullptr;
+	size_t size = 0;
+	uint32_t magic = 0;
+	if (!NextRecord(records, offset, payload, size) || size != sizeof(magic) + sizeof(segment))
+		throw PersistenceException("Corrupted checkpoint " + path.string());
+
+	std::memcpy(&magic, payload, sizeof(magic));
+	std::memcpy(&segment, payload + sizeof(magic), sizeof(segment));
+	if (magic != cCheckpointMagic)
+		throw PersistenceException("Corrupted checkpoint " + path.string());
+
+	records.erase(0, offset);
+	return true;
+}
+
+std::unique_ptr<LogFile> LogDirectory::BeginCheckpoint(uint64_t segment) const
+{
+	auto checkpoint = std::make_unique<LogFile>((fs::path(m_path) / cCheckpointTempName).string(), true);
+
+	std::string header;
+	const auto offset = BeginRecord(header);
+	header.append(reinterpret_cast<const char*>(&cCheckpointMagic), sizeof(cCheckpointMagic));
+	header.append(reinterpret_cast<const char*>(&segment), sizeof(segment));
+	EndRecord(header, offset);
+
+	checkpoint->Write(header);
+	return checkpoint;
+}
+
+void LogDirectory::CommitCheckpoint(std::unique_ptr<LogFile> checkpoint) const
+{
+	checkpoint->Sync();
+
+	const auto tempPath = checkpoint->GetPath();
+	checkpoint.reset();
+
+	std::error_code error;
+	fs::rename(tempPath, fs::path(m_path) / cCheckpointName, error);
+	if (error)
+		throw PersistenceException("Failed to replace checkpoint in " + m_path + ": " + error.message());
+
+	SyncDirectory(m_path);
+}
+
+std::string LogDirectory::ReadFile(const std::string& path) const
+{
+	std::string res;
+
+	const auto file = std::fopen(path.c_str(), "rb");
+	if (!file)
+		ThrowIoError("open", path);
+
+	char buffer[64 * 1024];
+	size_t read;
+	while ((read = std::fread(buffer, 1, sizeof(buffer), file)) != 0)
+		res.append(buffer, read);
+
+	const auto failed = std::ferror(file) != 0;
+	std::fclose(file);
+
+	if (failed)
+		ThrowIoError("read", path);
+
+	return res;
+}
+
+} //namespace persistence
+
+} //namespace internal
+
+} //namespace vs
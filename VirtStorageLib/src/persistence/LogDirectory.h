@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstdint>
+
+#include "../utils/NonCopyable.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace persistence
+{
+
+//
+// LogFile
+//
+// A file written sequentially; Sync makes everything written so far durable.
+//
+
+class LogFile :
+	private utils::NonCopyable
+{
+public:
+	// an existing file is appended to unless truncate is set
+	explicit LogFile(const std::string& path, bool truncate = false);
+	~LogFile();
+
+	void Write(const char* data, size_t size);
+	void Write(const std::string& data)
+	{
+		Write(data.data(), data.size());
+	}
+
+	void Sync();
+
+	const std::string& GetPath() const noexcept
+	{
+		return m_path;
+	}
+
+private:
+	std::FILE* m_file = nullptr;
+	std::string m_path;
+};
+
+//
+// LogDirectory
+//
+// Files of a persistent volume:
+//   wal.<segment> - log segments; records of a segment follow records of the previous one
+//   checkpoint    - a dump of a tree; log records from its segment on are replayed over it
+//
+
+class LogDirectory
+{
+public:
+	// creates the directory if needed
+	explicit LogDirectory(std::string path);
+
+	std::string GetSegmentPath(uint64_t segment) const;
+	// a segment file is created durably, records are appended to it
+	std::unique_ptr<LogFile> OpenSegment(uint64_t segment) const;
+
+	// in ascending order
+	std::vector<uint64_t> ListSegments() const;
+	std::string ReadSegment(uint64_t segment) const;
+	void RemoveSegmentsBefore(uint64_t segment) const;
+
+	// returns false if there is no checkpoint; segment is the first log segment not covered by it
+	bool ReadCheckpoint(uint64_t& segment, std::string& records) const;
+	// a new checkpoint is written to a temporary file and replaces the previous one on commit,
+	// so a crash leaves either the previous checkpoint or the whole new one
+	std::unique_ptr<LogFile> BeginCheckpoint(uint64_t segment) const;
+	void CommitCheckpoint(std::unique_ptr<LogFile> checkpoint) const;
+
+private:
+	std::string ReadFile(const std::string& path) const;
+
+	std::string m_path;
+};
+
+} //namespace persistence
+
+} //namespace internal
+
+} //namespace vs
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+#include "../utils/Crc32.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace persistence
+{
+
+//
+// Log records
+//
+// Log segments and checkpoints are sequences of records: [payload size: u32][payload crc: u32][payload].
+// A record whose size or crc doesn't match ends a sequence; it is a tail torn by a crash.
+//
+
+constexpr size_t cRecordHeaderSize = 2 * sizeof(uint32_t);
+
+// reserves a header; returns an offset to pass to EndRecord after a payload is appended
+inline size_t BeginRecord(std::string& buffer)
+{
+	const auto offset = buffer.size();
+	buffer.append(cRecordHeaderSize, '\0');
+	return offset;
+}
+
+inline void EndRecord(std::string& buffer, size_t offset)
+{
+	const auto payload = buffer.data() + offset + cRecordHeaderSize;
+	const auto size = static_cast<uint32_t>(buffer.size() - offset - cRecordHeaderSize);
+	const auto crc = utils::Crc32(payload, size);
+
+	std::memcpy(&buffer[offset], &size, sizeof(size));
+	std::memcpy(&buffer[offset + sizeof(size)], &crc, sizeof(crc));
+}
+
+// reads a record at offset and moves offset past it; returns false at the end of valid records
+inline bool NextRecord(const std::string& data, size_t& offset, const char*& payload, size_t& size)
+{
+	if (data.size() - offset < cRecordHeaderSize)
+		return false;
+
+	uint32_t recordSize;
+	uint32_t crc;
+	std::memcpy(&recordSize, data.data() + offset, sizeof(recordSize));
+	std::memcpy(&crc, data.data() + offset + sizeof(recordSize), sizeof(crc));
+
+	if (recordSize > data.size() - offset - cRecordHeaderSize)
+		return false;
+
+	payload = data.data() + offset + cRecordHeaderSize;
+	if (utils::Crc32(payload, recordSize) != crc)
+		return false;
+
+	size = recordSize;
+	offset += cRecordHeaderSize + recordSize;
+	return true;
+}
+
+} //namespace persistence
+
+} //namespace internal
+
+} //namespace vs
@@ -0,0 +1,196 @@
+#include "WriteAheadLog.h"
+
+#include <algorithm>
+
+#include "PersistenceException.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace persistence
+{
+
+WriteAheadLog::WriteAheadLog(const LogDirectory& directory, uint64_t segment, Options options) :
+	m_directory{ directory }, m_options{ options }, m_file{ directory.OpenSegment(segment) }, m_segment{ segment }
+{
+	m_thread = std::thread([this]() { Run(); });
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+	Close();
+}
+
+WriteAheadLog::Lsn WriteAheadLog::Append(const std::string& records)
+{
+	std::lock_guard lock(m_mutex);
+
+	if (m_closed)
+		return 0;
+
+	ThrowIfFailed();
+
+	m_buffer += records;
+	m_appendedLsn += records.size();
+	m_segmentSize.fetch_add(records.size(), std::memory_order_relaxed);
+
+	return m_appendedLsn;
+}
+
+void WriteAheadLog::Commit(Lsn lsn)
+{
+	if (!m_options.syncOnWrite)
+	{
+		if (m_failed.load(std::memory_order_acquire))
+		{
+			std::lock_guard lock(m_mutex);
+			ThrowIfFailed();
+		}
+		return;
+	}
+
+	std::unique_lock lock(m_mutex);
+
+	// writers arriving while a sync is in progress are served together by the next one
+	m_syncWaiters++;
+	m_flushCv.notify_one();
+	m_durableCv.wait(lock,
+		[this, lsn]()
+		{
+			return m_durableLsn >= lsn || !m_error.empty();
+		});
+	m_syncWaiters--;
+
+	if (m_durableLsn < lsn)
+		ThrowIfFailed();
+}
+
+uint64_t WriteAheadLog::Rotate()
+{
+	std::lock_guard ioLock(m_ioMutex);
+
+	std::string data;
+	Lsn lsn;
+	{
+		std::lock_guard lock(m_mutex);
+		ThrowIfFailed();
+
+		data.swap(m_buffer);
+		lsn = m_appendedLsn;
+		m_segmentSize.store(0, std::memory_order_relaxed);
+	}
+
+	WriteOut(data);
+	m_file = m_directory.OpenSegment(m_segment + 1);
+	m_segment++;
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_durableLsn = std::max(m_durableLsn, lsn);
+	}
+	m_durableCv.notify_all();
+
+	return m_segment;
+}
+
+void WriteAheadLog::Close()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		if (m_closed)
+			return;
+
+		m_closed = true;
+	}
+
+	m_flushCv.notify_one();
+	m_thread.join();
+}
+
+void WriteAheadLog::Run()
+{
+	std::unique_lock lock(m_mutex);
+
+	while (!m_closed)
+	{
+		m_flushCv.wait_for(lock, m_options.syncInterval,
+			[this]()
+			{
+				return m_closed || (m_syncWaiters != 0 && m_durableLsn < m_appendedLsn);
+			});
+
+		Flush(lock);
+	}
+
+	// the last records appended before closing
+	Flush(lock);
+}
+
+// called and returns with lock held
+void WriteAheadLog::Flush(std::unique_lock<std::mutex>& lock)
+{
+	lock.unlock();
+	std::lock_guard ioLock(m_ioMutex);
+	lock.lock();
+
+	// nothing is written after a failure, as it would follow a gap
+	if (m_buffer.empty() || !m_error.empty())
+		return;
+
+	std::string data;
+	data.swap(m_buffer);
+	const auto lsn = m_appendedLsn;
+
+	lock.unlock();
+
+	try
+	{
+		WriteOut(data);
+	}
+	catch (const std::exception&)
+	{
+		// reported by Append and Commit
+	}
+
+	lock.lock();
+
+	if (m_error.empty())
+		m_durableLsn = std::max(m_durableLsn, lsn);
+
+	m_durableCv.notify_all();
+}
+
+// must be called under m_ioMutex
+void WriteAheadLog::WriteOut(const std::string& data)
+{
+	try
+	{
+		m_file->Write(data);
+		m_file->Sync();
+	}
+	catch (const std::exception& e)
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_error = e.what();
+			m_failed.store(true, std::memory_order_release);
+		}
+		m_durableCv.notify_all();
+		throw;
+	}
+}
+
+void WriteAheadLog::ThrowIfFailed() const
+{
+	if (!m_error.empty())
+		throw PersistenceException("The log has failed: " + m_error);
+}
+
+} //namespace persistence
+
+} //namespace internal
+
+} //namespace vs
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "LogDirectory.h"
+#include "../utils/NonCopyable.h"
+
+namespace vs
+{
+
+namespace internal
+{
+
+namespace persistence
+{
+
+//
+// WriteAheadLog
+//
+// Appends records to log segments with group commit: writers only copy their records
+// into a shared buffer, a background thread writes the buffer out and syncs it with one fsync
+// for everything appended since the previous one.
+// A failed write or sync fails the log for good: records appended after the lost ones would
+// leave a gap in it, so Append, Commit and Rotate throw PersistenceException from then on.
+//
+
+class WriteAheadLog :
+	private utils::NonCopyable
+{
+public:
+	// a position in the log: the number of bytes appended before and including a record
+	using Lsn = uint64_t;
+
+	struct Options
+	{
+		bool syncOnWrite = false;
+		std::chrono::milliseconds syncInterval{ 10 };
+	};
+
+public:
+	// records are appended to the given segment of the directory
+	WriteAheadLog(const LogDirectory& directory, uint64_t segment, Options options);
+	~WriteAheadLog();
+
+	// records is a sequence of encoded records (see LogRecord.h); ignored once the log is closed
+	Lsn Append(const std::string& records);
+
+	// waits until everything up to lsn is on a disk if syncOnWrite is set, returns at once otherwise;
+	// throws if the log has failed, so a write failure in the background reaches writers either way
+	void Commit(Lsn lsn);
+
+	// records appended after the call go to a new segment; returns its number
+	// once everything appended before is on a disk
+	uint64_t Rotate();
+
+	// bytes appended to the current segment
+	size_t GetSegmentSize() const noexcept
+	{
+		return m_segmentSize.load(std::memory_order_relaxed);
+	}
+
+	// writes out everything appended and stops the background thread
+	void Close();
+
+private:
+	void Run();
+	void Flush(std::unique_lock<std::mutex>& lock);
+	// writes and syncs data to the current segment; a failure fails the log
+	void WriteOut(const std::string& data);
+	// must be called under m_mutex
+	void ThrowIfFailed() const;
+
+private:
+	const LogDirectory& m_directory;
+	const Options m_options;
+
+	// guarded by m_ioMutex
+	std::unique_ptr<LogFile> m_file;
+	uint64_t m_segment;
+	std::mutex m_ioMutex;
+
+	// guarded by m_mutex
+	std::string m_buffer;
+	Lsn m_appendedLsn = 0;
+	Lsn m_durableLsn = 0;
+	size_t m_syncWaiters = 0;
+	bool m_closed = false;
+	std::string m_error;
+	std::mutex m_mutex;
+	// raised together with setting m_error; lets Commit without syncOnWrite skip m_mutex
+	std::atomic<bool> m_failed{ false };
+	std::condition_variable m_flushCv;
+	std::condition_variable m_durableCv;
+
+	std::atomic<size_t> m_segmentSize{ 0 };
+	std::thread m_thread;
+};
+
+} //namespace persistence
+
+} //namespace internal
+
+} //namespace vs
@@ -0,0 +1,746 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <cstddef>
+
+namespace vs
+{
+
+namespace utils
+{
+
+//
+// BPlusTreeMap
+//
+// Ordered map keeping entries in leaves linked into a list. Keys of a node are stored apart
+// from values in a few cache lines, so a descent compares keys without touching payloads,
+// and range scans walk leaves sequentially.
+//
+// Provides the subset of the std::map interface used by the library.
+// KeyT and ValueT must be default constructible. Any modification invalidates iterators.
+// A moved-from map holds no nodes; it stays empty and usable, and allocates a root on the first insert.
+//
+
+template<typename KeyT, typename ValueT, typename CompareT = std::less<KeyT>>
+class BPlusTreeMap
+{
+	static constexpr size_t cKeysBytes = 256;
+	static constexpr size_t cCapacity = std::max<size_t>(8, cKeysBytes / sizeof(KeyT));
+	static constexpr size_t cMinCount = cCapacity / 2;
+
+	struct Node
+	{
+		explicit Node(bool isLeaf) : leaf{ isLeaf }
+		{
+		}
+
+		const bool leaf;
+		size_t count = 0;
+	};
+
+	struct Leaf : Node
+	{
+		Leaf() : Node(true)
+		{
+		}
+
+		std::array<KeyT, cCapacity> keys;
+		std::array<ValueT, cCapacity> values;
+		Leaf* prev = nullptr;
+		Leaf* next = nullptr;
+	};
+
+	// keys[i] separates children[i] (smaller keys) and children[i + 1]
+	struct Inner : Node
+	{
+		Inner() : Node(false)
+		{
+		}
+
+		std::array<KeyT, cCapacity> keys;
+		std::array<Node*, cCapacity + 1> children{};
+	};
+
+	template<bool IsConst>
+	class IteratorImpl
+	{
+	public:
+		using ValueRef = std::conditional_t<IsConst, const ValueT&, ValueT&>;
+
+		// iterators can't hand out std::pair references: keys and values are kept apart
+		struct Reference
+		{
+			const KeyT& first;
+			ValueRef second;
+		};
+
+		struct ArrowProxy
+		{
+			Reference ref;
+			const Reference* operator->() const { return &ref; }
+		};
+
+		IteratorImpl() = default;
+		IteratorImpl(Leaf* leaf, size_t index) : m_leaf{ leaf }, m_index{ index }
+		{
+		}
+
+		template<bool OtherIsConst, typename = std::enable_if_t<IsConst && !OtherIsConst>>
+		IteratorImpl(const IteratorImpl<OtherIsConst>& other) : m_leaf{ other.m_leaf }, m_index{ other.m_index }
+		{
+		}
+
+		Reference operator*() const { return { m_leaf->keys[m_index], m_leaf->values[m_index] }; }
+		ArrowProxy operator->() const { return { **this }; }
+
+		IteratorImpl& operator++()
+		{
+			if (++m_index == m_leaf->count)
+			{
+				m_leaf = m_leaf->next;
+				m_index = 0;
+			}
+			return *this;
+		}
+
+		IteratorImpl operator++(int)
+		{
+			auto res = *this;
+			++(*this);
+			return res;
+		}
+
+		bool operator==(const IteratorImpl& rhs) const noexcept { return m_leaf == rhs.m_leaf && m_index == rhs.m_index; }
+		bool operator!=(const IteratorImpl& rhs) const noexcept { return !(*this == rhs); }
+
+	private:
+		friend class BPlusTreeMap;
+		template<bool> friend class IteratorImpl;
+
+		Leaf* m_leaf = nullptr;
+		size_t m_index = 0;
+	};
+
+public:
+	using key_type = KeyT;
+	using mapped_type = ValueT;
+	using size_type = size_t;
+
+	using iterator = IteratorImpl<false>;
+	using const_iterator = IteratorImpl<true>;
+
+public:
+	BPlusTreeMap() : m_root{ new Leaf }
+	{
+	}
+
+	BPlusTreeMap(const BPlusTreeMap& other) : m_compare{ other.m_compare }
+	{
+		Leaf* lastLeaf = nullptr;
+		m_root = other.m_root ? Clone(other.m_root, lastLeaf) : nullptr;
+		m_size = other.m_size;
+		m_leafCount = other.m_leafCount;
+		m_innerCount = other.m_innerCount;
+	}
+
+	BPlusTreeMap(BPlusTreeMap&& other) noexcept :
+		m_root{ std::exchange(other.m_root, nullptr) },
+		m_size{ std::exchange(other.m_size, 0) },
+		m_leafCount{ std::exchange(other.m_leafCount, 0) },
+		m_innerCount{ std::exchange(other.m_innerCount, 0) },
+		m_compare{ other.m_compare }
+	{
+	}
+
+	BPlusTreeMap& operator = (const BPlusTreeMap& other)
+	{
+		if (this != &other)
+		{
+			BPlusTreeMap copy(other);
+			Swap(copy);
+		}
+		return *this;
+	}
+
+	BPlusTreeMap& operator = (BPlusTreeMap&& other) noexcept
+	{
+		if (this != &other)
+			Swap(other);
+		return *this;
+	}
+
+	~BPlusTreeMap()
+	{
+		Free(m_root);
+	}
+
+	iterator begin() noexcept { return MakeBegin<iterator>(); }
+	iterator end() noexcept { return {}; }
+	const_iterator begin() const noexcept { return MakeBegin<const_iterator>(); }
+	const_iterator end() const noexcept { return {}; }
+
+	size_t size() const noexcept { return m_size; }
+	bool empty() const noexcept { return m_size == 0; }
+
+	// tree nodes, including unused entries of them
+	size_t allocated_bytes() const noexcept { return m_leafCount * sizeof(Leaf) + m_innerCount * sizeof(Inner); }
+
+	iterator find(const KeyT& key) { return FindImpl<iterator>(key); }
+	const_iterator find(const KeyT& key) const { return FindImpl<const_iterator>(key); }
+
+	size_t count(const KeyT& key) const { return find(key) != end() ? 1 : 0; }
+
+	// first entry with a key not less than the given one
+	iterator lower_bound(const KeyT& key) { return LowerBoundImpl<iterator>(key); }
+	const_iterator lower_bound(const KeyT& key) const { return LowerBoundImpl<const_iterator>(key); }
+
+	// the beginning of one of partCount parts made of subtrees of the highest level having enough of them;
+	// partCount gives end(). Parts can be iterated concurrently
+	const_iterator split_point(size_t part, size_t partCount) const
+	{
+		if (part == 0)
+			return begin();
+		if (part >= partCount || !m_root)
+			return end();
+
+		std::vector<const Node*> level{ m_root };
+		while (level.size() < partCount && !level.front()->leaf)
+		{
+			std::vector<const Node*> nextLevel;
+			for (const auto node : level)
+			{
+				const auto inner = static_cast<const Inner*>(node);
+				nextLevel.insert(nextLevel.end(), inner->children.begin(), inner->children.begin() + inner->count + 1);
+			}
+			level = std::move(nextLevel);
+		}
+
+		auto node = level[level.size() * part / partCount];
+		while (!node->leaf)
+			node = static_cast<const Inner*>(node)->children[0];
+
+		const auto leaf = const_cast<Leaf*>(static_cast<const Leaf*>(node));
+		return leaf->count ? const_iterator(leaf, 0) : end();
+	}
+
+	template<typename... ArgsT>
+	std::pair<iterator, bool> try_emplace(const KeyT& key, ArgsT&&... args)
+	{
+		iterator pos;
+		Node* splitRight = nullptr;
+		KeyT separator{};
+
+		if (!m_root)
+		{
+			m_root = new Leaf;
+			m_leafCount = 1;
+		}
+
+		const auto inserted = InsertRec(m_root, key, pos, splitRight, separator, std::forward<ArgsT>(args)...);
+		if (splitRight)
+		{
+			auto newRoot = new Inner;
+			m_innerCount++;
+			newRoot->keys[0] = std::move(separator);
+			newRoot->children[0] = m_root;
+			newRoot->children[1] = splitRight;
+			newRoot->count = 1;
+			m_root = newRoot;
+		}
+
+		if (inserted)
+			m_size++;
+
+		return { pos, inserted };
+	}
+
+	template<typename T>
+	std::pair<iterator, bool> insert_or_assign(const KeyT& key, T&& value)
+	{
+		auto res = try_emplace(key, std::forward<T>(value));
+		if (!res.second)
+			res.first->second = std::forward<T>(value);
+		return res;
+	}
+
+	size_t erase(const KeyT& key)
+	{
+		if (!m_root || !EraseRec(m_root, key))
+			return 0;
+
+		m_size--;
+
+		if (!m_root->leaf && m_root->count == 0)
+		{
+			auto oldRoot = static_cast<Inner*>(m_root);
+			m_root = oldRoot->children[0];
+			delete oldRoot;
+			m_innerCount--;
+		}
+
+		return 1;
+	}
+
+	void clear()
+	{
+		Free(m_root);
+		m_root = new Leaf;
+		m_size = 0;
+		m_leafCount = 1;
+		m_innerCount = 0;
+	}
+
+private:
+	bool Less(const KeyT& lhs, const KeyT& rhs) const
+	{
+		return m_compare(lhs, rhs);
+	}
+
+	// index of a child which may contain the key
+	size_t ChildIndex(const Inner* inner, const KeyT& key) const
+	{
+		return std::upper_bound(inner->keys.begin(), inner->keys.begin() + inner->count, key,
+			[this](const KeyT& lhs, const KeyT& rhs) { return Less(lhs, rhs); }) - inner->keys.begin();
+	}
+
+	size_t KeyIndex(const Leaf* leaf, const KeyT& key) const
+	{
+		return std::lower_bound(leaf->keys.begin(), leaf->keys.begin() + leaf->count, key,
+			[this](const KeyT& lhs, const KeyT& rhs) { return Less(lhs, rhs); }) - leaf->keys.begin();
+	}
+
+	Leaf* FindLeaf(const KeyT& key) const
+	{
+		auto node = m_root;
+		while (!node->leaf)
+		{
+			auto inner = static_cast<Inner*>(node);
+			node = inner->children[ChildIndex(inner, key)];
+		}
+		return static_cast<Leaf*>(node);
+	}
+
+	template<typename IteratorT>
+	IteratorT MakeBegin() const
+	{
+		if (!m_root)
+			return {};
+
+		auto node = m_root;
+		while (!node->leaf)
+			node = static_cast<Inner*>(node)->children[0];
+
+		auto leaf = static_cast<Leaf*>(node);
+		return leaf->count ? IteratorT(leaf, 0) : IteratorT();
+	}
+
+	template<typename IteratorT>
+	IteratorT FindImpl(const KeyT& key) const
+	{
+		if (!m_root)
+			return {};
+
+		auto leaf = FindLeaf(key);
+		const auto index = KeyIndex(leaf, key);
+		if (index < leaf->count && !Less(key, leaf->keys[index]))
+			return IteratorT(leaf, index);
+
+		return {};
+	}
+
+	template<typename IteratorT>
+	IteratorT LowerBoundImpl(const KeyT& key) const
+	{
+		if (!m_root)
+			return {};
+
+		auto leaf = FindLeaf(key);
+		const auto index = KeyIndex(leaf, key);
+		if (index < leaf->count)
+			return IteratorT(leaf, index);
+
+		// only the root leaf can be empty
+		return leaf->next ? IteratorT(leaf->next, 0) : IteratorT();
+	}
+
+	// returns true if a new entry was inserted; pos points to the entry with the key
+	// if the node was split, splitRight and separator describe a new right sibling
+	template<typename... ArgsT>
+	bool InsertRec(Node* node, const KeyT& key, iterator& pos, Node*& splitRight, KeyT& separator, ArgsT&&... args)
+	{
+		if (node->leaf)
+			return InsertInLeaf(static_cast<Leaf*>(node), key, pos, splitRight, separator, std::forward<ArgsT>(args)...);
+
+		auto inner = static_cast<Inner*>(node);
+		const auto childIndex = ChildIndex(inner, key);
+
+		Node* childSplitRight = nullptr;
+		KeyT childSeparator{};
+		const auto inserted = InsertRec(inner->children[childIndex], key, pos, childSplitRight, childSeparator, std::forward<ArgsT>(args)...);
+
+		if (childSplitRight)
+			InsertInInner(inner, childIndex, std::move(childSeparator), childSplitRight, splitRight, separator);
+
+		return inserted;
+	}
+
+	template<typename... ArgsT>
+	bool InsertInLeaf(Leaf* leaf, const KeyT& key, iterator& pos, Node*& splitRight, KeyT& separator, ArgsT&&... args)
+	{
+		auto index = KeyIndex(leaf, key);
+		if (index < leaf->count && !Less(key, leaf->keys[index]))
+		{
+			pos = iterator(leaf, index);
+			return false;
+		}
+
+		auto target = leaf;
+		if (leaf->count == cCapacity)
+		{
+			auto right = new Leaf;
+			m_leafCount++;
+			MoveEntries(leaf, cMinCount, cCapacity, right, 0);
+			right->count = cCapacity - cMinCount;
+			leaf->count = cMinCount;
+
+			right->next = leaf->next;
+			if (right->next)
+				right->next->prev = right;
+			right->prev = leaf;
+			leaf->next = right;
+
+			if (index > cMinCount)
+			{
+				target = right;
+				index -= cMinCount;
+			}
+
+			splitRight = right;
+		}
+
+		MoveEntriesBackward(target, index, target->count, 1);
+		target->keys[index] = key;
+		target->values[index] = ValueT(std::forward<ArgsT>(args)...);
+		target->count++;
+
+		if (splitRight)
+			separator = static_cast<Leaf*>(splitRight)->keys[0];
+
+		pos = iterator(target, index);
+		return true;
+	}
+
+	// inserts a separator and a right child after children[childIndex]
+	void InsertInInner(Inner* inner, size_t childIndex, KeyT&& childSeparator, Node* childRight, Node*& splitRight, KeyT& separator)
+	{
+		if (inner->count < cCapacity)
+		{
+			for (auto i = inner->count; i > childIndex; i--)
+			{
+				inner->keys[i] = std::move(inner->keys[i - 1]);
+				inner->children[i + 1] = inner->children[i];
+			}
+			inner->keys[childIndex] = std::move(childSeparator);
+			inner->children[childIndex + 1] = childRight;
+			inner->count++;
+			return;
+		}
+
+		// full: lay out all keys and children in order, then split them into halves
+		std::array<KeyT, cCapacity + 1> keys;
+		std::array<Node*, cCapacity + 2> children;
+		for (size_t i = 0, j = 0; i <= cCapacity; i++)
+		{
+			if (i == childIndex)
+				keys[i] = std::move(childSeparator);
+			else
+				keys[i] = std::move(inner->keys[j++]);
+		}
+		for (size_t i = 0, j = 0; i <= cCapacity + 1; i++)
+		{
+			if (i == childIndex + 1)
+				children[i] = childRight;
+			else
+				children[i] = inner->children[j++];
+		}
+
+		auto right = new Inner;
+		m_innerCount++;
+		const auto leftCount = (cCapacity + 1) / 2;
+
+		for (size_t i = 0; i < leftCount; i++)
+		{
+			inner->keys[i] = std::move(keys[i]);
+			inner->children[i] = children[i];
+		}
+		inner->children[leftCount] = children[leftCount];
+		inner->count = leftCount;
+
+		separator = std::move(keys[leftCount]);
+
+		const auto rightCount = cCapacity - leftCount;
+		for (size_t i = 0; i < rightCount; i++)
+		{
+			right->keys[i] = std::move(keys[leftCount + 1 + i]);
+			right->children[i] = children[leftCount + 1 + i];
+		}
+		right->children[rightCount] = children[cCapacity + 1];
+		right->count = rightCount;
+
+		splitRight = right;
+	}
+
+	bool EraseRec(Node* node, const KeyT& key)
+	{
+		if (node->leaf)
+		{
+			auto leaf = static_cast<Leaf*>(node);
+			const auto index = KeyIndex(leaf, key);
+			if (index == leaf->count || Less(key, leaf->keys[index]))
+				return false;
+
+			MoveEntries(leaf, index + 1, leaf->count, leaf, index);
+			leaf->count--;
+			ResetEntry(leaf, leaf->count);
+			return true;
+		}
+
+		auto inner = static_cast<Inner*>(node);
+		const auto childIndex = ChildIndex(inner, key);
+		if (!EraseRec(inner->children[childIndex], key))
+			return false;
+
+		if (inner->children[childIndex]->count < cMinCount)
+			Rebalance(inner, childIndex);
+
+		return true;
+	}
+
+	// restores the minimal occupancy of children[index] by borrowing from a sibling or merging with it
+	void Rebalance(Inner* parent, size_t index)
+	{
+		auto child = parent->children[index];
+		auto left = index > 0 ? parent->children[index - 1] : nullptr;
+		auto right = index < parent->count ? parent->children[index + 1] : nullptr;
+
+		if (child->leaf)
+		{
+			auto leafChild = static_cast<Leaf*>(child);
+			if (left && left->count > cMinCount)
+			{
+				auto leftLeaf = static_cast<Leaf*>(left);
+				MoveEntriesBackward(leafChild, 0, leafChild->count, 1);
+				MoveEntries(leftLeaf, leftLeaf->count - 1, leftLeaf->count, leafChild, 0);
+				leftLeaf->count--;
+				leafChild->count++;
+				parent->keys[index - 1] = leafChild->keys[0];
+			}
+			else if (right && right->count > cMinCount)
+			{
+				auto rightLeaf = static_cast<Leaf*>(right);
+				MoveEntries(rightLeaf, 0, 1, leafChild, leafChild->count);
+				leafChild->count++;
+				MoveEntries(rightLeaf, 1, rightLeaf->count, rightLeaf, 0);
+				rightLeaf->count--;
+				ResetEntry(rightLeaf, rightLeaf->count);
+				parent->keys[index] = rightLeaf->keys[0];
+			}
+			else if (left)
+				MergeLeaves(parent, index - 1);
+			else if (right)
+				MergeLeaves(parent, index);
+		}
+		else
+		{
+			auto innerChild = static_cast<Inner*>(child);
+			if (left && left->count > cMinCount)
+			{
+				auto leftInner = static_cast<Inner*>(left);
+				for (auto i = innerChild->count; i > 0; i--)
+				{
+					innerChild->keys[i] = std::move(innerChild->keys[i - 1]);
+					innerChild->children[i + 1] = innerChild->children[i];
+				}
+				innerChild->children[1] = innerChild->children[0];
+				innerChild->keys[0] = std::move(parent->keys[index - 1]);
+				innerChild->children[0] = leftInner->children[leftInner->count];
+				innerChild->count++;
+
+				parent->keys[index - 1] = std::move(leftInner->keys[leftInner->count - 1]);
+				leftInner->count--;
+			}
+			else if (right && right->count > cMinCount)
+			{
+				auto rightInner = static_cast<Inner*>(right);
+				innerChild->keys[innerChild->count] = std::move(parent->keys[index]);
+				innerChild->children[innerChild->count + 1] = rightInner->children[0];
+				innerChild->count++;
+
+				parent->keys[index] = std::move(rightInner->keys[0]);
+				for (size_t i = 0; i + 1 < rightInner->count; i++)
+				{
+					rightInner->keys[i] = std::move(rightInner->keys[i + 1]);
+					rightInner->children[i] = rightInner->children[i + 1];
+				}
+				rightInner->children[rightInner->count - 1] = rightInner->children[rightInner->count];
+				rightInner->count--;
+			}
+			else if (left)
+				MergeInners(parent, index - 1);
+			else if (right)
+				MergeInners(parent, index);
+		}
+	}
+
+	// merges children[index + 1] into children[index]
+	void MergeLeaves(Inner* parent, size_t index)
+	{
+		auto left = static_cast<Leaf*>(parent->children[index]);
+		auto right = static_cast<Leaf*>(parent->children[index + 1]);
+
+		MoveEntries(right, 0, right->count, left, left->count);
+		left->count += right->count;
+
+		left->next = right->next;
+		if (left->next)
+			left->next->prev = left;
+
+		RemoveFromInner(parent, index);
+		delete right;
+		m_leafCount--;
+	}
+
+	void MergeInners(Inner* parent, size_t index)
+	{
+		auto left = static_cast<Inner*>(parent->children[index]);
+		auto right = static_cast<Inner*>(parent->children[index + 1]);
+
+		left->keys[left->count] = std::move(parent->keys[index]);
+		for (size_t i = 0; i < right->count; i++)
+		{
+			left->keys[left->count + 1 + i] = std::move(right->keys[i]);
+			left->children[left->count + 1 + i] = right->children[i];
+		}
+		left->children[left->count + 1 + right->count] = right->children[right->count];
+		left->count += right->count + 1;
+
+		RemoveFromInner(parent, index);
+
+		right->count = 0; // children were moved to the left node
+		delete right;
+		m_innerCount--;
+	}
+
+	// removes keys[index] and children[index + 1]
+	void RemoveFromInner(Inner* inner, size_t index)
+	{
+		for (auto i = index; i + 1 < inner->count; i++)
+		{
+			inner->keys[i] = std::move(inner->keys[i + 1]);
+			inner->children[i + 1] = inner->children[i + 2];
+		}
+		inner->count--;
+	}
+
+	static void MoveEntries(Leaf* from, size_t begin, size_t end, Leaf* to, size_t toIndex)
+	{
+		for (auto i = begin; i < end; i++, toIndex++)
+		{
+			to->keys[toIndex] = std::move(from->keys[i]);
+			to->values[toIndex] = std::move(from->values[i]);
+		}
+	}
+
+	// shifts [begin, end) by the offset to the right
+	static void MoveEntriesBackward(Leaf* leaf, size_t begin, size_t end, size_t offset)
+	{
+		for (auto i = end; i > begin; i--)
+		{
+			leaf->keys[i - 1 + offset] = std::move(leaf->keys[i - 1]);
+			leaf->values[i - 1 + offset] = std::move(leaf->values[i - 1]);
+		}
+	}
+
+	// releases resources held by a vacant position
+	static void ResetEntry(Leaf* leaf, size_t index)
+	{
+		leaf->keys[index] = KeyT{};
+		leaf->values[index] = ValueT{};
+	}
+
+	static Node* Clone(const Node* node, Leaf*& lastLeaf)
+	{
+		if (node->leaf)
+		{
+			auto leaf = new Leaf(*static_cast<const Leaf*>(node));
+			leaf->prev = lastLeaf;
+			leaf->next = nullptr;
+			if (lastLeaf)
+				lastLeaf->next = leaf;
+			lastLeaf = leaf;
+			return leaf;
+		}
+
+		// frees the part cloned so far if copying a key or a value throws
+		auto source = static_cast<const Inner*>(node);
+		auto inner = new Inner;
+		size_t cloned = 0;
+		try
+		{
+			inner->keys = source->keys;
+			for (; cloned <= source->count; cloned++)
+				inner->children[cloned] = Clone(source->children[cloned], lastLeaf);
+		}
+		catch (...)
+		{
+			for (size_t i = 0; i < cloned; i++)
+				Free(inner->children[i]);
+			delete inner;
+			throw;
+		}
+
+		inner->count = source->count;
+		return inner;
+	}
+
+	static void Free(Node* node)
+	{
+		if (!node)
+			return;
+
+		if (node->leaf)
+		{
+			delete static_cast<Leaf*>(node);
+			return;
+		}
+
+		auto inner = static_cast<Inner*>(node);
+		for (size_t i = 0; i <= inner->count; i++)
+			Free(inner->children[i]);
+		delete inner;
+	}
+
+	void Swap(BPlusTreeMap& other) noexcept
+	{
+		std::swap(m_root, other.m_root);
+		std::swap(m_size, other.m_size);
+		std::swap(m_leafCount, other.m_leafCount);
+		std::swap(m_innerCount, other.m_innerCount);
+		std::swap(m_compare, other.m_compare);
+	}
+
+private:
+	Node* m_root = nullptr;
+	size_t m_size = 0;
+	size_t m_leafCount = 1;
+	size_t m_innerCount = 0;
+	CompareT m_compare;
+};
+
+} //namespace utils
+
+} //namespace vs
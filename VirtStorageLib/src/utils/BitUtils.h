@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace vs
+{
+
+namespace utils
+{
+
+// returns the index of the least significant set bit; value must not be zero
+inline uint32_t CountTrailingZeros(uint64_t value) noexcept
+{
+#if defined(_MSC_VER)
+	unsigned long index = 0;
+	_BitScanForward64(&index, value);
+	return static_cast<uint32_t>(index);
+#else
+	return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+}
+
+// returns the number of zero bits above the most significant set bit; value must not be zero
+inline uint32_t CountLeadingZeros(uint64_t value) noexcept
+{
+#if defined(_MSC_VER)
+	unsigned long index = 0;
+	_BitScanReverse64(&index, value);
+	return static_cast<uint32_t>(63 - index);
+#else
+	return static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+}
+
+// finalizer of MurmurHash3; spreads poor hashes (e.g. std::hash<int> is an identity)
+inline uint64_t MixHash(uint64_t h) noexcept
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+// a hint to bring a cache line in ahead of use; never faults
+inline void Prefetch(const void* address) noexcept
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	_mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#elif defined(__GNUC__)
+	__builtin_prefetch(address);
+#else
+	(void)address;
+#endif
+}
+
+inline size_t NextPowerOfTwo(size_t value) noexcept
+{
+	size_t res = 1;
+	while (res < value)
+		res <<= 1;
+	return res;
+}
+
+} //namespace utils
+
+} //namespace vs
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include "BitUtils.h"
+#include "NonCopyable.h"
+
+namespace vs
+{
+
+namespace utils
+{
+
+//
+// BloomFilter
+//
+// Blocked Bloom filter over 64-bit hashes: all bits of a hash are in one cache line,
+// so a lookup costs a single cache miss. Bits are set with atomic or, so Add and MayContain
+// may be called concurrently. Keys cannot be removed.
+//
+
+class BloomFilter :
+	private NonCopyable
+{
+public:
+	// about 1% of false positives while the filter holds no more keys than its capacity
+	static constexpr size_t cBitsPerKey = 10;
+	static constexpr size_t cHashCount = 7;
+
+	explicit BloomFilter(size_t capacity) :
+		m_blockMask{ NextPowerOfTwo(std::max<size_t>(1, capacity * cBitsPerKey / cBlockBits)) - 1 },
+		m_blocks{ new Block[m_blockMask + 1] }
+	{
+	}
+
+	size_t GetCapacity() const noexcept
+	{
+		return (m_blockMask + 1) * cBlockBits / cBitsPerKey;
+	}
+
+	// hash must be well mixed (see MixHash)
+	void Add(uint64_t hash) noexcept
+	{
+		auto& block = m_blocks[BlockIndex(hash)];
+		ForEachBit(hash,
+			[&block](size_t bit)
+			{
+				block.words[bit / 64].fetch_or(uint64_t{ 1 } << (bit % 64), std::memory_order_relaxed);
+				return true;
+			});
+	}
+
+	// false if the hash was surely not added
+	bool MayContain(uint64_t hash) const noexcept
+	{
+		const auto& block = m_blocks[BlockIndex(hash)];
+		return ForEachBit(hash,
+			[&block](size_t bit)
+			{
+				return (block.words[bit / 64].load(std::memory_order_relaxed) & (uint64_t{ 1 } << (bit % 64))) != 0;
+			});
+	}
+
+private:
+	static constexpr size_t cCacheLineSize = 64;
+	static constexpr size_t cBlockBits = cCacheLineSize * 8;
+
+	struct alignas(cCacheLineSize) Block
+	{
+		std::atomic<uint64_t> words[cBlockBits / 64] = {};
+	};
+
+	size_t BlockIndex(uint64_t hash) const noexcept
+	{
+		return static_cast<size_t>(hash >> 32) & m_blockMask;
+	}
+
+	// double hashing within a block; stops once f returns false
+	template<typename F>
+	static bool ForEachBit(uint64_t hash, const F& f) noexcept
+	{
+		const auto bits = MixHash(hash);
+		const auto h1 = static_cast<uint32_t>(bits);
+		const auto h2 = static_cast<uint32_t>(bits >> 32) | 1;
+
+		for (uint32_t i = 0; i < cHashCount; i++)
+		{
+			if (!f((h1 + i * h2) % cBlockBits))
+				return false;
+		}
+
+		return true;
+	}
+
+private:
+	const size_t m_blockMask;
+	const std::unique_ptr<Block[]> m_blocks;
+};
+
+} //namespace utils
+
+} //namespace vs
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+namespace vs
+{
+
+namespace utils
+{
+
+// CRC-32 (IEEE 802.3); detects torn and corrupted records in files
+inline uint32_t Crc32(const void* data, size_t size) noexcept
+{
+	static const auto table = []()
+	{
+		std::array<uint32_t, 256> res{};
+		for (uint32_t i = 0; i < res.size(); i++)
+		{
+			auto crc = i;
+			for (int bit = 0; bit < 8; bit++)
+				crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+			res[i] = crc;
+		}
+		return res;
+	}();
+
+	auto crc = 0xFFFFFFFFu;
+	const auto bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++)
+		crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+
+	return crc ^ 0xFFFFFFFFu;
+}
+
+} //namespace utils
+
+} //namespace vs
@@ -0,0 +1,198 @@
+#include "EpochManager.h"
+
+#include <vector>
+#include <algorithm>
+#include <mutex>
+
+namespace vs
+{
+
+namespace utils
+{
+
+namespace
+{
+
+constexpr uint64_t cInactiveEpoch = 0;
+constexpr size_t cCollectThreshold = 64;
+constexpr size_t cCacheLineSize = 64;
+
+// per-thread state; a record is reused by another thread after its owner exits
+struct alignas(cCacheLineSize) ThreadRecord
+{
+	std::atomic<uint64_t> epoch{ cInactiveEpoch };
+	std::atomic<bool> inUse{ false };
+	ThreadRecord* next = nullptr;
+};
+
+struct RetiredObject
+{
+	void* object;
+	EpochManager::Deleter deleter;
+	uint64_t epoch;
+};
+
+struct RetiredList
+{
+	~RetiredList()
+	{
+		// process shutdown: nobody reads anymore
+		for (const auto& retired : objects)
+			retired.deleter(retired.object);
+	}
+
+	std::vector<RetiredObject> objects;
+	size_t collectAt = cCollectThreshold;
+	std::mutex mutex;
+};
+
+std::atomic<ThreadRecord*> g_records{ nullptr };
+std::atomic<uint64_t> g_globalEpoch{ 1 };
+
+RetiredList& GetRetiredList()
+{
+	static RetiredList retiredList;
+	return retiredList;
+}
+
+ThreadRecord* AcquireRecord()
+{
+	for (auto record = g_records.load(std::memory_order_acquire); record; record = record->next)
+	{
+		bool expected = false;
+		if (!record->inUse.load(std::memory_order_relaxed) &&
+			record->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+			return record;
+	}
+
+	// records are never freed, their number is bounded by the peak number of threads
+	auto record = new ThreadRecord;
+	record->inUse.store(true, std::memory_order_relaxed);
+
+	auto head = g_records.load(std::memory_order_relaxed);
+	do
+	{
+		record->next = head;
+	} while (!g_records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+
+	return record;
+}
+
+struct ThreadState
+{
+	ThreadState() : record{ AcquireRecord() }
+	{
+	}
+
+	~ThreadState()
+	{
+		record->epoch.store(cInactiveEpoch, std::memory_order_release);
+		record->inUse.store(false, std::memory_order_release);
+	}
+
+	ThreadRecord* record;
+	uint32_t depth = 0;
+};
+
+ThreadState& GetThreadState()
+{
+	thread_local ThreadState state;
+	return state;
+}
+
+// the global epoch can move on when every thread inside a critical section has observed it
+bool TryAdvanceEpoch()
+{
+	auto epoch = g_globalEpoch.load(std::memory_order_acquire);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	for (auto record = g_records.load(std::memory_order_acquire); record; record = record->next)
+	{
+		const auto recordEpoch = record->epoch.load(std::memory_order_acquire);
+		if (recordEpoch != cInactiveEpoch && recordEpoch != epoch)
+			return false;
+	}
+
+	return g_globalEpoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+}
+
+// an object retired in epoch E can't be reached by anyone once the global epoch is E + 2
+void CollectRetired(bool force)
+{
+	std::vector<RetiredObject> reclaimable;
+
+	{
+		auto& retiredList = GetRetiredList();
+		std::lock_guard lock(retiredList.mutex);
+
+		if (!force && retiredList.objects.size() < retiredList.collectAt)
+			return;
+
+		TryAdvanceEpoch();
+		const auto epoch = g_globalEpoch.load(std::memory_order_acquire);
+
+		auto& objects = retiredList.objects;
+		auto it = std::partition(objects.begin(), objects.end(),
+			[epoch](const RetiredObject& retired)
+			{
+				return retired.epoch + 2 > epoch;
+			});
+
+		reclaimable.assign(it, objects.end());
+		objects.erase(it, objects.end());
+
+		// long critical sections may hold reclamation back; don't rescan on every retire then
+		retiredList.collectAt = std::max(cCollectThreshold, objects.size() * 2);
+	}
+
+	// deleters may be heavy; run them outside the lock
+	for (const auto& retired : reclaimable)
+		retired.deleter(retired.object);
+}
+
+} //namespace
+
+void EpochManager::Enter() noexcept
+{
+	auto& state = GetThreadState();
+	if (state.depth++ != 0)
+		return;
+
+	state.record->epoch.store(g_globalEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+	// the announced epoch must be visible before any protected pointer is read
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void EpochManager::Leave() noexcept
+{
+	auto& state = GetThreadState();
+	if (--state.depth != 0)
+		return;
+
+	state.record->epoch.store(cInactiveEpoch, std::memory_order_release);
+}
+
+void EpochManager::Retire(void* object, Deleter deleter)
+{
+	// the object was unlinked before the epoch it is stamped with is read
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	{
+		auto& retiredList = GetRetiredList();
+		std::lock_guard lock(retiredList.mutex);
+		retiredList.objects.push_back({ object, deleter, g_globalEpoch.load(std::memory_order_acquire) });
+	}
+
+	CollectRetired(false);
+}
+
+void EpochManager::Collect()
+{
+	CollectRetired(true);
+}
+
+} //namespace utils
+
+} //namespace vs
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace vs
+{
+
+namespace utils
+{
+
+//
+// EpochManager
+//
+// Epoch-based memory reclamation. Readers enter a critical section with Guard, which only
+// writes to the calling thread's own record; writers unlink objects from shared structures
+// and hand them to Retire. Retired objects are deleted once every thread that might still
+// see them has left its critical section.
+//
+
+class EpochManager
+{
+public:
+	using Deleter = void(*)(void*);
+
+	// RAII critical section; may be nested
+	class Guard
+	{
+	public:
+		Guard() noexcept
+		{
+			Enter();
+		}
+
+		~Guard()
+		{
+			Leave();
+		}
+
+		Guard(const Guard&) = delete;
+		Guard& operator = (const Guard&) = delete;
+	};
+
+	template<typename T>
+	static void Retire(T* object)
+	{
+		Retire(object, [](void* p) { delete static_cast<T*>(p); });
+	}
+
+	static void Retire(void* object, Deleter deleter);
+
+	// deletes everything that can be reclaimed at the moment
+	static void Collect();
+
+private:
+	static void Enter() noexcept;
+	static void Leave() noexcept;
+};
+
+} //namespace utils
+
+} //namespace vs
@@ -0,0 +1,473 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <functional>
+#include <cstring>
+#include <cstdint>
+#include <new>
+
+#include "BitUtils.h"
+
+namespace vs
+{
+
+namespace utils
+{
+
+//
+// FlatHashMap
+//
+// Open-addressing hash map in the spirit of Swiss tables: entries live in one flat array,
+// every slot has a control byte (empty, deleted or 7 bits of the key hash) and probing
+// inspects a group of 8 control bytes at once with SWAR arithmetic, so a lookup usually
+// touches one control word and one slot instead of walking a bucket chain.
+//
+// Provides the subset of the std::unordered_map interface used by the library.
+// Any insertion may invalidate iterators and references.
+//
+
+template<typename KeyT, typename ValueT, typename HashT = std::hash<KeyT>, typename KeyEqualT = std::equal_to<KeyT>>
+class FlatHashMap
+{
+public:
+	using key_type = KeyT;
+	using mapped_type = ValueT;
+	using value_type = std::pair<const KeyT, ValueT>;
+	using size_type = size_t;
+
+private:
+	template<bool IsConst>
+	class IteratorImpl
+	{
+	public:
+		using MapPtr = std::conditional_t<IsConst, const FlatHashMap*, FlatHashMap*>;
+		using reference = std::conditional_t<IsConst, const value_type&, value_type&>;
+		using pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+
+		IteratorImpl() = default;
+		IteratorImpl(MapPtr map, size_t index) : m_map{ map }, m_index{ index }
+		{
+			SkipFree();
+		}
+
+		// iterator -> const_iterator
+		template<bool OtherIsConst, typename = std::enable_if_t<IsConst && !OtherIsConst>>
+		IteratorImpl(const IteratorImpl<OtherIsConst>& other) : m_map{ other.m_map }, m_index{ other.m_index }
+		{
+		}
+
+		reference operator*() const { return m_map->m_slots[m_index]; }
+		pointer operator->() const { return &m_map->m_slots[m_index]; }
+
+		IteratorImpl& operator++()
+		{
+			++m_index;
+			SkipFree();
+			return *this;
+		}
+
+		IteratorImpl operator++(int)
+		{
+			auto res = *this;
+			++(*this);
+			return res;
+		}
+
+		bool operator==(const IteratorImpl& rhs) const noexcept { return m_index == rhs.m_index; }
+		bool operator!=(const IteratorImpl& rhs) const noexcept { return m_index != rhs.m_index; }
+
+	private:
+		friend class FlatHashMap;
+		template<bool> friend class IteratorImpl;
+
+		void SkipFree()
+		{
+			while (m_index < m_map->m_capacity && !IsFull(m_map->m_ctrl[m_index]))
+				++m_index;
+		}
+
+		MapPtr m_map = nullptr;
+		size_t m_index = 0;
+	};
+
+public:
+	using iterator = IteratorImpl<false>;
+	using const_iterator = IteratorImpl<true>;
+
+public:
+	FlatHashMap() = default;
+
+	FlatHashMap(const FlatHashMap& other) : m_hasher{ other.m_hasher }, m_keyEqual{ other.m_keyEqual }
+	{
+		if (other.m_capacity == 0)
+			return;
+
+		// keeps the layout of the source; no rehashing is needed
+		Allocate(other.m_capacity);
+		size_t constructed = 0;
+		try
+		{
+			for (; constructed < m_capacity; constructed++)
+			{
+				if (IsFull(other.m_ctrl[constructed]))
+					new (&m_slots[constructed]) value_type(other.m_slots[constructed]);
+			}
+		}
+		catch (...)
+		{
+			for (size_t i = 0; i < constructed; i++)
+				if (IsFull(other.m_ctrl[i]))
+					m_slots[i].~value_type();
+			Deallocate();
+			throw;
+		}
+
+		std::memcpy(m_ctrl.get(), other.m_ctrl.get(), m_capacity);
+		m_size = other.m_size;
+		m_growthLeft = other.m_growthLeft;
+	}
+
+	FlatHashMap(FlatHashMap&& other) noexcept
+	{
+		Swap(other);
+	}
+
+	FlatHashMap& operator = (const FlatHashMap& other)
+	{
+		if (this != &other)
+		{
+			FlatHashMap copy(other);
+			Swap(copy);
+		}
+		return *this;
+	}
+
+	FlatHashMap& operator = (FlatHashMap&& other) noexcept
+	{
+		if (this != &other)
+		{
+			FlatHashMap tmp(std::move(other));
+			Swap(tmp);
+		}
+		return *this;
+	}
+
+	~FlatHashMap()
+	{
+		DestroySlots();
+		Deallocate();
+	}
+
+	iterator begin() noexcept { return iterator(this, 0); }
+	iterator end() noexcept { return iterator(this, m_capacity); }
+	const_iterator begin() const noexcept { return const_iterator(this, 0); }
+	const_iterator end() const noexcept { return const_iterator(this, m_capacity); }
+
+	size_t size() const noexcept { return m_size; }
+	bool empty() const noexcept { return m_size == 0; }
+
+	size_t capacity() const noexcept { return m_capacity; }
+	// slots and control bytes, used or not
+	size_t allocated_bytes() const noexcept { return m_capacity * (sizeof(value_type) + sizeof(Ctrl)); }
+
+	// the beginning of one of partCount parts of the same number of slots; partCount gives end().
+	// Parts can be iterated concurrently
+	const_iterator split_point(size_t part, size_t partCount) const noexcept
+	{
+		return const_iterator(this, part >= partCount ? m_capacity : m_capacity * part / partCount);
+	}
+
+	iterator find(const KeyT& key)
+	{
+		return iterator(this, FindIndex(key, HashOf(key)));
+	}
+
+	const_iterator find(const KeyT& key) const
+	{
+		return const_iterator(this, FindIndex(key, HashOf(key)));
+	}
+
+	size_t count(const KeyT& key) const
+	{
+		return FindIndex(key, HashOf(key)) != m_capacity ? 1 : 0;
+	}
+
+	// brings the first group probed for a key into the cache; lets batched lookups overlap misses
+	void prefetch(const KeyT& key) const
+	{
+		if (m_capacity == 0)
+			return;
+
+		const auto group = H1(HashOf(key)) & GroupMask();
+		Prefetch(m_ctrl.get() + group * cGroupSize);
+		Prefetch(m_slots + group * cGroupSize);
+	}
+
+	template<typename... ArgsT>
+	std::pair<iterator, bool> try_emplace(const KeyT& key, ArgsT&&... args)
+	{
+		const auto hash = HashOf(key);
+		auto index = FindIndex(key, hash);
+		if (index != m_capacity)
+			return { iterator(this, index), false };
+
+		index = PrepareInsert(hash);
+		new (&m_slots[index]) value_type(std::piecewise_construct,
+			std::forward_as_tuple(key),
+			std::forward_as_tuple(std::forward<ArgsT>(args)...));
+		SetCtrl(index, H2(hash));
+		m_size++;
+
+		return { iterator(this, index), true };
+	}
+
+	template<typename T>
+	std::pair<iterator, bool> insert_or_assign(const KeyT& key, T&& value)
+	{
+		auto res = try_emplace(key, std::forward<T>(value));
+		if (!res.second)
+			res.first->second = std::forward<T>(value);
+		return res;
+	}
+
+	size_t erase(const KeyT& key)
+	{
+		const auto index = FindIndex(key, HashOf(key));
+		if (index == m_capacity)
+			return 0;
+
+		EraseAt(index);
+		return 1;
+	}
+
+	iterator erase(const_iterator it)
+	{
+		const auto index = it.m_index;
+		EraseAt(index);
+		return iterator(this, index + 1);
+	}
+
+	void clear() noexcept
+	{
+		if (m_capacity == 0)
+			return;
+
+		DestroySlots();
+		std::memset(m_ctrl.get(), static_cast<uint8_t>(cEmpty), m_capacity);
+		m_size = 0;
+		m_growthLeft = MaxLoad(m_capacity);
+	}
+
+	void reserve(size_t count)
+	{
+		if (count <= m_size + m_growthLeft)
+			return;
+
+		Resize(CapacityFor(count));
+	}
+
+private:
+	using Ctrl = int8_t;
+
+	static constexpr Ctrl cEmpty = -128;   // 0b10000000
+	static constexpr Ctrl cDeleted = -2;   // 0b11111110
+	static constexpr size_t cGroupSize = 8;
+	static constexpr uint64_t cLsbs = 0x0101010101010101ULL;
+	static constexpr uint64_t cMsbs = 0x8080808080808080ULL;
+
+	static bool IsFull(Ctrl ctrl) noexcept { return ctrl >= 0; }
+
+	static uint64_t H1(uint64_t hash) noexcept { return hash >> 7; }
+	static Ctrl H2(uint64_t hash) noexcept { return static_cast<Ctrl>(hash & 0x7F); }
+
+	// 7/8 of slots can be occupied, so every probe sequence meets an empty slot
+	static size_t MaxLoad(size_t capacity) noexcept { return capacity - capacity / 8; }
+
+	static size_t CapacityFor(size_t count) noexcept
+	{
+		return NextPowerOfTwo(std::max<size_t>(cGroupSize, count + count / 7 + 1));
+	}
+
+	// masks of bytes (their high bits) in a group word matching a condition
+	static uint64_t MatchByte(uint64_t group, Ctrl h2) noexcept
+	{
+		// may report false positives next to a real match; keys are always compared afterwards
+		const auto x = group ^ (cLsbs * static_cast<uint8_t>(h2));
+		return (x - cLsbs) & ~x & cMsbs;
+	}
+
+	static uint64_t MatchEmpty(uint64_t group) noexcept
+	{
+		return group & ~(group << 6) & cMsbs;
+	}
+
+	static uint64_t MatchEmptyOrDeleted(uint64_t group) noexcept
+	{
+		return group & cMsbs;
+	}
+
+	uint64_t HashOf(const KeyT& key) const
+	{
+		return MixHash(static_cast<uint64_t>(m_hasher(key)));
+	}
+
+	size_t GroupMask() const noexcept { return m_capacity / cGroupSize - 1; }
+
+	uint64_t LoadGroup(size_t group) const noexcept
+	{
+		uint64_t res;
+		std::memcpy(&res, m_ctrl.get() + group * cGroupSize, sizeof(res));
+		return res;
+	}
+
+	void SetCtrl(size_t index, Ctrl ctrl) noexcept
+	{
+		m_ctrl[index] = ctrl;
+	}
+
+	// returns m_capacity if not found
+	size_t FindIndex(const KeyT& key, uint64_t hash) const
+	{
+		if (m_capacity == 0)
+			return m_capacity;
+
+		const auto mask = GroupMask();
+		const auto h2 = H2(hash);
+
+		// triangular probing over groups visits every group once
+		for (size_t group = H1(hash) & mask, step = 1;; group = (group + step++) & mask)
+		{
+			const auto ctrl = LoadGroup(group);
+			for (auto matches = MatchByte(ctrl, h2); matches; matches &= matches - 1)
+			{
+				const auto index = group * cGroupSize + CountTrailingZeros(matches) / 8;
+				if (m_keyEqual(m_slots[index].first, key))
+					return index;
+			}
+
+			if (MatchEmpty(ctrl))
+				return m_capacity;
+		}
+	}
+
+	size_t FindFreeIndex(uint64_t hash) const noexcept
+	{
+		const auto mask = GroupMask();
+		for (size_t group = H1(hash) & mask, step = 1;; group = (group + step++) & mask)
+		{
+			if (const auto free = MatchEmptyOrDeleted(LoadGroup(group)))
+				return group * cGroupSize + CountTrailingZeros(free) / 8;
+		}
+	}
+
+	size_t PrepareInsert(uint64_t hash)
+	{
+		if (m_capacity == 0)
+			Resize(cGroupSize);
+
+		auto index = FindFreeIndex(hash);
+		if (m_growthLeft == 0 && m_ctrl[index] != cDeleted)
+		{
+			// plenty of tombstones: rehash in place, otherwise grow
+			Resize(m_size * 2 < MaxLoad(m_capacity) ? m_capacity : m_capacity * 2);
+			index = FindFreeIndex(hash);
+		}
+
+		if (m_ctrl[index] == cEmpty)
+			m_growthLeft--;
+
+		return index;
+	}
+
+	void EraseAt(size_t index)
+	{
+		m_slots[index].~value_type();
+		m_size--;
+
+		// no probe sequence can have passed a group which still has an empty slot,
+		// so the slot may become empty instead of a tombstone
+		if (MatchEmpty(LoadGroup(index / cGroupSize)))
+		{
+			SetCtrl(index, cEmpty);
+			m_growthLeft++;
+		}
+		else
+			SetCtrl(index, cDeleted);
+	}
+
+	void Resize(size_t newCapacity)
+	{
+		FlatHashMap newMap;
+		newMap.Allocate(newCapacity);
+
+		for (size_t i = 0; i < m_capacity; i++)
+		{
+			if (!IsFull(m_ctrl[i]))
+				continue;
+
+			const auto hash = HashOf(m_slots[i].first);
+			const auto index = newMap.FindFreeIndex(hash);
+			new (&newMap.m_slots[index]) value_type(std::move_if_noexcept(m_slots[i]));
+			newMap.SetCtrl(index, H2(hash));
+			newMap.m_growthLeft--;
+			newMap.m_size++;
+		}
+
+		Swap(newMap);
+	}
+
+	void Allocate(size_t capacity)
+	{
+		m_ctrl.reset(new Ctrl[capacity]);
+		std::memset(m_ctrl.get(), static_cast<uint8_t>(cEmpty), capacity);
+		m_slots = std::allocator<value_type>().allocate(capacity);
+		m_capacity = capacity;
+		m_growthLeft = MaxLoad(capacity);
+	}
+
+	void Deallocate() noexcept
+	{
+		if (m_slots)
+			std::allocator<value_type>().deallocate(m_slots, m_capacity);
+
+		m_slots = nullptr;
+		m_ctrl.reset();
+		m_capacity = 0;
+		m_size = 0;
+		m_growthLeft = 0;
+	}
+
+	void DestroySlots() noexcept
+	{
+		for (size_t i = 0; i < m_capacity; i++)
+			if (IsFull(m_ctrl[i]))
+				m_slots[i].~value_type();
+	}
+
+	void Swap(FlatHashMap& other) noexcept
+	{
+		std::swap(m_ctrl, other.m_ctrl);
+		std::swap(m_slots, other.m_slots);
+		std::swap(m_capacity, other.m_capacity);
+		std::swap(m_size, other.m_size);
+		std::swap(m_growthLeft, other.m_growthLeft);
+		std::swap(m_hasher, other.m_hasher);
+		std::swap(m_keyEqual, other.m_keyEqual);
+	}
+
+private:
+	std::unique_ptr<Ctrl[]> m_ctrl;
+	value_type* m_slots = nullptr;
+	size_t m_capacity = 0;
+	size_t m_size = 0;
+	size_t m_growthLeft = 0;
+
+	HashT m_hasher;
+	KeyEqualT m_keyEqual;
+};
+
+} //namespace utils
+
+} //namespace vs
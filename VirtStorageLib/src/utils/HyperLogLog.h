@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "BitUtils.h"
+
+namespace vs
+{
+
+namespace utils
+{
+
+//
+// HyperLogLog
+//
+// Estimates the number of distinct 64-bit hashes added to it in cRegisterCount bytes: a register
+// keeps the longest run of leading zeros seen among hashes falling into it. The standard error
+// is about 1.04 / sqrt(cRegisterCount), i.e. 1.6%; small counts are corrected by linear counting.
+// Hashes must be well mixed (see MixHash). Not thread-safe
+//
+
+class HyperLogLog
+{
+public:
+	static constexpr unsigned cIndexBits = 12;
+	static constexpr size_t cRegisterCount = size_t{ 1 } << cIndexBits;
+
+	void Add(uint64_t hash) noexcept
+	{
+		const auto index = static_cast<size_t>(hash >> (64 - cIndexBits));
+		const auto rest = hash << cIndexBits;
+		const auto rank = static_cast<uint8_t>(rest == 0 ? 64 - cIndexBits + 1 : CountLeadingZeros(rest) + 1);
+
+		m_registers[index] = std::max(m_registers[index], rank);
+	}
+
+	size_t Estimate() const noexcept
+	{
+		constexpr auto m = static_cast<double>(cRegisterCount);
+		constexpr auto alpha = 0.7213 / (1 + 1.079 / m);
+
+		double sum = 0;
+		size_t zeros = 0;
+		for (const auto rank : m_registers)
+		{
+			sum += std::ldexp(1.0, -static_cast<int>(rank));
+			if (rank == 0)
+				zeros++;
+		}
+
+		auto estimate = alpha * m * m / sum;
+		if (estimate <= 2.5 * m && zeros != 0)
+			estimate = m * std::log(m / static_cast<double>(zeros));
+
+		return static_cast<size_t>(std::llround(estimate));
+	}
+
+private:
+	std::array<uint8_t, cRegisterCount> m_registers{};
+};
+
+} //namespace utils
+
+} //namespace vs
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "TypeTraits.h"
+
+namespace vs
+{
+
+namespace utils
+{
+
+//
+// GetMemorySize
+//
+// An estimation of memory taken by an object: its size plus the heap memory of strings
+// and vectors it is (or a variant of them is). Other types own no heap memory for it
+//
+
+template<typename T>
+size_t GetHeapSize(const T&) noexcept
+{
+	return 0;
+}
+
+template<typename CharT, typename TraitsT, typename AllocatorT>
+size_t GetHeapSize(const std::basic_string<CharT, TraitsT, AllocatorT>& str) noexcept
+{
+	// short strings are kept in place
+	return str.capacity() > std::basic_string<CharT, TraitsT, AllocatorT>().capacity() ? (str.capacity() + 1) * sizeof(CharT) : 0;
+}
+
+template<typename T, typename AllocatorT>
+size_t GetHeapSize(const std::vector<T, AllocatorT>& vec) noexcept
+{
+	return vec.capacity() * sizeof(T);
+}
+
+template<typename... Ts>
+size_t GetHeapSize(const std::variant<Ts...>& var) noexcept
+{
+	if (var.valueless_by_exception())
+		return 0;
+
+	return std::visit(
+		[](const auto& value)
+		{
+			return GetHeapSize(value);
+		}, var);
+}
+
+template<typename T>
+size_t GetMemorySize(const T& value) noexcept
+{
+	return sizeof(T) + GetHeapSize(value);
+}
+
+// memory a map takes beyond its key-values (which GetMemorySize estimates); node-based maps
+// without a report of their own are estimated by their typical layout
+template<typename MapT>
+size_t GetMapOverhead(const MapT& map) noexcept
+{
+	const auto entryBytes = map.size() * (sizeof(typename MapT::key_type) + sizeof(typename MapT::mapped_type));
+
+	if constexpr (HasAllocatedBytes<MapT>::value)
+	{
+		const auto allocated = map.allocated_bytes();
+		return allocated > entryBytes ? allocated - entryBytes : 0;
+	}
+	else if constexpr (HasBuckets<MapT>::value)
+	{
+		// a bucket array, and a link and a cached hash in every node
+		return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(void*) + sizeof(size_t));
+	}
+	else
+	{
+		// a red-black tree node: three links and a color
+		return map.size() * 4 * sizeof(void*);
+	}
+}
+
+} //namespace utils
+
+} //namespace vs
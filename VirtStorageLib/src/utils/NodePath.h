@@ -0,0 +1,41 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+
+namespace vs
+{
+
+namespace utils
+{
+
+constexpr char cPathSeparator = '/';
+
+// Walks a path of child names separated by '/' from node: step(node, name) gives the child of node
+// with the name (nullptr if there is none). Empty names are skipped, so "a//b/" is "a/b" and an empty path
+// is node itself. Returns the last node of the path or nullptr if the walk stops on a missing child.
+// Nodes are passed as implementation pointers, so no proxies are made on the way
+template<typename NodePtrT, typename StepT>
+NodePtrT WalkPath(NodePtrT node, const std::string& path, const StepT& step)
+{
+	// a single buffer for names, as maps of children are looked up by strings
+	std::string name;
+
+	for (size_t begin = 0; node && begin < path.size();)
+	{
+		const auto end = std::min(path.find(cPathSeparator, begin), path.size());
+		if (end != begin)
+		{
+			name.assign(path, begin, end - begin);
+			node = step(*node, name);
+		}
+
+		begin = end + 1;
+	}
+
+	return node;
+}
+
+} //namespace utils
+
+} //namespace vs
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "NonCopyable.h"
+
+namespace vs
+{
+
+namespace utils
+{
+
+//
+// PageCollector
+//
+// Pages a container without the order of a page: items are offered in any order,
+// and up to count ones with the smallest keys greater than a given one are kept in a bounded max-heap.
+// Keys are compared by LessT
+//
+
+template<typename KeyT, typename ValueT, typename LessT = std::less<KeyT>>
+class PageCollector :
+	private NonCopyable
+{
+public:
+	using ItemType = std::pair<KeyT, ValueT>;
+
+	// after is nullptr for the first page
+	PageCollector(const KeyT* after, size_t count, const LessT& less = {}) : m_after{ after }, m_count{ count }, m_less{ less }
+	{
+	}
+
+	bool IsFull() const noexcept
+	{
+		return m_heap.size() == m_count;
+	}
+
+	// the greatest key kept; there must be one
+	const KeyT& GetLast() const noexcept
+	{
+		return m_heap.front().first;
+	}
+
+	// true if an item with the key would be kept now; lets a caller skip making the item
+	bool Accepts(const KeyT& key) const
+	{
+		if (m_count == 0 || (m_after && !m_less(*m_after, key)))
+			return false;
+
+		return m_heap.size() < m_count || m_less(key, m_heap.front().first);
+	}
+
+	// the key must be accepted
+	void Add(KeyT key, ValueT value)
+	{
+		if (m_heap.size() == m_count)
+		{
+			std::pop_heap(m_heap.begin(), m_heap.end(), KeyLess{ m_less });
+			m_heap.pop_back();
+		}
+
+		m_heap.emplace_back(std::move(key), std::move(value));
+		std::push_heap(m_heap.begin(), m_heap.end(), KeyLess{ m_less });
+	}
+
+	// appends kept items in ascending order
+	void MoveTo(std::vector<ItemType>& items)
+	{
+		std::sort_heap(m_heap.begin(), m_heap.end(), KeyLess{ m_less });
+		std::move(m_heap.begin(), m_heap.end(), std::back_inserter(items));
+		m_heap.clear();
+	}
+
+private:
+	struct KeyLess
+	{
+		bool operator () (const ItemType& left, const ItemType& right) const
+		{
+			return less(left.first, right.first);
+		}
+
+		const LessT& less;
+	};
+
+	const KeyT* const m_after;
+	const size_t m_count;
+	const LessT m_less;
+	std::vector<ItemType> m_heap;
+};
+
+} //namespace utils
+
+} //namespace vs
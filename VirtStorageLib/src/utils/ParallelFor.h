@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+#include "WorkStealingPool.h"
+
+namespace vs
+{
+
+namespace utils
+{
+
+// the number of workers a parallel operation gets from the default pool, including the calling thread
+inline size_t GetParallelism()
+{
+	return WorkStealingPool::GetDefault().GetThreadCount() + 1;
+}
+
+//
+// ParallelFor
+//
+// Calls f(worker, item) for every item of [0, itemCount) on up to workerCount workers of the default pool;
+// the calling thread is worker 0, others get indices less than workerCount as they join.
+// Items are handed out one by one, so uneven items balance out. The calling thread never waits
+// for helpers which haven't started yet: it takes the remaining items itself, so nested calls
+// made from pool tasks don't deadlock. The first exception thrown by f stops handing items out
+// and is rethrown once all started workers are done.
+//
+
+template<typename F>
+void ParallelFor(size_t workerCount, size_t itemCount, const F& f)
+{
+	struct State
+	{
+		std::atomic<size_t> nextItem{ 0 };
+		std::exception_ptr error;
+		size_t nextWorker = 1;
+		size_t activeHelpers = 0;
+		bool closed = false;
+		std::mutex mutex;
+		std::condition_variable helpersDone;
+	};
+
+	// helpers which start after the call has returned only see the state
+	const auto state = std::make_shared<State>();
+
+	const auto work =
+		[state, itemCount, &f](size_t worker)
+		{
+			try
+			{
+				for (auto item = state->nextItem++; item < itemCount; item = state->nextItem++)
+					f(worker, item);
+			}
+			catch (...)
+			{
+				std::lock_guard lock(state->mutex);
+				if (!state->error)
+					state->error = std::current_exception();
+				state->nextItem = itemCount;
+			}
+		};
+
+	auto& pool = WorkStealingPool::GetDefault();
+	const auto helperCount = std::max<size_t>(1, std::min({ workerCount, itemCount, pool.GetThreadCount() + 1 })) - 1;
+	for (size_t i = 0; i < helperCount; i++)
+		pool.Submit(
+			[state, work]()
+			{
+				size_t worker = 0;
+				{
+					std::lock_guard lock(state->mutex);
+					if (state->closed)
+						return;
+
+					worker = state->nextWorker++;
+					state->activeHelpers++;
+				}
+
+				work(worker);
+
+				std::lock_guard lock(state->mutex);
+				if (--state->activeHelpers == 0)
+					state->helpersDone.notify_all();
+			});
+
+	work(0);
+
+	{
+		std::unique_lock lock(state->mutex);
+		state->closed = true;
+		state->helpersDone.wait(lock,
+			[&state]()
+			{
+				return state->activeHelpers == 0;
+			});
+	}
+
+	if (state->error)
+		std::rethrow_exception(state->error);
+}
+
+} //namespace utils
+
+} //namespace vs
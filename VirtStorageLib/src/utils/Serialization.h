@@ -0,0 +1,204 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <variant>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+namespace vs
+{
+
+namespace utils
+{
+
+//
+// BinaryWriter/BinaryReader
+//
+// Native-endian binary encoding of keys and values for files written and read on the same platform.
+// Serializer<T> is specialized for arithmetic types, std::string, vectors of arithmetic types
+// and variants of serializable types; other types may add their own specializations.
+//
+
+class BinaryWriter
+{
+public:
+	explicit BinaryWriter(std::string& buffer) : m_buffer{ buffer }
+	{
+	}
+
+	void WriteBytes(const void* data, size_t size)
+	{
+		m_buffer.append(static_cast<const char*>(data), size);
+	}
+
+	template<typename T>
+	void WritePod(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+		WriteBytes(&value, sizeof(value));
+	}
+
+private:
+	std::string& m_buffer;
+};
+
+class BinaryReader
+{
+public:
+	BinaryReader(const char* data, size_t size) : m_data{ data }, m_end{ data + size }
+	{
+	}
+
+	// throws std::out_of_range if there is not enough data
+	void ReadBytes(void* data, size_t size)
+	{
+		if (size > Remaining())
+			throw std::out_of_range("Unexpected end of serialized data");
+
+		std::memcpy(data, m_data, size);
+		m_data += size;
+	}
+
+	template<typename T>
+	T ReadPod()
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+		T value;
+		ReadBytes(&value, sizeof(value));
+		return value;
+	}
+
+	size_t Remaining() const noexcept
+	{
+		return static_cast<size_t>(m_end - m_data);
+	}
+
+private:
+	const char* m_data;
+	const char* m_end;
+};
+
+template<typename T, typename = void>
+struct Serializer;
+
+template<typename T, typename = void>
+struct IsSerializable : std::false_type {};
+
+template<typename T>
+struct IsSerializable<T, std::void_t<decltype(Serializer<T>::Write(std::declval<BinaryWriter&>(), std::declval<const T&>()))>> : std::true_type {};
+
+template<typename T>
+struct Serializer<T, std::enable_if_t<std::is_arithmetic_v<T>>>
+{
+	static void Write(BinaryWriter& writer, const T& value)
+	{
+		writer.WritePod(value);
+	}
+
+	static void Read(BinaryReader& reader, T& value)
+	{
+		value = reader.ReadPod<T>();
+	}
+};
+
+template<>
+struct Serializer<std::string>
+{
+	static void Write(BinaryWriter& writer, const std::string& value)
+	{
+		writer.WritePod(static_cast<uint64_t>(value.size()));
+		writer.WriteBytes(value.data(), value.size());
+	}
+
+	static void Read(BinaryReader& reader, std::string& value)
+	{
+		value.resize(ReadSize(reader, 1));
+		reader.ReadBytes(value.data(), value.size());
+	}
+
+	// a size is checked against the remaining data, so a corrupted one doesn't cause a huge allocation
+	static size_t ReadSize(BinaryReader& reader, size_t elementSize)
+	{
+		const auto size = reader.ReadPod<uint64_t>();
+		if (size > reader.Remaining() / elementSize)
+			throw std::out_of_range("Unexpected end of serialized data");
+
+		return static_cast<size_t>(size);
+	}
+};
+
+template<typename T>
+struct Serializer<std::vector<T>, std::enable_if_t<std::is_arithmetic_v<T>>>
+{
+	static void Write(BinaryWriter& writer, const std::vector<T>& value)
+	{
+		writer.WritePod(static_cast<uint64_t>(value.size()));
+		writer.WriteBytes(value.data(), value.size() * sizeof(T));
+	}
+
+	static void Read(BinaryReader& reader, std::vector<T>& value)
+	{
+		value.resize(Serializer<std::string>::ReadSize(reader, sizeof(T)));
+		reader.ReadBytes(value.data(), value.size() * sizeof(T));
+	}
+};
+
+template<typename... Ts>
+struct Serializer<std::variant<Ts...>, std::enable_if_t<(IsSerializable<Ts>::value && ...)>>
+{
+	using VariantType = std::variant<Ts...>;
+
+	static_assert(sizeof...(Ts) < 256, "Too many variant alternatives");
+
+	static void Write(BinaryWriter& writer, const VariantType& value)
+	{
+		writer.WritePod(static_cast<uint8_t>(value.index()));
+		std::visit(
+			[&writer](const auto& alternative)
+			{
+				Serializer<std::decay_t<decltype(alternative)>>::Write(writer, alternative);
+			}, value);
+	}
+
+	static void Read(BinaryReader& reader, VariantType& value)
+	{
+		ReadAlternative<0>(reader, reader.ReadPod<uint8_t>(), value);
+	}
+
+private:
+	template<size_t I>
+	static void ReadAlternative(BinaryReader& reader, size_t index, VariantType& value)
+	{
+		if constexpr (I < sizeof...(Ts))
+		{
+			if (index != I)
+				return ReadAlternative<I + 1>(reader, index, value);
+
+			std::variant_alternative_t<I, VariantType> alternative;
+			Serializer<decltype(alternative)>::Read(reader, alternative);
+			value = std::move(alternative);
+		}
+		else
+			throw std::out_of_range("Invalid variant index in serialized data");
+	}
+};
+
+template<typename T>
+void Serialize(BinaryWriter& writer, const T& value)
+{
+	Serializer<T>::Write(writer, value);
+}
+
+template<typename T>
+void Deserialize(BinaryReader& reader, T& value)
+{
+	Serializer<T>::Read(reader, value);
+}
+
+} //namespace utils
+
+} //namespace vs
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace vs
+{
+
+namespace utils
+{
+
+//
+// TimerWheel
+//
+// Hierarchical timer wheel of keys: cLevelCount levels of cSlotCount slots, a slot of level L
+// spans cSlotCount^L ticks. A key is scheduled into the lowest level which slot ends no later than
+// the next slot of the upper level starts, and moves one level down when time reaches its slot,
+// so both scheduling and expiry cost O(1) per key. Keys scheduled beyond the top level wait
+// in its last slot and are rescheduled from there.
+// Not thread-safe
+//
+
+template<typename KeyT>
+class TimerWheel
+{
+public:
+	using Tick = uint64_t;
+
+public:
+	explicit TimerWheel(Tick now = 0) : m_now{ now }
+	{
+	}
+
+	Tick GetNow() const noexcept
+	{
+		return m_now;
+	}
+
+	size_t GetSize() const noexcept
+	{
+		return m_size;
+	}
+
+	// a deadline which has passed is due on the next Advance
+	void Schedule(const KeyT& key, Tick deadline)
+	{
+		Place(Entry{ key, deadline });
+		m_size++;
+	}
+
+	// moves time up to now and calls onDue(key) for keys which deadlines have come;
+	// stops after limit keys, the rest of them are due on the next call.
+	// Returns false if it has stopped because of the limit
+	template<typename OnDueT>
+	bool Advance(Tick now, size_t limit, const OnDueT& onDue)
+	{
+		size_t dueCount = 0;
+
+		for (;;)
+		{
+			if (m_size == 0)
+			{
+				m_now = std::max(m_now, now);
+				return true;
+			}
+
+			auto& dueSlot = GetSlot(0, m_now);
+			while (!dueSlot.empty())
+			{
+				if (dueCount == limit)
+					return false;
+
+				const auto entry = std::move(dueSlot.back());
+				dueSlot.pop_back();
+				m_levelSizes[0]--;
+				m_size--;
+
+				onDue(entry.key);
+				dueCount++;
+			}
+
+			if (m_now >= now)
+				return true;
+
+			// no key is due until the lowest level wraps around
+			if (m_levelSizes[0] == 0)
+				m_now = std::min(now, m_now | cSlotMask);
+
+			if (m_now < now)
+				Step();
+		}
+	}
+
+	void Clear()
+	{
+		m_slots.clear();
+		m_levelSizes.fill(0);
+		m_size = 0;
+	}
+
+private:
+	static constexpr size_t cLevelCount = 4;
+	static constexpr unsigned cSlotBits = 6;
+	static constexpr size_t cSlotCount = size_t{ 1 } << cSlotBits;
+	static constexpr Tick cSlotMask = cSlotCount - 1;
+
+	struct Entry
+	{
+		KeyT key;
+		Tick deadline;
+	};
+
+	using SlotType = std::vector<Entry>;
+
+	static size_t GetSlotIndex(size_t level, Tick tick) noexcept
+	{
+		return static_cast<size_t>((tick >> (level * cSlotBits)) & cSlotMask);
+	}
+
+	SlotType& GetSlot(size_t level, Tick tick)
+	{
+		if (m_slots.empty())
+			m_slots.resize(cLevelCount * cSlotCount);
+
+		return m_slots[level * cSlotCount + GetSlotIndex(level, tick)];
+	}
+
+	void Place(Entry&& entry)
+	{
+		auto level = size_t{ 0 };
+		auto tick = std::max(entry.deadline, m_now);
+
+		if (tick != m_now)
+		{
+			// the lowest level where the deadline and now share all upper digits
+			while (level < cLevelCount - 1 && (tick >> ((level + 1) * cSlotBits)) != (m_now >> ((level + 1) * cSlotBits)))
+				level++;
+
+			// beyond the top level: the last slot of it
+			const auto topShift = level * cSlotBits;
+			if ((tick >> topShift) - (m_now >> topShift) >= cSlotCount)
+				tick = ((m_now >> topShift) + cSlotMask) << topShift;
+		}
+
+		GetSlot(level, tick).push_back(std::move(entry));
+		m_levelSizes[level]++;
+	}
+
+	// moves to the next tick; slots of upper levels starting at it are spread over lower levels
+	void Step()
+	{
+		m_now++;
+
+		size_t level = 0;
+		while (level < cLevelCount - 1 && GetSlotIndex(level, m_now) == 0)
+			level++;
+
+		for (; level > 0; level--)
+		{
+			auto& slot = GetSlot(level, m_now);
+			if (slot.empty())
+				continue;
+
+			SlotType entries;
+			entries.swap(slot);
+			m_levelSizes[level] -= entries.size();
+
+			for (auto& entry : entries)
+				Place(std::move(entry));
+		}
+	}
+
+private:
+	Tick m_now;
+	// allocated on the first Schedule
+	std::vector<SlotType> m_slots;
+	std::array<size_t, cLevelCount> m_levelSizes{};
+	size_t m_size = 0;
+};
+
+} //namespace utils
+
+} //namespace vs
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+
+namespace vs
+{
+
+namespace utils
+{
+
+template<typename T, typename = void>
+struct IsEqualityComparable : std::false_type {};
+
+template<typename T>
+struct IsEqualityComparable<T, std::void_t<decltype(std::declval<const T&>() == std::declval<const T&>())>> : std::true_type {};
+
+// ordered maps (std::map, BPlusTreeMap) provide lower_bound
+template<typename MapT, typename = void>
+struct IsOrderedMap : std::false_type {};
+
+template<typename MapT>
+struct IsOrderedMap<MapT, std::void_t<decltype(std::declval<MapT&>().lower_bound(std::declval<const typename MapT::key_type&>()))>> : std::true_type {};
+
+// maps which can prefetch a key's slot ahead of a lookup (FlatHashMap)
+template<typename MapT, typename = void>
+struct HasPrefetch : std::false_type {};
+
+template<typename MapT>
+struct HasPrefetch<MapT, std::void_t<decltype(std::declval<const MapT&>().prefetch(std::declval<const typename MapT::key_type&>()))>> : std::true_type {};
+
+// maps which can be split into parts iterated concurrently (FlatHashMap, BPlusTreeMap)
+template<typename MapT, typename = void>
+struct HasSplitPoint : std::false_type {};
+
+template<typename MapT>
+struct HasSplitPoint<MapT, std::void_t<decltype(std::declval<const MapT&>().split_point(size_t{}, size_t{}))>> : std::true_type {};
+
+// maps with the bucket interface of std::unordered_map
+template<typename MapT, typename = void>
+struct HasBuckets : std::false_type {};
+
+template<typename MapT>
+struct HasBuckets<MapT, std::void_t<decltype(std::declval<const MapT&>().begin(std::declval<const MapT&>().bucket_count()))>> : std::true_type {};
+
+// maps which report memory they have allocated (FlatHashMap, BPlusTreeMap)
+template<typename MapT, typename = void>
+struct HasAllocatedBytes : std::false_type {};
+
+template<typename MapT>
+struct HasAllocatedBytes<MapT, std::void_t<decltype(std::declval<const MapT&>().allocated_bytes())>> : std::true_type {};
+
+// dictionary engines which can tell a key is surely missing (FilteredDict)
+template<typename DictT, typename KeyT, typename = void>
+struct HasMayContain : std::false_type {};
+
+template<typename DictT, typename KeyT>
+struct HasMayContain<DictT, KeyT, std::void_t<decltype(std::declval<const DictT&>().MayContain(std::declval<const KeyT&>()))>> : std::true_type {};
+
+} //namespace utils
+
+} //namespace vs
@@ -0,0 +1,178 @@
+#include "WorkStealingPool.h"
+#include "ThreadPoolOptions.h"
+
+#include <algorithm>
+
+namespace vs
+{
+
+namespace utils
+{
+
+namespace
+{
+
+// a worker of a pool knows its deque
+thread_local const WorkStealingPool* t_pool = nullptr;
+thread_local size_t t_workerIndex = 0;
+
+std::mutex g_defaultMutex;
+size_t g_defaultThreadCount = 0;
+bool g_defaultCreated = false;
+
+size_t GetDefaultThreadCount()
+{
+	std::lock_guard lock(g_defaultMutex);
+
+	g_defaultCreated = true;
+	if (g_defaultThreadCount != 0)
+		return g_defaultThreadCount;
+
+	return std::max<size_t>(1, std::thread::hardware_concurrency()) - 1;
+}
+
+} //namespace
+
+WorkStealingPool::WorkStealingPool(size_t threadCount)
+{
+	m_workers.reserve(threadCount);
+	for (size_t i = 0; i < threadCount; i++)
+		m_workers.push_back(std::make_unique<Worker>());
+
+	for (size_t i = 0; i < threadCount; i++)
+		m_workers[i]->thread = std::thread([this, i]() { Run(i); });
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard lock(m_idleMutex);
+		m_stopping = true;
+	}
+	m_idleCv.notify_all();
+
+	for (auto& worker : m_workers)
+		worker->thread.join();
+}
+
+void WorkStealingPool::Submit(Task task)
+{
+	// a pool without threads is a synchronous one
+	if (m_workers.empty())
+		return task();
+
+	const auto index = t_pool == this ? t_workerIndex : m_nextWorker++ % m_workers.size();
+	{
+		auto& worker = *m_workers[index];
+		std::lock_guard lock(worker.mutex);
+		worker.tasks.push_back(std::move(task));
+	}
+
+	// either a parking worker sees the task counted, or it is counted as a sleeper here (both are seq_cst);
+	// the lock makes sure it is waiting already when notified
+	m_pending.fetch_add(1);
+	if (m_sleepers.load() == 0)
+		return;
+
+	{
+		std::lock_guard lock(m_idleMutex);
+	}
+	m_idleCv.notify_one();
+}
+
+WorkStealingPool& WorkStealingPool::GetDefault()
+{
+	static WorkStealingPool pool(GetDefaultThreadCount());
+	return pool;
+}
+
+bool WorkStealingPool::ConfigureDefault(size_t threadCount)
+{
+	std::lock_guard lock(g_defaultMutex);
+
+	if (g_defaultCreated)
+		return false;
+
+	g_defaultThreadCount = threadCount;
+	return true;
+}
+
+void WorkStealingPool::Run(size_t index)
+{
+	t_pool = this;
+	t_workerIndex = index;
+
+	while (true)
+	{
+		if (auto task = TryTake(index))
+		{
+			task();
+			continue;
+		}
+
+		// a bounded backoff: new tasks often come soon after, and waking a parked worker costs a system call
+		for (size_t round = 0; round < cBackoffRounds && m_pending.load(std::memory_order_acquire) == 0; round++)
+			std::this_thread::yield();
+
+		if (m_pending.load(std::memory_order_acquire) == 0 && !Park())
+			return;
+	}
+}
+
+WorkStealingPool::Task WorkStealingPool::TryTake(size_t index)
+{
+	if (m_pending.load(std::memory_order_acquire) == 0)
+		return {};
+
+	{
+		auto& own = *m_workers[index];
+		std::lock_guard lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			auto task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			m_pending.fetch_sub(1, std::memory_order_relaxed);
+			return task;
+		}
+	}
+
+	for (size_t i = 1; i < m_workers.size(); i++)
+	{
+		auto& victim = *m_workers[(index + i) % m_workers.size()];
+		std::lock_guard lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			auto task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			m_pending.fetch_sub(1, std::memory_order_relaxed);
+			return task;
+		}
+	}
+
+	return {};
+}
+
+bool WorkStealingPool::Park()
+{
+	std::unique_lock lock(m_idleMutex);
+
+	m_sleepers.fetch_add(1);
+	m_idleCv.wait(lock,
+		[this]()
+		{
+			return m_stopping || m_pending.load() != 0;
+		});
+	m_sleepers.fetch_sub(1);
+
+	// tasks left on destruction are run first
+	return !m_stopping || m_pending.load() != 0;
+}
+
+} //namespace utils
+
+bool ConfigureThreadPool(const ThreadPoolOptions& options)
+{
+	return utils::WorkStealingPool::ConfigureDefault(options.threadCount);
+}
+
+} //namespace vs
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "NonCopyable.h"
+
+namespace vs
+{
+
+namespace utils
+{
+
+//
+// WorkStealingPool
+//
+// A bounded set of worker threads with a deque of tasks each. A task submitted by a worker goes to
+// the bottom of the worker's own deque and is taken from there first, while the data it touches
+// is still in the cache; an idle worker steals from the tops of other deques. Tasks submitted
+// by other threads are spread over the deques in turn.
+//
+// Pending tasks are counted by an atomic counter, so submitters and thieves share no lock. A worker
+// finding nothing backs off for a while and then parks; m_idleMutex is taken only to park and to wake
+// parked workers, and a submitter takes it only if some worker is parked.
+//
+// Tasks must not throw. Tasks left on destruction are run before workers exit.
+//
+
+class WorkStealingPool :
+	private NonCopyable
+{
+public:
+	using Task = std::function<void()>;
+
+	explicit WorkStealingPool(size_t threadCount);
+	~WorkStealingPool();
+
+	void Submit(Task task);
+
+	size_t GetThreadCount() const noexcept
+	{
+		return m_workers.size();
+	}
+
+	// the process-wide pool; it is created by the first call
+	static WorkStealingPool& GetDefault();
+
+	// sets the number of threads of the default pool; returns false if it is already created
+	static bool ConfigureDefault(size_t threadCount);
+
+private:
+	static constexpr size_t cCacheLineSize = 64;
+
+	struct alignas(cCacheLineSize) Worker
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		std::thread thread;
+	};
+
+	static constexpr size_t cBackoffRounds = 64;
+
+	void Run(size_t index);
+	// an empty task if no deque has one
+	Task TryTake(size_t index);
+	// false if the pool is stopping and no task is left
+	bool Park();
+
+private:
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::atomic<size_t> m_nextWorker{ 0 };
+
+	// tasks in deques; a task is counted after it is pushed and until it is popped
+	alignas(cCacheLineSize) std::atomic<size_t> m_pending{ 0 };
+	// workers waiting for m_idleCv
+	alignas(cCacheLineSize) std::atomic<size_t> m_sleepers{ 0 };
+
+	bool m_stopping = false;
+	std::mutex m_idleMutex;
+	std::condition_variable m_idleCv;
+};
+
+} //namespace utils
+
+} //namespace vs
@@ -0,0 +1,191 @@
+#include <string>
+#include <map>
+#include <stdexcept>
+
+#include "gtest/gtest.h"
+
+#include "../src/utils/BPlusTreeMap.h"
+
+using namespace std;
+using namespace vs::utils;
+
+TEST(BPlusTreeMapTest, Insert_Find_Erase)
+{
+	BPlusTreeMap<int, string> map;
+
+	EXPECT_TRUE(map.empty());
+	EXPECT_EQ(map.find(1), map.end());
+	EXPECT_EQ(map.begin(), map.end());
+
+	EXPECT_TRUE(map.try_emplace(1, "one").second);
+	EXPECT_FALSE(map.try_emplace(1, "another one").second);
+	EXPECT_EQ(map.find(1)->second, "one");
+
+	EXPECT_FALSE(map.insert_or_assign(1, "new one").second);
+	EXPECT_EQ(map.find(1)->second, "new one");
+
+	EXPECT_EQ(map.erase(1), 1);
+	EXPECT_EQ(map.erase(1), 0);
+	EXPECT_TRUE(map.empty());
+}
+
+TEST(BPlusTreeMapTest, Matches_Std_Map)
+{
+	BPlusTreeMap<int, int> map;
+	std::map<int, int> reference;
+
+	// enough keys for several levels; erasures exercise borrowing and merging
+	for (int i = 0; i < 50000; i++)
+	{
+		const int key = (i * 7919) % 20011;
+		if (i % 3 == 0)
+			EXPECT_EQ(map.erase(key), reference.erase(key));
+		else
+		{
+			const auto res = map.try_emplace(key, i);
+			EXPECT_EQ(res.second, reference.try_emplace(key, i).second);
+			EXPECT_EQ(res.first->first, key);
+		}
+	}
+
+	ASSERT_EQ(map.size(), reference.size());
+	EXPECT_TRUE(std::equal(reference.begin(), reference.end(), map.begin(),
+		[](const auto& lhs, const auto& rhs)
+		{
+			return lhs.first == rhs.first && lhs.second == rhs.second;
+		}));
+
+	for (int key = -1; key < 20013; key += 7)
+	{
+		const auto it = map.lower_bound(key);
+		const auto referenceIt = reference.lower_bound(key);
+		if (referenceIt == reference.end())
+			EXPECT_EQ(it, map.end());
+		else
+			EXPECT_EQ(it->first, referenceIt->first);
+	}
+
+	for (const auto& kv : reference)
+		map.erase(kv.first);
+	EXPECT_TRUE(map.empty());
+	EXPECT_EQ(map.begin(), map.end());
+}
+
+TEST(BPlusTreeMapTest, Copy)
+{
+	BPlusTreeMap<string, int> map;
+	for (int i = 0; i < 1000; i++)
+		map.try_emplace(to_string(i), i);
+
+	auto copy = map;
+	map.clear();
+
+	EXPECT_EQ(copy.size(), 1000);
+	EXPECT_EQ(copy.find("42")->second, 42);
+	EXPECT_EQ(copy.lower_bound("100")->first, "100");
+	EXPECT_EQ(copy.lower_bound("1000")->first, "101");
+	EXPECT_EQ(copy.lower_bound("9990"), copy.end());
+
+	size_t count = 0;
+	string previous;
+	for (const auto& kv : copy)
+	{
+		EXPECT_TRUE(count == 0 || previous < kv.first);
+		previous = kv.first;
+		count++;
+	}
+	EXPECT_EQ(count, 1000);
+}
+
+TEST(BPlusTreeMapTest, Split_Points)
+{
+	BPlusTreeMap<int, int> map;
+	EXPECT_EQ(map.split_point(1, 4), map.end());
+
+	for (int i = 0; i < 10000; i++)
+		map.try_emplace(i, i);
+
+	// parts cover all keys once, in order
+	for (size_t partCount : { 1, 3, 16, 1000 })
+	{
+		int next = 0;
+		for (size_t part = 0; part < partCount; part++)
+			for (auto it = map.split_point(part, partCount); it != map.split_point(part + 1, partCount); ++it)
+				EXPECT_EQ(it->first, next++);
+		EXPECT_EQ(next, 10000);
+	}
+}
+
+TEST(BPlusTreeMapTest, Moved_From_Map_Is_Empty_And_Usable)
+{
+	BPlusTreeMap<int, int> map;
+	for (int i = 0; i < 1000; i++)
+		map.try_emplace(i, i);
+
+	auto moved = std::move(map);
+	EXPECT_EQ(moved.size(), 1000);
+	EXPECT_EQ(moved.find(42)->second, 42);
+
+	EXPECT_TRUE(map.empty());
+	EXPECT_EQ(map.allocated_bytes(), 0);
+	EXPECT_EQ(map.begin(), map.end());
+	EXPECT_EQ(map.find(42), map.end());
+	EXPECT_EQ(map.lower_bound(42), map.end());
+	EXPECT_EQ(map.split_point(1, 4), map.end());
+	EXPECT_EQ(map.erase(42), 0);
+
+	const auto copy = map;
+	EXPECT_TRUE(copy.empty());
+
+	EXPECT_TRUE(map.try_emplace(7, 7).second);
+	EXPECT_EQ(map.size(), 1);
+	EXPECT_EQ(map.begin()->first, 7);
+}
+
+namespace
+{
+
+// counts live instances; copying throws once the countdown reaches zero
+struct Counted
+{
+	static inline int liveCount = 0;
+	static inline int copiesLeft = -1;
+
+	Counted() { liveCount++; }
+	Counted(Counted&&) noexcept { liveCount++; }
+	Counted& operator = (Counted&&) noexcept = default;
+	Counted& operator = (const Counted&) = default;
+	~Counted() { liveCount--; }
+
+	Counted(const Counted&)
+	{
+		if (copiesLeft == 0)
+			throw runtime_error("copy failed");
+		if (copiesLeft > 0)
+			copiesLeft--;
+		liveCount++;
+	}
+};
+
+} //namespace
+
+TEST(BPlusTreeMapTest, Failed_Copy_Frees_Cloned_Nodes)
+{
+	using MapType = BPlusTreeMap<int, Counted>;
+
+	{
+		MapType map;
+		for (int i = 0; i < 1000; i++)
+			map.try_emplace(i);
+
+		const auto liveCount = Counted::liveCount;
+
+		// fails in the middle of the tree
+		Counted::copiesLeft = liveCount / 2;
+		EXPECT_THROW(MapType{ map }, runtime_error);
+		Counted::copiesLeft = -1;
+
+		EXPECT_EQ(Counted::liveCount, liveCount);
+	}
+	EXPECT_EQ(Counted::liveCount, 0);
+}
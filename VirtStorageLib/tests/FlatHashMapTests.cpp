@@ -0,0 +1,106 @@
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+#include "../src/utils/FlatHashMap.h"
+
+using namespace std;
+using namespace vs::utils;
+
+TEST(FlatHashMapTest, Insert_Find_Erase)
+{
+	FlatHashMap<int, string> map;
+
+	EXPECT_TRUE(map.empty());
+	EXPECT_EQ(map.find(1), map.end());
+
+	EXPECT_TRUE(map.try_emplace(1, "one").second);
+	EXPECT_FALSE(map.try_emplace(1, "another one").second);
+	EXPECT_EQ(map.find(1)->second, "one");
+
+	EXPECT_FALSE(map.insert_or_assign(1, "new one").second);
+	EXPECT_EQ(map.find(1)->second, "new one");
+
+	EXPECT_EQ(map.erase(1), 1);
+	EXPECT_EQ(map.erase(1), 0);
+	EXPECT_EQ(map.count(1), 0);
+	EXPECT_TRUE(map.empty());
+}
+
+TEST(FlatHashMapTest, Matches_Unordered_Map)
+{
+	FlatHashMap<int, int> map;
+	unordered_map<int, int> reference;
+
+	// inserts and erases interleaved enough to grow and to leave tombstones
+	for (int i = 0; i < 20000; i++)
+	{
+		const int key = (i * 7919) % 5003;
+		if (i % 3 == 0)
+			EXPECT_EQ(map.erase(key), reference.erase(key));
+		else
+		{
+			map.insert_or_assign(key, i);
+			reference.insert_or_assign(key, i);
+		}
+	}
+
+	EXPECT_EQ(map.size(), reference.size());
+
+	size_t visited = 0;
+	for (const auto& kv : map)
+	{
+		EXPECT_EQ(reference.at(kv.first), kv.second);
+		visited++;
+	}
+	EXPECT_EQ(visited, reference.size());
+
+	for (int key = 0; key < 5003; key++)
+		EXPECT_EQ(map.count(key), reference.count(key));
+}
+
+TEST(FlatHashMapTest, Copy_Move_Clear)
+{
+	FlatHashMap<string, int> map;
+	for (int i = 0; i < 100; i++)
+		map.try_emplace(to_string(i), i);
+
+	auto copy = map;
+	EXPECT_EQ(copy.size(), 100);
+	EXPECT_EQ(copy.find("42")->second, 42);
+
+	auto moved = std::move(copy);
+	EXPECT_EQ(moved.size(), 100);
+	EXPECT_EQ(moved.find("99")->second, 99);
+
+	map.clear();
+	EXPECT_TRUE(map.empty());
+	EXPECT_EQ(map.find("42"), map.end());
+	EXPECT_EQ(moved.find("42")->second, 42);
+}
+
+TEST(FlatHashMapTest, Split_Points)
+{
+	FlatHashMap<int, int> map;
+	EXPECT_EQ(map.split_point(0, 4), map.end());
+
+	for (int i = 0; i < 10000; i++)
+		map.try_emplace(i, i);
+
+	// parts cover all keys once
+	for (size_t partCount : { 1, 3, 16, 1000 })
+	{
+		std::vector<int> keys;
+		for (size_t part = 0; part < partCount; part++)
+			for (auto it = map.split_point(part, partCount); it != map.split_point(part + 1, partCount); ++it)
+				keys.push_back(it->first);
+
+		std::sort(keys.begin(), keys.end());
+		ASSERT_EQ(keys.size(), 10000u);
+		for (int i = 0; i < 10000; i++)
+			EXPECT_EQ(keys[i], i);
+	}
+}
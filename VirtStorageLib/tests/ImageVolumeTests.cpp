@@ -0,0 +1,218 @@
+#include <filesystem>
+#include <fstream>
+#include "gtest/gtest.h"
+
+#include "ImageVolume.h"
+#include "TestTools.h"
+#include "TestData.h"
+
+using namespace std;
+using namespace vs;
+using namespace test_tools;
+
+namespace fs = std::filesystem;
+
+using ImageVolumeType = ImageVolume<KeyType, ValueType>;
+
+class ImageVolumeTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        m_path = (fs::temp_directory_path() / ("VirtStorageImageTest_" + std::string(testName))).string();
+        fs::remove(m_path);
+    }
+
+    void TearDown() override
+    {
+        fs::remove(m_path);
+    }
+
+    std::string m_path;
+};
+
+TEST_F(ImageVolumeTest, Write_Then_Read)
+{
+    {
+        const auto volume = CreateVolume(cRawRoot1, 100);
+        const auto root = volume.GetRoot();
+        root->Insert(1000, blob{ 1, 2, 3 });
+        root->InsertChild("empty");
+
+        WriteImage(root, m_path);
+    }
+
+    ImageVolumeType image{ m_path, 100 };
+    const auto root = image.GetRoot();
+
+    auto expected = cRawRoot1;
+    expected.values[1000] = blob{ 1, 2, 3 };
+    expected.children.push_back({ "empty", {}, {} });
+    EXPECT_TRUE(IsEqual(root, expected));
+    EXPECT_EQ(root->GetPriority(), 100);
+
+    ValueVariant value;
+    EXPECT_TRUE(root->Find(1000, value));
+    EXPECT_EQ(value, (ValueVariant{ blob{ 1, 2, 3 } }));
+    EXPECT_FALSE(root->Find(1001, value));
+    EXPECT_TRUE(root->Contains(1000));
+
+    EXPECT_EQ(root->FindByPath("child/child2")->GetName(), "child2");
+    EXPECT_EQ(root->FindByPath("child/missing"), nullptr);
+    EXPECT_TRUE(root->FindValueByPath("child/child2", 21, value));
+    EXPECT_EQ(value, ValueVariant{ 1 });
+    EXPECT_EQ(root->InsertChildPath("child/child2")->GetName(), "child2");
+    EXPECT_THROW(root->InsertChildPath("child/New"), ReadOnlyNodeException);
+
+    // keys come in ascending order
+    KeyType lastKey = numeric_limits<KeyType>::min();
+    root->ForEachInRange(numeric_limits<KeyType>::min(), 1000,
+        [&lastKey](const auto& key, auto&)
+        {
+            EXPECT_LT(lastKey, key);
+            lastKey = key;
+        });
+    EXPECT_LT(lastKey, 1000);
+
+    KeyType foundKey;
+    EXPECT_TRUE(root->LowerBound(lastKey + 1, foundKey, value));
+    EXPECT_EQ(foundKey, 1000);
+    EXPECT_FALSE(root->LowerBound(1001, foundKey, value));
+
+    INode<KeyType, ValueType>::FoundValuesType values;
+    EXPECT_EQ(root->MultiFind({ 1000, 1001 }, values), 1);
+    EXPECT_TRUE(values[0].has_value());
+    EXPECT_FALSE(values[1].has_value());
+
+    // pages follow the key order
+    INode<KeyType, ValueType>::KeyValuesType page;
+    auto cursor = root->NextKeyValues({}, 1, page);
+    ASSERT_EQ(page.size(), 1u);
+    EXPECT_TRUE(root->LowerBound(page.back().first + 1, foundKey, value));
+    cursor = root->NextKeyValues(cursor, 1, page);
+    ASSERT_EQ(page.size(), 1u);
+    EXPECT_EQ(page[0].first, foundKey);
+    EXPECT_EQ(page[0].second, value);
+    EXPECT_TRUE(root->NextKeyValues(INode<KeyType, ValueType>::CursorType::After(1000), 3, page).IsEnd());
+    EXPECT_TRUE(page.empty());
+
+    ScanOptions options;
+    options.threadCount = 3;
+    options.subtree = true;
+    const auto keyCount = ParallelReduce(root, options, size_t{ 0 },
+        [](size_t& count, const auto&, const auto&)
+        {
+            count++;
+        },
+        [](size_t& count, size_t other)
+        {
+            count += other;
+        });
+
+    size_t expectedCount = 0;
+    std::function<void(ImageVolumeType::NodeType::NodePtr)> countKeys =
+        [&expectedCount, &countKeys](const auto& node)
+        {
+            node->ForEachKeyValue(
+                [&expectedCount](const auto&, auto&)
+                {
+                    expectedCount++;
+                });
+            node->ForEachChild(countKeys);
+        };
+    countKeys(root);
+    EXPECT_EQ(keyCount, expectedCount);
+
+    // the node table of the image gives subtree stats
+    const auto stats = root->GetSubtreeStats();
+    EXPECT_EQ(stats.keyCount, expectedCount);
+    EXPECT_GT(stats.payloadBytes, expectedCount * sizeof(KeyType));
+    EXPECT_EQ(root->GetStats().childCount, cRawRoot1.children.size() + 1);
+
+    const auto empty = root->FindChild("empty");
+    ASSERT_NE(empty, nullptr);
+
+    ImageVolumeType::NodeType::ChildrenType children;
+    EXPECT_TRUE(root->NextChildren({}, cRawRoot1.children.size() + 2, children).IsEnd());
+    EXPECT_EQ(children.size(), cRawRoot1.children.size() + 1);
+    EXPECT_EQ(root->FindChild("missing"), nullptr);
+
+    EXPECT_THROW(root->Insert(1, 1), ReadOnlyNodeException);
+    EXPECT_THROW(root->Erase(1000), ReadOnlyNodeException);
+    EXPECT_THROW(root->Replace(1000, 1), ReadOnlyNodeException);
+    EXPECT_THROW(root->InsertWithTtl(1, 1, std::chrono::seconds(1)), ReadOnlyNodeException);
+    EXPECT_THROW(root->Touch(1000, std::chrono::seconds(1)), ReadOnlyNodeException);
+    EXPECT_THROW(empty->InsertChild("child"), ReadOnlyNodeException);
+    EXPECT_THROW(root->RemoveChild("empty"), ReadOnlyNodeException);
+
+    // calls changing nothing work as usual
+    EXPECT_FALSE(root->Replace(1001, 1));
+    EXPECT_FALSE(root->TryInsert(1000, 1));
+    EXPECT_NO_THROW(root->Erase(1001));
+    EXPECT_NO_THROW(root->RemoveChild("missing"));
+    EXPECT_NE(root->InsertChild("empty"), nullptr);
+
+    image.FreeRoot();
+    EXPECT_THROW(empty->Contains(1), ActionOnRemovedNodeException);
+}
+
+TEST_F(ImageVolumeTest, Mount_Into_Storage)
+{
+    StorageType storage{ "Virtual Root" };
+
+    {
+        const auto volume = CreateVolume(cRawRoot2, 0);
+        WriteImage(volume.GetRoot(), m_path);
+    }
+
+    ImageVolumeType image{ m_path, 100 };
+    const auto volume = CreateVolume(cRawRoot1, 200);
+
+    const auto virtRoot = storage.GetRoot();
+    virtRoot->Mount(volume.GetRoot());
+    virtRoot->Mount(image.GetRoot());
+
+    auto expected = cRawRoot1;
+    expected.Merge(cRawRoot2);
+    EXPECT_TRUE(IsEqual(virtRoot, expected));
+
+    // a writable volume of a higher priority takes changes
+    virtRoot->Insert(12345, "new");
+    EXPECT_TRUE(volume.GetRoot()->Contains(12345));
+
+    // an image of a Storage is written like a volume's one
+    const auto nested = m_path + ".nested";
+    WriteImage(image.GetRoot(), nested);
+    {
+        ImageVolumeType copy{ nested, 0 };
+        EXPECT_TRUE(IsEqual(copy.GetRoot(), cRawRoot2));
+    }
+    fs::remove(nested);
+
+    // a freed image leaves a storage like a freed volume
+    image.FreeRoot();
+    auto remaining = cRawRoot1;
+    remaining.values[12345] = "new";
+    EXPECT_TRUE(IsEqual(virtRoot, remaining));
+}
+
+TEST_F(ImageVolumeTest, Corrupted_Image_Is_Rejected)
+{
+    EXPECT_THROW((ImageVolumeType{ m_path, 0 }), PersistenceException);
+
+    {
+        ofstream file(m_path, ios::binary);
+        file << "not an image at all, not an image at all, not an image at all, not an image at all";
+    }
+    EXPECT_THROW((ImageVolumeType{ m_path, 0 }), PersistenceException);
+
+    {
+        const auto volume = CreateVolume(cRawRoot1, 0);
+        WriteImage(volume.GetRoot(), m_path);
+    }
+    EXPECT_THROW((ImageVolume<int64_t, ValueType>{ m_path, 0 }), PersistenceException);
+
+    fs::resize_file(m_path, fs::file_size(m_path) - 1);
+    EXPECT_THROW((ImageVolumeType{ m_path, 0 }), PersistenceException);
+}
@@ -0,0 +1,265 @@
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include "gtest/gtest.h"
+
+#include "TestTools.h"
+
+using namespace std;
+using namespace vs;
+using namespace test_tools;
+
+namespace fs = std::filesystem;
+
+class PersistenceTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        m_directory = fs::temp_directory_path() / ("VirtStoragePersistenceTest_" + std::string(testName));
+        fs::remove_all(m_directory);
+
+        m_options.directory = m_directory.string();
+    }
+
+    void TearDown() override
+    {
+        fs::remove_all(m_directory);
+    }
+
+    fs::path m_directory;
+    PersistenceOptions m_options;
+};
+
+TEST_F(PersistenceTest, Recover_Tree)
+{
+    {
+        VolumeType volume{ "Root", 0, m_options };
+        const auto root = volume.GetRoot();
+
+        root->Insert(1, "one");
+        root->Insert(2, 2.5);
+        root->Insert(3, blob{ 1, 2, 3 });
+        root->Erase(2);
+        EXPECT_TRUE(root->Replace(3, int64_t{ 333 }));
+        EXPECT_FALSE(root->TryInsert(1, "uno"));
+
+        const auto child = root->InsertChild("child");
+        child->Insert(10, 10);
+        child->InsertChild("grandchild")->Insert(100, "deep");
+
+        root->InsertChild("removed")->Insert(5, 5);
+        root->RemoveChild("removed");
+
+        // changes made by iterations are logged too
+        child->ForEachKeyValue(
+            [](const auto&, auto& value)
+            {
+                value = 11;
+            });
+    }
+
+    VolumeType volume{ "Root", 0, m_options };
+    const auto root = volume.GetRoot();
+
+    ValueVariant value;
+    EXPECT_TRUE(root->Find(1, value));
+    EXPECT_EQ(value, ValueVariant{ "one" });
+    EXPECT_FALSE(root->Contains(2));
+    EXPECT_TRUE(root->Find(3, value));
+    EXPECT_EQ(value, ValueVariant{ int64_t{ 333 } });
+
+    const auto child = root->FindChild("child");
+    ASSERT_NE(child, nullptr);
+    EXPECT_TRUE(child->Find(10, value));
+    EXPECT_EQ(value, ValueVariant{ 11 });
+
+    const auto grandchild = child->FindChild("grandchild");
+    ASSERT_NE(grandchild, nullptr);
+    EXPECT_TRUE(grandchild->Find(100, value));
+    EXPECT_EQ(value, ValueVariant{ "deep" });
+
+    EXPECT_EQ(root->FindChild("removed"), nullptr);
+}
+
+TEST_F(PersistenceTest, Iteration_Callback_Writes_To_The_Tree)
+{
+    {
+        VolumeType volume{ "Root", 0, m_options };
+        const auto root = volume.GetRoot();
+        const auto copies = root->InsertChild("copies");
+
+        for (int i = 0; i < 100; i++)
+            root->Insert(i, i);
+
+        // key locks are not held during the callback, so it may change other nodes of the tree
+        root->ForEachKeyValue(
+            [&copies](const auto& key, auto& value)
+            {
+                copies->Insert(key, value);
+                value = key + 1;
+            });
+    }
+
+    VolumeType volume{ "Root", 0, m_options };
+    const auto root = volume.GetRoot();
+    const auto copies = root->FindChild("copies");
+    ASSERT_NE(copies, nullptr);
+
+    ValueVariant value;
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_TRUE(copies->Find(i, value));
+        EXPECT_EQ(value, ValueVariant{ i });
+        EXPECT_TRUE(root->Find(i, value));
+        EXPECT_EQ(value, ValueVariant{ i + 1 });
+    }
+}
+
+TEST_F(PersistenceTest, Checkpoint_Truncates_Log)
+{
+    m_options.checkpointLogSize = 4096;
+
+    const int cKeyCount = 2000;
+    {
+        VolumeType volume{ "Root", 0, m_options };
+        const auto child = volume.GetRoot()->InsertChild("child");
+
+        for (int i = 0; i < cKeyCount; i++)
+            child->Insert(i, i);
+
+        // checkpoints are taken in the background
+        const auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+        while (!fs::exists(m_directory / "checkpoint") && chrono::steady_clock::now() < deadline)
+            this_thread::sleep_for(chrono::milliseconds(10));
+        EXPECT_TRUE(fs::exists(m_directory / "checkpoint"));
+
+        for (int i = 0; i < cKeyCount; i += 2)
+            child->Erase(i);
+    }
+
+    VolumeType volume{ "Root", 0, m_options };
+    const auto child = volume.GetRoot()->FindChild("child");
+    ASSERT_NE(child, nullptr);
+
+    size_t count = 0;
+    child->ForEachKeyValue(
+        [&count](const auto& key, auto& value)
+        {
+            EXPECT_EQ(key % 2, 1);
+            EXPECT_EQ(value, ValueVariant{ key });
+            count++;
+        });
+    EXPECT_EQ(count, cKeyCount / 2);
+}
+
+TEST_F(PersistenceTest, Torn_Tail_Is_Ignored)
+{
+    {
+        VolumeType volume{ "Root", 0, m_options };
+        volume.GetRoot()->Insert(1, "durable");
+    }
+
+    // a record cut by a crash
+    for (const auto& entry : fs::directory_iterator(m_directory))
+    {
+        const char torn[] = { 0x20, 0, 0, 0, 'g', 'a', 'r', 'b' };
+        ofstream segment(entry.path(), ios::binary | ios::app);
+        segment.write(torn, sizeof(torn));
+    }
+
+    {
+        VolumeType volume{ "Root", 0, m_options };
+        const auto root = volume.GetRoot();
+
+        ValueVariant value;
+        EXPECT_TRUE(root->Find(1, value));
+        EXPECT_EQ(value, ValueVariant{ "durable" });
+
+        root->Insert(2, "after crash");
+    }
+
+    VolumeType volume{ "Root", 0, m_options };
+    EXPECT_TRUE(volume.GetRoot()->Contains(1));
+    EXPECT_TRUE(volume.GetRoot()->Contains(2));
+}
+
+TEST_F(PersistenceTest, SyncOnWrite_Concurrent_Writers)
+{
+    m_options.syncOnWrite = true;
+
+    const int cThreadCount = 4;
+    const int cKeysPerThread = 200;
+    {
+        VolumeType volume{ "Root", 0, m_options };
+        const auto root = volume.GetRoot();
+
+        std::vector<std::thread> writers;
+        for (int t = 0; t < cThreadCount; t++)
+            writers.emplace_back(
+                [&root, t]()
+                {
+                    for (int i = 0; i < cKeysPerThread; i++)
+                        root->Insert(t * cKeysPerThread + i, i);
+                });
+
+        for (auto& writer : writers)
+            writer.join();
+
+        root->MultiErase({ 0, 1, 2 });
+    }
+
+    VolumeType volume{ "Root", 0, m_options };
+    const auto root = volume.GetRoot();
+
+    size_t count = 0;
+    root->ForEachKeyValue(
+        [&count](const auto&, auto&)
+        {
+            count++;
+        });
+    EXPECT_EQ(count, cThreadCount * cKeysPerThread - 3);
+}
+
+TEST_F(PersistenceTest, Failed_Write_Fails_The_Log)
+{
+    // writes to /dev/full fail with ENOSPC; the log moves to it with the first checkpoint
+    if (!fs::exists("/dev/full"))
+        GTEST_SKIP() << "/dev/full is not available";
+
+    m_options.checkpointLogSize = 4096;
+    m_options.syncInterval = chrono::milliseconds(1);
+
+    VolumeType volume{ "Root", 0, m_options };
+    const auto root = volume.GetRoot();
+    fs::create_symlink("/dev/full", m_directory / "wal.1");
+
+    // without syncOnWrite the failure is reported by later changes
+    int key = 0;
+    auto failed = false;
+    const auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+    while (!failed && chrono::steady_clock::now() < deadline)
+    {
+        try
+        {
+            root->Insert(key, key);
+            key++;
+        }
+        catch (const PersistenceException&)
+        {
+            failed = true;
+        }
+    }
+    ASSERT_TRUE(failed);
+
+    // the log stays failed, and changes which are not logged are not applied;
+    // the change which has reported the failure may have been applied before
+    key++;
+    EXPECT_THROW(root->Insert(key, key), PersistenceException);
+    EXPECT_FALSE(root->Contains(key));
+    EXPECT_THROW(root->Erase(0), PersistenceException);
+    EXPECT_TRUE(root->Contains(0));
+}
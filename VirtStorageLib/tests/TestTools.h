@@ -1,5 +1,7 @@
 #pragma once
 
+#include <list>
+
 #include "Storage.h"
 #include "Volume.h"
 
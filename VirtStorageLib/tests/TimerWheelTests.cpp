@@ -0,0 +1,76 @@
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../src/utils/TimerWheel.h"
+
+using namespace std;
+using namespace vs::utils;
+
+TEST(TimerWheelTest, Keys_Are_Due_At_Their_Deadlines)
+{
+	using WheelType = TimerWheel<int>;
+	WheelType wheel;
+
+	// deadlines on every level, on boundaries of slots and beyond the top level
+	const vector<WheelType::Tick> deadlines{ 0, 1, 5, 63, 64, 65, 127, 4095, 4096, 4097, 300000, 262144, 16777215, 16777216, (uint64_t{ 1 } << 24) + 5, uint64_t{ 3 } << 24 };
+	for (size_t i = 0; i < deadlines.size(); i++)
+		wheel.Schedule(static_cast<int>(i), deadlines[i]);
+
+	EXPECT_EQ(wheel.GetSize(), deadlines.size());
+
+	map<int, WheelType::Tick> dueTicks;
+	mt19937 random{ 17 };
+	while (wheel.GetSize() != 0)
+	{
+		const auto now = wheel.GetNow() + random() % 1000 + 1;
+		EXPECT_TRUE(wheel.Advance(now, SIZE_MAX,
+			[&](int key)
+			{
+				EXPECT_EQ(dueTicks.count(key), 0u);
+				dueTicks[key] = wheel.GetNow();
+			}));
+		EXPECT_EQ(wheel.GetNow(), now);
+	}
+
+	ASSERT_EQ(dueTicks.size(), deadlines.size());
+	for (size_t i = 0; i < deadlines.size(); i++)
+		EXPECT_EQ(dueTicks[static_cast<int>(i)], deadlines[i]);
+}
+
+TEST(TimerWheelTest, Advance_Stops_At_Limit)
+{
+	TimerWheel<int> wheel{ 100 };
+
+	for (int i = 0; i < 10; i++)
+		wheel.Schedule(i, 103);
+
+	// a deadline which has passed is due on the next call
+	wheel.Schedule(10, 50);
+
+	vector<int> due;
+	const auto collect = [&due](int key)
+	{
+		due.push_back(key);
+	};
+
+	EXPECT_FALSE(wheel.Advance(105, 4, collect));
+	EXPECT_EQ(due.size(), 4u);
+	EXPECT_EQ(due.front(), 10);
+
+	EXPECT_FALSE(wheel.Advance(105, 4, collect));
+	EXPECT_EQ(due.size(), 8u);
+
+	EXPECT_TRUE(wheel.Advance(105, 4, collect));
+	EXPECT_EQ(due.size(), 11u);
+	EXPECT_EQ(wheel.GetSize(), 0u);
+	EXPECT_EQ(wheel.GetNow(), 105u);
+
+	// nothing scheduled: time moves at once
+	EXPECT_TRUE(wheel.Advance(1000000, 4, collect));
+	EXPECT_EQ(wheel.GetNow(), 1000000u);
+	EXPECT_EQ(due.size(), 11u);
+}
@@ -1,9 +1,15 @@
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
 #include "gtest/gtest.h"
 
 #include "Storage.h"
 #include "Volume.h"
+#include "ThreadPoolOptions.h"
 #include "TestTools.h"
 #include "TestData.h"
+#include "../src/MountPropagationQueue.h"
 
 using namespace std;
 using namespace vs;
@@ -330,6 +336,12 @@ TEST_F(VirtualNodeTest, Insert_TryInsert_Erase_Find_Contains_Replace)
 
     EXPECT_FALSE(child->Replace(5001, 111));
 
+    EXPECT_TRUE(child->Visit(5000,
+        [](const ValueVariant& value)
+        {
+            EXPECT_EQ(value, ValueVariant{ 111 });
+        }));
+
     child->Erase(5000);
     EXPECT_FALSE(child->Contains(5000));
 }
@@ -353,4 +365,804 @@ TEST_F(VirtualNodeTest, Insert_TryInsert_For_Empty_Node_Produces_Exception)
 
     EXPECT_THROW(virtRoot->Insert(5001, "Another value"), InsertInEmptyVirtualNodeException);
     EXPECT_THROW(virtRoot->TryInsert(5002, "Another value"), InsertInEmptyVirtualNodeException);
-}
\ No newline at end of file
+}
+TEST_F(VirtualNodeTest, ForEachInRange_LowerBound)
+{
+    const auto virtRoot = m_storage.GetRoot();
+
+    const auto volume1 = CreateVolume(cRawRoot1, 200);
+    const auto volume2 = CreateVolume(cRawRoot2, 100);
+
+    virtRoot->Mount(volume1.GetRoot());
+    virtRoot->Mount(volume2.GetRoot());
+
+    const auto child = virtRoot->FindChild("child");
+
+    // child: {1, 100}, {2, 200} from Root1 shadow {1, 100}, {2, 200}, {3, 300} from Root2
+    RawNode::DictType values;
+    child->ForEachInRange(2, 10,
+        [&values](const auto& key, auto& value)
+        {
+            EXPECT_TRUE(values.insert({ key, value }).second);
+        });
+    EXPECT_EQ(values, (RawNode::DictType{ {2, 200}, {3, 300} }));
+
+    KeyType foundKey;
+    ValueVariant value;
+    EXPECT_TRUE(child->LowerBound(3, foundKey, value));
+    EXPECT_EQ(foundKey, 3);
+    EXPECT_EQ(value, ValueVariant{ 300 });
+    EXPECT_FALSE(child->LowerBound(4, foundKey, value));
+}
+
+TEST_F(VirtualNodeTest, MultiFind_MultiInsert_MultiErase)
+{
+    const auto virtRoot = m_storage.GetRoot();
+
+    const auto volume1 = CreateVolume(cRawRoot1, 200);
+    const auto volume2 = CreateVolume(cRawRoot2, 100);
+
+    virtRoot->Mount(volume1.GetRoot());
+    virtRoot->Mount(volume2.GetRoot());
+
+    const auto child = virtRoot->FindChild("child");
+
+    // child: {1, 100}, {2, 200} from Root1 shadow {1, 100}, {2, 200}, {3, 300} from Root2
+    IVirtualNode<KeyType, ValueType>::FoundValuesType values;
+    EXPECT_EQ(child->MultiFind({ 3, 1, 4 }, values), 2u);
+    EXPECT_EQ(values[0], ValueVariant{ 300 });
+    EXPECT_EQ(values[1], ValueVariant{ 100 });
+    EXPECT_FALSE(values[2].has_value());
+
+    // existing keys are replaced where they are, new ones go to the node with the highest priority
+    child->MultiInsert({ { 3, 333 }, { 500, 5 } });
+    EXPECT_EQ(child->MultiFind({ 3, 500 }, values), 2u);
+    EXPECT_EQ(values[0], ValueVariant{ 333 });
+    EXPECT_EQ(values[1], ValueVariant{ 5 });
+    EXPECT_TRUE(volume1.GetRoot()->FindChild("child")->Contains(500));
+    EXPECT_FALSE(volume2.GetRoot()->FindChild("child")->Contains(500));
+
+    child->MultiErase({ 1, 500 });
+    EXPECT_FALSE(child->Contains(1));
+    EXPECT_FALSE(child->Contains(500));
+    EXPECT_TRUE(child->Contains(2));
+}
+
+TEST_F(VirtualNodeTest, MultiInsert_Groups_Keys_By_Owner)
+{
+    const auto virtRoot = m_storage.GetRoot();
+
+    const auto volume1 = CreateVolume(cRawRoot1, 200);
+    const auto volume2 = CreateVolume(cRawRoot2, 100);
+
+    virtRoot->Mount(volume1.GetRoot());
+    virtRoot->Mount(volume2.GetRoot());
+
+    const auto child = virtRoot->FindChild("child");
+    const auto child1 = volume1.GetRoot()->FindChild("child");
+    const auto child2 = volume2.GetRoot()->FindChild("child");
+
+    // 2 is owned by Root1 which shadows it in Root2, 3 is owned by Root2 only; the last of duplicates wins
+    child->MultiInsert({ { 3, 301 }, { 600, 6 }, { 2, 222 }, { 3, 302 }, { 700, 7 }, { 600, 66 } });
+
+    ValueVariant value;
+    EXPECT_TRUE(child1->Find(2, value));
+    EXPECT_EQ(value, ValueVariant{ 222 });
+    EXPECT_TRUE(child2->Find(2, value));
+    EXPECT_EQ(value, ValueVariant{ 200 });
+
+    EXPECT_FALSE(child1->Contains(3));
+    EXPECT_TRUE(child2->Find(3, value));
+    EXPECT_EQ(value, ValueVariant{ 302 });
+
+    EXPECT_TRUE(child1->Find(600, value));
+    EXPECT_EQ(value, ValueVariant{ 66 });
+    EXPECT_TRUE(child1->Contains(700));
+    EXPECT_FALSE(child2->Contains(600));
+    EXPECT_FALSE(child2->Contains(700));
+
+    // keys of a removed node are new to the rest of them
+    volume2.GetRoot()->RemoveChildIf(
+        [](auto node)
+        {
+            return node->GetName() == "child";
+        });
+    child->MultiInsert({ { 3, 303 } });
+    EXPECT_TRUE(child1->Find(3, value));
+    EXPECT_EQ(value, ValueVariant{ 303 });
+}
+
+TEST_F(VirtualNodeTest, Filtered_Volumes)
+{
+    using FilteredVolumeType = Volume<KeyType, ValueType, FilteredDict<KeyType, ValueType>>;
+
+    const auto virtRoot = m_storage.GetRoot();
+
+    // volumes without a key are skipped by their filters; the result is the same as without them
+    std::vector<FilteredVolumeType> volumes;
+    for (int i = 0; i < 5; i++)
+    {
+        volumes.emplace_back("Volume" + std::to_string(i), 100 + i);
+        volumes.back().GetRoot()->Insert(i, i);
+        volumes.back().GetRoot()->Insert(100, i);
+        virtRoot->Mount(volumes.back().GetRoot());
+    }
+
+    ValueVariant value;
+    for (int i = 0; i < 5; i++)
+    {
+        EXPECT_TRUE(virtRoot->Find(i, value));
+        EXPECT_EQ(value, ValueVariant{ i });
+    }
+    EXPECT_FALSE(virtRoot->Contains(5));
+
+    // the highest priority wins
+    EXPECT_TRUE(virtRoot->Find(100, value));
+    EXPECT_EQ(value, ValueVariant{ 4 });
+
+    EXPECT_TRUE(virtRoot->Replace(2, 22));
+    EXPECT_TRUE(volumes[2].GetRoot()->Find(2, value));
+    EXPECT_EQ(value, ValueVariant{ 22 });
+
+    IVirtualNode<KeyType, ValueType>::FoundValuesType values;
+    EXPECT_EQ(virtRoot->MultiFind({ 0, 5, 3 }, values), 2u);
+    EXPECT_EQ(values[0], ValueVariant{ 0 });
+    EXPECT_FALSE(values[1].has_value());
+    EXPECT_EQ(values[2], ValueVariant{ 3 });
+
+    virtRoot->Erase(100);
+    virtRoot->MultiErase({ 0, 1 });
+    EXPECT_FALSE(virtRoot->Contains(100));
+    EXPECT_FALSE(virtRoot->Contains(0));
+    EXPECT_FALSE(virtRoot->Contains(1));
+    EXPECT_TRUE(virtRoot->Contains(2));
+}
+
+TEST(VirtualNodeLocationCacheTest, Cached_Locations_Follow_Changes)
+{
+    StorageOptions options;
+    options.locationCacheCapacity = 4;
+    StorageType storage{ "VirtRoot", options };
+    const auto virtRoot = storage.GetRoot();
+
+    VolumeType low{ "Low", 1 };
+    VolumeType high{ "High", 2 };
+    virtRoot->Mount(low.GetRoot());
+    virtRoot->Mount(high.GetRoot());
+
+    low.GetRoot()->Insert(1, "low");
+
+    ValueVariant value;
+    EXPECT_TRUE(virtRoot->Find(1, value));
+    EXPECT_EQ(value, ValueVariant{ "low" });
+    EXPECT_FALSE(virtRoot->Contains(2));
+
+    // changes made directly in volumes are reported to the storage
+    high.GetRoot()->Insert(1, "high");
+    high.GetRoot()->Insert(2, "high");
+    EXPECT_TRUE(virtRoot->Find(1, value));
+    EXPECT_EQ(value, ValueVariant{ "high" });
+    EXPECT_TRUE(virtRoot->Contains(2));
+
+    high.GetRoot()->Erase(1);
+    EXPECT_TRUE(virtRoot->Find(1, value));
+    EXPECT_EQ(value, ValueVariant{ "low" });
+
+    // as well as mounts
+    VolumeType top{ "Top", 3 };
+    top.GetRoot()->Insert(1, "top");
+    virtRoot->Mount(top.GetRoot());
+    EXPECT_TRUE(virtRoot->Find(1, value));
+    EXPECT_EQ(value, ValueVariant{ "top" });
+
+    virtRoot->Unmount(top.GetRoot());
+    EXPECT_TRUE(virtRoot->Find(1, value));
+    EXPECT_EQ(value, ValueVariant{ "low" });
+
+    // more keys than the cache keeps
+    for (int i = 10; i < 20; i++)
+        virtRoot->Insert(i, i);
+    for (int i = 10; i < 20; i++)
+    {
+        EXPECT_TRUE(virtRoot->Find(i, value));
+        EXPECT_EQ(value, ValueVariant{ i });
+    }
+    EXPECT_TRUE(virtRoot->Replace(10, 100));
+    EXPECT_TRUE(high.GetRoot()->Find(10, value));
+    EXPECT_EQ(value, ValueVariant{ 100 });
+
+    // mounted children get the cache as well
+    high.GetRoot()->InsertChild("child");
+    const auto virtChild = virtRoot->FindChild("child");
+    ASSERT_NE(virtChild, nullptr);
+    EXPECT_FALSE(virtChild->Contains(1));
+    high.GetRoot()->FindChild("child")->Insert(1, 1);
+    EXPECT_TRUE(virtChild->Contains(1));
+
+    high.FreeRoot();
+    EXPECT_FALSE(virtRoot->Contains(2));
+    EXPECT_TRUE(virtRoot->Find(1, value));
+    EXPECT_EQ(value, ValueVariant{ "low" });
+}
+
+TEST(VirtualNodeLocationCacheTest, Evicted_Keys_Leave_Cached_Locations)
+{
+    StorageOptions options;
+    options.locationCacheCapacity = 16;
+    StorageType storage{ "VirtRoot", options };
+    const auto virtRoot = storage.GetRoot();
+
+    VolumeType base{ "Base", 1 };
+    VolumeType cache{ "Cache", 2, EvictionOptions{ 8 } };
+    virtRoot->Mount(base.GetRoot());
+    virtRoot->Mount(cache.GetRoot());
+
+    base.GetRoot()->Insert(1, "base");
+    cache.GetRoot()->Insert(1, "cache");
+
+    ValueVariant value;
+    EXPECT_TRUE(virtRoot->Find(1, value));
+    EXPECT_EQ(value, ValueVariant{ "cache" });
+
+    // the key not looked up anymore is evicted by newer ones
+    for (int i = 100; i < 120; i++)
+        virtRoot->Insert(i, i);
+
+    EXPECT_FALSE(cache.GetRoot()->Contains(1));
+    EXPECT_TRUE(virtRoot->Find(1, value));
+    EXPECT_EQ(value, ValueVariant{ "base" });
+}
+
+TEST_F(VirtualNodeTest, Concurrent_Reads_While_Mounting)
+{
+    const auto virtRoot = m_storage.GetRoot();
+
+    VolumeType base{ "Base", 1 };
+    VolumeType overlay{ "Overlay", 2 };
+    base.GetRoot()->Insert(1, "base");
+    overlay.GetRoot()->Insert(1, "overlay");
+    virtRoot->Mount(base.GetRoot());
+
+    // readers see one of mount tables: the key is always there
+    std::atomic<bool> stop{ false };
+    std::atomic<int> failures{ 0 };
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++)
+        readers.emplace_back(
+            [&]()
+            {
+                ValueVariant value;
+                while (!stop)
+                {
+                    if (!virtRoot->Find(1, value) || !virtRoot->Contains(1))
+                        failures++;
+                    else if (value != ValueVariant{ "base" } && value != ValueVariant{ "overlay" })
+                        failures++;
+                }
+            });
+
+    for (int i = 0; i < 200; i++)
+    {
+        virtRoot->Mount(overlay.GetRoot());
+        virtRoot->Unmount(overlay.GetRoot());
+    }
+
+    stop = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    EXPECT_EQ(failures, 0);
+
+    ValueVariant value;
+    virtRoot->Mount(overlay.GetRoot());
+    EXPECT_TRUE(virtRoot->Find(1, value));
+    EXPECT_EQ(value, ValueVariant{ "overlay" });
+}
+
+TEST_F(VirtualNodeTest, PinWriteTarget)
+{
+    const auto virtRoot = m_storage.GetRoot();
+
+    VolumeType low{ "Low", 1 };
+    VolumeType high{ "High", 2 };
+    VolumeType notMounted{ "NotMounted", 3 };
+    virtRoot->Mount(low.GetRoot());
+    virtRoot->Mount(high.GetRoot());
+
+    low.GetRoot()->Insert(1, "low");
+    high.GetRoot()->Insert(2, "high");
+
+    // without a pinned node a found key is replaced where it is, a new one goes to the highest priority
+    virtRoot->Insert(1, "replaced");
+    virtRoot->Insert(3, "new");
+    EXPECT_TRUE(low.GetRoot()->Contains(1));
+    EXPECT_FALSE(high.GetRoot()->Contains(1));
+    EXPECT_TRUE(high.GetRoot()->Contains(3));
+
+    EXPECT_FALSE(virtRoot->PinWriteTarget(notMounted.GetRoot()));
+    EXPECT_TRUE(virtRoot->PinWriteTarget(low.GetRoot()));
+
+    virtRoot->Insert(2, "pinned");
+    virtRoot->Insert(4, "pinned");
+    EXPECT_TRUE(virtRoot->TryInsert(5, "pinned"));
+    EXPECT_FALSE(virtRoot->TryInsert(3, "pinned"));
+    virtRoot->MultiInsert({ { 6, "pinned" } });
+
+    ValueVariant value;
+    for (const auto key : { 2, 4, 5, 6 })
+    {
+        EXPECT_TRUE(low.GetRoot()->Find(key, value));
+        EXPECT_EQ(value, ValueVariant{ "pinned" });
+    }
+
+    // a key of a node with higher priority shadows the pinned one
+    EXPECT_TRUE(virtRoot->Find(2, value));
+    EXPECT_EQ(value, ValueVariant{ "high" });
+
+    // an unmounted target is unpinned
+    virtRoot->Unmount(low.GetRoot());
+    virtRoot->Insert(7, "unpinned");
+    EXPECT_TRUE(high.GetRoot()->Contains(7));
+
+    virtRoot->Mount(low.GetRoot());
+    EXPECT_TRUE(virtRoot->PinWriteTarget(low.GetRoot()));
+    EXPECT_TRUE(virtRoot->PinWriteTarget(nullptr));
+    virtRoot->Insert(8, "unpinned");
+    EXPECT_TRUE(high.GetRoot()->Contains(8));
+}
+
+TEST(VirtualNodeIterationTest, Streaming_Iteration_Skips_Shadowed_Keys)
+{
+    StorageOptions options;
+    options.iterationMode = IterationMode::Streaming;
+    StorageType storage{ "VirtRoot", options };
+    const auto virtRoot = storage.GetRoot();
+
+    auto volume1 = CreateVolume(cRawRoot1, 200);
+    auto volume2 = CreateVolume(cRawRoot2, 100);
+    virtRoot->Mount(volume1.GetRoot());
+    virtRoot->Mount(volume2.GetRoot());
+
+    auto root = cRawRoot1;
+    root.Merge(cRawRoot2);
+    EXPECT_TRUE(IsEqual(virtRoot, root));
+
+    StorageType overlay{ "Overlay", options };
+    VolumeType low{ "Low", 1 };
+    VolumeType high{ "High", 2 };
+    overlay.GetRoot()->Mount(low.GetRoot());
+    overlay.GetRoot()->Mount(high.GetRoot());
+
+    for (int i = 0; i < 100; i++)
+        low.GetRoot()->Insert(i, "low");
+    for (int i = 50; i < 150; i++)
+        high.GetRoot()->Insert(i, "high");
+
+    // every visible key exactly once, with the value of the node with the highest priority
+    std::map<KeyType, ValueType> visited;
+    size_t count = 0;
+    overlay.GetRoot()->ForEachKeyValue(
+        [&visited, &count](const auto& key, auto& value)
+        {
+            visited[key] = value;
+            count++;
+        });
+
+    EXPECT_EQ(count, 150u);
+    EXPECT_EQ(visited.size(), 150u);
+    EXPECT_EQ(visited[10], ValueType{ "low" });
+    EXPECT_EQ(visited[60], ValueType{ "high" });
+
+    count = 0;
+    overlay.GetRoot()->ForEachInRange(40, 60,
+        [&count](const auto& key, auto& value)
+        {
+            EXPECT_EQ(value, ValueType{ key < 50 ? "low" : "high" });
+            count++;
+        });
+    EXPECT_EQ(count, 20u);
+}
+
+TEST(VirtualNodeIterationTest, Snapshot_Iteration_Along_With_Writes)
+{
+    StorageType overlay{ "Overlay" };
+    VolumeType low{ "Low", 1 };
+    VolumeType high{ "High", 2 };
+    overlay.GetRoot()->Mount(low.GetRoot());
+    overlay.GetRoot()->Mount(high.GetRoot());
+
+    for (int i = 0; i < 100; i++)
+        low.GetRoot()->Insert(i, "low");
+    for (int i = 50; i < 150; i++)
+        high.GetRoot()->Insert(i, "high");
+
+    // writes made by the functor don't change the visited view
+    std::map<KeyType, ValueType> visited;
+    size_t count = 0;
+    overlay.GetRoot()->ForEachKeyValueSnapshot(
+        [&](const auto& key, const auto& value)
+        {
+            visited[key] = value;
+            count++;
+
+            overlay.GetRoot()->Insert(key + 1000, "new");
+            low.GetRoot()->Erase(key);
+        });
+
+    EXPECT_EQ(count, 150u);
+    EXPECT_EQ(visited.size(), 150u);
+    EXPECT_EQ(visited[10], ValueType{ "low" });
+    EXPECT_EQ(visited[60], ValueType{ "high" });
+
+    EXPECT_TRUE(overlay.GetRoot()->Contains(1010));
+    EXPECT_FALSE(overlay.GetRoot()->Contains(10));
+}
+
+TEST(VirtualNodeIterationTest, Paged_Iteration)
+{
+    StorageType overlay{ "Overlay" };
+    VolumeType low{ "Low", 1 };
+    VolumeType high{ "High", 2 };
+    overlay.GetRoot()->Mount(low.GetRoot());
+    overlay.GetRoot()->Mount(high.GetRoot());
+
+    for (int i = 0; i < 100; i++)
+        low.GetRoot()->Insert(i, "low");
+    for (int i = 50; i < 150; i += 2)
+        high.GetRoot()->Insert(i, "high");
+
+    std::map<KeyType, ValueType> expected;
+    overlay.GetRoot()->ForEachKeyValue(
+        [&expected](const auto& key, auto& value)
+        {
+            expected[key] = value;
+        });
+
+    // pages don't overlap and shadowed keys get values of the node with the highest priority
+    std::map<KeyType, ValueType> visited;
+    size_t count = 0;
+    IVirtualNode<KeyType, ValueType>::KeyValuesType page;
+    IVirtualNode<KeyType, ValueType>::CursorType cursor;
+    while (!cursor.IsEnd())
+    {
+        cursor = overlay.GetRoot()->NextKeyValues(cursor, 9, page);
+        for (const auto& keyValue : page)
+            visited[keyValue.first] = keyValue.second;
+        count += page.size();
+    }
+
+    EXPECT_EQ(count, expected.size());
+    EXPECT_EQ(visited, expected);
+    EXPECT_EQ(overlay.GetRoot()->GetPageOrder(), PageOrder::Hashes);
+
+    // volumes of different orders are merged in the order of keys
+    Volume<KeyType, ValueType, OrderedDict<KeyType, ValueType>> ordered{ "Ordered", 3 };
+    ordered.GetRoot()->Insert(1000, "ordered");
+    overlay.GetRoot()->Mount(ordered.GetRoot());
+    expected[1000] = "ordered";
+    EXPECT_EQ(overlay.GetRoot()->GetPageOrder(), PageOrder::Keys);
+
+    std::vector<KeyType> keys;
+    visited.clear();
+    for (cursor = {}; !cursor.IsEnd();)
+    {
+        cursor = overlay.GetRoot()->NextKeyValues(cursor, 9, page);
+        for (const auto& keyValue : page)
+        {
+            keys.push_back(keyValue.first);
+            visited[keyValue.first] = keyValue.second;
+        }
+    }
+
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    EXPECT_EQ(keys.size(), expected.size());
+    EXPECT_EQ(visited, expected);
+
+    overlay.GetRoot()->InsertChild("first");
+    overlay.GetRoot()->InsertChild("second");
+
+    IVirtualNode<KeyType, ValueType>::ChildrenType children;
+    auto childCursor = overlay.GetRoot()->NextChildren({}, 1, children);
+    ASSERT_EQ(children.size(), 1u);
+    EXPECT_EQ(children[0]->GetName(), "first");
+    childCursor = overlay.GetRoot()->NextChildren(childCursor, 10, children);
+    ASSERT_EQ(children.size(), 1u);
+    EXPECT_EQ(children[0]->GetName(), "second");
+    EXPECT_TRUE(childCursor.IsEnd());
+}
+
+TEST(VirtualNodeStatsTest, Distinct_Keys_Of_Mounted_Volumes)
+{
+    StorageType storage{ "VirtRoot" };
+    const auto virtRoot = storage.GetRoot();
+    virtRoot->InsertChild("child");
+
+    VolumeType base{ "Base", 1 };
+    VolumeType overlay{ "Overlay", 2 };
+    for (int i = 0; i < 20000; i++)
+        base.GetRoot()->Insert(i, i);
+    for (int i = 10000; i < 40000; i++)
+        overlay.GetRoot()->Insert(i, i);
+
+    // a single volume is counted exactly
+    virtRoot->Mount(base.GetRoot());
+    auto stats = virtRoot->GetStats();
+    EXPECT_EQ(stats.keyCount, 20000u);
+    EXPECT_EQ(stats.childCount, 1u);
+    EXPECT_EQ(virtRoot->EstimateDistinctKeyCount(), 20000u);
+
+    // stats sum up 50000 keys, 40000 of which are distinct
+    virtRoot->Mount(overlay.GetRoot());
+    stats = virtRoot->GetStats();
+    EXPECT_EQ(stats.keyCount, 50000u);
+    EXPECT_EQ(stats.payloadBytes, base.GetRoot()->GetStats().payloadBytes + overlay.GetRoot()->GetStats().payloadBytes);
+
+    const auto distinctKeyCount = virtRoot->EstimateDistinctKeyCount();
+    EXPECT_GT(distinctKeyCount, 38000u);
+    EXPECT_LT(distinctKeyCount, 42000u);
+}
+
+TEST(VirtualNodeMountPropagationTest, Asynchronous_Propagation)
+{
+    StorageOptions options;
+    options.mountPropagation = MountPropagation::Asynchronous;
+
+    StorageType storage{ "VirtRoot", options };
+    const auto virtRoot = storage.GetRoot();
+
+    const auto volume = CreateVolume(cRawRoot1, 100);
+    virtRoot->Mount(volume.GetRoot());
+    EXPECT_TRUE(IsEqual(virtRoot, cRawRoot1));
+
+    // children come and go in bulk, and grandchildren are inserted along with them
+    const auto volumeRoot = volume.GetRoot();
+    for (int i = 0; i < 1000; i++)
+    {
+        const auto child = volumeRoot->InsertChild("Bulk" + to_string(i));
+        child->Insert(i, i);
+        child->InsertChild("Grandchild")->Insert(i, i * 10);
+    }
+
+    for (int i = 0; i < 1000; i += 2)
+        volumeRoot->RemoveChild("Bulk" + to_string(i));
+
+    virtRoot->FlushMounting();
+    EXPECT_TRUE(IsEqual(virtRoot, ToRawNode(volumeRoot)));
+
+    const auto virtChild = virtRoot->FindChild("Bulk1");
+    ASSERT_NE(virtChild, nullptr);
+    virtChild->FlushMounting();
+    ValueType value;
+    EXPECT_TRUE(virtChild->FindChild("Grandchild")->Find(1, value));
+    EXPECT_EQ(value, ValueType{ 10 });
+
+    // changes queued before an unmount don't reach the storage
+    for (int i = 0; i < 100; i++)
+        volumeRoot->InsertChild("Late" + to_string(i));
+    virtRoot->Unmount(volumeRoot);
+
+    virtRoot->FlushMounting();
+    EXPECT_EQ(virtRoot->FindChild("Late0"), nullptr);
+    EXPECT_EQ(virtRoot->FindChild("Bulk1"), nullptr);
+}
+
+TEST(VirtualNodeMountPropagationTest, Errors_Are_Rethrown_By_Flush)
+{
+    struct Receiver
+    {
+        void ApplyMountChanges(const std::vector<internal::MountPropagationQueue<Receiver, std::shared_ptr<int>>::Change>& changes)
+        {
+            applied += changes.size();
+            if (fail)
+                throw std::runtime_error("mount failed");
+        }
+
+        size_t applied = 0;
+        bool fail = false;
+    };
+
+    const auto queue = internal::MountPropagationQueue<Receiver, std::shared_ptr<int>>::CreateInstance();
+    const auto failing = std::make_shared<Receiver>();
+    failing->fail = true;
+    const auto succeeding = std::make_shared<Receiver>();
+
+    queue->Push(failing, 1, nullptr, true);
+    queue->Push(succeeding, 2, nullptr, true);
+    EXPECT_THROW(queue->Flush(), std::runtime_error);
+
+    // a failing receiver doesn't stop the others, and the error is reported once
+    EXPECT_EQ(failing->applied, 1u);
+    EXPECT_EQ(succeeding->applied, 1u);
+    queue->Push(succeeding, 3, nullptr, true);
+    EXPECT_NO_THROW(queue->Flush());
+    EXPECT_EQ(succeeding->applied, 2u);
+}
+
+TEST(VirtualNodeMountPropagationTest, Changes_Are_Drained_By_A_Pool_Task)
+{
+    struct Receiver
+    {
+        void ApplyMountChanges(const std::vector<internal::MountPropagationQueue<Receiver, std::shared_ptr<int>>::Change>& changes)
+        {
+            // changes pushed while a batch is applied come in the next one
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            applied += changes.size();
+            if (++batches == 1)
+                throw std::runtime_error("mount failed");
+        }
+
+        std::atomic<size_t> batches{ 0 };
+        std::atomic<size_t> applied{ 0 };
+    };
+
+    utils::WorkStealingPool pool(2);
+    const auto queue = internal::MountPropagationQueue<Receiver, std::shared_ptr<int>>::CreateInstance(pool);
+    const auto receiver = std::make_shared<Receiver>();
+
+    // nobody flushes, so a worker of the pool applies the changes
+    for (NodeId id = 1; id <= 100; id++)
+        queue->Push(receiver, id, nullptr, true);
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (receiver->applied != 100 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+    EXPECT_EQ(receiver->applied, 100u);
+    EXPECT_LT(receiver->batches, 100u);
+
+    // the error of the drain reaches Flush once
+    EXPECT_THROW(queue->Flush(), std::runtime_error);
+
+    // a drain is submitted again once the queue has been emptied
+    queue->Push(receiver, 101, nullptr, true);
+    EXPECT_NO_THROW(queue->Flush());
+    EXPECT_EQ(receiver->applied, 101u);
+}
+
+TEST(VirtualNodeParallelMountTest, Same_Tree_As_Sequential_Mount)
+{
+    // the pool may have been created by an earlier test of the process
+    ConfigureThreadPool({ 3 });
+
+    const auto fill =
+        [](const VolumeType::NodePtr& node, int seed)
+        {
+            vector<VolumeType::NodePtr> level{ node };
+            for (int depth = 0; depth < 4; depth++)
+            {
+                vector<VolumeType::NodePtr> next;
+                for (const auto& parent : level)
+                    for (int i = 0; i < 5; i++)
+                    {
+                        const auto child = parent->InsertChild("Child" + to_string(i));
+                        child->Insert(i, seed + depth);
+                        child->Insert(seed, i);
+                        next.push_back(child);
+                    }
+                level = move(next);
+            }
+        };
+
+    StorageOptions sequentialOptions;
+    sequentialOptions.parallelMounting = false;
+
+    StorageType parallel{ "Parallel" };
+    StorageType sequential{ "Sequential", sequentialOptions };
+
+    VolumeType base{ "Base", 1 };
+    VolumeType overlay{ "Overlay", 2 };
+    fill(base.GetRoot(), 100);
+    fill(overlay.GetRoot(), 200);
+    for (const auto& storage : { parallel.GetRoot(), sequential.GetRoot() })
+    {
+        storage->Mount(base.GetRoot());
+        storage->Mount(overlay.GetRoot());
+    }
+
+    EXPECT_TRUE(IsEqual(parallel.GetRoot(), sequential.GetRoot()));
+    EXPECT_EQ(ToRawNode(parallel.GetRoot()->FindChild("Child4")->FindChild("Child3")).children.size(), 5u);
+
+    // every mounted node follows its volume
+    base.GetRoot()->FindChild("Child1")->FindChild("Child2")->InsertChild("New")->Insert(1, 1);
+    overlay.GetRoot()->FindChild("Child1")->FindChild("Child2")->RemoveChild("Child0");
+    EXPECT_TRUE(IsEqual(parallel.GetRoot(), sequential.GetRoot()));
+    EXPECT_NE(parallel.GetRoot()->FindChild("Child1")->FindChild("Child2")->FindChild("New"), nullptr);
+}
+
+TEST(VirtualNodeLazyMountTest, Children_Are_Mounted_When_Visited)
+{
+    using VolumeNodeType = IVolumeNode<KeyType, ValueType>;
+
+    struct NoEvents : internal::INodeEvents<VolumeNodeType>
+    {
+        void OnNodeAdded(NodePtr) override
+        {
+        }
+
+        void OnNodeRemoved(NodePtr) override
+        {
+        }
+    };
+
+    StorageOptions options;
+    options.lazyMounting = true;
+
+    StorageType storage{ "VirtRoot", options };
+    StorageType eagerStorage{ "EagerRoot" };
+    const auto virtRoot = storage.GetRoot();
+
+    const auto volume1 = CreateVolume(cRawRoot1, 100);
+    const auto volume2 = CreateVolume(cRawRoot2, 200);
+    virtRoot->Mount(volume1.GetRoot());
+    virtRoot->Mount(volume2.GetRoot());
+    eagerStorage.GetRoot()->Mount(volume1.GetRoot());
+    eagerStorage.GetRoot()->Mount(volume2.GetRoot());
+
+    // the storage subscribes to a volume node once it mounts the node: cookies show whether it has come in between
+    const auto subscription = dynamic_pointer_cast<internal::INodeEventsSubscription<VolumeNodeType>>(volume1.GetRoot()->FindChild("child"));
+    const auto takeCookie =
+        [&subscription]()
+        {
+            const auto cookie = subscription->RegisterSubscriber(make_shared<NoEvents>());
+            subscription->UnregisterSubscriber(cookie);
+            return cookie;
+        };
+
+    // stats report children of the volumes as pending instead of mounting them (checked by cookies below)
+    const auto stats = virtRoot->GetStats();
+    EXPECT_EQ(stats.childCount, 0u);
+    EXPECT_EQ(stats.pendingChildCount, volume1.GetRoot()->GetStats().childCount + volume2.GetRoot()->GetStats().childCount);
+
+    const auto cookie = takeCookie();
+    EXPECT_EQ(takeCookie(), cookie + 1);
+
+    // keys don't need children; children of a visited node are mounted, their children are not
+    ValueType value;
+    EXPECT_TRUE(virtRoot->Find(1, value));
+    EXPECT_EQ(takeCookie(), cookie + 2);
+
+    // a child inserted before its parent is visited is found as well
+    volume1.GetRoot()->FindChild("child_1_1")->InsertChild("Late")->Insert(5, 5);
+
+    const auto virtChild = virtRoot->FindChild("child");
+    ASSERT_NE(virtChild, nullptr);
+    EXPECT_EQ(takeCookie(), cookie + 4);
+
+    // the visited part follows changes of volumes
+    volume1.GetRoot()->InsertChild("New");
+    EXPECT_NE(virtRoot->FindChild("New"), nullptr);
+
+    EXPECT_TRUE(IsEqual(virtRoot, eagerStorage.GetRoot()));
+    EXPECT_NE(virtRoot->FindChild("child_1_1")->FindChild("Late"), nullptr);
+}
+
+TEST(VirtualNodePathTest, Paths_Of_Lazily_Mounted_Volumes)
+{
+    StorageOptions options;
+    options.lazyMounting = true;
+
+    StorageType storage{ "VirtRoot", options };
+    const auto virtRoot = storage.GetRoot();
+
+    const auto volume1 = CreateVolume(cRawRoot1, 100);
+    const auto volume2 = CreateVolume(cRawRoot2, 200);
+    virtRoot->Mount(volume1.GetRoot());
+    virtRoot->Mount(volume2.GetRoot());
+
+    // deferred children are mounted along the path
+    const auto node = virtRoot->FindByPath("child/child1");
+    ASSERT_NE(node, nullptr);
+    EXPECT_EQ(node->GetName(), "child1");
+    EXPECT_TRUE(IsEqual(node, virtRoot->FindChild("child")->FindChild("child1")));
+    EXPECT_EQ(virtRoot->FindByPath("child/missing"), nullptr);
+
+    ValueType value;
+    EXPECT_TRUE(virtRoot->FindValueByPath("child_1_1/child_1_1_1", 11, value));
+    EXPECT_EQ(value, ValueType{ 1 });
+    EXPECT_FALSE(virtRoot->FindValueByPath("child_1_1/missing", 11, value));
+
+    // nodes missing in volumes are inserted as ordinary virtual nodes
+    const auto inserted = virtRoot->InsertChildPath("child/child1/New/Newer");
+    EXPECT_EQ(inserted->GetName(), "Newer");
+    EXPECT_EQ(virtRoot->FindByPath("child/child1/New/Newer")->GetName(), "Newer");
+    EXPECT_EQ(volume1.GetRoot()->FindByPath("child/child1/New"), nullptr);
+}
@@ -2,9 +2,16 @@
 //
 
 #include <iostream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
 #include "gtest/gtest.h"
 
 #include "TestTools.h"
+#include "../src/utils/MemorySize.h"
 
 using namespace std;
 using namespace vs;
@@ -113,6 +120,50 @@ TEST_F(VolumeNodeTest, RemovedChild_Produces_Exception)
     EXPECT_THROW(foundChild->GetName(), ActionOnRemovedNodeException);
 }
 
+TEST_F(VolumeNodeTest, Subscribers_Are_Notified_Of_Structural_Changes)
+{
+    using VolumeNodeType = IVolumeNode<KeyType, ValueType>;
+
+    struct CountingEvents : internal::INodeEvents<VolumeNodeType>
+    {
+        void OnNodeAdded(NodePtr) override
+        {
+            added++;
+        }
+
+        void OnNodeRemoved(NodePtr) override
+        {
+            removed++;
+        }
+
+        atomic<int> added{ 0 };
+        atomic<int> removed{ 0 };
+    };
+
+    auto root = m_volume.GetRoot();
+    const auto subscription = dynamic_pointer_cast<internal::INodeEventsSubscription<VolumeNodeType>>(root);
+    ASSERT_NE(subscription, nullptr);
+
+    const auto events = make_shared<CountingEvents>();
+    const auto cookie = subscription->RegisterSubscriber(events);
+
+    // inserting an existing child changes nothing
+    root->InsertChild("Child");
+    root->InsertChild("Child");
+    EXPECT_EQ(events->added, 1);
+
+    root->RemoveChild("Child");
+    root->RemoveChild("Child");
+    EXPECT_EQ(events->removed, 1);
+
+    subscription->UnregisterSubscriber(cookie);
+
+    root->InsertChild("Child");
+    root->RemoveChild("Child");
+    EXPECT_EQ(events->added, 1);
+    EXPECT_EQ(events->removed, 1);
+}
+
 TEST_F(VolumeNodeTest, Insert_Erase_Find_Contains_Replace)
 {
     const auto root = m_volume.GetRoot();
@@ -141,4 +192,1146 @@ TEST_F(VolumeNodeTest, TryInsert)
 
     EXPECT_TRUE(root->TryInsert(100, "test"));
     EXPECT_FALSE(root->TryInsert(100, "new test"));
-}
\ No newline at end of file
+}
+
+TEST(FlatVolumeNodeTest, Insert_Erase_Find_Contains_Replace)
+{
+    using FlatVolumeType = Volume<KeyType, ValueType, FlatHashDict<KeyType, ValueType>>;
+
+    FlatVolumeType volume{ "Root", 0 };
+    const auto root = volume.GetRoot();
+
+    EXPECT_TRUE(root->TryInsert(100, "test"));
+    EXPECT_FALSE(root->TryInsert(100, "new test"));
+
+    ValueVariant value;
+    EXPECT_TRUE(root->Find(100, value));
+    EXPECT_EQ(get<string>(value), "test");
+
+    EXPECT_TRUE(root->Replace(100, 3.14));
+    EXPECT_TRUE(root->Find(100, value));
+    EXPECT_EQ(get<double>(value), 3.14);
+
+    // children inherit the dictionary engine
+    const auto child = root->InsertChild("child");
+    for (int i = 0; i < 1000; i++)
+        child->Insert(i, i);
+    for (int i = 0; i < 1000; i += 2)
+        child->Erase(i);
+
+    EXPECT_FALSE(child->Contains(0));
+    EXPECT_TRUE(child->Find(1, value));
+    EXPECT_EQ(get<int32_t>(value), 1);
+
+    root->Erase(100);
+    EXPECT_FALSE(root->Contains(100));
+    EXPECT_FALSE(root->Replace(100, 100));
+}
+
+TEST(ShardedVolumeNodeTest, Concurrent_Writers)
+{
+    using ShardedDictType = ShardedFlatHashDict<KeyType, ValueType>;
+    using ShardedVolumeType = Volume<KeyType, ValueType, ShardedDictType>;
+
+    DictOptions<ShardedDictType> options;
+    options.shardCount = 8;
+
+    ShardedVolumeType volume{ "Root", 0, options };
+    const auto root = volume.GetRoot();
+
+    const int cThreadCount = 4;
+    const int cKeysPerThread = 5000;
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < cThreadCount; t++)
+        writers.emplace_back(
+            [&root, t]()
+            {
+                for (int i = 0; i < cKeysPerThread; i++)
+                    root->Insert(t * cKeysPerThread + i, i);
+            });
+
+    for (auto& writer : writers)
+        writer.join();
+
+    size_t count = 0;
+    root->ForEachKeyValue(
+        [&count](const auto&, auto&)
+        {
+            count++;
+        });
+    EXPECT_EQ(count, cThreadCount * cKeysPerThread);
+
+    ValueVariant value;
+    EXPECT_TRUE(root->Find(cKeysPerThread + 7, value));
+    EXPECT_EQ(get<int32_t>(value), 7);
+
+    root->Erase(cKeysPerThread + 7);
+    EXPECT_FALSE(root->Contains(cKeysPerThread + 7));
+}
+
+TEST(ShardedVolumeNodeTest, Bulk_MultiInsert)
+{
+    using ShardedDictType = ShardedFlatHashDict<KeyType, ValueType>;
+    using ShardedVolumeType = Volume<KeyType, ValueType, ShardedDictType>;
+
+    ShardedVolumeType volume{ "Root", 0 };
+    const auto root = volume.GetRoot();
+
+    // large batches fill shards in parallel
+    const int cKeyCount = 3 * ShardedDictType::cParallelBatchSize;
+    IVolumeNode<KeyType, ValueType>::KeyValuesType keyValues;
+    for (int i = 0; i < cKeyCount; i++)
+        keyValues.emplace_back(i, std::to_string(i));
+    keyValues.emplace_back(7, "seven");
+
+    root->MultiInsert(std::move(keyValues));
+
+    size_t count = 0;
+    root->ForEachKeyValue(
+        [&count](const auto& key, auto& value)
+        {
+            EXPECT_EQ(value, ValueVariant{ key == 7 ? "seven" : std::to_string(key) });
+            count++;
+        });
+    EXPECT_EQ(count, static_cast<size_t>(cKeyCount));
+}
+
+TEST(RcuVolumeNodeTest, Snapshot_Is_Released_By_Another_Thread_After_Dictionary)
+{
+    using DictType = RcuHashDict<KeyType, ValueType>;
+
+    DictType::SnapshotType snapshot;
+    {
+        DictType dict;
+        for (int i = 0; i < 100; i++)
+            dict.Insert(i, std::to_string(i));
+
+        dict.TakeSnapshot(
+            [&snapshot](auto taken)
+            {
+                snapshot = std::move(taken);
+            });
+
+        // entries replaced and erased after the snapshot are kept for it
+        for (int i = 0; i < 100; i++)
+        {
+            if (i % 2 == 0)
+                dict.Erase(i);
+            else
+                dict.Insert(i, std::string("changed"));
+        }
+    }
+
+    std::thread scanner(
+        [snapshot = std::move(snapshot)]() mutable
+        {
+            size_t count = 0;
+            bool mismatch = false;
+            DictType::ForEachInSnapshot(snapshot,
+                [&](const auto& key, const auto& value)
+                {
+                    count++;
+                    mismatch |= get<string>(value) != std::to_string(key);
+                });
+            EXPECT_EQ(count, 100u);
+            EXPECT_FALSE(mismatch);
+
+            snapshot.reset();
+        });
+    scanner.join();
+}
+
+TEST(RcuVolumeNodeTest, Readers_Along_With_Writer)
+{
+    using RcuVolumeType = Volume<KeyType, ValueType, RcuHashDict<KeyType, ValueType>>;
+
+    RcuVolumeType volume{ "Root", 0 };
+    const auto root = volume.GetRoot();
+
+    const int cKeyCount = 1000;
+    for (int i = 0; i < cKeyCount; i++)
+        root->Insert(i, std::to_string(i));
+
+    std::atomic<bool> stop{ false };
+    std::atomic<int> mismatches{ 0 };
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++)
+        readers.emplace_back(
+            [&]()
+            {
+                ValueVariant value;
+                while (!stop.load())
+                {
+                    for (int i = 0; i < cKeyCount; i++)
+                    {
+                        // even keys are stable, odd ones are rewritten by the writer
+                        if (i % 2 == 0 && (!root->Find(i, value) || get<string>(value) != std::to_string(i)))
+                            mismatches++;
+                    }
+                }
+            });
+
+    for (int round = 0; round < 20; round++)
+        for (int i = 1; i < cKeyCount; i += 2)
+        {
+            root->Erase(i);
+            root->Insert(i, std::to_string(i + round));
+            root->Insert(cKeyCount + i, i); // grows the table
+        }
+
+    stop = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    EXPECT_EQ(mismatches.load(), 0);
+
+    ValueVariant value;
+    EXPECT_TRUE(root->Find(1, value));
+    EXPECT_EQ(get<string>(value), "20");
+
+    EXPECT_FALSE(root->TryInsert(2, "new"));
+    EXPECT_TRUE(root->Replace(2, 2));
+    EXPECT_TRUE(root->Find(2, value));
+    EXPECT_EQ(get<int32_t>(value), 2);
+
+    root->ForEachKeyValue(
+        [](const auto&, auto& value)
+        {
+            value = 0;
+        });
+    EXPECT_TRUE(root->Find(1, value));
+    EXPECT_EQ(get<int32_t>(value), 0);
+}
+
+TEST(OrderedVolumeNodeTest, ForEachInRange_LowerBound)
+{
+    using OrderedVolumeType = Volume<KeyType, ValueType, OrderedDict<KeyType, ValueType>>;
+
+    OrderedVolumeType volume{ "Root", 0 };
+    const auto root = volume.GetRoot();
+
+    for (int i = 0; i < 1000; i++)
+        root->Insert(i * 10, i);
+
+    std::vector<KeyType> keys;
+    root->ForEachInRange(95, 150,
+        [&keys](const auto& key, auto&)
+        {
+            keys.push_back(key);
+        });
+    EXPECT_EQ(keys, (std::vector<KeyType>{ 100, 110, 120, 130, 140 }));
+
+    KeyType foundKey;
+    ValueVariant value;
+    EXPECT_TRUE(root->LowerBound(95, foundKey, value));
+    EXPECT_EQ(foundKey, 100);
+    EXPECT_EQ(get<int32_t>(value), 10);
+
+    EXPECT_TRUE(root->LowerBound(100, foundKey, value));
+    EXPECT_EQ(foundKey, 100);
+    EXPECT_FALSE(root->LowerBound(9991, foundKey, value));
+
+    // hash dictionaries give the same answers, though by a full scan
+    VolumeType hashVolume{ "Root", 0 };
+    const auto hashRoot = hashVolume.GetRoot();
+    for (int i = 0; i < 1000; i++)
+        hashRoot->Insert(i * 10, i);
+
+    std::vector<KeyType> hashKeys;
+    hashRoot->ForEachInRange(95, 150,
+        [&hashKeys](const auto& key, auto&)
+        {
+            hashKeys.push_back(key);
+        });
+    std::sort(hashKeys.begin(), hashKeys.end());
+    EXPECT_EQ(hashKeys, keys);
+
+    EXPECT_TRUE(hashRoot->LowerBound(95, foundKey, value));
+    EXPECT_EQ(foundKey, 100);
+}
+
+TEST_F(VolumeNodeTest, Visit)
+{
+    const auto root = m_volume.GetRoot();
+
+    const blob payload(4096, 0xAB);
+    root->Insert(1, payload);
+
+    const void* visitedData = nullptr;
+    EXPECT_TRUE(root->Visit(1,
+        [&](const ValueVariant& value)
+        {
+            EXPECT_EQ(get<blob>(value), payload);
+            visitedData = get<blob>(value).data();
+        }));
+
+    // a value is visited in place: the same buffer for every call
+    EXPECT_TRUE(root->Visit(1,
+        [&](const ValueVariant& value)
+        {
+            EXPECT_EQ(get<blob>(value).data(), visitedData);
+        }));
+
+    EXPECT_FALSE(root->Visit(2,
+        [](const ValueVariant&)
+        {
+            ADD_FAILURE();
+        }));
+}
+
+TEST(FilteredVolumeNodeTest, No_False_Negatives_After_Erases_And_Growth)
+{
+    using FilteredDictType = FilteredDict<KeyType, ValueType, FlatHashDict<KeyType, ValueType>>;
+    using FilteredVolumeType = Volume<KeyType, ValueType, FilteredDictType>;
+
+    DictOptions<FilteredDictType> options;
+    options.expectedKeyCount = 16;
+
+    FilteredVolumeType volume{ "Root", 0, options };
+    const auto root = volume.GetRoot();
+
+    // the filter is rebuilt several times on the way
+    const int cKeyCount = 20000;
+    for (int i = 0; i < cKeyCount; i++)
+        root->Insert(i, i);
+    for (int i = 0; i < cKeyCount; i += 2)
+        root->Erase(i);
+
+    const auto child = root->InsertChild("child");
+    child->Insert(1, 1);
+
+    ValueVariant value;
+    for (int i = 0; i < cKeyCount; i++)
+        EXPECT_EQ(root->Find(i, value), i % 2 == 1);
+    EXPECT_TRUE(child->Contains(1));
+    EXPECT_FALSE(child->Contains(2));
+
+    // missing keys mostly don't pass the filter
+    const auto filter = dynamic_pointer_cast<internal::IKeyFilter<KeyType>>(root);
+    ASSERT_NE(filter, nullptr);
+
+    int falsePositives = 0;
+    for (int i = cKeyCount; i < 2 * cKeyCount; i++)
+        falsePositives += filter->MayContain(i) ? 1 : 0;
+    EXPECT_LT(falsePositives, cKeyCount / 20);
+}
+
+TEST(FilteredVolumeNodeTest, Pinned_Filter_Answers_As_The_Node)
+{
+    using FilteredVolumeType = Volume<KeyType, ValueType, FilteredDict<KeyType, ValueType>>;
+
+    FilteredVolumeType volume{ "Root", 0 };
+    const auto child = volume.GetRoot()->InsertChild("child");
+    for (int i = 0; i < 1000; i += 2)
+        child->Insert(i, i);
+
+    // a batch probes the node itself rather than its proxy
+    const auto filter = dynamic_pointer_cast<internal::IKeyFilter<KeyType>>(child);
+    ASSERT_NE(filter, nullptr);
+    auto pinned = filter->PinKeyFilter();
+    ASSERT_NE(pinned, nullptr);
+    EXPECT_NE(pinned.get(), filter.get());
+    for (int i = 0; i < 2000; i++)
+        EXPECT_EQ(pinned->MayContain(i), filter->MayContain(i));
+
+    // a pin keeps a removed node for the rest of a batch; once the node is gone,
+    // its proxy pins nothing and leaves it to fail when called
+    volume.GetRoot()->RemoveChild("child");
+    EXPECT_TRUE(pinned->MayContain(0));
+    pinned.reset();
+    EXPECT_EQ(filter->PinKeyFilter(), nullptr);
+    EXPECT_TRUE(filter->MayContain(1));
+}
+
+TEST(FilteredVolumeNodeTest, Erases_Of_Missing_Keys_Keep_The_Filter)
+{
+    FilteredDict<KeyType, ValueType> dict;
+    for (int i = 0; i < 1000; i++)
+        dict.Insert(i, i);
+
+    NodeStats before;
+    dict.AddStats(before);
+
+    // false positives of the filter reach the inner engine, but they erase nothing
+    std::vector<KeyType> missing;
+    for (int i = 1000; i < 201000; i++)
+    {
+        EXPECT_FALSE(dict.Erase(i));
+        missing.push_back(i);
+    }
+    std::vector<size_t> erased;
+    dict.MultiErase(missing, internal::dict::IndexSequence{ missing.size() }, erased);
+    EXPECT_TRUE(erased.empty());
+
+    // a rebuilt filter would be sized for the growth of the node
+    NodeStats after;
+    dict.AddStats(after);
+    EXPECT_EQ(after.overheadBytes, before.overheadBytes);
+
+    EXPECT_TRUE(dict.Erase(1));
+    dict.MultiErase({ 1, 2, 3 }, internal::dict::IndexSequence{ 3 }, erased);
+    EXPECT_EQ(erased, (std::vector<size_t>{ 1, 2 }));
+}
+
+TEST(FilteredVolumeNodeTest, Overwrites_Keep_The_Filter)
+{
+    FilteredDict<KeyType, ValueType> dict;
+    for (int i = 0; i < 1000; i++)
+        EXPECT_TRUE(dict.Insert(i, i));
+
+    NodeStats before;
+    dict.AddStats(before);
+
+    // overwritten keys are in the filter already, so they don't count towards a rebuild
+    std::vector<std::pair<KeyType, ValueType>> keyValues;
+    for (int i = 0; i < 1000; i++)
+        keyValues.emplace_back(i, -i);
+    for (int round = 0; round < 10; round++)
+    {
+        for (int i = 0; i < 1000; i++)
+            EXPECT_FALSE(dict.Insert(i, round));
+        EXPECT_EQ(dict.MultiInsert(keyValues, internal::dict::IndexSequence{ keyValues.size() }), 0u);
+    }
+
+    // a rebuilt filter would be sized for the growth of the node
+    NodeStats after;
+    dict.AddStats(after);
+    EXPECT_EQ(after.overheadBytes, before.overheadBytes);
+    EXPECT_EQ(after.keyCount, 1000u);
+}
+
+//
+// Tests run on every dictionary engine
+//
+
+// names engines in test names instead of their indices
+struct EngineNames
+{
+    template<typename DictT>
+    static std::string GetName(int)
+    {
+        if constexpr (std::is_same_v<DictT, HashDict<KeyType, ValueType>>)
+            return "Hash";
+        else if constexpr (std::is_same_v<DictT, FlatHashDict<KeyType, ValueType>>)
+            return "FlatHash";
+        else if constexpr (std::is_same_v<DictT, OrderedDict<KeyType, ValueType>>)
+            return "Ordered";
+        else if constexpr (std::is_same_v<DictT, ShardedFlatHashDict<KeyType, ValueType>>)
+            return "ShardedFlatHash";
+        else if constexpr (std::is_same_v<DictT, RcuHashDict<KeyType, ValueType>>)
+            return "RcuHash";
+        else
+            return "Filtered";
+    }
+};
+
+template<typename DictT>
+class VolumeNodeEngineTest : public ::testing::Test
+{
+};
+
+using Engines = ::testing::Types<
+    HashDict<KeyType, ValueType>,
+    FlatHashDict<KeyType, ValueType>,
+    OrderedDict<KeyType, ValueType>,
+    ShardedFlatHashDict<KeyType, ValueType>,
+    RcuHashDict<KeyType, ValueType>,
+    FilteredDict<KeyType, ValueType>>;
+
+TYPED_TEST_SUITE(VolumeNodeEngineTest, Engines, EngineNames);
+
+// engines keeping keys in chunks of a locked dictionary
+template<typename DictT>
+class VolumeNodeChunksTest : public ::testing::Test
+{
+};
+
+using ChunkedEngines = ::testing::Types<
+    HashDict<KeyType, ValueType>,
+    FlatHashDict<KeyType, ValueType>,
+    OrderedDict<KeyType, ValueType>>;
+
+TYPED_TEST_SUITE(VolumeNodeChunksTest, ChunkedEngines, EngineNames);
+
+TYPED_TEST(VolumeNodeEngineTest, MultiFind_MultiInsert_MultiErase)
+{
+    Volume<KeyType, ValueType, TypeParam> volume{ "Root", 0 };
+    const auto root = volume.GetRoot();
+
+    using NodeType = IVolumeNode<KeyType, ValueType>;
+
+    NodeType::KeyValuesType keyValues;
+    for (int i = 0; i < 100; i++)
+        keyValues.emplace_back(i, i);
+    // the last of duplicate keys wins
+    keyValues.emplace_back(7, "seven");
+
+    root->MultiInsert(std::move(keyValues));
+
+    NodeType::KeysType keys{ 7, 1000, 99, 0 };
+    NodeType::FoundValuesType values;
+    EXPECT_EQ(root->MultiFind(keys, values), 3u);
+    ASSERT_EQ(values.size(), keys.size());
+    EXPECT_EQ(values[0], ValueVariant{ "seven" });
+    EXPECT_FALSE(values[1].has_value());
+    EXPECT_EQ(values[2], ValueVariant{ 99 });
+    EXPECT_EQ(values[3], ValueVariant{ 0 });
+
+    root->MultiErase({ 7, 99, 1000 });
+    EXPECT_EQ(root->MultiFind(keys, values), 1u);
+    EXPECT_FALSE(root->Contains(7));
+    EXPECT_TRUE(root->Contains(8));
+}
+
+namespace
+{
+
+struct ChangedKeys : internal::IKeyEvents<KeyType>
+{
+    void OnKeyChanged(const KeyType& key) override
+    {
+        keys.push_back(key);
+    }
+
+    std::vector<KeyType> keys;
+};
+
+} //namespace
+
+TYPED_TEST(VolumeNodeEngineTest, Only_Erased_Keys_Are_Notified)
+{
+    Volume<KeyType, ValueType, TypeParam> volume{ "Root", 0 };
+    const auto root = volume.GetRoot();
+
+    const auto changed = std::make_shared<ChangedKeys>();
+    dynamic_pointer_cast<internal::IKeyEventsSubscription<KeyType>>(root)->RegisterKeySubscriber(changed);
+
+    for (int i = 0; i < 10; i++)
+        root->Insert(i, i);
+    changed->keys.clear();
+
+    // the single-key and the batched paths raise the same events
+    root->Erase(1);
+    root->Erase(100);
+    EXPECT_EQ(changed->keys, (std::vector<KeyType>{ 1 }));
+
+    changed->keys.clear();
+    root->MultiErase({ 5, 200, 1, 3, 300 });
+    EXPECT_EQ(changed->keys, (std::vector<KeyType>{ 5, 3 }));
+}
+
+TYPED_TEST(VolumeNodeEngineTest, Snapshot_Is_Stable_While_Writing)
+{
+    Volume<KeyType, ValueType, TypeParam> volume{ "Root", 0 };
+    const auto root = volume.GetRoot();
+
+    // more keys than a chunk of a locked dictionary holds
+    const int cKeyCount = 10000;
+    for (int i = 0; i < cKeyCount; i++)
+        root->Insert(i, i);
+
+    // a functor may change the node: changes are not seen by the running iteration
+    size_t count = 0;
+    bool mismatch = false;
+    root->ForEachKeyValueSnapshot(
+        [&](const auto& key, const auto& value)
+        {
+            if (count++ == 0)
+            {
+                for (int i = 0; i < cKeyCount; i += 2)
+                    root->Erase(i);
+                for (int i = 1; i < cKeyCount; i += 2)
+                    root->Insert(i, -i);
+                root->Insert(cKeyCount, cKeyCount);
+            }
+
+            mismatch |= key >= cKeyCount || value != ValueVariant{ key };
+        });
+    EXPECT_EQ(count, static_cast<size_t>(cKeyCount));
+    EXPECT_FALSE(mismatch);
+
+    count = 0;
+    root->ForEachKeyValueSnapshot(
+        [&count](const auto&, const auto&)
+        {
+            count++;
+        });
+    EXPECT_EQ(count, static_cast<size_t>(cKeyCount / 2 + 1));
+
+    // keys below cKeyCount are stable, the others are changed by a writer while snapshots are taken
+    std::atomic<bool> stop{ false };
+    std::thread writer(
+        [&]()
+        {
+            for (int round = 0; !stop.load(); round++)
+                for (int i = cKeyCount + 1; i < 2 * cKeyCount; i++)
+                {
+                    if (round % 2 == 0)
+                        root->Insert(i, round);
+                    else
+                        root->Erase(i);
+                }
+        });
+
+    for (int round = 0; round < 20; round++)
+    {
+        size_t stableCount = 0;
+        root->ForEachKeyValueSnapshot(
+            [&stableCount](const auto& key, const auto&)
+            {
+                if (key < cKeyCount)
+                    stableCount++;
+            });
+        EXPECT_EQ(stableCount, static_cast<size_t>(cKeyCount / 2));
+    }
+
+    stop = true;
+    writer.join();
+}
+
+TYPED_TEST(VolumeNodeChunksTest, Chunks_Are_Split_And_Merged)
+{
+    Volume<KeyType, ValueType, TypeParam> volume{ "Root", 0 };
+    const auto root = volume.GetRoot();
+
+    // chunks are split as keys come and merged as they go
+    const int cKeyCount = 5 * static_cast<int>(TypeParam::cMaxChunkSize);
+    for (int i = 0; i < cKeyCount; i++)
+        root->Insert(i, i);
+    for (int i = 0; i < cKeyCount; i++)
+        if (i % 16 != 0)
+            root->Erase(i);
+
+    EXPECT_EQ(root->GetStats().keyCount, static_cast<size_t>(cKeyCount / 16));
+
+    int count = 0;
+    bool mismatch = false;
+    root->ForEachKeyValueSnapshot(
+        [&](const auto& key, const auto& value)
+        {
+            count++;
+            mismatch |= key % 16 != 0 || value != ValueVariant{ key };
+        });
+    EXPECT_EQ(count, cKeyCount / 16);
+    EXPECT_FALSE(mismatch);
+
+    // an ordered dictionary is ordered across its chunks
+    KeyType foundKey;
+    ValueType value;
+    EXPECT_TRUE(root->LowerBound(cKeyCount / 2 + 1, foundKey, value));
+    EXPECT_EQ(foundKey, cKeyCount / 2 + 16);
+    EXPECT_FALSE(root->LowerBound(cKeyCount, foundKey, value));
+
+    KeyType lastKey = -1;
+    count = 0;
+    root->ForEachInRange(16, cKeyCount - 16,
+        [&](const auto& key, auto&)
+        {
+            if (TypeParam::IsOrdered())
+            {
+                EXPECT_LT(lastKey, key);
+            }
+            lastKey = key;
+            count++;
+        });
+    EXPECT_EQ(count, cKeyCount / 16 - 2);
+}
+
+TYPED_TEST(VolumeNodeEngineTest, NextKeyValues)
+{
+    Volume<KeyType, ValueType, TypeParam> volume{ "Root", 0 };
+    const auto root = volume.GetRoot();
+
+    using NodeType = IVolumeNode<KeyType, ValueType>;
+
+    const int cKeyCount = 100;
+    for (int i = 0; i < cKeyCount; i++)
+        root->Insert(i * 37 % cKeyCount * 2, i);
+
+    // even keys are present all the time, odd ones come and go between pages
+    std::vector<KeyType> visited;
+    NodeType::KeyValuesType page;
+    NodeType::CursorType cursor;
+    for (int round = 0; !cursor.IsEnd(); round++)
+    {
+        cursor = root->NextKeyValues(cursor, 7, page);
+        EXPECT_LE(page.size(), 7u);
+        for (const auto& keyValue : page)
+            visited.push_back(keyValue.first);
+
+        root->Insert(round * 2 + 1, round);
+        root->Erase(round * 2 - 1);
+    }
+
+    // keys come in the order of the engine
+    EXPECT_EQ(root->GetPageOrder(), TypeParam::cPageOrder);
+    EXPECT_TRUE(std::is_sorted(visited.begin(), visited.end(), PageLess<KeyType>{ TypeParam::cPageOrder }));
+    EXPECT_EQ(std::adjacent_find(visited.begin(), visited.end()), visited.end());
+    EXPECT_EQ(std::count_if(visited.begin(), visited.end(), [](KeyType key) { return key % 2 == 0; }), cKeyCount);
+
+    EXPECT_TRUE(root->NextKeyValues(cursor, 7, page).IsEnd());
+    EXPECT_TRUE(page.empty());
+    EXPECT_EQ(root->NextKeyValues({}, 0, page), NodeType::CursorType{}.InOrder(TypeParam::cPageOrder));
+
+    // pages in another order scan the node
+    const auto otherOrder = TypeParam::cPageOrder == PageOrder::Keys ? PageOrder::Hashes : PageOrder::Keys;
+    visited.clear();
+    for (cursor = NodeType::CursorType{}.InOrder(otherOrder); !cursor.IsEnd();)
+    {
+        cursor = root->NextKeyValues(cursor, 7, page);
+        for (const auto& keyValue : page)
+            visited.push_back(keyValue.first);
+    }
+
+    EXPECT_TRUE(std::is_sorted(visited.begin(), visited.end(), PageLess<KeyType>{ otherOrder }));
+    EXPECT_EQ(std::count_if(visited.begin(), visited.end(), [](KeyType key) { return key % 2 == 0; }), cKeyCount);
+}
+
+namespace
+{
+
+// counts hashes and comparisons of keys, so a test sees how many keys an engine has visited
+struct CountedKey
+{
+    bool operator == (const CountedKey& other) const
+    {
+        return value == other.value;
+    }
+
+    bool operator < (const CountedKey& other) const
+    {
+        touches++;
+        return value < other.value;
+    }
+
+    int value = 0;
+
+    inline static size_t touches = 0;
+};
+
+} //namespace
+
+template<>
+struct std::hash<CountedKey>
+{
+    size_t operator () (const CountedKey& key) const noexcept
+    {
+        CountedKey::touches++;
+        return std::hash<int>()(key.value);
+    }
+};
+
+template<typename DictT>
+class DictPageTest : public ::testing::Test
+{
+};
+
+using PagedDicts = ::testing::Types<
+    internal::dict::LockedDict<CountedKey, int, std::unordered_map<CountedKey, int>>,
+    internal::dict::LockedDict<CountedKey, int, utils::FlatHashMap<CountedKey, int>>,
+    internal::dict::LockedDict<CountedKey, int, utils::BPlusTreeMap<CountedKey, int>>,
+    internal::dict::ShardedDict<CountedKey, int, internal::dict::LockedDict<CountedKey, int, utils::FlatHashMap<CountedKey, int>>>,
+    internal::dict::RcuDict<CountedKey, int>,
+    internal::dict::FilteredDict<CountedKey, int>>;
+
+TYPED_TEST_SUITE(DictPageTest, PagedDicts);
+
+TYPED_TEST(DictPageTest, Pages_Resume_Without_A_Scan)
+{
+    using ChunkType = internal::dict::LockedDict<CountedKey, int>;
+
+    const int cKeyCount = 32 * static_cast<int>(ChunkType::cMaxChunkSize);
+    const size_t cPageSize = 16;
+
+    TypeParam dict;
+    for (int i = 0; i < cKeyCount; i++)
+        dict.Insert(CountedKey{ i }, i);
+
+    // a page in the order of the engine visits at most a few chunks of a locked dictionary,
+    // however large the dictionary is; pages in another order scan all of it
+    std::vector<std::pair<CountedKey, int>> page;
+    std::vector<CountedKey> visited;
+    size_t maxTouches = 0;
+    for (size_t round = 0; round < 64; round++)
+    {
+        const auto after = visited.empty() ? nullptr : &visited.back();
+
+        CountedKey::touches = 0;
+        page.clear();
+        dict.NextPage(after, cPageSize, TypeParam::cPageOrder, page);
+        maxTouches = std::max(maxTouches, CountedKey::touches);
+
+        ASSERT_EQ(page.size(), cPageSize);
+        for (const auto& keyValue : page)
+            visited.push_back(keyValue.first);
+    }
+
+    EXPECT_LT(maxTouches, 8 * (ChunkType::cMaxChunkSize + cPageSize));
+    EXPECT_TRUE(std::is_sorted(visited.begin(), visited.end(), PageLess<CountedKey>{ TypeParam::cPageOrder }));
+    EXPECT_EQ(std::adjacent_find(visited.begin(), visited.end()), visited.end());
+
+    const auto otherOrder = TypeParam::cPageOrder == PageOrder::Keys ? PageOrder::Hashes : PageOrder::Keys;
+    CountedKey::touches = 0;
+    page.clear();
+    dict.NextPage(&visited.back(), cPageSize, otherOrder, page);
+    EXPECT_GE(CountedKey::touches, static_cast<size_t>(cKeyCount));
+}
+
+TEST_F(VolumeNodeTest, NextChildren)
+{
+    const auto root = m_volume.GetRoot();
+    for (const auto& name : { "e", "b", "d", "a", "c" })
+        root->InsertChild(name);
+
+    using NodeType = IVolumeNode<KeyType, ValueType>;
+
+    NodeType::ChildrenType children;
+    auto cursor = root->NextChildren({}, 2, children);
+    ASSERT_EQ(children.size(), 2u);
+    EXPECT_EQ(children[0]->GetName(), "a");
+    EXPECT_EQ(children[1]->GetName(), "b");
+
+    root->RemoveChild("c");
+    root->InsertChild("bb");
+
+    cursor = root->NextChildren(cursor, 2, children);
+    ASSERT_EQ(children.size(), 2u);
+    EXPECT_EQ(children[0]->GetName(), "bb");
+    EXPECT_EQ(children[1]->GetName(), "d");
+    EXPECT_FALSE(cursor.IsEnd());
+
+    cursor = root->NextChildren(cursor, 2, children);
+    ASSERT_EQ(children.size(), 1u);
+    EXPECT_EQ(children[0]->GetName(), "e");
+    EXPECT_TRUE(cursor.IsEnd());
+}
+
+TEST_F(VolumeNodeTest, Paths)
+{
+    const auto root = m_volume.GetRoot();
+    root->Insert(0, 0);
+
+    const auto node = root->InsertChildPath("a/b/c");
+    node->Insert(1, 1);
+    EXPECT_EQ(node->GetName(), "c");
+    EXPECT_TRUE(root->FindChild("a")->FindChild("b")->FindChild("c")->Contains(1));
+
+    // existing nodes are kept, empty names are skipped
+    EXPECT_TRUE(root->InsertChildPath("/a//b/c/")->Contains(1));
+    EXPECT_TRUE(root->FindByPath("a/b/c")->Contains(1));
+    EXPECT_TRUE(root->FindChild("a")->FindByPath("b/c")->Contains(1));
+    EXPECT_TRUE(root->FindByPath("")->Contains(0));
+    EXPECT_EQ(root->FindByPath("a/x/c"), nullptr);
+
+    ValueType value;
+    EXPECT_TRUE(root->FindValueByPath("a/b/c", 1, value));
+    EXPECT_EQ(value, ValueType{ 1 });
+    EXPECT_FALSE(root->FindValueByPath("a/b/c", 2, value));
+    EXPECT_FALSE(root->FindValueByPath("a/b/x", 1, value));
+
+    root->FindByPath("a")->RemoveChild("b");
+    EXPECT_EQ(root->FindByPath("a/b/c"), nullptr);
+    EXPECT_FALSE(root->FindValueByPath("a/b/c", 1, value));
+}
+
+TYPED_TEST(VolumeNodeEngineTest, ParallelReduce)
+{
+    Volume<KeyType, ValueType, TypeParam> volume{ "Root", 0 };
+    const auto root = volume.GetRoot();
+
+    const int cKeyCount = 10000;
+    for (int i = 0; i < cKeyCount; i++)
+        root->Insert(i, i);
+
+    const auto child = root->InsertChild("child");
+    child->InsertChild("grandchild")->Insert(cKeyCount, cKeyCount);
+
+    ScanOptions options;
+    options.threadCount = 4;
+
+    const auto sum = [&root](const ScanOptions& options)
+    {
+        return ParallelReduce(root, options, int64_t{ 0 },
+            [](int64_t& state, const auto& key, const auto& value)
+            {
+                EXPECT_EQ(value, ValueVariant{ key });
+                state += key;
+            },
+            [](int64_t& state, int64_t other)
+            {
+                state += other;
+            });
+    };
+
+    const int64_t expected = int64_t{ cKeyCount } * (cKeyCount - 1) / 2;
+    EXPECT_EQ(sum(options), expected);
+
+    options.subtree = true;
+    EXPECT_EQ(sum(options), expected + cKeyCount);
+
+    options.threadCount = 1;
+    EXPECT_EQ(sum(options), expected + cKeyCount);
+
+    // every worker gets its own index
+    options.threadCount = 3;
+    std::atomic<size_t> badWorkers{ 0 };
+    root->ParallelScan(options,
+        [&badWorkers](size_t worker, const auto&, const auto&)
+        {
+            if (worker >= 3)
+                badWorkers++;
+        });
+    EXPECT_EQ(badWorkers.load(), 0u);
+
+    EXPECT_THROW(root->ParallelScan(options,
+        [](size_t, const auto& key, const auto&)
+        {
+            if (key == 77)
+                throw std::runtime_error("stop");
+        }), std::runtime_error);
+}
+
+TYPED_TEST(VolumeNodeEngineTest, InsertWithTtl_Touch)
+{
+    using namespace std::chrono_literals;
+    using NodeType = IVolumeNode<KeyType, ValueType>;
+
+    Volume<KeyType, ValueType, TypeParam> volume{ "Root", 0 };
+    const auto root = volume.GetRoot();
+
+    ValueType value;
+    root->Insert(1, 1);
+    root->InsertWithTtl(2, 2, 0ms);
+    root->InsertWithTtl(3, 3, 1h);
+    EXPECT_FALSE(root->Find(2, value));
+    EXPECT_FALSE(root->Contains(2));
+    EXPECT_TRUE(root->Find(3, value));
+    EXPECT_EQ(value, ValueType{ 3 });
+
+    EXPECT_FALSE(root->Touch(2, 1h));
+    EXPECT_FALSE(root->Touch(4, 1h));
+    EXPECT_TRUE(root->Touch(3, 0ms));
+    EXPECT_FALSE(root->Contains(3));
+    EXPECT_FALSE(root->Replace(3, 3));
+
+    // any other change makes a key permanent
+    EXPECT_TRUE(root->Touch(1, 0ms));
+    root->InsertWithTtl(1, 1, 0ms);
+    root->Insert(1, 10);
+    EXPECT_TRUE(root->Find(1, value));
+    EXPECT_EQ(value, ValueType{ 10 });
+
+    root->InsertWithTtl(4, 4, 0ms);
+    EXPECT_TRUE(root->TryInsert(4, 40));
+    EXPECT_TRUE(root->Find(4, value));
+    EXPECT_EQ(value, ValueType{ 40 });
+
+    root->InsertWithTtl(50, 50, 0ms);
+    root->Insert(60, 60);
+    KeyType foundKey;
+    EXPECT_TRUE(root->LowerBound(45, foundKey, value));
+    EXPECT_EQ(foundKey, 60);
+
+    root->InsertWithTtl(70, 70, 0ms);
+    NodeType::FoundValuesType found;
+    EXPECT_EQ(root->MultiFind({ 1, 70, 60 }, found), 2u);
+    EXPECT_FALSE(found[1].has_value());
+
+    // keys expire without lookups; iterations don't visit them
+    const int cKeyCount = 1000;
+    for (int i = 100; i < 100 + cKeyCount; i++)
+        root->InsertWithTtl(i, i, 20ms);
+    root->InsertWithTtl(5, 5, 1h);
+    std::this_thread::sleep_for(50ms);
+
+    for (int i = 0; i < cKeyCount / 10; i++)
+        root->Insert(6, i);
+
+    size_t count = 0;
+    root->ForEachKeyValue(
+        [&count](const auto&, auto&)
+        {
+            count++;
+        });
+    EXPECT_EQ(count, 5u);
+
+    NodeType::KeyValuesType page;
+    EXPECT_TRUE(root->NextKeyValues({}, 100, page).IsEnd());
+    EXPECT_EQ(page.size(), 5u);
+}
+
+TYPED_TEST(VolumeNodeEngineTest, Key_Budget)
+{
+    Volume<KeyType, ValueType, TypeParam> volume{ "Root", 0, DictOptions<TypeParam>{}, EvictionOptions{ 100 } };
+    const auto root = volume.GetRoot();
+
+    const auto countKeys = [](const auto& node)
+    {
+        size_t count = 0;
+        node->ForEachKeyValue(
+            [&count](const auto&, auto&)
+            {
+                count++;
+            });
+        return count;
+    };
+
+    // keys looked up between insertions aren't evicted
+    ValueType value;
+    for (int i = 0; i < 1000; i++)
+    {
+        for (int hot = 0; hot < 10; hot++)
+            root->Contains(hot);
+
+        root->Insert(i, i);
+        EXPECT_LE(countKeys(root), 100u);
+    }
+
+    EXPECT_EQ(countKeys(root), 100u);
+    for (int hot = 0; hot < 10; hot++)
+        EXPECT_TRUE(root->Find(hot, value));
+    EXPECT_TRUE(root->Find(999, value));
+
+    // erased keys free their room at once
+    root->MultiErase({ 0, 1, 2, 3, 4 });
+    EXPECT_EQ(countKeys(root), 95u);
+    root->MultiInsert({ { 2000, 2000 }, { 2001, 2001 } });
+    EXPECT_TRUE(root->Contains(5));
+    EXPECT_EQ(countKeys(root), 97u);
+
+    // children share the budget of the tree: the root over its half evicts for the child
+    const auto child = root->InsertChild("child");
+    for (int i = 0; i < 200; i++)
+    {
+        child->Insert(i, i);
+        EXPECT_LE(countKeys(root) + countKeys(child), 100u);
+    }
+    EXPECT_EQ(countKeys(root), 50u);
+    EXPECT_EQ(countKeys(child), 50u);
+
+    // keys of a removed child leave the budget
+    root->RemoveChild("child");
+    for (int i = 3000; i < 3050; i++)
+        root->Insert(i, i);
+    EXPECT_EQ(countKeys(root), 100u);
+}
+
+TEST(VolumeNodeEvictionTest, Byte_Budget)
+{
+    EvictionOptions options;
+    options.maxBytes = 64 * 1024;
+    VolumeType volume{ "Root", 0, options };
+    const auto root = volume.GetRoot();
+
+    const std::string cValue(1024, 'v');
+    for (int i = 0; i < 1000; i++)
+        root->Insert(i, cValue);
+
+    size_t count = 0;
+    KeyType present = 0;
+    root->ForEachKeyValue(
+        [&count, &present](const auto& key, auto&)
+        {
+            count++;
+            present = key;
+        });
+    EXPECT_GT(count, 32u);
+    EXPECT_LT(count, 64u);
+
+    // a value growing by Replace is accounted as well
+    EXPECT_TRUE(root->Replace(present, std::string(32 * 1024, 'v')));
+    count = 0;
+    root->ForEachKeyValue(
+        [&count](const auto&, auto&)
+        {
+            count++;
+        });
+    EXPECT_LT(count, 32u);
+}
+
+TYPED_TEST(VolumeNodeEngineTest, Counters_And_Subtree_Rollups)
+{
+    Volume<KeyType, ValueType, TypeParam> volume{ "Root", 0 };
+    const auto root = volume.GetRoot();
+
+    // counters must match a recount after every kind of change
+    const auto expectStats = [](const auto& node)
+    {
+        NodeStats expected;
+        node->ForEachKeyValueSnapshot(
+            [&expected](const KeyType& key, const ValueType& value)
+            {
+                expected.keyCount++;
+                expected.payloadBytes += utils::GetMemorySize(key) + utils::GetMemorySize(value);
+            });
+
+        const auto stats = node->GetStats();
+        EXPECT_EQ(stats.keyCount, expected.keyCount);
+        EXPECT_EQ(stats.payloadBytes, expected.payloadBytes);
+        EXPECT_GT(stats.overheadBytes, 0u);
+    };
+
+    for (int i = 0; i < 1000; i++)
+        root->Insert(i, i % 2 ? ValueType{ i } : ValueType{ std::string(100, 'v') });
+    expectStats(root);
+
+    root->Insert(1, std::string(1000, 'v'));
+    EXPECT_TRUE(root->Replace(2, 2));
+    EXPECT_FALSE(root->TryInsert(3, std::string(1000, 'v')));
+    EXPECT_TRUE(root->TryInsert(1000, std::string(1000, 'v')));
+    root->Erase(4);
+    root->Erase(5000);
+    expectStats(root);
+
+    root->MultiInsert({ { 6, std::string(500, 'v') }, { 2000, 2000 } });
+    root->MultiErase({ 7, 8, 3000 });
+    expectStats(root);
+
+    root->ForEachKeyValue(
+        [](const KeyType& key, ValueType& value)
+        {
+            if (key % 10 == 0)
+                value = std::string(200, 'v');
+        });
+    root->ForEachInRange(100, 200,
+        [](const KeyType&, ValueType& value)
+        {
+            value = 0;
+        });
+    expectStats(root);
+    EXPECT_EQ(root->GetStats().keyCount, 999u);
+
+    // subtrees: the cache follows changes at any depth and removals of children
+    const auto child = root->InsertChild("child");
+    const auto grandChild = child->InsertChild("grandChild");
+    child->InsertChild("otherChild");
+    for (int i = 0; i < 100; i++)
+        grandChild->Insert(i, std::string(100, 'v'));
+
+    const auto expectSubtree = [](const auto& node, size_t keyCount, size_t descendantCount)
+    {
+        auto stats = node->GetSubtreeStats();
+        EXPECT_EQ(stats.keyCount, keyCount);
+        EXPECT_EQ(stats.childCount, descendantCount);
+
+        // an unchanged subtree gives its cache
+        const auto cached = node->GetSubtreeStats();
+        EXPECT_EQ(cached.payloadBytes, stats.payloadBytes);
+        EXPECT_EQ(cached.overheadBytes, stats.overheadBytes);
+    };
+
+    expectSubtree(root, 1099, 3);
+    expectSubtree(child, 100, 2);
+    EXPECT_EQ(root->GetSubtreeStats().payloadBytes, root->GetStats().payloadBytes + grandChild->GetStats().payloadBytes + child->GetStats().payloadBytes);
+
+    grandChild->Erase(0);
+    expectSubtree(root, 1098, 3);
+    grandChild->Insert(1000, 1000);
+    expectSubtree(child, 100, 2);
+    expectSubtree(root, 1099, 3);
+
+    root->RemoveChild("child");
+    expectSubtree(root, 999, 0);
+}
@@ -0,0 +1,133 @@
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../src/utils/WorkStealingPool.h"
+#include "../src/utils/ParallelFor.h"
+
+using namespace std;
+using namespace vs::utils;
+
+namespace
+{
+
+void WaitFor(const atomic<int>& counter, int value)
+{
+	const auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+	while (counter.load() != value && chrono::steady_clock::now() < deadline)
+		this_thread::yield();
+}
+
+} //namespace
+
+TEST(WorkStealingPoolTest, Runs_Submitted_Tasks)
+{
+	atomic<int> done{ 0 };
+	{
+		WorkStealingPool pool(3);
+		EXPECT_EQ(pool.GetThreadCount(), 3u);
+
+		// tasks submitted by workers go to their own deques and are stolen by idle ones
+		for (int i = 0; i < 100; i++)
+			pool.Submit(
+				[&pool, &done]()
+				{
+					for (int j = 0; j < 10; j++)
+						pool.Submit(
+							[&done]()
+							{
+								done++;
+							});
+					done++;
+				});
+
+		WaitFor(done, 1100);
+		EXPECT_EQ(done.load(), 1100);
+	}
+
+	// a pool without threads runs tasks in place
+	WorkStealingPool inPlace(0);
+	inPlace.Submit(
+		[&done]()
+		{
+			done++;
+		});
+	EXPECT_EQ(done.load(), 1101);
+}
+
+TEST(WorkStealingPoolTest, Nested_ParallelFor)
+{
+	const size_t cItemCount = 64;
+
+	vector<atomic<int>> visits(cItemCount * cItemCount);
+	ParallelFor(GetParallelism(), cItemCount,
+		[&visits, cItemCount](size_t, size_t outer)
+		{
+			// calls made from workers of the pool don't wait for helpers which can't start
+			ParallelFor(GetParallelism(), cItemCount,
+				[&visits, cItemCount, outer](size_t, size_t inner)
+				{
+					visits[outer * cItemCount + inner]++;
+				});
+		});
+
+	for (const auto& visit : visits)
+		EXPECT_EQ(visit.load(), 1);
+
+	EXPECT_THROW(ParallelFor(GetParallelism(), cItemCount,
+		[](size_t, size_t item)
+		{
+			if (item == 7)
+				throw runtime_error("stop");
+		}), runtime_error);
+
+	ParallelFor(GetParallelism(), 0,
+		[](size_t, size_t)
+		{
+			FAIL();
+		});
+}
+
+TEST(WorkStealingPoolTest, Parked_Workers_Are_Woken_By_Any_Submitter)
+{
+	atomic<int> done{ 0 };
+	{
+		WorkStealingPool pool(3);
+
+		// pauses between bursts let the workers back off and park
+		vector<thread> submitters;
+		for (int t = 0; t < 4; t++)
+			submitters.emplace_back(
+				[&pool, &done]()
+				{
+					for (int burst = 0; burst < 20; burst++)
+					{
+						for (int i = 0; i < 50; i++)
+							pool.Submit(
+								[&done]()
+								{
+									done++;
+								});
+						this_thread::sleep_for(chrono::milliseconds(1));
+					}
+				});
+		for (auto& submitter : submitters)
+			submitter.join();
+
+		WaitFor(done, 4000);
+		EXPECT_EQ(done.load(), 4000);
+
+		// tasks left on destruction are run before workers exit
+		for (int i = 0; i < 1000; i++)
+			pool.Submit(
+				[&done]()
+				{
+					done++;
+				});
+	}
+	EXPECT_EQ(done.load(), 5000);
+}